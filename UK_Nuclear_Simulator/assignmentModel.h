@@ -0,0 +1,651 @@
+/*This is the weapon-target assignment nuclearControl runs when it is started with
+"--assign-window-ms MS". Instead of sending every launch order to every silo and
+submarine, it keeps an inventory of the effector units that have registered, each with a
+position, a range and a number of weapons it may fire per decision window, and collects
+the targets decided on during a window. When the window closes every target is given the
+effectors that should engage it, and each command only goes to those units.
+
+Positions are in km on a flat map centred on the UK (x east, y north). Targets are placed
+by the name of their location and effectors by their type and unit ID, since neither the
+reports nor the HELLO frames carry coordinates. The effectors are indexed in a uniform grid
+of ASSIGN_CELL_KM cells, so the nearest effectors of a target are found by looking at the
+rings of cells around its own, stopping once a ring is further away than what was found.
+
+An order is one weapon for one target: targets at ASSIGN_SALVO_PRIORITY or above get two.
+The value of an order is the target's priority times the chance of a kill, which falls
+from 1 next to the effector to 0.5 at the edge of its range. The greedy pass takes the
+orders by priority and gives each the nearest effector with a weapon left. With
+"--assign-solver auction" the same orders are then auctioned (Bertsekas' auction algorithm)
+over their ASSIGN_CANDIDATES nearest effectors, which can move weapons to where they are
+worth more, and the auction's result replaces the greedy one if it is worth more and
+finished within "--assign-budget-us".*/
+#ifndef ASSIGNMENT_MODEL_H
+#define ASSIGNMENT_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "modelThreads.h"
+
+#define ASSIGN_WORLD_KM 8000.0f //The map is this wide and high, so the grid is ASSIGN_GRID cells each way.
+#define ASSIGN_CELL_KM 250.0f
+#define ASSIGN_GRID 32
+#define ASSIGN_CANDIDATES 8
+#define ASSIGN_EPSILON 0.5f     //The auction's smallest bid, its result is within orders * epsilon of the best.
+#define ASSIGN_SALVO_PRIORITY 90
+#define ASSIGN_MAX_PRIORITY 100
+#define ASSIGN_SILO_RANGE_KM 3000.0f
+#define ASSIGN_SUB_RANGE_KM 1500.0f
+#define ASSIGN_DEFAULT_CAPACITY 1
+#define ASSIGN_DEFAULT_EFFECTORS 4096
+#define ASSIGN_DEFAULT_BUDGET_US 1000
+#define ASSIGN_LOCATION_SIZE 50
+
+//These are the effector types.
+enum
+{
+    ASSIGN_SILO = 0,
+    ASSIGN_SUB = 1
+};
+
+//This is one effector unit in the inventory. owner is the connection it registered on.
+typedef struct
+{
+    float x, y;
+    float range_km;
+    int kind;
+    int left; //Weapons it may still be given in this window.
+    uint32_t unit_id;
+    void *owner;
+} AssignEffector;
+
+//This is a target decided on during the current window.
+typedef struct
+{
+    float x, y;
+    int priority;
+    char location[ASSIGN_LOCATION_SIZE];
+} AssignTarget;
+
+/*This is the inventory, the current window's targets and the solver's work arrays, all
+sized at startup for max_effectors effectors and as many targets. After assign_solve,
+order_target and order_effector say which effector fires each order (-1 for none).*/
+typedef struct
+{
+    int max_effectors;
+    int capacity;
+    int auction;
+    int budget_us;
+    AssignEffector *effectors;
+    int effector_count;
+    int index_dirty;
+    int *cell_start; //Where each cell's effectors start in cell_items, ASSIGN_GRID * ASSIGN_GRID + 1 entries.
+    int *cell_items;
+    int *cell_armed; //Where the effectors with weapons left end in each cell, the others are kept after them.
+    int *item_of;    //Where each effector is in cell_items.
+    int armed;       //How many effectors have weapons left, the greedy pass stops looking at 0.
+    AssignTarget *targets;
+    int target_count;
+    int order_count;
+    int *order_target;
+    int *order_effector;
+    int *order_slot;      //The weapon an order holds in the auction, effector * capacity + weapon.
+    int *candidates;      //ASSIGN_CANDIDATES effectors per target, -1 where there are fewer.
+    float *candidate_value;
+    float *price;
+    int *slot_owner;
+    int *queue;
+    unsigned long windows;
+    unsigned long targets_seen;
+    unsigned long orders_assigned;
+    unsigned long orders_unassigned;
+    unsigned long auction_wins;
+    unsigned long auction_over_budget;
+    long long solve_ns_total;
+    long long solve_ns_max;
+    long long last_solve_ns;
+    double greedy_value;
+    double value;
+} AssignModel;
+
+//These are the seas the sensors report, placed on the map.
+static const struct
+{
+    const char *name;
+    float x, y;
+} assign_places[] = {
+    {"North Atlantic", -1200.0f, 0.0f}, {"English Channel", 0.0f, -450.0f}, {"Baltic Sea", 1300.0f, 200.0f},
+    {"Irish Sea", -300.0f, 0.0f}, {"Norwegian Sea", 500.0f, 1200.0f}, {"North Sea", 300.0f, 200.0f},
+    {"Arctic Ocean", 600.0f, 3400.0f}, {"Mediterranean", 900.0f, -2000.0f}, {"Barents Sea", 2400.0f, 2600.0f}};
+
+#define ASSIGN_PLACES ((int)(sizeof(assign_places) / sizeof(assign_places[0])))
+
+//This mixes a 32 bit value into a well spread one.
+static inline uint32_t assign_mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x7feb352dU;
+    h ^= h >> 15;
+    h *= 0x846ca68bU;
+    return h ^ (h >> 16);
+}
+
+//This returns a value spread over [-1, 1) from a hash.
+static inline float assign_spread(uint32_t h)
+{
+    return (float)(h & 0xffff) / 32768.0f - 1.0f;
+}
+
+//This keeps a position on the map, so it falls in one of the grid's cells.
+static inline float assign_clamp(float v)
+{
+    float edge = ASSIGN_WORLD_KM / 2.0f - 1.0f;
+    return v < -edge ? -edge : (v > edge ? edge : v);
+}
+
+//This places a location by its name. A name that is not one of the known seas gets a spot from its hash.
+static inline void assign_locate(const char *location, float *x, float *y)
+{
+    for (int i = 0; i < ASSIGN_PLACES; i++)
+    {
+        if (strcmp(location, assign_places[i].name) == 0)
+        {
+            *x = assign_places[i].x;
+            *y = assign_places[i].y;
+            return;
+        }
+    }
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)location; *c; c++) hash = (hash ^ *c) * 16777619u;
+    *x = assign_spread(assign_mix(hash)) * 3000.0f;
+    *y = assign_spread(assign_mix(hash + 1)) * 3000.0f;
+}
+
+/*This places an effector unit. Silos are spread over the UK, and submarines patrol the
+known seas in turn, within 200 km of the sea's centre.*/
+static inline void assign_place(int kind, uint32_t unit_id, float *x, float *y)
+{
+    uint32_t h = assign_mix(unit_id * 2654435761u + (uint32_t)kind);
+    if (kind == ASSIGN_SILO)
+    {
+        *x = -150.0f + assign_spread(h) * 250.0f;
+        *y = 150.0f + assign_spread(h >> 16) * 450.0f;
+        return;
+    }
+    int sea = (int)(unit_id % ASSIGN_PLACES);
+    *x = assign_places[sea].x + assign_spread(h) * 200.0f;
+    *y = assign_places[sea].y + assign_spread(h >> 16) * 200.0f;
+}
+
+static inline int assign_cell(float v)
+{
+    return (int)((v + ASSIGN_WORLD_KM / 2.0f) / ASSIGN_CELL_KM);
+}
+
+//This releases what assign_init reserved.
+static inline void assign_destroy(AssignModel *model)
+{
+    free(model->effectors);
+    free(model->cell_start);
+    free(model->cell_items);
+    free(model->cell_armed);
+    free(model->item_of);
+    free(model->targets);
+    free(model->order_target);
+    free(model->order_effector);
+    free(model->order_slot);
+    free(model->candidates);
+    free(model->candidate_value);
+    free(model->price);
+    free(model->slot_owner);
+    free(model->queue);
+    memset(model, 0, sizeof(*model));
+}
+
+/*This reserves the inventory and the work arrays for max_effectors effectors with
+capacity weapons each per window. It returns 0 or -1.*/
+static inline int assign_init(AssignModel *model, int max_effectors, int capacity, int auction, int budget_us)
+{
+    memset(model, 0, sizeof(*model));
+    model->max_effectors = max_effectors;
+    model->capacity = capacity;
+    model->auction = auction;
+    model->budget_us = budget_us;
+    size_t effectors = (size_t)max_effectors;
+    size_t orders = 2 * effectors;
+    size_t slots = effectors * (size_t)capacity;
+    model->effectors = calloc(effectors, sizeof(AssignEffector));
+    model->cell_start = calloc(ASSIGN_GRID * ASSIGN_GRID + 1, sizeof(int));
+    model->cell_items = calloc(effectors, sizeof(int));
+    model->cell_armed = calloc(ASSIGN_GRID * ASSIGN_GRID, sizeof(int));
+    model->item_of = calloc(effectors, sizeof(int));
+    model->targets = calloc(effectors, sizeof(AssignTarget));
+    model->order_target = calloc(orders, sizeof(int));
+    model->order_effector = calloc(orders, sizeof(int));
+    model->order_slot = calloc(orders, sizeof(int));
+    model->candidates = calloc(effectors * ASSIGN_CANDIDATES, sizeof(int));
+    model->candidate_value = calloc(effectors * ASSIGN_CANDIDATES, sizeof(float));
+    model->price = calloc(slots, sizeof(float));
+    model->slot_owner = calloc(slots, sizeof(int));
+    model->queue = calloc(orders, sizeof(int));
+    if (!model->effectors || !model->cell_start || !model->cell_items || !model->cell_armed || !model->item_of || !model->targets || !model->order_target ||
+        !model->order_effector || !model->order_slot || !model->candidates || !model->candidate_value ||
+        !model->price || !model->slot_owner || !model->queue)
+    {
+        assign_destroy(model);
+        return -1;
+    }
+    return 0;
+}
+
+/*This adds an effector unit that registered on owner to the inventory. It returns 0,
+or -1 if the inventory is full.*/
+static inline int assign_add_effector(AssignModel *model, void *owner, uint32_t unit_id, int kind)
+{
+    if (model->effector_count >= model->max_effectors) return -1;
+    AssignEffector *effector = &model->effectors[model->effector_count++];
+    assign_place(kind, unit_id, &effector->x, &effector->y);
+    effector->x = assign_clamp(effector->x);
+    effector->y = assign_clamp(effector->y);
+    effector->range_km = kind == ASSIGN_SILO ? ASSIGN_SILO_RANGE_KM : ASSIGN_SUB_RANGE_KM;
+    effector->kind = kind;
+    effector->left = model->capacity;
+    effector->unit_id = unit_id;
+    effector->owner = owner;
+    model->index_dirty = 1;
+    return 0;
+}
+
+//This takes every effector that registered on owner out of the inventory, when its connection closes.
+static inline void assign_remove_owner(AssignModel *model, const void *owner)
+{
+    for (int i = 0; i < model->effector_count;)
+    {
+        if (model->effectors[i].owner == owner)
+        {
+            model->effectors[i] = model->effectors[--model->effector_count];
+            model->index_dirty = 1;
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+/*This adds a target to the current window at a position, for the benchmark, and
+assign_add_target places it by its location. They return 0, or -1 if the window is full.*/
+static inline int assign_add_target_at(AssignModel *model, float x, float y, const char *location, int priority)
+{
+    if (model->target_count >= model->max_effectors) return -1;
+    AssignTarget *target = &model->targets[model->target_count++];
+    target->x = assign_clamp(x);
+    target->y = assign_clamp(y);
+    target->priority = priority < 0 ? 0 : (priority > ASSIGN_MAX_PRIORITY ? ASSIGN_MAX_PRIORITY : priority);
+    snprintf(target->location, sizeof(target->location), "%s", location);
+    return 0;
+}
+
+static inline int assign_add_target(AssignModel *model, const char *location, int priority)
+{
+    float x, y;
+    assign_locate(location, &x, &y);
+    return assign_add_target_at(model, x, y, location, priority);
+}
+
+/*This rebuilds the grid after the inventory changed, counting the effectors per cell and
+then placing them. It is only called between windows, when every effector has its weapons.*/
+static inline void assign_index(AssignModel *model)
+{
+    int cells = ASSIGN_GRID * ASSIGN_GRID;
+    memset(model->cell_start, 0, (size_t)(cells + 1) * sizeof(int));
+    for (int i = 0; i < model->effector_count; i++)
+    {
+        const AssignEffector *e = &model->effectors[i];
+        model->cell_start[assign_cell(e->y) * ASSIGN_GRID + assign_cell(e->x) + 1]++;
+    }
+    for (int c = 0; c < cells; c++) model->cell_start[c + 1] += model->cell_start[c];
+    for (int i = 0; i < model->effector_count; i++)
+    {
+        const AssignEffector *e = &model->effectors[i];
+        int cell = assign_cell(e->y) * ASSIGN_GRID + assign_cell(e->x);
+        model->item_of[i] = model->cell_start[cell];
+        model->cell_items[model->cell_start[cell]++] = i;
+    }
+    for (int c = cells; c > 0; c--) model->cell_start[c] = model->cell_start[c - 1];
+    model->cell_start[0] = 0;
+    for (int c = 0; c < cells; c++) model->cell_armed[c] = model->cell_start[c + 1];
+    model->armed = model->effector_count;
+    model->index_dirty = 0;
+}
+
+//This moves an effector that has no weapons left behind the armed ones of its cell.
+static inline void assign_disarm(AssignModel *model, int effector)
+{
+    const AssignEffector *e = &model->effectors[effector];
+    int cell = assign_cell(e->y) * ASSIGN_GRID + assign_cell(e->x);
+    int last = --model->cell_armed[cell];
+    model->armed--;
+    int at = model->item_of[effector];
+    int other = model->cell_items[last];
+    model->cell_items[at] = other;
+    model->item_of[other] = at;
+    model->cell_items[last] = effector;
+    model->item_of[effector] = last;
+}
+
+//This returns the value of an effector firing at a target, 0 if it is out of range.
+static inline float assign_value(const AssignModel *model, int target, int effector)
+{
+    const AssignTarget *t = &model->targets[target];
+    const AssignEffector *e = &model->effectors[effector];
+    float dx = t->x - e->x, dy = t->y - e->y;
+    float d2 = dx * dx + dy * dy;
+    if (d2 > e->range_km * e->range_km) return 0.0f;
+    return (float)t->priority * (1.0f - 0.5f * model_sqrt(d2) / e->range_km);
+}
+
+/*This finds up to max effectors in range of a target, the most valuable first, skipping
+the ones with no weapons left when with_weapons is set, and leaves their values in values.
+It walks the rings of cells around the target's own and stops at the first ring that is
+out of every effector's range or, once max are found, too far to beat the worst of them.
+It returns how many it found.*/
+static inline int assign_nearest(const AssignModel *model, int target, int *out, float *values, int max,
+                                 int with_weapons)
+{
+    const AssignTarget *t = &model->targets[target];
+    int cx = assign_cell(t->x), cy = assign_cell(t->y);
+    int found = 0;
+    for (int ring = 0; ring < ASSIGN_GRID; ring++)
+    {
+        float nearest = (float)(ring - 1) * ASSIGN_CELL_KM;
+        float best = (float)t->priority * (1.0f - 0.5f * nearest / ASSIGN_SILO_RANGE_KM);
+        if (nearest > ASSIGN_SILO_RANGE_KM || (found == max && best <= values[found - 1])) break;
+        for (int gy = cy - ring; gy <= cy + ring; gy++)
+        {
+            if (gy < 0 || gy >= ASSIGN_GRID) continue;
+            int edge = gy == cy - ring || gy == cy + ring; //Only the first and last rows are whole.
+            for (int gx = cx - ring; gx <= cx + ring; gx += edge || ring == 0 ? 1 : 2 * ring)
+            {
+                if (gx < 0 || gx >= ASSIGN_GRID) continue;
+                int cell = gy * ASSIGN_GRID + gx;
+                int end = with_weapons ? model->cell_armed[cell] : model->cell_start[cell + 1];
+                for (int k = model->cell_start[cell]; k < end; k++)
+                {
+                    int e = model->cell_items[k];
+                    float value = assign_value(model, target, e);
+                    if (value <= 0.0f || (found == max && value <= values[found - 1])) continue;
+                    int at = found < max ? found++ : max - 1;
+                    for (; at > 0 && values[at - 1] < value; at--)
+                    {
+                        out[at] = out[at - 1];
+                        values[at] = values[at - 1];
+                    }
+                    out[at] = e;
+                    values[at] = value;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+static inline long long assign_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*This turns the window's targets into orders, highest priority first (a counting sort,
+since priorities run from 0 to ASSIGN_MAX_PRIORITY), two for a target at ASSIGN_SALVO_PRIORITY.*/
+static inline void assign_orders(AssignModel *model)
+{
+    int first[ASSIGN_MAX_PRIORITY + 2] = {0};
+    for (int t = 0; t < model->target_count; t++) first[ASSIGN_MAX_PRIORITY - model->targets[t].priority + 1]++;
+    for (int p = 0; p <= ASSIGN_MAX_PRIORITY; p++) first[p + 1] += first[p];
+    for (int t = 0; t < model->target_count; t++) model->queue[first[ASSIGN_MAX_PRIORITY - model->targets[t].priority]++] = t;
+    model->order_count = 0;
+    for (int i = 0; i < model->target_count; i++)
+    {
+        int t = model->queue[i];
+        int weapons = model->targets[t].priority >= ASSIGN_SALVO_PRIORITY ? 2 : 1;
+        for (int w = 0; w < weapons; w++)
+        {
+            model->order_target[model->order_count] = t;
+            model->order_effector[model->order_count++] = -1;
+        }
+    }
+}
+
+//This finds the ASSIGN_CANDIDATES most valuable effectors of every target, which both passes start from.
+static inline void assign_candidates(AssignModel *model)
+{
+    for (int t = 0; t < model->target_count; t++)
+    {
+        int *candidates = &model->candidates[t * ASSIGN_CANDIDATES];
+        float *values = &model->candidate_value[t * ASSIGN_CANDIDATES];
+        int found = assign_nearest(model, t, candidates, values, ASSIGN_CANDIDATES, 0);
+        for (int k = found; k < ASSIGN_CANDIDATES; k++) candidates[k] = -1;
+    }
+}
+
+/*This is the greedy pass: each order in turn gets the most valuable effector that still has
+a weapon, from its target's candidates or, once they are all used, from the grid.*/
+static inline double assign_greedy(AssignModel *model)
+{
+    double total = 0.0;
+    for (int o = 0; o < model->order_count && model->armed > 0; o++)
+    {
+        int t = model->order_target[o];
+        const int *candidates = &model->candidates[t * ASSIGN_CANDIDATES];
+        int effector = -1;
+        float value = 0.0f;
+        for (int k = 0; k < ASSIGN_CANDIDATES && candidates[k] >= 0 && effector < 0; k++)
+        {
+            if (model->effectors[candidates[k]].left <= 0) continue;
+            effector = candidates[k];
+            value = model->candidate_value[t * ASSIGN_CANDIDATES + k];
+        }
+        if (effector < 0 && (candidates[ASSIGN_CANDIDATES - 1] < 0 ||
+                             assign_nearest(model, t, &effector, &value, 1, 1) == 0)) continue;
+        if (--model->effectors[effector].left == 0) assign_disarm(model, effector);
+        model->order_effector[o] = effector;
+        total += value;
+    }
+    return total;
+}
+
+/*This is the auction. Weapon w of effector e is slot e * capacity + w, and every order
+that holds no slot bids for the one worth most to it at the current prices, raising its
+price by how much more it is worth than the next best (keeping no weapon is worth 0) plus
+ASSIGN_EPSILON and taking it from its holder, who bids again. It returns the value of the
+result, or -1 if it ran past the budget.*/
+static inline double assign_auction(AssignModel *model, long long deadline_ns)
+{
+    int capacity = model->capacity;
+    int slots = model->effector_count * capacity;
+    for (int s = 0; s < slots; s++)
+    {
+        model->price[s] = 0.0f;
+        model->slot_owner[s] = -1;
+    }
+    for (int o = 0; o < model->order_count; o++)
+    {
+        model->order_slot[o] = -1;
+        model->queue[o] = o;
+    }
+
+    //The queue is a ring of the orders waiting to bid, which are never more than all of them.
+    int head = 0, waiting = model->order_count;
+    for (unsigned long bids = 0; waiting > 0; bids++)
+    {
+        if ((bids & 63) == 0 && assign_now_ns() > deadline_ns) return -1.0;
+        int o = model->queue[head];
+        head = (head + 1) % model->order_count;
+        waiting--;
+
+        int best_slot = -1;
+        float best = 0.0f, second = 0.0f;
+        const int *candidates = &model->candidates[model->order_target[o] * ASSIGN_CANDIDATES];
+        const float *values = &model->candidate_value[model->order_target[o] * ASSIGN_CANDIDATES];
+        for (int k = 0; k < ASSIGN_CANDIDATES && candidates[k] >= 0; k++)
+        {
+            int e = candidates[k];
+            for (int w = 0; w < capacity; w++)
+            {
+                float value = values[k] - model->price[e * capacity + w];
+                if (value > best)
+                {
+                    second = best;
+                    best = value;
+                    best_slot = e * capacity + w;
+                }
+                else if (value > second)
+                {
+                    second = value;
+                }
+            }
+        }
+        if (best_slot < 0) continue; //Nothing is worth having at these prices, the order goes without.
+
+        model->price[best_slot] += best - second + ASSIGN_EPSILON;
+        int outbid = model->slot_owner[best_slot];
+        model->slot_owner[best_slot] = o;
+        model->order_slot[o] = best_slot;
+        if (outbid >= 0)
+        {
+            model->order_slot[outbid] = -1;
+            model->queue[(head + waiting++) % model->order_count] = outbid;
+        }
+    }
+
+    double total = 0.0;
+    for (int o = 0; o < model->order_count; o++)
+    {
+        if (model->order_slot[o] >= 0) total += assign_value(model, model->order_target[o], model->order_slot[o] / capacity);
+    }
+    return total;
+}
+
+/*This assigns the window's targets: the greedy pass, then the auction if it is enabled and
+worth more. It leaves the orders in order_target and order_effector and returns how many
+there are; assign_next_window then opens the next window.*/
+static inline int assign_solve(AssignModel *model)
+{
+    long long started = assign_now_ns();
+    if (model->index_dirty) assign_index(model);
+    assign_orders(model);
+    assign_candidates(model);
+    double value = assign_greedy(model);
+    model->greedy_value += value;
+    if (model->auction && model->order_count > 0)
+    {
+        double auction = assign_auction(model, started + (long long)model->budget_us * 1000LL);
+        if (auction < 0.0)
+        {
+            model->auction_over_budget++;
+        }
+        else if (auction > value)
+        {
+            value = auction;
+            model->auction_wins++;
+            for (int o = 0; o < model->order_count; o++)
+            {
+                model->order_effector[o] = model->order_slot[o] >= 0 ? model->order_slot[o] / model->capacity : -1;
+            }
+        }
+    }
+    model->value += value;
+
+    for (int o = 0; o < model->order_count; o++)
+    {
+        if (model->order_effector[o] >= 0) model->orders_assigned++;
+        else model->orders_unassigned++;
+    }
+    model->windows++;
+    model->targets_seen += (unsigned long)model->target_count;
+    model->last_solve_ns = assign_now_ns() - started;
+    model->solve_ns_total += model->last_solve_ns;
+    if (model->last_solve_ns > model->solve_ns_max) model->solve_ns_max = model->last_solve_ns;
+    return model->order_count;
+}
+
+//This empties the window and gives every effector its weapons back.
+static inline void assign_next_window(AssignModel *model)
+{
+    model->target_count = 0;
+    model->order_count = 0;
+    for (int i = 0; i < model->effector_count; i++) model->effectors[i].left = model->capacity;
+    for (int c = 0; c < ASSIGN_GRID * ASSIGN_GRID; c++) model->cell_armed[c] = model->cell_start[c + 1];
+    model->armed = model->effector_count;
+}
+
+//This writes the assignment figures to a summary file.
+static inline void assign_report(const AssignModel *model, FILE *summary_fp)
+{
+    int silos = 0;
+    for (int i = 0; i < model->effector_count; i++) silos += model->effectors[i].kind == ASSIGN_SILO;
+    fprintf(summary_fp, "Weapon-Target Assignment: %s solver, %d weapons per unit per window, inventory at the end %d silos "
+            "and %d submarines (of %d)\n", model->auction ? "auction" : "greedy", model->capacity, silos,
+            model->effector_count - silos, model->max_effectors);
+    fprintf(summary_fp, "Decision Windows: %lu, Targets: %lu, Orders Assigned: %lu, Unassigned (nothing in range): %lu\n",
+            model->windows, model->targets_seen, model->orders_assigned, model->orders_unassigned);
+    fprintf(summary_fp, "Solve Time: avg %.1f us, max %.1f us; Value: %.1f (greedy alone %.1f)",
+            model->windows ? (double)model->solve_ns_total / 1000.0 / (double)model->windows : 0.0,
+            (double)model->solve_ns_max / 1000.0, model->value, model->greedy_value);
+    if (model->auction)
+    {
+        fprintf(summary_fp, ", auction better in %lu windows, over budget in %lu", model->auction_wins,
+                model->auction_over_budget);
+    }
+    fprintf(summary_fp, "\n");
+}
+
+/*This is "--assign-benchmark N": it fills the inventory with N effectors, half silos and
+half submarines, and a window with N targets, all spread over the map rather than placed, then times the greedy
+pass and the auction on them and prints what each achieved, without starting the server.*/
+static inline int assign_benchmark(int count, int capacity, int budget_us)
+{
+    AssignModel model;
+    if (assign_init(&model, count, capacity, 1, budget_us) < 0)
+    {
+        fprintf(stderr, "Failed to allocate the assignment model for %d effectors\n", count);
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        assign_add_effector(&model, NULL, (uint32_t)(i / 2 + 1), i % 2 ? ASSIGN_SUB : ASSIGN_SILO);
+        uint32_t h = assign_mix((uint32_t)i * 7919u + 1u);
+        model.effectors[i].x = assign_spread(assign_mix(h + 1)) * 3500.0f;
+        model.effectors[i].y = assign_spread(assign_mix(h + 2)) * 3500.0f + 500.0f;
+        assign_add_target_at(&model, assign_spread(h) * 3000.0f, assign_spread(h >> 16) * 3000.0f + 500.0f,
+                             "benchmark", 71 + (int)(assign_mix(h) % 30));
+    }
+    assign_solve(&model);
+    unsigned long assigned = model.orders_assigned;
+    printf("%d effectors, %d targets, %d orders: greedy and auction in %.1f us (%s), value %.1f against %.1f greedy "
+           "alone, %lu orders assigned\n", count, count, model.order_count, (double)model.last_solve_ns / 1000.0,
+           model.auction_over_budget ? "auction over budget" : model.auction_wins ? "auction better" : "greedy kept",
+           model.value, model.greedy_value, assigned);
+
+    //This times the greedy pass alone on the same window.
+    assign_next_window(&model);
+    model.target_count = count;
+    model.auction = 0;
+    model.windows = 0;
+    model.solve_ns_total = 0;
+    for (int run = 0; run < 10; run++)
+    {
+        assign_solve(&model);
+        assign_next_window(&model);
+        model.target_count = count;
+    }
+    printf("Greedy alone: %.1f us per window\n", (double)model.solve_ns_total / 1000.0 / (double)model.windows);
+    assign_destroy(&model);
+    return 0;
+}
+
+#endif
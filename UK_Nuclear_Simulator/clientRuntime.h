@@ -0,0 +1,1419 @@
+/*This is the client runtime shared by missileSilo, submarine, radar and satellite.
+One process hosts many logical units of the same kind. The units share a small
+number of connections to nuclearControl, every frame carries the unit ID, and a
+connection that fails or is closed by the server is retried with exponential
+backoff instead of ending the run.*/
+#ifndef CLIENT_RUNTIME_H
+#define CLIENT_RUNTIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "wireCodec.h"
+#include "shmRing.h"
+#include "tlsTransport.h"
+
+#define BACKOFF_INITIAL_MS 100
+#define BACKOFF_MAX_MS 5000
+#define NODE_PORT_STRIDE 100 //nuclearControl node K listens on the standard ports plus K * 100.
+#define ACK_DELAY_MS 20 //The longest an acknowledgement waits for others to share its frame.
+#define ACK_DEDUP_WINDOW 64 //Recent command sequence numbers remembered per link to spot retransmissions.
+#define TRANSPORT_TCP 0
+#define TRANSPORT_UNIX 1
+#define TRANSPORT_SHM 2
+#define TRANSPORT_TLS 3
+#define SHM_FULL_WAIT_MS 100 //How long a send waits for room in a full ring before the link is dropped.
+#define TRANSPORT_BENCH_PAYLOAD 64 //About the size of an encrypted report.
+#define REPORT_BATCH_BYTES 1400 //The default "--batch-bytes", about what fits in one Ethernet-sized TCP segment.
+#define REPORT_BATCH_MAX 16384 //The room for reports each link keeps, and the most "--batch-bytes" can ask for.
+#define BATCH_BY_SIZE 0
+#define BATCH_BY_TIME 1
+#define BATCH_BY_CRITICAL 2
+#define BATCH_BY_OTHER 3 //Ahead of another frame, or when the link ends or closes.
+
+//Every client program provides its own log file writer.
+void log_event(const char *event_type, const char *details);
+
+/*These are the runtime settings every client accepts on the command line:
+"--units N" logical units hosted by the process, "--connections M" sockets they share,
+"--nodes K" nuclearControl nodes the units are partitioned across by unit ID and
+"--codec text|binary" for the encoding to offer nuclearControl. codec is 0 for text
+or the WIRE_VERSION offered. "--failover" makes a lost link try the hot standby's ports
+(STANDBY_PORT_OFFSET above the usual ones) and the primary's in turn. "--transport unix"
+connects to nuclearControl's AF_UNIX sockets instead of TCP (see protocol.h), "--transport shm"
+offers it shared-memory rings on each TCP connection (see shmRing.h), "--transport tls"
+runs TLS 1.3 on it if the client was built with it (see tlsTransport.h), and
+"--transport-benchmark N" compares them without starting the client. "--batch-ms MS" holds
+a link's reports back and sends them together once "--batch-bytes N" of them are waiting
+or the oldest has waited MS, while a critical report takes the ones waiting with it at once.
+"--nodelay" sets TCP_NODELAY on the TCP sockets so a lone frame is not held back by
+Nagle's algorithm, which batching does as well.*/
+typedef struct
+{
+    int units;
+    int connections;
+    int nodes;
+    int codec;
+    int failover;
+    int transport;
+    int transport_benchmark;
+    int batch_ms;
+    int batch_bytes;
+    int nodelay;
+} RuntimeConfig;
+
+/*This is one multiplexed connection together with its reconnect state, receive buffer
+and the acknowledgements waiting to go back to nuclearControl. Acknowledgements ride
+along with the next frame sent on the link, or go on their own after ACK_DELAY_MS.
+With "--batch-ms" the reports waiting to be sent are kept as whole frames in batch.*/
+typedef struct
+{
+    int sock;
+    int index;
+    int port;
+    int backoff_ms;
+    long long next_attempt_ms;
+    int connects;
+    size_t rx_used;
+    char rx[FRAME_BUFFER_SIZE];
+    char acks[FRAME_MAX_PAYLOAD];
+    size_t acks_len;
+    int acks_pending;
+    long long acks_since_ms;
+    char outcomes[FRAME_MAX_PAYLOAD];
+    size_t outcomes_len;
+    int outcomes_pending;
+    char batch[REPORT_BATCH_MAX];
+    size_t batch_len;
+    int batch_frames;
+    long long batch_since_ms;
+    long long batch_first_ns;  //When the oldest waiting report was queued.
+    long long batch_queued_ns; //The sum of the times every waiting report was queued, for their wait.
+    unsigned long seen[ACK_DEDUP_WINDOW];
+    int seen_next;
+    int credits; //INTEL frames the server will still take, it can go below 0 after critical reports.
+    int codec;   //The binary codec version agreed for this connection, 0 while it is text only.
+    int ended;   //nuclearControl sent END, the link stays closed.
+    int on_standby; //port is the standby's, with --failover.
+    ShmLink shm;    //The link's rings with "--transport shm", segment is NULL while it is on TCP.
+    int tcp_only;   //An offer of rings went unanswered, so none is made again.
+#ifdef USE_TLS
+    SSL *tls;       //The link's TLS state with "--transport tls", NULL until its handshake is over.
+#endif
+} Link;
+
+typedef struct ClientRuntime ClientRuntime;
+
+//This is called for every frame received from nuclearControl.
+typedef void (*FrameHandler)(ClientRuntime *rt, Link *link, const FrameHeader *header,
+                             const char *payload);
+
+/*This is the runtime itself. Unit IDs run from 1 to unit_count and unit u is
+always carried on link (u - 1) % link_count. Link l goes to node l % node_count and
+link_count is a multiple of node_count, so unit u always lands on node (u - 1) % node_count.*/
+struct ClientRuntime
+{
+    const char *kind;
+    const char *server_ip;
+    int port;
+    int unit_count;
+    int link_count;
+    int node_count;
+    int codec;
+    int failover;
+    int transport;
+    int batch_ms;
+    size_t batch_bytes;
+    size_t batch_room; //The most a batch may hold, one receive buffer of the server's on AF_UNIX.
+    int nodelay;
+    Link *links;
+    FrameHandler on_frame;
+    unsigned long frames_sent;
+    unsigned long frames_dropped;
+    unsigned long reconnects;
+    unsigned long acks_sent;
+    unsigned long ack_frames;
+    unsigned long acks_piggybacked;
+    unsigned long outcomes_sent;
+    unsigned long outcome_frames;
+    unsigned long duplicates;
+    unsigned long reports_held;
+    unsigned long credit_grants;
+    int links_ended;
+    unsigned long standby_connects;
+    unsigned long ring_links;
+    unsigned long ring_refusals;
+    unsigned long ring_records_sent;
+    unsigned long ring_records_received;
+    unsigned long ring_doorbells;
+    unsigned long ring_full;
+    unsigned long tls_handshakes;
+    unsigned long tls_kernel_send;
+    unsigned long tls_kernel_recv;
+    unsigned long report_batches;
+    unsigned long batched_reports;
+    int batch_largest;
+    unsigned long batch_flushes[4]; //By BATCH_BY_* reason.
+    long long batch_wait_ns;
+    long long batch_wait_max_ns;
+#ifdef USE_TLS
+    SSL_CTX *tls_ctx; //Made at the first connection, once nuclearControl has written its certificate.
+#endif
+};
+
+/*This consumes one runtime option at argv[*i]. It returns 1 if the option
+belonged to the runtime, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int runtime_parse_option(RuntimeConfig *config, int argc, char *argv[], int *i)
+{
+    int *target = NULL;
+    if (strcmp(argv[*i], "--failover") == 0)
+    {
+        config->failover = 1;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--nodelay") == 0)
+    {
+        config->nodelay = 1;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--codec") == 0)
+    {
+        if (*i + 1 >= argc) return -1;
+        const char *codec = argv[++*i];
+        if (strcmp(codec, "text") == 0) config->codec = 0;
+        else if (strcmp(codec, "binary") == 0) config->codec = WIRE_VERSION;
+        else return -1;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--transport") == 0)
+    {
+        if (*i + 1 >= argc) return -1;
+        const char *transport = argv[++*i];
+        if (strcmp(transport, "tcp") == 0) config->transport = TRANSPORT_TCP;
+        else if (strcmp(transport, "unix") == 0) config->transport = TRANSPORT_UNIX;
+        else if (strcmp(transport, "shm") == 0) config->transport = TRANSPORT_SHM;
+        else if (strcmp(transport, "tls") == 0) config->transport = TRANSPORT_TLS;
+        else return -1;
+#ifndef USE_TLS
+        if (config->transport == TRANSPORT_TLS)
+        {
+            fprintf(stderr, "--transport tls needs the client built with -DUSE_TLS and linked with -lssl -lcrypto\n");
+            return -1;
+        }
+#endif
+        return 1;
+    }
+    if (strcmp(argv[*i], "--units") == 0) target = &config->units;
+    else if (strcmp(argv[*i], "--connections") == 0) target = &config->connections;
+    else if (strcmp(argv[*i], "--nodes") == 0) target = &config->nodes;
+    else if (strcmp(argv[*i], "--transport-benchmark") == 0) target = &config->transport_benchmark;
+    else if (strcmp(argv[*i], "--batch-ms") == 0) target = &config->batch_ms;
+    else if (strcmp(argv[*i], "--batch-bytes") == 0) target = &config->batch_bytes;
+    else return 0;
+
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) <= 0) return -1;
+    if (target == &config->batch_bytes && atoi(argv[*i + 1]) > REPORT_BATCH_MAX) return -1;
+    *target = atoi(argv[++*i]);
+    return 1;
+}
+
+//This sets up the links for a runtime. It returns 0 or -1 if memory is not available.
+static inline int runtime_init(ClientRuntime *rt, const char *kind, const char *server_ip, int port,
+                               const RuntimeConfig *config, FrameHandler on_frame)
+{
+    memset(rt, 0, sizeof(*rt));
+    rt->kind = kind;
+    rt->server_ip = server_ip;
+    rt->port = port;
+    rt->unit_count = config->units;
+    rt->node_count = config->nodes > 0 ? config->nodes : 1;
+    rt->codec = config->codec;
+    rt->failover = config->failover;
+    rt->transport = config->transport;
+    rt->batch_ms = config->batch_ms;
+    rt->batch_bytes = config->batch_bytes > 0 ? (size_t)config->batch_bytes : REPORT_BATCH_BYTES;
+    //A batch on AF_UNIX is one packet, and nuclearControl loses whatever does not fit its buffer.
+    rt->batch_room = config->transport == TRANSPORT_UNIX ? FRAME_BUFFER_SIZE : REPORT_BATCH_MAX;
+    if (rt->batch_bytes > rt->batch_room) rt->batch_bytes = rt->batch_room;
+    rt->nodelay = config->nodelay || config->batch_ms > 0;
+    rt->link_count = config->connections < config->units ? config->connections : config->units;
+    rt->link_count = (rt->link_count + rt->node_count - 1) / rt->node_count * rt->node_count;
+    rt->on_frame = on_frame;
+    rt->links = calloc((size_t)rt->link_count, sizeof(Link));
+    if (!rt->links) return -1;
+    for (int i = 0; i < rt->link_count; i++)
+    {
+        rt->links[i].sock = -1;
+        rt->links[i].index = i;
+        rt->links[i].port = port + (i % rt->node_count) * NODE_PORT_STRIDE;
+        rt->links[i].backoff_ms = BACKOFF_INITIAL_MS;
+    }
+    return 0;
+}
+
+//This returns the link that carries a unit's frames.
+static inline Link *runtime_link_for(ClientRuntime *rt, uint32_t unit_id)
+{
+    return &rt->links[(unit_id - 1) % (uint32_t)rt->link_count];
+}
+
+//This unmaps a link's rings, keeping their counts for the summary.
+static inline void runtime_close_ring(ClientRuntime *rt, Link *link)
+{
+    if (!link->shm.segment) return;
+    rt->ring_records_sent += link->shm.records_sent;
+    rt->ring_records_received += link->shm.records_received;
+    rt->ring_doorbells += link->shm.doorbells;
+    rt->ring_full += link->shm.full;
+    shm_link_close(&link->shm);
+}
+
+//This drops a link's TLS state when its socket is closed.
+static inline void runtime_close_tls(Link *link)
+{
+#ifdef USE_TLS
+    SSL_free(link->tls);
+    link->tls = NULL;
+#else
+    (void)link;
+#endif
+}
+
+/*This says whether a link's TLS connection holds decrypted bytes that have not been
+read yet, which poll cannot see on the socket.*/
+static inline int runtime_tls_pending(const Link *link)
+{
+#ifdef USE_TLS
+    return link->tls && SSL_pending(link->tls) > 0;
+#else
+    (void)link;
+    return 0;
+#endif
+}
+
+/*This sends frames on a link, through its ring or its TLS connection if it has one. The doorbell only goes
+on the socket when nuclearControl is waiting for it. A full ring is given SHM_FULL_WAIT_MS
+to be emptied by the server before the send fails. It returns 0, or -1 with errno set.*/
+static inline int runtime_write(Link *link, const char *data, size_t length)
+{
+#ifdef USE_TLS
+    if (link->tls) return tls_write_all(link->tls, link->sock, data, length);
+#endif
+    if (!link->shm.segment) return send_all(link->sock, data, length);
+    long long give_up = 0;
+    int result;
+    while ((result = shm_link_send(&link->shm, data, length)) < 0)
+    {
+        if (give_up == 0) give_up = now_ms() + SHM_FULL_WAIT_MS;
+        else if (now_ms() >= give_up)
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        sched_yield();
+    }
+    if (result == 0) return 0;
+    char doorbell[FRAME_HEADER_SIZE];
+    int doorbell_len = frame_encode(doorbell, sizeof(doorbell), FRAME_SHM, UNIT_BROADCAST, "", 0);
+    return send_all(link->sock, doorbell, (size_t)doorbell_len);
+}
+
+/*This closes a broken link and schedules the next attempt. The wait doubles
+after every failure up to BACKOFF_MAX_MS, with some jitter so that many
+processes restarting together do not reconnect in lock step. With --failover the next
+attempt goes to the other of the primary and the standby, and the wait only doubles once
+both have been tried, so a standby that has taken over is reached on the first retry.*/
+static inline void runtime_link_down(ClientRuntime *rt, Link *link, const char *reason)
+{
+    char log_msg[256];
+    runtime_close_ring(rt, link);
+    runtime_close_tls(link);
+    if (link->sock >= 0)
+    {
+        close(link->sock);
+        link->sock = -1;
+        snprintf(log_msg, sizeof(log_msg), "%s link %d to port %d lost: %s, retrying in %d ms",
+                 rt->kind, link->index, link->port, reason, link->backoff_ms);
+        log_event("CONNECTION", log_msg);
+    }
+    int jitter = link->backoff_ms / 4 > 0 ? rand() % (link->backoff_ms / 4 + 1) : 0;
+    link->next_attempt_ms = now_ms() + link->backoff_ms + jitter;
+    if (rt->failover)
+    {
+        link->on_standby = !link->on_standby;
+        link->port += link->on_standby ? STANDBY_PORT_OFFSET : -STANDBY_PORT_OFFSET;
+    }
+    if (!rt->failover || !link->on_standby)
+    {
+        link->backoff_ms = link->backoff_ms * 2 > BACKOFF_MAX_MS ? BACKOFF_MAX_MS : link->backoff_ms * 2;
+    }
+    link->rx_used = 0;
+    link->acks_len = 0; //The server forgets its in-flight commands for a closed connection too.
+    link->acks_pending = 0;
+    link->outcomes_len = 0;
+    link->outcomes_pending = 0;
+    rt->frames_dropped += (unsigned long)link->batch_frames; //Reports still waiting go with the connection.
+    link->batch_len = 0;
+    link->batch_frames = 0;
+    memset(link->seen, 0, sizeof(link->seen));
+    link->codec = 0; //A new connection negotiates again.
+}
+
+/*This writes the link's pending acknowledgements as an ACK frame into out and clears
+them. It returns the frame size, or 0 if nothing is pending.*/
+static inline int runtime_take_acks(ClientRuntime *rt, Link *link, char *out, size_t cap)
+{
+    if (link->acks_pending == 0) return 0;
+    int frame_len = frame_encode(out, cap, FRAME_ACK, UNIT_BROADCAST, link->acks, link->acks_len);
+    if (frame_len < 0) return 0;
+    rt->acks_sent += (unsigned long)link->acks_pending;
+    rt->ack_frames++;
+    link->acks_len = 0;
+    link->acks_pending = 0;
+    return frame_len;
+}
+
+//This is the monotonic clock in nanoseconds, for the waits of batched reports and the transport benchmark.
+static inline long long runtime_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*This sends the reports waiting in a link's batch with one write, counting why under
+reason (BATCH_BY_*). On TCP that is one send, on TLS one record and on a ring one record
+with at most one doorbell, however many reports it holds. Reports that cannot be written
+are dropped with the link.*/
+static inline void runtime_flush_batch(ClientRuntime *rt, Link *link, int reason)
+{
+    int frames = link->batch_frames;
+    size_t length = link->batch_len;
+    if (frames == 0) return;
+    link->batch_len = 0;
+    link->batch_frames = 0;
+    if (link->sock < 0 || runtime_write(link, link->batch, length) < 0)
+    {
+        rt->frames_dropped += (unsigned long)frames;
+        if (link->sock >= 0) runtime_link_down(rt, link, strerror(errno));
+        return;
+    }
+    long long now = runtime_now_ns();
+    rt->frames_sent += (unsigned long)frames;
+    rt->report_batches++;
+    rt->batched_reports += (unsigned long)frames;
+    rt->batch_flushes[reason]++;
+    if (frames > rt->batch_largest) rt->batch_largest = frames;
+    rt->batch_wait_ns += frames * now - link->batch_queued_ns;
+    if (now - link->batch_first_ns > rt->batch_wait_max_ns) rt->batch_wait_max_ns = now - link->batch_first_ns;
+}
+
+/*This sends one frame for a unit. Frames for a unit whose link is down are
+counted as dropped rather than queued. Pending acknowledgements on the link are
+put in front of the frame so both leave in the same send. It returns 0 or -1.*/
+static inline int runtime_send(ClientRuntime *rt, uint32_t unit_id, uint8_t type,
+                               const char *payload, size_t length)
+{
+    Link *link = runtime_link_for(rt, unit_id);
+    char frame[2 * (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD)];
+    int ack_len = 0;
+    runtime_flush_batch(rt, link, BATCH_BY_OTHER); //Reports waiting in the batch were sent first.
+    if (link->sock >= 0 && link->acks_pending > 0)
+    {
+        ack_len = runtime_take_acks(rt, link, frame, sizeof(frame) / 2);
+        if (ack_len > 0) rt->acks_piggybacked++;
+    }
+    int frame_len = frame_encode(frame + ack_len, sizeof(frame) - (size_t)ack_len, type, unit_id, payload, length);
+    if (link->sock < 0 || frame_len < 0)
+    {
+        rt->frames_dropped++;
+        return -1;
+    }
+    frame_len += ack_len;
+    if (runtime_write(link, frame, (size_t)frame_len) < 0)
+    {
+        rt->frames_dropped++;
+        runtime_link_down(rt, link, strerror(errno));
+        return -1;
+    }
+    rt->frames_sent++;
+    return 0;
+}
+
+/*This adds one report to its link's batch with "--batch-ms". The batch is sent first if
+the report does not fit in batch_room, and together with the report once batch_bytes are waiting or
+straight away if the report is critical. It returns 0, or -1 if the report was dropped.*/
+static inline int runtime_batch_report(ClientRuntime *rt, Link *link, uint32_t unit_id, uint8_t type,
+                                       const char *payload, size_t length, int critical)
+{
+    if (link->batch_len + FRAME_HEADER_SIZE + length > rt->batch_room) runtime_flush_batch(rt, link, BATCH_BY_SIZE);
+    int frame_len = link->sock >= 0 ? frame_encode(link->batch + link->batch_len, rt->batch_room - link->batch_len,
+                                                   type, unit_id, payload, length) : -1;
+    if (frame_len < 0)
+    {
+        rt->frames_dropped++;
+        return -1;
+    }
+    long long now = runtime_now_ns();
+    if (link->batch_frames == 0)
+    {
+        link->batch_since_ms = now_ms();
+        link->batch_first_ns = now;
+        link->batch_queued_ns = 0;
+    }
+    link->batch_len += (size_t)frame_len;
+    link->batch_frames++;
+    link->batch_queued_ns += now;
+    if (critical) runtime_flush_batch(rt, link, BATCH_BY_CRITICAL);
+    else if (link->batch_len >= rt->batch_bytes) runtime_flush_batch(rt, link, BATCH_BY_SIZE);
+    return link->sock >= 0 ? 0 : -1;
+}
+
+/*This returns how long a link's batch may still wait before it is sent by time. While it
+is empty that is the whole limit, since a report may be queued at any moment.*/
+static inline long long runtime_batch_wait(const ClientRuntime *rt, const Link *link, long long now)
+{
+    return link->batch_frames > 0 ? link->batch_since_ms + rt->batch_ms - now : rt->batch_ms;
+}
+
+/*This sends one sensor report, of type FRAME_INTEL or FRAME_INTEL_BIN, under credit flow
+control. A routine report is held back (counted and not sent) when the link has no credit
+left, while a critical report above CRITICAL_THREAT_LEVEL always goes. With "--batch-ms"
+the report is batched rather than sent on its own. It returns 0, or -1 if the report was
+not sent.*/
+static inline int runtime_send_report(ClientRuntime *rt, uint32_t unit_id, uint8_t type, const char *payload,
+                                      size_t length, int threat_level)
+{
+    Link *link = runtime_link_for(rt, unit_id);
+    if (link->sock >= 0 && link->credits <= 0 && threat_level <= CRITICAL_THREAT_LEVEL)
+    {
+        rt->reports_held++;
+        return -1;
+    }
+    int result = rt->batch_ms > 0 && link->sock >= 0
+                     ? runtime_batch_report(rt, link, unit_id, type, payload, length, threat_level > CRITICAL_THREAT_LEVEL)
+                     : runtime_send(rt, unit_id, type, payload, length);
+    if (result < 0) return -1;
+    link->credits--;
+    return 0;
+}
+
+//This sends a link's pending acknowledgements on their own in one ACK frame.
+static inline void runtime_flush_acks(ClientRuntime *rt, Link *link)
+{
+    char frame[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+    int frame_len = runtime_take_acks(rt, link, frame, sizeof(frame));
+    if (frame_len > 0 && link->sock >= 0 && runtime_write(link, frame, (size_t)frame_len) < 0)
+    {
+        runtime_link_down(rt, link, strerror(errno));
+    }
+}
+
+/*This acknowledges command seq on the link it arrived on, with the time the effector
+processed it. The acknowledgement is batched with others and sent with the next frame
+on the link, once ACK_MAX_BATCH are waiting, or after ACK_DELAY_MS, whichever is first.
+It returns 1 if the command was already acknowledged, meaning nuclearControl
+retransmitted it and the caller should not act on it a second time, and 0 otherwise.*/
+static inline int runtime_ack(ClientRuntime *rt, Link *link, unsigned long seq, long long processed_ms)
+{
+    int duplicate = 0;
+    for (int i = 0; i < ACK_DEDUP_WINDOW; i++)
+    {
+        if (link->seen[i] == seq) duplicate = 1;
+    }
+    if (duplicate) rt->duplicates++;
+    else
+    {
+        link->seen[link->seen_next] = seq;
+        link->seen_next = (link->seen_next + 1) % ACK_DEDUP_WINDOW;
+    }
+
+    //A retransmission is acknowledged again, since the first acknowledgement may be what was lost.
+    if (link->acks_pending == 0) link->acks_since_ms = processed_ms;
+    link->acks_len += (size_t)snprintf(link->acks + link->acks_len, sizeof(link->acks) - link->acks_len,
+                                       "%s%lu@%lld", link->acks_pending ? "," : "", seq, processed_ms);
+    if (++link->acks_pending >= ACK_MAX_BATCH) runtime_flush_acks(rt, link);
+    return duplicate;
+}
+
+/*This sends a link's pending flight outcomes in one OUTCOME frame. Outcomes for a link
+that is down are dropped, like its acknowledgements.*/
+static inline void runtime_flush_outcomes(ClientRuntime *rt, Link *link)
+{
+    char frame[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+    if (link->outcomes_pending == 0) return;
+    int frame_len = frame_encode(frame, sizeof(frame), FRAME_OUTCOME, UNIT_BROADCAST, link->outcomes,
+                                 link->outcomes_len);
+    if (link->sock >= 0 && frame_len > 0)
+    {
+        if (runtime_write(link, frame, (size_t)frame_len) < 0) runtime_link_down(rt, link, strerror(errno));
+        else
+        {
+            rt->outcomes_sent += (unsigned long)link->outcomes_pending;
+            rt->outcome_frames++;
+        }
+    }
+    link->outcomes_len = 0;
+    link->outcomes_pending = 0;
+}
+
+/*This reports how a unit's flight ended, on the unit's link. Outcomes are batched and
+go out once OUTCOME_MAX_BATCH are waiting or when the caller flushes them with
+runtime_flush_all_outcomes, which the effectors do after every batch of flights.*/
+static inline void runtime_outcome(ClientRuntime *rt, uint32_t unit_id, unsigned long seq, char result,
+                                   long long flight_ms)
+{
+    Link *link = runtime_link_for(rt, unit_id);
+    link->outcomes_len += (size_t)snprintf(link->outcomes + link->outcomes_len,
+                                           sizeof(link->outcomes) - link->outcomes_len, "%s%u:%lu:%c:%lld",
+                                           link->outcomes_pending ? "," : "", unit_id, seq, result, flight_ms);
+    if (++link->outcomes_pending >= OUTCOME_MAX_BATCH) runtime_flush_outcomes(rt, link);
+}
+
+//This sends the pending flight outcomes of every link.
+static inline void runtime_flush_all_outcomes(ClientRuntime *rt)
+{
+    for (int i = 0; i < rt->link_count; i++)
+    {
+        runtime_flush_outcomes(rt, &rt->links[i]);
+    }
+}
+
+/*This ends a link for good when nuclearControl sends END. The reports, acknowledgements and
+flight outcomes still pending are sent first, so the server counts every command it was sent.*/
+static inline void runtime_link_end(ClientRuntime *rt, Link *link, const char *payload, uint32_t length)
+{
+    char log_msg[256];
+    runtime_flush_batch(rt, link, BATCH_BY_OTHER);
+    runtime_flush_acks(rt, link);
+    runtime_flush_outcomes(rt, link);
+    runtime_close_tls(link);
+    if (link->sock >= 0)
+    {
+        close(link->sock);
+        link->sock = -1;
+    }
+    link->ended = 1;
+    rt->links_ended++;
+    snprintf(log_msg, sizeof(log_msg), "%s link %d closed by Nuclear Control: %.*s", rt->kind, link->index,
+             (int)(length < 128 ? length : 128), payload);
+    log_event("CONNECTION", log_msg);
+    runtime_close_ring(rt, link); //Last, since payload may be in the ring.
+}
+
+//This returns 1 once nuclearControl has ended the run on every link.
+static inline int runtime_ended(const ClientRuntime *rt)
+{
+    return rt->links_ended == rt->link_count;
+}
+
+/*This connects a socket to a port of nuclearControl, over TCP or to the port's
+AF_UNIX socket. It returns 0, or -1 with errno set.*/
+static inline int runtime_connect_port(const ClientRuntime *rt, int sock, int port)
+{
+    if (rt->transport == TRANSPORT_UNIX)
+    {
+        struct sockaddr_un local_addr = {0};
+        local_addr.sun_family = AF_UNIX;
+        snprintf(local_addr.sun_path, sizeof(local_addr.sun_path), UNIX_SOCKET_PATH, port);
+        return connect(sock, (struct sockaddr *)&local_addr, sizeof(local_addr));
+    }
+    struct sockaddr_in server_addr = {0};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, rt->server_ip, &server_addr.sin_addr) <= 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    return connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
+}
+
+/*This hands every complete frame at the start of data to the handler, taking care of the
+runtime's own frame types itself. It returns the bytes used, or -1 once the link has gone
+down or been ended, after which data may no longer be mapped if it was in the link's ring.*/
+static inline int runtime_handle_frames(ClientRuntime *rt, Link *link, const char *data, size_t used)
+{
+    char log_msg[128];
+    size_t offset = 0;
+    while (link->sock >= 0)
+    {
+        FrameHeader header;
+        const char *payload;
+        int consumed = frame_parse(data + offset, used - offset, &header, &payload);
+        if (consumed == 0) break;
+        if (consumed < 0)
+        {
+            runtime_link_down(rt, link, "Invalid frame");
+            return -1;
+        }
+        if (header.type == FRAME_CREDIT)
+        {
+            //Credits are handled by the runtime itself and never reach the program.
+            char count[16];
+            size_t len = header.length < sizeof(count) - 1 ? header.length : sizeof(count) - 1;
+            memcpy(count, payload, len);
+            count[len] = '\0';
+            link->credits += atoi(count);
+            rt->credit_grants++;
+        }
+        else if (header.type == FRAME_END)
+        {
+            runtime_link_end(rt, link, payload, header.length);
+            return -1;
+        }
+        else if (header.type == FRAME_SHM)
+        {
+            //A doorbell. The ring it is for is read once the socket has been.
+        }
+        else if (header.type == FRAME_CODEC)
+        {
+            //So is the codec answer. The server only ever agrees to the version offered.
+            link->codec = header.length == 1 && (uint8_t)payload[0] == rt->codec ? rt->codec : 0;
+            snprintf(log_msg, sizeof(log_msg), "Link %d using the %s encoding", link->index,
+                     link->codec ? "binary" : "text");
+            log_event("CONNECTION", log_msg);
+        }
+        else
+        {
+            rt->on_frame(rt, link, &header, payload);
+        }
+        offset += (size_t)consumed;
+    }
+    return link->sock >= 0 ? (int)offset : -1;
+}
+
+/*This offers nuclearControl shared-memory rings on a link that has just connected, before
+anything else is sent on it, and waits up to SHM_OFFER_TIMEOUT_MS for the answer. The link
+stays on TCP if the server refuses. Without an answer it cannot tell whether the server took
+the rings, so the link is reconnected and makes no more offers. The segment's name is removed
+either way, since a server that took it has it mapped by the time it answers.*/
+static inline void runtime_offer_ring(ClientRuntime *rt, Link *link)
+{
+    char name[SHM_NAME_SIZE];
+    char frame[FRAME_HEADER_SIZE + SHM_NAME_SIZE];
+    char log_msg[256];
+    if (shm_link_create(&link->shm, name, sizeof(name)) < 0)
+    {
+        snprintf(log_msg, sizeof(log_msg), "Link %d could not create its rings (%s), staying on TCP", link->index,
+                 strerror(errno));
+        log_event("ERROR", log_msg);
+        rt->ring_refusals++;
+        return;
+    }
+    int frame_len = frame_encode(frame, sizeof(frame), FRAME_SHM, UNIT_BROADCAST, name, strlen(name));
+    int accepted = 0;
+    int answered = 0;
+    long long deadline = now_ms() + SHM_OFFER_TIMEOUT_MS;
+    size_t offset = 0;
+    int waiting = send_all(link->sock, frame, (size_t)frame_len) == 0;
+    while (waiting)
+    {
+        FrameHeader header;
+        const char *payload;
+        int consumed = frame_parse(link->rx + offset, link->rx_used - offset, &header, &payload);
+        if (consumed > 0)
+        {
+            //Only the answer is taken here. Commands sent before it stay for runtime_connect_link.
+            if (header.type != FRAME_SHM)
+            {
+                offset += (size_t)consumed;
+                continue;
+            }
+            answered = 1;
+            accepted = header.length == 1 && payload[0] == SHM_ACCEPTED;
+            memmove(link->rx + offset, link->rx + offset + consumed, link->rx_used - offset - (size_t)consumed);
+            link->rx_used -= (size_t)consumed;
+            break;
+        }
+        struct pollfd fd = {link->sock, POLLIN, 0};
+        long long left = deadline - now_ms();
+        if (consumed < 0 || left <= 0 || poll(&fd, 1, (int)left) <= 0) break;
+        ssize_t bytes = recv(link->sock, link->rx + link->rx_used, sizeof(link->rx) - link->rx_used, 0);
+        if (bytes <= 0) break;
+        link->rx_used += (size_t)bytes;
+    }
+    shm_unlink(name);
+    if (accepted)
+    {
+        rt->ring_links++;
+        snprintf(log_msg, sizeof(log_msg), "Link %d using shared-memory rings", link->index);
+        log_event("CONNECTION", log_msg);
+        return;
+    }
+    shm_link_close(&link->shm);
+    rt->ring_refusals++;
+    if (answered)
+    {
+        snprintf(log_msg, sizeof(log_msg), "Link %d staying on TCP, Nuclear Control refused its rings", link->index);
+        log_event("CONNECTION", log_msg);
+        return;
+    }
+    link->tcp_only = 1;
+    runtime_link_down(rt, link, "no answer to the offer of rings, reconnecting on TCP only");
+}
+
+#ifdef USE_TLS
+/*This runs the TLS handshake on a link that has just connected, checking that
+nuclearControl presents the certificate in TLS_CERT_FILE. A failure takes the link down
+to be retried like a failed connect, since the server may not have written its
+certificate yet. It returns 0 or -1.*/
+static inline int runtime_start_tls(ClientRuntime *rt, Link *link)
+{
+    char error[256];
+    char log_msg[512];
+    if (!rt->tls_ctx) rt->tls_ctx = tls_client_context(TLS_CERT_FILE, error, sizeof(error));
+    SSL *ssl = rt->tls_ctx ? tls_handshake(rt->tls_ctx, link->sock, 0, error, sizeof(error)) : NULL;
+    if (!ssl)
+    {
+        snprintf(log_msg, sizeof(log_msg), "TLS handshake failed: %s", error);
+        runtime_link_down(rt, link, log_msg);
+        return -1;
+    }
+    link->tls = ssl;
+    rt->tls_handshakes++;
+    rt->tls_kernel_send += (unsigned long)tls_ktls_send(ssl);
+    rt->tls_kernel_recv += (unsigned long)tls_ktls_recv(ssl);
+    snprintf(log_msg, sizeof(log_msg), "Link %d using %s with %s, records sent by the %s and received by the %s",
+             link->index, SSL_get_version(ssl), SSL_get_cipher_name(ssl), tls_ktls_send(ssl) ? "kernel" : "process",
+             tls_ktls_recv(ssl) ? "kernel" : "process");
+    log_event("CONNECTION", log_msg);
+    return 0;
+}
+#endif
+
+/*This connects one link and announces every unit it carries with a HELLO frame,
+offering the binary codec in each one if it was asked for.*/
+static inline void runtime_connect_link(ClientRuntime *rt, Link *link)
+{
+    char log_msg[256];
+    int sock = rt->transport == TRANSPORT_UNIX ? socket(AF_UNIX, SOCK_SEQPACKET, 0) : socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        runtime_link_down(rt, link, strerror(errno));
+        return;
+    }
+
+    if (runtime_connect_port(rt, sock, link->port) < 0)
+    {
+        snprintf(log_msg, sizeof(log_msg), "Connection failed on link %d: %s, retrying in %d ms",
+                 link->index, strerror(errno), link->backoff_ms);
+        log_event("ERROR", log_msg);
+        close(sock);
+        runtime_link_down(rt, link, strerror(errno));
+        return;
+    }
+
+    //Batching takes the place of Nagle's algorithm, which would hold back a critical report behind the last batch.
+    int on = 1;
+    if (rt->nodelay && rt->transport != TRANSPORT_UNIX && setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+    {
+        snprintf(log_msg, sizeof(log_msg), "Link %d could not set TCP_NODELAY: %s", link->index, strerror(errno));
+        log_event("ERROR", log_msg);
+    }
+    link->sock = sock;
+    link->backoff_ms = BACKOFF_INITIAL_MS;
+    link->rx_used = 0;
+    link->credits = CREDIT_WINDOW;
+    if (link->connects++ > 0) rt->reconnects++;
+    if (link->on_standby) rt->standby_connects++;
+    snprintf(log_msg, sizeof(log_msg), "Connected to Nuclear Control on link %d (port %d%s)", link->index, link->port,
+             rt->transport == TRANSPORT_UNIX ? ", AF_UNIX" : "");
+    log_event("CONNECTION", log_msg);
+    if (rt->transport == TRANSPORT_SHM && !link->tcp_only) runtime_offer_ring(rt, link);
+#ifdef USE_TLS
+    if (rt->transport == TRANSPORT_TLS && runtime_start_tls(rt, link) < 0) return;
+#endif
+
+    char hello[64];
+    int hello_len = rt->codec ? snprintf(hello, sizeof(hello), "%s" CODEC_OFFER "%d", rt->kind, rt->codec)
+                              : snprintf(hello, sizeof(hello), "%s", rt->kind);
+    for (int unit = link->index + 1; unit <= rt->unit_count && link->sock >= 0; unit += rt->link_count)
+    {
+        runtime_send(rt, (uint32_t)unit, FRAME_HELLO, hello, (size_t)hello_len);
+    }
+
+    //Frames that arrived while the rings were offered are acted on now rather than on the next doorbell.
+    if (link->sock >= 0 && link->rx_used > 0)
+    {
+        int offset = runtime_handle_frames(rt, link, link->rx, link->rx_used);
+        if (offset < 0) return;
+        memmove(link->rx, link->rx + offset, link->rx_used - (size_t)offset);
+        link->rx_used -= (size_t)offset;
+    }
+}
+
+/*This hands every record waiting in a link's ring to the handler. A record is what one send
+put in the ring and holds whole frames, which are parsed where they are. A record that does
+not hold whole frames or runs past the ring takes the link down.*/
+static inline void runtime_read_ring(ClientRuntime *rt, Link *link)
+{
+    size_t length = 0;
+    const char *record;
+    while (link->sock >= 0 && link->shm.segment && (record = shm_link_peek(&link->shm, &length)) != NULL)
+    {
+        int consumed = runtime_handle_frames(rt, link, record, length);
+        if (consumed < 0) return;
+        if (shm_link_release(&link->shm, length) < 0 || (size_t)consumed != length)
+        {
+            runtime_link_down(rt, link, "Invalid ring record");
+            return;
+        }
+    }
+    if (link->sock >= 0 && link->shm.segment && length == SHM_INVALID) runtime_link_down(rt, link, "Invalid ring record");
+}
+
+/*This reads a link's ring and returns 1 once it is empty and marked as sleeping, so the
+caller may wait on the socket for the doorbell, or 0 if records kept coming and it should
+look again before waiting. Links without rings can always wait.*/
+static inline int runtime_ring_idle(ClientRuntime *rt, Link *link)
+{
+    if (!link->shm.segment) return 1;
+    runtime_read_ring(rt, link);
+    return !link->shm.segment || shm_link_idle(&link->shm);
+}
+
+//This reads whatever is waiting on a link and hands every complete frame to the handler.
+static inline void runtime_read_link(ClientRuntime *rt, Link *link)
+{
+    ssize_t bytes;
+#ifdef USE_TLS
+    if (link->tls) bytes = tls_read(link->tls, link->sock, link->rx + link->rx_used, sizeof(link->rx) - link->rx_used);
+    else
+#endif
+    bytes = recv(link->sock, link->rx + link->rx_used, sizeof(link->rx) - link->rx_used, 0);
+    if (bytes <= 0)
+    {
+        if (bytes < 0 && (errno == EINTR || errno == EAGAIN)) return; //EAGAIN: part of a TLS record.
+        runtime_link_down(rt, link, bytes == 0 ? "Server closed connection" : strerror(errno));
+        return;
+    }
+    link->rx_used += (size_t)bytes;
+
+    int offset = runtime_handle_frames(rt, link, link->rx, link->rx_used);
+    if (offset < 0) return;
+    memmove(link->rx, link->rx + offset, link->rx_used - (size_t)offset);
+    link->rx_used -= (size_t)offset;
+    if (link->shm.segment) runtime_read_ring(rt, link);
+}
+
+/*This is the runtime's event loop step. It reconnects links whose backoff has
+expired, then waits up to timeout_ms for frames from nuclearControl. A shorter
+wait is used while a reconnect is pending, or acknowledgements or a batch of reports
+are due, so that they happen on time.*/
+static inline void runtime_poll(ClientRuntime *rt, int timeout_ms)
+{
+    struct pollfd fds[rt->link_count];
+    Link *polled[rt->link_count];
+    int count = 0;
+    long long now = now_ms();
+
+    for (int i = 0; i < rt->link_count; i++)
+    {
+        Link *link = &rt->links[i];
+        if (link->ended) continue;
+        if (link->sock < 0 && now >= link->next_attempt_ms) runtime_connect_link(rt, link);
+        if (link->sock >= 0 && (!runtime_ring_idle(rt, link) || runtime_tls_pending(link))) timeout_ms = 0;
+        if (link->sock >= 0 && link->acks_pending > 0)
+        {
+            long long due = link->acks_since_ms + ACK_DELAY_MS - now;
+            if (due <= 0) runtime_flush_acks(rt, link);
+            else if (due < timeout_ms) timeout_ms = (int)due;
+        }
+        if (link->sock >= 0 && link->batch_frames > 0)
+        {
+            long long due = runtime_batch_wait(rt, link, now);
+            if (due <= 0) runtime_flush_batch(rt, link, BATCH_BY_TIME);
+            else if (due < timeout_ms) timeout_ms = (int)due;
+        }
+        if (link->sock < 0)
+        {
+            long long wait = link->next_attempt_ms - now;
+            if (wait < timeout_ms) timeout_ms = wait > 0 ? (int)wait : 0;
+            continue;
+        }
+        fds[count].fd = link->sock;
+        fds[count].events = POLLIN;
+        polled[count++] = link;
+    }
+
+    if (poll(fds, (nfds_t)count, timeout_ms) < 0) return;
+    for (int i = 0; i < count; i++)
+    {
+        if ((fds[i].revents & (POLLIN | POLLERR | POLLHUP)) || runtime_tls_pending(polled[i]))
+        {
+            runtime_read_link(rt, polled[i]);
+        }
+    }
+}
+
+//This writes the flow control figures to a sensor's summary file.
+static inline void runtime_report_credits(const ClientRuntime *rt, FILE *summary_fp)
+{
+    fprintf(summary_fp, "Reports Held Back By Flow Control: %lu, Credit Grants Received: %lu\n",
+            rt->reports_held, rt->credit_grants);
+}
+
+/*This writes the report batching figures to a sensor's summary file: how many reports
+each send carried, what sent the batches and how long reports waited in them.*/
+static inline void runtime_report_batches(const ClientRuntime *rt, FILE *summary_fp)
+{
+    if (rt->batch_ms <= 0) return;
+    fprintf(summary_fp, "Report Batches (up to %zu bytes or %d ms): %lu reports in %lu sends, avg %.1f per send, "
+            "largest %d; sent full %lu, on time %lu, by a critical report %lu, ahead of other frames %lu; "
+            "wait in a batch avg %.2f ms, max %.2f ms\n", rt->batch_bytes, rt->batch_ms, rt->batched_reports,
+            rt->report_batches, rt->report_batches ? (double)rt->batched_reports / (double)rt->report_batches : 0.0,
+            rt->batch_largest, rt->batch_flushes[BATCH_BY_SIZE], rt->batch_flushes[BATCH_BY_TIME],
+            rt->batch_flushes[BATCH_BY_CRITICAL], rt->batch_flushes[BATCH_BY_OTHER],
+            rt->batched_reports ? (double)rt->batch_wait_ns / (double)rt->batched_reports / 1e6 : 0.0,
+            (double)rt->batch_wait_max_ns / 1e6);
+}
+
+//This writes the acknowledgement figures to a client's summary file.
+static inline void runtime_report_acks(const ClientRuntime *rt, FILE *summary_fp)
+{
+    fprintf(summary_fp, "Commands Acknowledged: %lu in %lu ACK frames (%lu sent with other frames), "
+            "Retransmissions Ignored: %lu\n", rt->acks_sent, rt->ack_frames, rt->acks_piggybacked, rt->duplicates);
+}
+
+//This writes how the run ended to a client's summary file.
+static inline void runtime_report_end(const ClientRuntime *rt, FILE *summary_fp)
+{
+    fprintf(summary_fp, "Links Ended By Nuclear Control: %d of %d\n", rt->links_ended, rt->link_count);
+    if (rt->failover)
+    {
+        fprintf(summary_fp, "Connections Made To The Standby: %lu\n", rt->standby_connects);
+    }
+    if (rt->transport == TRANSPORT_SHM)
+    {
+        fprintf(summary_fp, "Shared-Memory Rings: %lu connections on rings, %lu on TCP; records sent %lu, received %lu, "
+                "doorbells rung %lu (%.1f%% of sends), ring full %lu times\n", rt->ring_links, rt->ring_refusals,
+                rt->ring_records_sent, rt->ring_records_received, rt->ring_doorbells,
+                rt->ring_records_sent ? 100.0 * (double)rt->ring_doorbells / (double)rt->ring_records_sent : 0.0,
+                rt->ring_full);
+    }
+    if (rt->transport == TRANSPORT_TLS)
+    {
+        fprintf(summary_fp, "TLS 1.3: %lu handshakes, kernel TLS sending on %lu and receiving on %lu\n",
+                rt->tls_handshakes, rt->tls_kernel_send, rt->tls_kernel_recv);
+    }
+}
+
+//This closes every link at the end of the simulation.
+static inline void runtime_close(ClientRuntime *rt)
+{
+    for (int i = 0; i < rt->link_count; i++)
+    {
+        if (rt->links[i].sock >= 0)
+        {
+            runtime_flush_batch(rt, &rt->links[i], BATCH_BY_OTHER);
+            runtime_flush_acks(rt, &rt->links[i]);
+            runtime_flush_outcomes(rt, &rt->links[i]);
+            runtime_close_ring(rt, &rt->links[i]);
+            runtime_close_tls(&rt->links[i]);
+            shutdown(rt->links[i].sock, SHUT_RDWR);
+            close(rt->links[i].sock);
+            rt->links[i].sock = -1;
+        }
+    }
+    free(rt->links);
+    rt->links = NULL;
+#ifdef USE_TLS
+    SSL_CTX_free(rt->tls_ctx);
+    rt->tls_ctx = NULL;
+#endif
+}
+
+static inline int runtime_compare_ns(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/*This is one end of a transport under the benchmark: a connected socket, with the ring or
+the TLS connection on top of it if there is one. cipher is the Caesar pass of the programs,
+run over the payload of every frame sent and received, or NULL. With batch, streamed frames
+are gathered into sends of up to that many bytes, as "--batch-ms" does with reports.*/
+typedef struct
+{
+    int sock;
+    ShmLink *shm;
+    void (*cipher)(const char *text, char *out, size_t len);
+    size_t batch;
+#ifdef USE_TLS
+    SSL *tls;
+#endif
+} BenchEnd;
+
+//This reads what is there like recv, waiting in poll while a TLS record is incomplete.
+static inline ssize_t runtime_bench_read(BenchEnd *end, char *buffer, size_t size)
+{
+#ifdef USE_TLS
+    while (end->tls)
+    {
+        ssize_t bytes = tls_read(end->tls, end->sock, buffer, size);
+        if (bytes >= 0 || errno != EAGAIN) return bytes;
+        struct pollfd fd = {end->sock, POLLIN, 0};
+        poll(&fd, 1, -1);
+    }
+#endif
+    return recv(end->sock, buffer, size, 0);
+}
+
+//This receives exactly length bytes, which may take several reads on a TCP stream. It returns 0 or -1.
+static inline int runtime_bench_read_all(BenchEnd *end, char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t bytes = runtime_bench_read(end, buffer, length);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return -1;
+        buffer += bytes;
+        length -= (size_t)bytes;
+    }
+    return 0;
+}
+
+//This runs the Caesar pass over the payload of a frame in place, as a sensor or effector would.
+static inline void runtime_bench_cipher(BenchEnd *end, char *frame, size_t length)
+{
+    char text[FRAME_MAX_PAYLOAD + 1];
+    char out[FRAME_MAX_PAYLOAD + 1];
+    if (!end->cipher || length <= FRAME_HEADER_SIZE) return;
+    size_t payload_len = length - FRAME_HEADER_SIZE;
+    memcpy(text, frame + FRAME_HEADER_SIZE, payload_len);
+    text[payload_len] = '\0';
+    end->cipher(text, out, sizeof(out));
+    memcpy(frame + FRAME_HEADER_SIZE, out, payload_len);
+}
+
+/*This sends one frame for the transport benchmark, through the ring when there is one,
+ringing the doorbell on the socket as runtime_write does. It returns 0 or -1.*/
+static inline int runtime_bench_send(BenchEnd *end, const char *data, size_t length)
+{
+    char frame[FRAME_BUFFER_SIZE];
+    if (end->cipher && length <= sizeof(frame))
+    {
+        memcpy(frame, data, length);
+        runtime_bench_cipher(end, frame, length);
+        data = frame;
+    }
+#ifdef USE_TLS
+    if (end->tls) return tls_write_all(end->tls, end->sock, data, length);
+#endif
+    if (!end->shm) return send_all(end->sock, data, length);
+    int result;
+    while ((result = shm_link_send(end->shm, data, length)) < 0) sched_yield();
+    return result == 0 ? 0 : send_all(end->sock, "", 1);
+}
+
+/*This receives one frame of length bytes for the transport benchmark. From a ring it
+yields a few times before marking itself sleeping and waiting for the doorbell, much as
+the client's event loop does. It returns 0 or -1.*/
+static inline int runtime_bench_recv(BenchEnd *end, char *buffer, size_t length)
+{
+    if (!end->shm)
+    {
+        if (runtime_bench_read_all(end, buffer, length) < 0) return -1;
+        runtime_bench_cipher(end, buffer, length);
+        return 0;
+    }
+    for (int spins = 0;; spins++)
+    {
+        size_t record_len;
+        const char *record = shm_link_peek(end->shm, &record_len);
+        if (record)
+        {
+            memcpy(buffer, record, record_len < length ? record_len : length);
+            if (shm_link_release(end->shm, record_len) < 0) return -1;
+            return record_len == length ? 0 : -1;
+        }
+        if (record_len == SHM_INVALID) return -1;
+        if (spins < 16) sched_yield();
+        else if (shm_link_idle(end->shm))
+        {
+            char doorbell;
+            if (recv(end->sock, &doorbell, 1, 0) != 1) return -1;
+        }
+    }
+}
+
+/*This is the far end of the transport benchmark. It runs in a child process, as
+nuclearControl would, and echoes count frames back one at a time, then takes count
+more that are streamed at it without answers and sends one byte once it has them all.
+Streamed frames are read in bulk, and deciphered one by one, unless they come out of a ring.*/
+static inline void runtime_bench_peer(BenchEnd *end, int count, size_t frame_len)
+{
+    char buffer[FRAME_BUFFER_SIZE];
+    for (int i = 0; i < count; i++)
+    {
+        if (runtime_bench_recv(end, buffer, frame_len) < 0 || runtime_bench_send(end, buffer, frame_len) < 0) return;
+    }
+    for (int i = 0; end->shm && i < count; i++)
+    {
+        if (runtime_bench_recv(end, buffer, frame_len) < 0) return;
+    }
+    size_t left = end->shm ? 0 : (size_t)count * frame_len;
+    size_t used = 0;
+    while (left > 0)
+    {
+        ssize_t bytes = runtime_bench_read(end, buffer + used, sizeof(buffer) - used);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) return;
+        left -= (size_t)bytes < left ? (size_t)bytes : left;
+        used += (size_t)bytes;
+        size_t offset = 0;
+        for (; used - offset >= frame_len; offset += frame_len) runtime_bench_cipher(end, buffer + offset, frame_len);
+        memmove(buffer, buffer + offset, used - offset);
+        used -= offset;
+    }
+    end->cipher = NULL;
+    runtime_bench_send(end, "", 1);
+}
+
+/*This times one transport from the client's end: count round trips of a report sized
+frame, then count frames sent one per send as runtime_send does, or in batches, up to the
+peer's answer that all of them arrived. It returns 0 or -1.*/
+static inline int runtime_bench_transport(const char *name, BenchEnd *end, int count, const char *frame,
+                                          size_t frame_len)
+{
+    char echo[FRAME_BUFFER_SIZE];
+    long long *round_trips = malloc((size_t)count * sizeof(long long));
+    if (!round_trips) return -1;
+    for (int i = 0; i < count; i++)
+    {
+        long long started = runtime_now_ns();
+        if (runtime_bench_send(end, frame, frame_len) < 0 || runtime_bench_recv(end, echo, frame_len) < 0)
+        {
+            free(round_trips);
+            return -1;
+        }
+        round_trips[i] = runtime_now_ns() - started;
+    }
+    long long total = 0;
+    for (int i = 0; i < count; i++) total += round_trips[i];
+    qsort(round_trips, (size_t)count, sizeof(long long), runtime_compare_ns);
+
+    char batch[REPORT_BATCH_MAX + FRAME_BUFFER_SIZE];
+    size_t batch_len = 0;
+    long sends = 0;
+    long long started = runtime_now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        if (end->batch == 0)
+        {
+            if (runtime_bench_send(end, frame, frame_len) < 0) break;
+            continue;
+        }
+        memcpy(batch + batch_len, frame, frame_len);
+        batch_len += frame_len;
+        if (batch_len < end->batch && i + 1 < count) continue;
+        if (runtime_bench_send(end, batch, batch_len) < 0) break;
+        batch_len = 0;
+        sends++;
+    }
+    end->cipher = NULL;
+    int done = runtime_bench_recv(end, echo, 1);
+    double stream_s = (double)(runtime_now_ns() - started) / 1e9;
+    if (done == 0)
+    {
+        printf("%s: round trip avg %.1f us, median %.1f us, p99 %.1f us; streaming %.2f million frames/s "
+               "(%.0f MB/s, %.0f ns per frame)", name, (double)total / count / 1000.0,
+               (double)round_trips[count / 2] / 1000.0, (double)round_trips[count * 99 / 100] / 1000.0,
+               count / stream_s / 1e6, count * (double)frame_len / stream_s / 1e6, stream_s * 1e9 / count);
+        if (end->shm)
+        {
+            printf("; doorbells on %.1f%% of sends",
+                   end->shm->records_sent ? 100.0 * end->shm->doorbells / end->shm->records_sent : 0.0);
+        }
+        if (sends > 0)
+        {
+            //While streaming, a frame waits for the ones queued after it in its batch, half of them on average.
+            double per_send = (double)count / (double)sends;
+            printf("; %.1f frames per send, each waiting about %.1f us for its batch to fill", per_send,
+                   (per_send - 1.0) / 2.0 * stream_s * 1e6 / count);
+        }
+        printf("\n");
+    }
+    free(round_trips);
+    return done;
+}
+
+/*This makes a connected TCP pair through a listener on an ephemeral loopback port.
+It returns 0, or -1 with errno set.*/
+static inline int runtime_bench_tcp_pair(int socks[2])
+{
+    struct sockaddr_in addr = {0};
+    socklen_t addr_len = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    socks[0] = socks[1] = -1;
+    if (listener >= 0 && bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0 && listen(listener, 1) == 0 &&
+        getsockname(listener, (struct sockaddr *)&addr, &addr_len) == 0)
+    {
+        socks[0] = socket(AF_INET, SOCK_STREAM, 0);
+        if (socks[0] >= 0 && connect(socks[0], (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            socks[1] = accept(listener, NULL, NULL);
+        }
+    }
+    if (listener >= 0) close(listener);
+    if (socks[0] >= 0 && socks[1] >= 0) return 0;
+    if (socks[0] >= 0) close(socks[0]);
+    return -1;
+}
+
+/*This is "--transport-benchmark N": it compares TCP over loopback as it is, with the
+program's Caesar pass over every payload at both ends, with TCP_NODELAY and the frames
+streamed in batches of batch_bytes, an AF_UNIX SOCK_SEQPACKET socket pair, a shared-memory
+ring segment with a socket pair for its doorbell and, if the program was built with it,
+TLS 1.3 over loopback. Each talks to a child process, on N round trips and N streamed
+frames of a report's size, without starting the client.*/
+static inline int runtime_transport_benchmark(int count, int batch_bytes,
+                                              void (*cipher)(const char *text, char *out, size_t len))
+{
+    char payload[TRANSPORT_BENCH_PAYLOAD];
+    char frame[FRAME_HEADER_SIZE + TRANSPORT_BENCH_PAYLOAD];
+    memset(payload, 'R', sizeof(payload));
+    int frame_len = frame_encode(frame, sizeof(frame), FRAME_INTEL, 1, payload, sizeof(payload));
+    printf("%d round trips and %d streamed frames of %d bytes on each transport\n", count, count, frame_len);
+
+    const char *names[] = {"TCP loopback", "TCP loopback, Caesar", "TCP loopback, batched", "AF_UNIX SOCK_SEQPACKET",
+                           "Shared-memory rings", "TLS 1.3 over TCP loopback"};
+    const int transports[] = {TRANSPORT_TCP, TRANSPORT_TCP, TRANSPORT_TCP, TRANSPORT_UNIX, TRANSPORT_SHM, TRANSPORT_TLS};
+#ifdef USE_TLS
+    int rows = 6;
+#else
+    int rows = 5;
+#endif
+    for (int row = 0; row < rows; row++)
+    {
+        int transport = transports[row];
+        int socks[2] = {-1, -1};
+        ShmLink shm = {0};
+        char name[SHM_NAME_SIZE];
+        if (transport == TRANSPORT_SHM)
+        {
+            //The child maps the segment by name as nuclearControl does, before the name is removed.
+            if (shm_link_create(&shm, name, sizeof(name)) < 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, socks) < 0)
+            {
+                socks[0] = socks[1] = -1;
+            }
+        }
+        else if (transport == TRANSPORT_UNIX)
+        {
+            if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socks) < 0) socks[0] = socks[1] = -1;
+        }
+        else
+        {
+            runtime_bench_tcp_pair(socks);
+        }
+        if (socks[0] < 0 || socks[1] < 0)
+        {
+            fprintf(stderr, "Failed to connect the %s pair: %s\n", names[row], strerror(errno));
+            if (socks[0] >= 0) close(socks[0]);
+            if (shm.segment)
+            {
+                shm_link_close(&shm);
+                shm_unlink(name);
+            }
+            return 1;
+        }
+
+        BenchEnd end = {0};
+        end.sock = socks[0];
+        end.shm = shm.segment ? &shm : NULL;
+        end.cipher = row == 1 ? cipher : NULL;
+        char label[128];
+        snprintf(label, sizeof(label), "%s", names[row]);
+        if (row == 2)
+        {
+            int on = 1;
+            end.batch = batch_bytes > 0 ? (size_t)batch_bytes : REPORT_BATCH_BYTES;
+            setsockopt(socks[0], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            setsockopt(socks[1], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            snprintf(label, sizeof(label), "%s (TCP_NODELAY, up to %zu bytes per send)", names[row], end.batch);
+        }
+#ifdef USE_TLS
+        //The pair is made in memory for the child, and the client end does not check it.
+        char error[256];
+        int generated;
+        SSL_CTX *server_ctx = transport == TRANSPORT_TLS ? tls_server_context(NULL, NULL, &generated, error, sizeof(error)) : NULL;
+        SSL_CTX *client_ctx = transport == TRANSPORT_TLS ? tls_client_context(NULL, error, sizeof(error)) : NULL;
+        if (transport == TRANSPORT_TLS && (!server_ctx || !client_ctx))
+        {
+            fprintf(stderr, "TLS unavailable: %s\n", error);
+            SSL_CTX_free(server_ctx);
+            SSL_CTX_free(client_ctx);
+            close(socks[0]);
+            close(socks[1]);
+            return 1;
+        }
+#endif
+
+        pid_t peer = fork();
+        if (peer == 0)
+        {
+            close(socks[0]);
+            ShmLink server = {0};
+            BenchEnd far = end;
+            far.sock = socks[1];
+            far.shm = NULL;
+            if (shm.segment)
+            {
+                shm_link_close(&shm);
+                if (shm_link_open(&server, name) < 0) _exit(1);
+                far.shm = &server;
+            }
+#ifdef USE_TLS
+            if (server_ctx && !(far.tls = tls_handshake(server_ctx, socks[1], 1, error, sizeof(error)))) _exit(1);
+#endif
+            runtime_bench_peer(&far, count, (size_t)frame_len);
+            _exit(0);
+        }
+        close(socks[1]);
+        int result = peer < 0 ? -1 : 0;
+#ifdef USE_TLS
+        if (result == 0 && client_ctx)
+        {
+            end.tls = tls_handshake(client_ctx, socks[0], 0, error, sizeof(error));
+            if (!end.tls) result = -1;
+            else snprintf(label, sizeof(label), "%s (%s, records sent by the %s)", names[row],
+                          SSL_get_cipher_name(end.tls), tls_ktls_send(end.tls) ? "kernel" : "process");
+        }
+#endif
+        if (result == 0) result = runtime_bench_transport(label, &end, count, frame, (size_t)frame_len);
+        close(socks[0]);
+        if (peer > 0) waitpid(peer, NULL, 0);
+#ifdef USE_TLS
+        SSL_free(end.tls);
+        SSL_CTX_free(server_ctx);
+        SSL_CTX_free(client_ctx);
+#endif
+        if (shm.segment)
+        {
+            shm_link_close(&shm);
+            shm_unlink(name);
+        }
+        if (result < 0)
+        {
+            fprintf(stderr, "The %s benchmark failed\n", names[row]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,464 @@
+/*This is the coroutine runtime radar and satellite use with "--coroutines". Without it
+a client keeps a next report time for every unit and its main loop works out which
+units are due; with it every unit is a coroutine whose behaviour reads as the old
+sequential loop (send a report, sleep, send the next one) while thousands of them share
+the one thread, together with a coroutine per link that waits for frames from
+nuclearControl.
+
+The coroutines are stackless: a coroutine is a function that is called again every time
+it is resumed, and the CO_ macros below jump back to where it suspended with a switch on
+the line it left from (Duff's device, as in Protothreads). Nothing is kept on a stack
+between resumes, so a unit costs its Coroutine and whatever state it keeps in its own
+structure, a few dozen bytes, instead of a thread's or a process's stack. The price is
+that local variables do not survive a suspension (keep them in the unit's structure),
+the body cannot suspend inside a switch statement of its own, and two CO_ macros must
+not share a line.
+
+The scheduler keeps a queue of the coroutines ready to run, a binary heap of the ones
+sleeping or waiting with a timeout, and an epoll instance for the ones waiting for a
+descriptor, registered one shot so a wake-up is taken once. When nothing is ready it
+sleeps in epoll_wait until the earliest timer. A resume is what the summary calls a
+context switch: the scheduler calling into a coroutine and the coroutine returning.*/
+#ifndef COROUTINE_RUNTIME_H
+#define COROUTINE_RUNTIME_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "clientRuntime.h"
+
+#define CO_MAX_EVENTS 64
+#define CO_LINK_CHECK_MS 250 //The longest a link coroutine waits before it looks at its link again.
+
+//These are the states of a coroutine.
+enum
+{
+    CO_READY = 0,
+    CO_RUNNING = 1,
+    CO_SLEEPING = 2,
+    CO_WAITING = 3, //For a descriptor, with a timeout.
+    CO_DONE = 4
+};
+
+typedef struct Coroutine Coroutine;
+typedef struct CoScheduler CoScheduler;
+
+//This is a coroutine's body. It is called to start the coroutine and every time it is resumed.
+typedef void (*CoFunction)(CoScheduler *sched, Coroutine *co);
+
+/*This is a coroutine. It goes first in the structure of the unit it runs, so the body can
+turn the pointer it is given back into its unit. ready is 1 after CO_WAIT_FD if the
+descriptor became readable and 0 if the wait timed out.*/
+struct Coroutine
+{
+    CoFunction run;
+    int line;
+    int state;
+    int heap_index;
+    int fd;
+    int ready;
+    long long wake_ms;
+};
+
+/*These are the settings the sensors accept on the command line: "--coroutines" to run
+their units as coroutines and "--coroutine-benchmark N" to time N of them without a server.*/
+typedef struct
+{
+    int enabled;
+    int benchmark;
+} CoConfig;
+
+//This is the scheduler, with room for capacity coroutines, and the counters the summary reports.
+struct CoScheduler
+{
+    int epoll_fd;
+    int capacity;
+    int spawned;
+    int alive;
+    int stopping;
+    Coroutine **queue; //The ready coroutines, a ring of capacity entries from queue_head.
+    int queue_head;
+    int queue_count;
+    Coroutine **timers; //A binary heap on wake_ms.
+    int timer_count;
+    unsigned long long resumes;
+    unsigned long fd_wakeups;
+    unsigned long timer_wakeups;
+    unsigned long epoll_waits;
+    long long run_ns;   //Time spent in co_run, resumes and waiting both.
+    long long busy_ns;  //The part of it spent in the coroutines.
+};
+
+//These suspend the running coroutine. A body starts with CO_BEGIN and ends with CO_END.
+#define CO_BEGIN(co) switch ((co)->line) { case 0:
+#define CO_END(co) } (co)->state = CO_DONE
+#define CO_SUSPEND(co) (co)->line = __LINE__; return; case __LINE__:
+#define CO_YIELD(sched, co) do { co_ready(sched, co); CO_SUSPEND(co); } while (0)
+#define CO_SLEEP(sched, co, ms) do { co_sleep_until(sched, co, now_ms() + (ms)); CO_SUSPEND(co); } while (0)
+#define CO_WAIT_FD(sched, co, fd, timeout_ms) do { co_wait_fd(sched, co, fd, timeout_ms); CO_SUSPEND(co); } while (0)
+
+/*This consumes one coroutine option at argv[*i]. It returns 1 if the option belonged to
+the runtime, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int co_parse_option(CoConfig *config, int argc, char *argv[], int *i)
+{
+    if (strcmp(argv[*i], "--coroutines") == 0)
+    {
+        config->enabled = 1;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--coroutine-benchmark") != 0) return 0;
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) <= 0) return -1;
+    config->benchmark = atoi(argv[++*i]);
+    return 1;
+}
+
+static inline long long co_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//This releases what co_init reserved.
+static inline void co_destroy(CoScheduler *sched)
+{
+    if (sched->epoll_fd >= 0) close(sched->epoll_fd);
+    free(sched->queue);
+    free(sched->timers);
+    memset(sched, 0, sizeof(*sched));
+    sched->epoll_fd = -1;
+}
+
+//This sets up a scheduler for capacity coroutines. It returns 0 or -1.
+static inline int co_init(CoScheduler *sched, int capacity)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->capacity = capacity;
+    sched->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sched->queue = calloc((size_t)capacity, sizeof(Coroutine *));
+    sched->timers = calloc((size_t)capacity, sizeof(Coroutine *));
+    if (sched->epoll_fd < 0 || !sched->queue || !sched->timers)
+    {
+        co_destroy(sched);
+        return -1;
+    }
+    return 0;
+}
+
+//These keep the timer heap ordered, moving the coroutine at index up or down.
+static inline void co_heap_place(CoScheduler *sched, int index, Coroutine *co)
+{
+    sched->timers[index] = co;
+    co->heap_index = index;
+}
+
+static inline void co_heap_up(CoScheduler *sched, int index)
+{
+    Coroutine *co = sched->timers[index];
+    while (index > 0 && sched->timers[(index - 1) / 2]->wake_ms > co->wake_ms)
+    {
+        co_heap_place(sched, index, sched->timers[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    co_heap_place(sched, index, co);
+}
+
+static inline void co_heap_down(CoScheduler *sched, int index)
+{
+    Coroutine *co = sched->timers[index];
+    for (;;)
+    {
+        int child = 2 * index + 1;
+        if (child >= sched->timer_count) break;
+        if (child + 1 < sched->timer_count && sched->timers[child + 1]->wake_ms < sched->timers[child]->wake_ms) child++;
+        if (sched->timers[child]->wake_ms >= co->wake_ms) break;
+        co_heap_place(sched, index, sched->timers[child]);
+        index = child;
+    }
+    co_heap_place(sched, index, co);
+}
+
+//This takes a coroutine off the timer heap.
+static inline void co_heap_remove(CoScheduler *sched, Coroutine *co)
+{
+    int index = co->heap_index;
+    Coroutine *last = sched->timers[--sched->timer_count];
+    co->heap_index = -1;
+    if (last == co) return;
+    co_heap_place(sched, index, last);
+    co_heap_up(sched, index);
+    co_heap_down(sched, last->heap_index);
+}
+
+//This puts a coroutine at the back of the ready queue.
+static inline void co_ready(CoScheduler *sched, Coroutine *co)
+{
+    co->state = CO_READY;
+    sched->queue[(sched->queue_head + sched->queue_count++) % sched->capacity] = co;
+}
+
+//This starts a coroutine on its next turn. It returns 0, or -1 if the scheduler is full.
+static inline int co_spawn(CoScheduler *sched, Coroutine *co, CoFunction run)
+{
+    if (sched->spawned >= sched->capacity) return -1;
+    memset(co, 0, sizeof(*co));
+    co->run = run;
+    co->heap_index = -1;
+    co->fd = -1;
+    sched->spawned++;
+    sched->alive++;
+    co_ready(sched, co);
+    return 0;
+}
+
+//This puts the running coroutine to sleep until wake_ms. CO_SLEEP calls it.
+static inline void co_sleep_until(CoScheduler *sched, Coroutine *co, long long wake_ms)
+{
+    co->state = CO_SLEEPING;
+    co->wake_ms = wake_ms;
+    co->heap_index = sched->timer_count++;
+    sched->timers[co->heap_index] = co;
+    co_heap_up(sched, co->heap_index);
+}
+
+/*This makes the running coroutine wait until fd is readable or timeout_ms have passed.
+CO_WAIT_FD calls it. If the descriptor cannot be watched, the coroutine is resumed
+straight away as if it were readable, and finds out what is wrong when it reads.*/
+static inline void co_wait_fd(CoScheduler *sched, Coroutine *co, int fd, int timeout_ms)
+{
+    struct epoll_event event = {0};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = co;
+    if (epoll_ctl(sched->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0 &&
+        epoll_ctl(sched->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+        co->ready = 1;
+        co_ready(sched, co);
+        return;
+    }
+    co->fd = fd;
+    co->ready = 0;
+    co_sleep_until(sched, co, now_ms() + timeout_ms);
+    co->state = CO_WAITING;
+}
+
+//This resumes a coroutine once and counts it.
+static inline void co_resume(CoScheduler *sched, Coroutine *co)
+{
+    co->state = CO_RUNNING;
+    co->run(sched, co);
+    sched->resumes++;
+    if (co->state == CO_RUNNING || co->state == CO_DONE)
+    {
+        //A body that returned without suspending has finished too.
+        co->state = CO_DONE;
+        sched->alive--;
+    }
+}
+
+/*This runs the coroutines until deadline_ms, until none is left or until one of them
+sets stopping. The ready ones run in turn; then the timers that are due and the
+descriptors that became readable make their coroutines ready, waiting in epoll_wait
+for the earliest timer when nothing is.*/
+static inline void co_run(CoScheduler *sched, long long deadline_ms)
+{
+    struct epoll_event events[CO_MAX_EVENTS];
+    long long started = co_now_ns();
+    while (sched->alive > 0 && !sched->stopping)
+    {
+        long long now = now_ms();
+        if (now >= deadline_ms) break;
+        while (sched->timer_count > 0 && sched->timers[0]->wake_ms <= now)
+        {
+            Coroutine *co = sched->timers[0];
+            co_heap_remove(sched, co);
+            if (co->state == CO_WAITING) epoll_ctl(sched->epoll_fd, EPOLL_CTL_DEL, co->fd, NULL);
+            sched->timer_wakeups++;
+            co_ready(sched, co);
+        }
+
+        //Only the coroutines ready now run in this turn, the ones they make ready wait for the next.
+        long long busy = co_now_ns();
+        for (int turn = sched->queue_count; turn > 0 && !sched->stopping; turn--)
+        {
+            Coroutine *co = sched->queue[sched->queue_head];
+            sched->queue_head = (sched->queue_head + 1) % sched->capacity;
+            sched->queue_count--;
+            co_resume(sched, co);
+        }
+        sched->busy_ns += co_now_ns() - busy;
+        if (sched->alive == 0 || sched->stopping) break;
+
+        long long wait = deadline_ms - now_ms();
+        if (sched->timer_count > 0 && sched->timers[0]->wake_ms - now_ms() < wait) wait = sched->timers[0]->wake_ms - now_ms();
+        if (sched->queue_count > 0 || wait < 0) wait = 0;
+        int count = epoll_wait(sched->epoll_fd, events, CO_MAX_EVENTS, wait > INT_MAX ? INT_MAX : (int)wait);
+        sched->epoll_waits++;
+        for (int e = 0; e < count; e++)
+        {
+            Coroutine *co = events[e].data.ptr;
+            if (co->state != CO_WAITING) continue;
+            co_heap_remove(sched, co);
+            co->ready = 1;
+            sched->fd_wakeups++;
+            co_ready(sched, co);
+        }
+    }
+    sched->run_ns += co_now_ns() - started;
+}
+
+/*This is the coroutine for one link of a client runtime. It connects the link when its
+backoff expires, waits for frames and hands them to the runtime, and sends the link's
+acknowledgements and batched reports when they are due, until nuclearControl ends the link.
+Units queue reports without waking it, so with "--batch-ms" it never waits longer than
+the batch limit.*/
+typedef struct
+{
+    Coroutine co;
+    ClientRuntime *rt;
+    Link *link;
+} CoLink;
+
+static inline void co_link(CoScheduler *sched, Coroutine *co)
+{
+    CoLink *task = (CoLink *)co;
+    Link *link = task->link;
+    long long wait;
+    CO_BEGIN(co);
+    while (!link->ended)
+    {
+        if (link->sock < 0 && now_ms() < link->next_attempt_ms)
+        {
+            CO_SLEEP(sched, co, link->next_attempt_ms - now_ms());
+            continue;
+        }
+        if (link->sock < 0) runtime_connect_link(task->rt, link);
+        if (link->sock >= 0 && !runtime_ring_idle(task->rt, link))
+        {
+            CO_YIELD(sched, co); //Records kept coming, so look at the ring again before waiting.
+            continue;
+        }
+        if (link->sock < 0) continue;
+        if (runtime_tls_pending(link))
+        {
+            runtime_read_link(task->rt, link); //Decrypted bytes epoll cannot see on the socket.
+            CO_YIELD(sched, co);
+            continue;
+        }
+        wait = link->acks_pending > 0 ? link->acks_since_ms + ACK_DELAY_MS - now_ms() : CO_LINK_CHECK_MS;
+        if (task->rt->batch_ms > 0 && runtime_batch_wait(task->rt, link, now_ms()) < wait)
+        {
+            wait = runtime_batch_wait(task->rt, link, now_ms());
+        }
+        CO_WAIT_FD(sched, co, link->sock, wait > 0 ? (int)wait : 0);
+        if (co->ready && link->sock >= 0) runtime_read_link(task->rt, link);
+        if (link->sock >= 0 && link->acks_pending > 0 && now_ms() >= link->acks_since_ms + ACK_DELAY_MS)
+        {
+            runtime_flush_acks(task->rt, link);
+        }
+        if (link->sock >= 0 && link->batch_frames > 0 && runtime_batch_wait(task->rt, link, now_ms()) <= 0)
+        {
+            runtime_flush_batch(task->rt, link, BATCH_BY_TIME);
+        }
+    }
+    if (runtime_ended(task->rt)) sched->stopping = 1;
+    CO_END(co);
+}
+
+//This starts a co_link coroutine for every link of rt, in tasks. It returns 0 or -1.
+static inline int co_spawn_links(CoScheduler *sched, ClientRuntime *rt, CoLink *tasks)
+{
+    for (int l = 0; l < rt->link_count; l++)
+    {
+        tasks[l].rt = rt;
+        tasks[l].link = &rt->links[l];
+        if (co_spawn(sched, &tasks[l].co, co_link) < 0) return -1;
+    }
+    return 0;
+}
+
+/*This writes the coroutine figures to a summary file. unit_size is the size of the
+structure each unit's coroutine lives in.*/
+static inline void co_report(const CoScheduler *sched, size_t unit_size, FILE *summary_fp)
+{
+    double seconds = (double)sched->run_ns / 1e9;
+    fprintf(summary_fp, "Coroutines: %d in one thread, %zu bytes per unit (%zu in the unit, %zu in the scheduler)\n",
+            sched->spawned, unit_size + 2 * sizeof(Coroutine *), unit_size, 2 * sizeof(Coroutine *));
+    fprintf(summary_fp, "Context Switches: %llu (%.0f per second), %.0f ns each with the work done, Wake-ups: %lu by timer, %lu by "
+            "descriptor, %lu epoll waits\n", sched->resumes, seconds > 0.0 ? (double)sched->resumes / seconds : 0.0,
+            sched->resumes ? (double)sched->busy_ns / (double)sched->resumes : 0.0, sched->timer_wakeups,
+            sched->fd_wakeups, sched->epoll_waits);
+}
+
+/*These are the benchmark's coroutines: a yielder switches rounds times in a row, and a
+sleeper sleeps 1 to 10 ms at a time until the benchmark's deadline.*/
+typedef struct
+{
+    Coroutine co;
+    int rounds;
+} CoBench;
+
+static inline void co_bench_yielder(CoScheduler *sched, Coroutine *co)
+{
+    CoBench *unit = (CoBench *)co;
+    CO_BEGIN(co);
+    while (unit->rounds-- > 0) CO_YIELD(sched, co);
+    CO_END(co);
+}
+
+static inline void co_bench_sleeper(CoScheduler *sched, Coroutine *co)
+{
+    CoBench *unit = (CoBench *)co;
+    CO_BEGIN(co);
+    for (;;) CO_SLEEP(sched, co, 1 + unit->rounds++ % 10);
+    CO_END(co);
+}
+
+/*This is "--coroutine-benchmark N": it runs N coroutines that only yield, to time a
+context switch, then N that sleep on timers for a second, to time the timer path, and
+prints both with the memory a unit takes, without starting the client.*/
+static inline int co_benchmark(int count)
+{
+    CoScheduler sched;
+    CoBench *units = calloc((size_t)count, sizeof(CoBench));
+    if (!units || co_init(&sched, count) < 0)
+    {
+        fprintf(stderr, "Failed to set up %d coroutines\n", count);
+        free(units);
+        return 1;
+    }
+    int rounds = count >= 100000 ? 10 : 1000000 / count;
+    for (int i = 0; i < count; i++)
+    {
+        co_spawn(&sched, &units[i].co, co_bench_yielder);
+        units[i].rounds = rounds;
+    }
+    co_run(&sched, LLONG_MAX);
+    printf("%d coroutines yielding %d times each: %.1f million context switches per second, %.1f ns each\n", count,
+           rounds, (double)sched.resumes / ((double)sched.run_ns / 1e9) / 1e6, (double)sched.run_ns / (double)sched.resumes);
+    co_destroy(&sched);
+
+    if (co_init(&sched, count) < 0)
+    {
+        free(units);
+        return 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        co_spawn(&sched, &units[i].co, co_bench_sleeper);
+        units[i].rounds = i;
+    }
+    co_run(&sched, now_ms() + 1000);
+    printf("%d coroutines sleeping 1 to 10 ms: %.1f million wake-ups per second, %.1f%% of the thread busy\n", count,
+           (double)sched.resumes / ((double)sched.run_ns / 1e9) / 1e6, 100.0 * (double)sched.busy_ns / (double)sched.run_ns);
+    co_report(&sched, sizeof(CoBench), stdout);
+    co_destroy(&sched);
+    free(units);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,277 @@
+/*This is the simulated effector model shared by missileSilo and submarine.
+Each unit has a number of launchers that need a reload time after every launch,
+and a priority queue of commands waiting for a free launcher. Nothing sleeps:
+the client's event loop asks the model when the next launcher frees up and waits
+in the runtime until then, so commands keep being received while launchers reload.
+The queue memory is reserved at startup, like the slab in slab.h.*/
+#ifndef EFFECTOR_MODEL_H
+#define EFFECTOR_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+
+#define DEFAULT_LAUNCHERS 1
+#define DEFAULT_RELOAD_MS 500
+#define DEFAULT_QUEUE_DEPTH 64
+#define TARGET_SIZE 50
+
+/*These are the settings the effector clients accept on the command line:
+"--launchers N" per unit, "--reload-ms MS" per launcher and "--queue-depth N" per unit.*/
+typedef struct
+{
+    int launchers;
+    int reload_ms;
+    int queue_depth;
+} EffectorConfig;
+
+/*This is one command waiting for a launcher. Higher priority goes first, then the oldest.
+command_seq is nuclearControl's sequence number for the command, 0 if it sent none.*/
+typedef struct
+{
+    int priority;
+    unsigned long seq;
+    unsigned long command_seq;
+    long long enqueued_ms;
+    char target[TARGET_SIZE];
+} QueuedCommand;
+
+//This is one simulated unit: its command heap and the time each launcher is ready again.
+typedef struct
+{
+    QueuedCommand *heap;
+    int size;
+    long long *launcher_ready;
+} EffectorUnit;
+
+//This is called when a launcher fires, with how long the command waited in the queue.
+typedef void (*LaunchHandler)(uint32_t unit_id, const char *target, int priority, unsigned long command_seq,
+                              long long queue_delay_ms);
+
+/*This is the model for every unit of the process, plus the counters that
+the summary reports for queueing delay and launcher saturation.*/
+typedef struct
+{
+    EffectorConfig config;
+    int unit_count;
+    EffectorUnit *units;
+    QueuedCommand *heap_memory;
+    long long *ready_memory;
+    LaunchHandler launch;
+    unsigned long seq;
+    int pending;
+    unsigned long commands_received;
+    unsigned long commands_launched;
+    unsigned long commands_waited;
+    unsigned long commands_dropped;
+    long long queue_delay_total_ms;
+    long long queue_delay_max_ms;
+    int queue_depth_max;
+    long long busy_ms;
+    long long started_ms;
+} EffectorModel;
+
+/*This consumes one effector option at argv[*i]. It returns 1 if the option
+belonged to the model, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int effector_parse_option(EffectorConfig *config, int argc, char *argv[], int *i)
+{
+    int *target = NULL;
+    if (strcmp(argv[*i], "--launchers") == 0) target = &config->launchers;
+    else if (strcmp(argv[*i], "--reload-ms") == 0) target = &config->reload_ms;
+    else if (strcmp(argv[*i], "--queue-depth") == 0) target = &config->queue_depth;
+    else return 0;
+
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+    *target = atoi(argv[++*i]);
+    return (config->launchers > 0 && config->queue_depth > 0) ? 1 : -1;
+}
+
+//This reserves the queues and launcher timers for every unit. It returns 0 or -1.
+static inline int effector_init(EffectorModel *model, int unit_count, const EffectorConfig *config,
+                                LaunchHandler launch, long long now)
+{
+    memset(model, 0, sizeof(*model));
+    model->config = *config;
+    model->unit_count = unit_count;
+    model->launch = launch;
+    model->started_ms = now;
+    model->units = calloc((size_t)unit_count, sizeof(EffectorUnit));
+    model->heap_memory = calloc((size_t)unit_count * (size_t)config->queue_depth, sizeof(QueuedCommand));
+    model->ready_memory = calloc((size_t)unit_count * (size_t)config->launchers, sizeof(long long));
+    if (!model->units || !model->heap_memory || !model->ready_memory)
+    {
+        free(model->units);
+        free(model->heap_memory);
+        free(model->ready_memory);
+        return -1;
+    }
+    for (int i = 0; i < unit_count; i++)
+    {
+        model->units[i].heap = model->heap_memory + (size_t)i * (size_t)config->queue_depth;
+        model->units[i].launcher_ready = model->ready_memory + (size_t)i * (size_t)config->launchers;
+    }
+    return 0;
+}
+
+//This says whether command a should launch before command b.
+static inline int command_before(const QueuedCommand *a, const QueuedCommand *b)
+{
+    return a->priority > b->priority || (a->priority == b->priority && a->seq < b->seq);
+}
+
+//This pushes a command onto a unit's heap, sifting it up to its place.
+static inline void heap_push(EffectorUnit *unit, const QueuedCommand *command)
+{
+    int i = unit->size++;
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (!command_before(command, &unit->heap[parent])) break;
+        unit->heap[i] = unit->heap[parent];
+        i = parent;
+    }
+    unit->heap[i] = *command;
+}
+
+//This removes the first command from a unit's heap into out.
+static inline void heap_pop(EffectorUnit *unit, QueuedCommand *out)
+{
+    *out = unit->heap[0];
+    QueuedCommand last = unit->heap[--unit->size];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= unit->size) break;
+        if (child + 1 < unit->size && command_before(&unit->heap[child + 1], &unit->heap[child])) child++;
+        if (!command_before(&unit->heap[child], &last)) break;
+        unit->heap[i] = unit->heap[child];
+        i = child;
+    }
+    if (unit->size > 0) unit->heap[i] = last;
+}
+
+//This fires queued commands on every launcher of one unit that has finished reloading.
+static inline void effector_dispatch_unit(EffectorModel *model, int index, long long now)
+{
+    EffectorUnit *unit = &model->units[index];
+    for (int l = 0; l < model->config.launchers && unit->size > 0; l++)
+    {
+        if (unit->launcher_ready[l] > now) continue;
+
+        QueuedCommand command;
+        heap_pop(unit, &command);
+        model->pending--;
+        long long delay = now - command.enqueued_ms;
+        model->queue_delay_total_ms += delay;
+        if (delay > model->queue_delay_max_ms) model->queue_delay_max_ms = delay;
+        model->commands_launched++;
+        model->busy_ms += model->config.reload_ms;
+        unit->launcher_ready[l] = now + model->config.reload_ms;
+        model->launch((uint32_t)(index + 1), command.target, command.priority, command.command_seq, delay);
+    }
+}
+
+/*This takes the last queued command out of a full heap when a more urgent one
+arrives. The last command is always one of the leaves, so only those are searched.*/
+static inline int heap_evict_last(EffectorUnit *unit, const QueuedCommand *incoming)
+{
+    int worst = unit->size / 2;
+    for (int i = worst + 1; i < unit->size; i++)
+    {
+        if (command_before(&unit->heap[worst], &unit->heap[i])) worst = i;
+    }
+    if (!command_before(incoming, &unit->heap[worst])) return -1;
+
+    //The leaf is replaced by the heap's tail, which can only need to move up.
+    QueuedCommand moved = unit->heap[--unit->size];
+    int i = worst;
+    while (i < unit->size && i > 0 && command_before(&moved, &unit->heap[(i - 1) / 2]))
+    {
+        unit->heap[i] = unit->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    if (i < unit->size) unit->heap[i] = moved;
+    return 0;
+}
+
+/*This queues a command for a unit and launches straight away if a launcher is free.
+When the queue is full the least urgent command is dropped, which is the new one
+unless it outranks something already waiting. It returns 0 or -1 if the new one is dropped.*/
+static inline int effector_submit(EffectorModel *model, uint32_t unit_id, const char *target,
+                                  int priority, unsigned long command_seq, long long now)
+{
+    if (unit_id < 1 || (int)unit_id > model->unit_count) return -1;
+    EffectorUnit *unit = &model->units[unit_id - 1];
+    model->commands_received++;
+
+    QueuedCommand command;
+    command.priority = priority;
+    command.seq = model->seq++;
+    command.command_seq = command_seq;
+    command.enqueued_ms = now;
+    snprintf(command.target, sizeof(command.target), "%s", target);
+    if (unit->size >= model->config.queue_depth)
+    {
+        model->commands_dropped++;
+        if (heap_evict_last(unit, &command) < 0) return -1;
+        model->pending--;
+    }
+    heap_push(unit, &command);
+    model->pending++;
+    if (unit->size > model->queue_depth_max) model->queue_depth_max = unit->size;
+
+    effector_dispatch_unit(model, (int)unit_id - 1, now);
+    if (unit->size > 0) model->commands_waited++; //Every launcher was still reloading.
+    return 0;
+}
+
+/*This is the model's timer. It fires every command whose launcher has reloaded and
+returns the time of the next reload that matters, or LLONG_MAX if nothing is waiting.*/
+static inline long long effector_run(EffectorModel *model, long long now)
+{
+    long long next = LLONG_MAX;
+    if (model->pending == 0) return next;
+    for (int i = 0; i < model->unit_count; i++)
+    {
+        EffectorUnit *unit = &model->units[i];
+        if (unit->size == 0) continue;
+        effector_dispatch_unit(model, i, now);
+        for (int l = 0; l < model->config.launchers && unit->size > 0; l++)
+        {
+            if (unit->launcher_ready[l] < next) next = unit->launcher_ready[l];
+        }
+    }
+    return next;
+}
+
+/*This writes the queueing and saturation figures to a summary file. Utilisation is
+the share of all launcher time spent reloading since the model started.*/
+static inline void effector_report(const EffectorModel *model, FILE *summary_fp, long long now)
+{
+    long long capacity_ms = (now - model->started_ms) * model->unit_count * model->config.launchers;
+    fprintf(summary_fp, "Launchers Per Unit: %d, Reload Time: %d ms, Queue Depth: %d\n",
+            model->config.launchers, model->config.reload_ms, model->config.queue_depth);
+    fprintf(summary_fp, "Commands Received: %lu, Launched: %lu, Dropped (queue full): %lu, Still Queued: %d\n",
+            model->commands_received, model->commands_launched, model->commands_dropped, model->pending);
+    fprintf(summary_fp, "Commands That Waited For A Launcher: %lu, Max Queue Length: %d\n",
+            model->commands_waited, model->queue_depth_max);
+    fprintf(summary_fp, "Queue Delay: avg %.1f ms, max %lld ms\n",
+            model->commands_launched ? (double)model->queue_delay_total_ms / (double)model->commands_launched : 0.0,
+            model->queue_delay_max_ms);
+    fprintf(summary_fp, "Launcher Utilisation: %.1f%%\n",
+            capacity_ms > 0 ? 100.0 * (double)model->busy_ms / (double)capacity_ms : 0.0);
+}
+
+//This releases the queue memory at the end of the simulation.
+static inline void effector_destroy(EffectorModel *model)
+{
+    free(model->units);
+    free(model->heap_memory);
+    free(model->ready_memory);
+    memset(model, 0, sizeof(*model));
+}
+
+#endif
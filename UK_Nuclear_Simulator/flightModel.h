@@ -0,0 +1,507 @@
+/*This is the flight engine shared by missileSilo and submarine. Every launch becomes a
+flight towards a simulated target that moves and does not wait to be hit, and the flights
+in progress are integrated with a fixed step every FLIGHT_TICK_MS. A flight ends when it
+passes within its weapon's kill radius of the target (which it then destroys with the
+weapon's kill probability), when it has passed the target, when a missile falls back to
+the ground or when it runs out of time, and the client reports the outcome to nuclearControl.
+
+Flights are kept as a structure of arrays, with the flights in progress packed at the
+front so a tick only touches live state. The integrator works on FLIGHT_LANES flights at
+a time with GCC's vector extensions and runs all of a tick's steps on one group of flights
+before moving to the next, so their state stays in registers. With "--flight-threads N"
+the flights are split into N shares that meet at a barrier once per tick, like the
+propagation threads of orbitModel.h. Guidance is lead pursuit: the weapon steers its
+velocity towards the point where the target will be when it gets there, limited to the
+weapon's turn rate.*/
+#ifndef FLIGHT_MODEL_H
+#define FLIGHT_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "protocol.h"
+#include "effectorModel.h"
+#include "modelThreads.h"
+
+#define FLIGHT_DEFAULT_STEP_MS 20
+#define FLIGHT_DEFAULT_CAPACITY 65536
+#define FLIGHT_MAX_CAPACITY (1 << 22)
+#define FLIGHT_MAX_THREADS 64
+#define FLIGHT_TICK_MS 50         //How often the flights in progress are brought up to date.
+#define FLIGHT_PARALLEL_MIN 4096  //Fewer flights than this are integrated on the calling thread.
+#define FLIGHT_GAIN 2.0f          //How fast the weapon turns its velocity onto the line of sight, per second.
+
+#ifdef __AVX__
+#define FLIGHT_LANES 8
+#else
+#define FLIGHT_LANES 4
+#endif
+
+typedef float FlightVec __attribute__((vector_size(FLIGHT_LANES * sizeof(float))));
+typedef int32_t FlightMask __attribute__((vector_size(FLIGHT_LANES * sizeof(int32_t))));
+
+//These are the states of a flight. Everything but FLIGHT_FLYING is the reason it ended.
+enum
+{
+    FLIGHT_FLYING = 0,
+    FLIGHT_INTERCEPT = 1, //Came within the kill radius.
+    FLIGHT_PASSED = 2,    //Was moving away from the target.
+    FLIGHT_FELL = 3,      //A missile came back down to the ground.
+    FLIGHT_EXPIRED = 4,   //Flew for longer than max_flight_s.
+    FLIGHT_STATES = 5
+};
+
+//This is how a weapon flies and where its targets are, in km and seconds.
+typedef struct
+{
+    const char *weapon;
+    float thrust;          //Acceleration while the motor burns, km/s2.
+    float burn_s;
+    float drag;            //The drag deceleration is drag * speed^2.
+    float gravity;
+    float turn;            //The largest steering acceleration, km/s2.
+    float kill_radius_km;
+    float max_flight_s;
+    float min_range_km, max_range_km;
+    float min_altitude_km, max_altitude_km;
+    float target_speed_kms;
+    float kill_probability;
+} FlightProfile;
+
+//These are a silo's interceptor missile (30 g turns, 2 km/s at burnout) and a submarine's heavyweight torpedo (50 knots).
+static const FlightProfile flight_missile =
+    {"missile", 0.2f, 10.0f, 0.0005f, 0.0098f, 0.3f, 0.05f, 150.0f, 20.0f, 150.0f, 5.0f, 20.0f, 0.3f, 0.85f};
+static const FlightProfile flight_torpedo =
+    {"torpedo", 0.004f, 600.0f, 6.0f, 0.0f, 0.003f, 0.02f, 600.0f, 2.0f, 10.0f, 0.0f, 0.0f, 0.01f, 0.9f};
+
+/*These are the settings the effector clients accept on the command line for the engine:
+"--flight-threads N", "--flight-step-ms MS" of simulated time per integration step,
+"--flight-time-scale X" simulated seconds per real second, "--max-flights N" in progress
+at once and "--flight-benchmark N" to fly N flights without a server and time them.*/
+typedef struct
+{
+    int threads;
+    int step_ms;
+    int time_scale;
+    int capacity;
+    int benchmark;
+} FlightConfig;
+
+typedef struct FlightModel FlightModel;
+
+//This is called for every flight that ended in a tick, with its index and its outcome (an OUTCOME_ letter).
+typedef void (*FlightHandler)(const FlightModel *model, size_t flight, char result);
+
+/*This is the engine: the flights, packed into [0, count), and the counters the summary
+reports. The float and state arrays are padded to a whole number of vectors, and slots
+past count hold FLIGHT_EXPIRED so the integrator leaves them alone.*/
+struct FlightModel
+{
+    const FlightProfile *profile;
+    FlightConfig config;
+    size_t capacity;
+    size_t count;
+    float *x, *y, *z, *vx, *vy, *vz;     //The weapon, from its launcher.
+    float *tx, *ty, *tz, *tvx, *tvy;     //The target, which keeps its height.
+    float *t;                            //Time of flight so far.
+    int32_t *state;
+    uint32_t *unit;
+    unsigned long *seq;
+    char (*target)[TARGET_SIZE];
+    long long last_tick_ms;
+    long long due_ms;                    //Simulated time not yet integrated.
+    int tick_steps;
+    ModelPool pool;
+    unsigned long launched;
+    unsigned long refused;
+    unsigned long ended[FLIGHT_STATES];
+    unsigned long destroyed;
+    size_t peak;
+    double flight_s_total;
+    double flight_s_max;
+    unsigned long long flight_steps;
+    long long integrate_ns_total;
+};
+
+/*This consumes one flight engine option at argv[*i]. It returns 1 if the option
+belonged to the engine, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int flight_parse_option(FlightConfig *config, int argc, char *argv[], int *i)
+{
+    int *target = NULL;
+    if (strcmp(argv[*i], "--flight-threads") == 0) target = &config->threads;
+    else if (strcmp(argv[*i], "--flight-step-ms") == 0) target = &config->step_ms;
+    else if (strcmp(argv[*i], "--flight-time-scale") == 0) target = &config->time_scale;
+    else if (strcmp(argv[*i], "--max-flights") == 0) target = &config->capacity;
+    else if (strcmp(argv[*i], "--flight-benchmark") == 0) target = &config->benchmark;
+    else return 0;
+
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+    *target = atoi(argv[++*i]);
+    return (config->threads > 0 && config->threads <= FLIGHT_MAX_THREADS && config->step_ms > 0 &&
+            config->time_scale > 0 && config->capacity > 0 && config->capacity <= FLIGHT_MAX_CAPACITY &&
+            config->benchmark <= FLIGHT_MAX_CAPACITY) ? 1 : -1;
+}
+
+//This is model_rsqrt for every lane.
+static inline FlightVec flight_rsqrt_vec(FlightVec v)
+{
+    FlightVec r = (FlightVec)(0x5f3759df - ((FlightMask)v >> 1));
+    r = r * (1.5f - 0.5f * v * r * r);
+    return r * (1.5f - 0.5f * v * r * r);
+}
+
+//These pick a where bits are set in the mask and b elsewhere.
+static inline FlightVec flight_select(FlightMask mask, FlightVec a, FlightVec b)
+{
+    return (FlightVec)(((FlightMask)a & mask) | ((FlightMask)b & ~mask));
+}
+
+static inline FlightMask flight_select_state(FlightMask mask, int state, FlightMask other)
+{
+    return (mask & state) | (other & ~mask);
+}
+
+//This returns 1 if any lane of the mask is set.
+static inline int flight_any(FlightMask mask)
+{
+    int32_t any = 0;
+    for (int lane = 0; lane < FLIGHT_LANES; lane++) any |= mask[lane];
+    return any != 0;
+}
+
+/*This is the integrator. It runs steps fixed steps of step_s on the flights from first
+to end, which must be on FLIGHT_LANES boundaries, one group of lanes at a time. Each step
+moves the target, steers and accelerates the weapon (semi-implicit Euler: velocity
+first, then position with the new velocity), and ends the flight if the closest approach
+within the step came inside the kill radius, or for any of the other reasons above.*/
+static inline void flight_integrate(FlightModel *model, size_t first, size_t end, int steps)
+{
+    const FlightProfile *p = model->profile;
+    const float dt = (float)model->config.step_ms / 1000.0f;
+    for (size_t i = first; i < end; i += FLIGHT_LANES)
+    {
+        FlightMask state = *(FlightMask *)&model->state[i];
+        if (!flight_any(state == FLIGHT_FLYING)) continue;
+        FlightVec x = *(FlightVec *)&model->x[i], y = *(FlightVec *)&model->y[i], z = *(FlightVec *)&model->z[i];
+        FlightVec vx = *(FlightVec *)&model->vx[i], vy = *(FlightVec *)&model->vy[i], vz = *(FlightVec *)&model->vz[i];
+        FlightVec tx = *(FlightVec *)&model->tx[i], ty = *(FlightVec *)&model->ty[i], tz = *(FlightVec *)&model->tz[i];
+        FlightVec tvx = *(FlightVec *)&model->tvx[i], tvy = *(FlightVec *)&model->tvy[i];
+        FlightVec t = *(FlightVec *)&model->t[i];
+
+        for (int step = 0; step < steps; step++)
+        {
+            FlightMask flying = state == FLIGHT_FLYING;
+            if (!flight_any(flying)) break;
+
+            /*This steers towards where the target will be when the weapon gets there at its
+            current speed (lead pursuit), limited to the turn rate, and lifts against gravity.*/
+            FlightVec rx = tx - x, ry = ty - y, rz = tz - z;
+            FlightVec speed2 = vx * vx + vy * vy + vz * vz;
+            FlightVec speed = speed2 * flight_rsqrt_vec(speed2 + 1e-12f);
+            FlightVec range = (rx * rx + ry * ry + rz * rz) * flight_rsqrt_vec(rx * rx + ry * ry + rz * rz + 1e-12f);
+            FlightVec to_go = range / (speed + p->target_speed_kms + 1e-3f);
+            FlightVec ax = rx + tvx * to_go, ay = ry + tvy * to_go;
+            FlightVec aim = flight_rsqrt_vec(ax * ax + ay * ay + rz * rz + 1e-12f);
+            FlightVec gx = FLIGHT_GAIN * (ax * aim * speed - vx);
+            FlightVec gy = FLIGHT_GAIN * (ay * aim * speed - vy);
+            FlightVec gz = FLIGHT_GAIN * (rz * aim * speed - vz) + p->gravity;
+            FlightVec limit = p->turn * flight_rsqrt_vec(gx * gx + gy * gy + gz * gz + 1e-12f);
+            limit = flight_select(limit < 1.0f, limit, limit * 0.0f + 1.0f);
+            FlightVec thrust = flight_select(t < p->burn_s, aim * p->thrust, aim * 0.0f);
+            FlightVec drag = p->drag * speed;
+
+            FlightVec nvx = vx + (ax * thrust + gx * limit - drag * vx) * dt;
+            FlightVec nvy = vy + (ay * thrust + gy * limit - drag * vy) * dt;
+            FlightVec nvz = vz + (rz * thrust + gz * limit - drag * vz - p->gravity) * dt;
+
+            //The closest approach during the step, with the target moving at its own velocity.
+            FlightVec wx = nvx - tvx, wy = nvy - tvy, wz = nvz;
+            FlightVec closing = rx * wx + ry * wy + rz * wz;
+            FlightVec tau = closing / (wx * wx + wy * wy + wz * wz + 1e-12f);
+            tau = flight_select(tau < 0.0f, tau * 0.0f, flight_select(tau > dt, tau * 0.0f + dt, tau));
+            FlightVec cx = rx - wx * tau, cy = ry - wy * tau, cz = rz - wz * tau;
+            FlightVec nt = t + dt;
+            FlightMask hit = flying & (cx * cx + cy * cy + cz * cz < p->kill_radius_km * p->kill_radius_km);
+            FlightMask passed = flying & (closing < 0.0f) & (nt > p->burn_s);
+            FlightMask fell = flying & (z + nvz * dt < 0.0f) & (nt > 1.0f) & -(p->gravity > 0.0f);
+            FlightMask expired = flying & (nt > p->max_flight_s);
+            state = flight_select_state(expired, FLIGHT_EXPIRED, state);
+            state = flight_select_state(fell, FLIGHT_FELL, state);
+            state = flight_select_state(passed, FLIGHT_PASSED, state);
+            state = flight_select_state(hit, FLIGHT_INTERCEPT, state);
+
+            vx = flight_select(flying, nvx, vx);
+            vy = flight_select(flying, nvy, vy);
+            vz = flight_select(flying, nvz, vz);
+            x = flight_select(flying, x + nvx * dt, x);
+            y = flight_select(flying, y + nvy * dt, y);
+            z = flight_select(flying, z + nvz * dt, z);
+            tx = flight_select(flying, tx + tvx * dt, tx);
+            ty = flight_select(flying, ty + tvy * dt, ty);
+            t = flight_select(flying, flight_select(hit, t + tau, nt), t);
+        }
+
+        *(FlightVec *)&model->x[i] = x;
+        *(FlightVec *)&model->y[i] = y;
+        *(FlightVec *)&model->z[i] = z;
+        *(FlightVec *)&model->vx[i] = vx;
+        *(FlightVec *)&model->vy[i] = vy;
+        *(FlightVec *)&model->vz[i] = vz;
+        *(FlightVec *)&model->tx[i] = tx;
+        *(FlightVec *)&model->ty[i] = ty;
+        *(FlightVec *)&model->t[i] = t;
+        *(FlightMask *)&model->state[i] = state;
+    }
+}
+
+//This is the share of the packed flights a thread integrates, on FLIGHT_LANES boundaries.
+static inline void flight_share(const FlightModel *model, int index, int threads, size_t *first, size_t *end)
+{
+    size_t vectors = (model->count + FLIGHT_LANES - 1) / FLIGHT_LANES;
+    *first = vectors * (size_t)index / (size_t)threads * FLIGHT_LANES;
+    *end = vectors * (size_t)(index + 1) / (size_t)threads * FLIGHT_LANES;
+}
+
+//This integrates a thread's share of the flights for the steps of the current tick.
+static inline void flight_integrate_share(void *arg, int index)
+{
+    FlightModel *model = arg;
+    size_t first, end;
+    flight_share(model, index, model->config.threads, &first, &end);
+    flight_integrate(model, first, end, model->tick_steps);
+}
+
+//This stops the integration threads and releases the flight arrays, or whatever flight_init reserved.
+static inline void flight_destroy(FlightModel *model)
+{
+    model_pool_stop(&model->pool);
+    float **fields[] = {&model->x, &model->y, &model->z, &model->vx, &model->vy, &model->vz,
+                        &model->tx, &model->ty, &model->tz, &model->tvx, &model->tvy, &model->t};
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        free(*fields[f]);
+    }
+    free(model->state);
+    free(model->unit);
+    free(model->seq);
+    free(model->target);
+    memset(model, 0, sizeof(*model));
+}
+
+/*This reserves room for config.capacity flights in progress. It returns 0 or -1, and
+frees what it reserved on failure.*/
+static inline int flight_init(FlightModel *model, const FlightProfile *profile, const FlightConfig *config)
+{
+    memset(model, 0, sizeof(*model));
+    model->profile = profile;
+    model->config = *config;
+    model->capacity = ((size_t)config->capacity + FLIGHT_LANES - 1) / FLIGHT_LANES * FLIGHT_LANES;
+    size_t size = model->capacity * sizeof(float);
+    float **fields[] = {&model->x, &model->y, &model->z, &model->vx, &model->vy, &model->vz,
+                        &model->tx, &model->ty, &model->tz, &model->tvx, &model->tvy, &model->t};
+    int failed = 0;
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        failed |= !(*fields[f] = aligned_alloc(sizeof(FlightVec), size));
+    }
+    failed |= !(model->state = aligned_alloc(sizeof(FlightVec), size));
+    model->unit = calloc(model->capacity, sizeof(uint32_t));
+    model->seq = calloc(model->capacity, sizeof(unsigned long));
+    model->target = calloc(model->capacity, TARGET_SIZE);
+    if (failed || !model->unit || !model->seq || !model->target)
+    {
+        flight_destroy(model);
+        return -1;
+    }
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        memset(*fields[f], 0, size);
+    }
+    for (size_t i = 0; i < model->capacity; i++) model->state[i] = FLIGHT_EXPIRED;
+    return 0;
+}
+
+/*This starts a thread for every share of the flights but the first, which the calling
+thread integrates itself. It returns 0 or -1, and the engine carries on single threaded
+if it fails.*/
+static inline int flight_start_threads(FlightModel *model)
+{
+    return model_pool_start(&model->pool, model->config.threads, flight_integrate_share, model);
+}
+
+/*This launches a weapon from unit_id for command seq. The target is placed on a bearing
+taken from its name, at a random range and height in the profile's limits, and moves off
+in a random direction. It returns 0, or -1 if config.capacity flights are already in progress.*/
+static inline int flight_launch(FlightModel *model, uint32_t unit_id, unsigned long seq, const char *target,
+                                long long now)
+{
+    const FlightProfile *p = model->profile;
+    if (model->count >= (size_t)model->config.capacity)
+    {
+        model->refused++;
+        return -1;
+    }
+    if (model->count == 0)
+    {
+        model->last_tick_ms = now;
+        model->due_ms = 0;
+    }
+
+    uint32_t hash = 5381;
+    for (const char *c = target; *c; c++) hash = hash * 33 + (unsigned char)*c;
+    float bx = (float)(hash & 0xffff) / 32768.0f - 1.0f + (float)(rand() % 100) / 1000.0f;
+    float by = (float)(hash >> 16) / 32768.0f - 1.0f + (float)(rand() % 100) / 1000.0f;
+    float norm = model_rsqrt(bx * bx + by * by + 1e-6f);
+    float range = p->min_range_km + (p->max_range_km - p->min_range_km) * (float)(rand() % 1000) / 1000.0f;
+    float hx = (float)(rand() % 2001) / 1000.0f - 1.0f;
+    float hy = (float)(rand() % 2001) / 1000.0f - 1.0f;
+    float heading = model_rsqrt(hx * hx + hy * hy + 1e-6f) * p->target_speed_kms;
+
+    size_t i = model->count++;
+    model->x[i] = model->y[i] = model->z[i] = 0.0f;
+    model->vx[i] = p->gravity > 0.0f ? 0.0f : bx * norm * 0.005f; //Missiles leave the silo straight up.
+    model->vy[i] = p->gravity > 0.0f ? 0.0f : by * norm * 0.005f;
+    model->vz[i] = p->gravity > 0.0f ? 0.05f : 0.0f;
+    model->tx[i] = bx * norm * range;
+    model->ty[i] = by * norm * range;
+    model->tz[i] = p->min_altitude_km + (p->max_altitude_km - p->min_altitude_km) * (float)(rand() % 1000) / 1000.0f;
+    model->tvx[i] = hx * heading;
+    model->tvy[i] = hy * heading;
+    model->t[i] = 0.0f;
+    model->state[i] = FLIGHT_FLYING;
+    model->unit[i] = unit_id;
+    model->seq[i] = seq;
+    snprintf(model->target[i], TARGET_SIZE, "%s", target);
+    model->launched++;
+    if (model->count > model->peak) model->peak = model->count;
+    return 0;
+}
+
+//This moves the last flight into slot i, so the flights in progress stay packed.
+static inline void flight_remove(FlightModel *model, size_t i)
+{
+    size_t last = --model->count;
+    if (i != last)
+    {
+        float **fields[] = {&model->x, &model->y, &model->z, &model->vx, &model->vy, &model->vz,
+                            &model->tx, &model->ty, &model->tz, &model->tvx, &model->tvy, &model->t};
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+        {
+            (*fields[f])[i] = (*fields[f])[last];
+        }
+        model->state[i] = model->state[last];
+        model->unit[i] = model->unit[last];
+        model->seq[i] = model->seq[last];
+        memcpy(model->target[i], model->target[last], TARGET_SIZE);
+    }
+    model->state[last] = FLIGHT_EXPIRED;
+}
+
+/*This brings the flights up to now: the real time since the last tick, times the time
+scale, is integrated in whole steps (the rest waits for the next tick), on every thread
+once there are FLIGHT_PARALLEL_MIN flights. Each flight that ended is passed to done with
+its outcome and removed. It returns when the next tick is due, or LLONG_MAX if nothing flies.*/
+static inline long long flight_tick(FlightModel *model, long long now, FlightHandler done)
+{
+    if (model->count == 0) return LLONG_MAX;
+    if (now < model->last_tick_ms + FLIGHT_TICK_MS) return model->last_tick_ms + FLIGHT_TICK_MS;
+    model->due_ms += (now - model->last_tick_ms) * model->config.time_scale;
+    model->last_tick_ms = now;
+    int steps = (int)(model->due_ms / model->config.step_ms);
+    model->due_ms -= (long long)steps * model->config.step_ms;
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (model->pool.workers && model->count >= FLIGHT_PARALLEL_MIN)
+    {
+        model->tick_steps = steps;
+        model_pool_run(&model->pool);
+    }
+    else
+    {
+        flight_integrate(model, 0, (model->count + FLIGHT_LANES - 1) / FLIGHT_LANES * FLIGHT_LANES, steps);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    model->integrate_ns_total += (finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec);
+    model->flight_steps += (unsigned long long)model->count * (unsigned long long)steps;
+
+    //Removing a flight moves another into its slot, so the slot is looked at again.
+    for (size_t i = 0; i < model->count;)
+    {
+        int state = model->state[i];
+        if (state == FLIGHT_FLYING)
+        {
+            i++;
+            continue;
+        }
+        char result = OUTCOME_MISSED;
+        if (state == FLIGHT_INTERCEPT)
+        {
+            result = rand() < (int)(model->profile->kill_probability * (float)RAND_MAX) ? OUTCOME_DESTROYED
+                                                                                        : OUTCOME_SURVIVED;
+        }
+        model->ended[state]++;
+        if (result == OUTCOME_DESTROYED) model->destroyed++;
+        model->flight_s_total += model->t[i];
+        if (model->t[i] > model->flight_s_max) model->flight_s_max = model->t[i];
+        if (done) done(model, i, result);
+        flight_remove(model, i);
+    }
+    return model->count > 0 ? now + FLIGHT_TICK_MS : LLONG_MAX;
+}
+
+//This writes the flight figures to a summary file.
+static inline void flight_report(const FlightModel *model, FILE *summary_fp)
+{
+    unsigned long ended = model->launched - model->count;
+    fprintf(summary_fp, "Flight Engine: %s, %d threads, %d ms steps, time scale %dx, Kernel Width: %d lanes\n",
+            model->profile->weapon, model->pool.workers ? model->config.threads : 1, model->config.step_ms,
+            model->config.time_scale, FLIGHT_LANES);
+    fprintf(summary_fp, "Flights Launched: %lu, Refused (%d in flight): %lu, Still In Flight: %zu, Peak In Flight: %zu\n",
+            model->launched, model->config.capacity, model->refused, model->count, model->peak);
+    fprintf(summary_fp, "Targets Destroyed: %lu, Intercepted But Survived: %lu, Missed: %lu "
+            "(passed %lu, fell %lu, out of time %lu)\n", model->destroyed, model->ended[FLIGHT_INTERCEPT] - model->destroyed,
+            model->ended[FLIGHT_PASSED] + model->ended[FLIGHT_FELL] + model->ended[FLIGHT_EXPIRED],
+            model->ended[FLIGHT_PASSED], model->ended[FLIGHT_FELL], model->ended[FLIGHT_EXPIRED]);
+    fprintf(summary_fp, "Time Of Flight: avg %.1f s, max %.1f s (simulated), Integration: %llu flight steps, %.2f ns each\n",
+            ended ? model->flight_s_total / (double)ended : 0.0, model->flight_s_max, model->flight_steps,
+            model->flight_steps ? (double)model->integrate_ns_total / (double)model->flight_steps : 0.0);
+}
+
+/*This is "--flight-benchmark N": it launches N flights at once at random targets, without
+a server, and integrates them tick after tick as fast as it can (FLIGHT_TICK_MS of real time
+per tick) until they have all ended, then prints the integration cost and the outcomes.*/
+static inline int flight_benchmark(const FlightProfile *profile, const FlightConfig *config)
+{
+    static const char *const targets[] = {"North Atlantic", "English Channel", "Baltic Sea", "Irish Sea",
+                                          "Arctic Ocean", "Mediterranean", "Barents Sea", "North Sea"};
+    FlightModel model;
+    FlightConfig bench = *config;
+    if (bench.capacity < bench.benchmark) bench.capacity = bench.benchmark;
+    if (flight_init(&model, profile, &bench) < 0 || flight_start_threads(&model) < 0)
+    {
+        fprintf(stderr, "Failed to set up %d flights\n", bench.benchmark);
+        return 1;
+    }
+    for (int f = 0; f < bench.benchmark; f++)
+    {
+        flight_launch(&model, (uint32_t)(f % 16 + 1), (unsigned long)f + 1, targets[f % 8], 0);
+    }
+    int ticks = 0;
+    for (long long now = FLIGHT_TICK_MS; model.count > 0; now += FLIGHT_TICK_MS, ticks++)
+    {
+        flight_tick(&model, now, NULL);
+    }
+    printf("%d %s flights over %d threads in %d ticks: %.2f ns per flight step, %.1f million flight steps per second\n",
+           bench.benchmark, profile->weapon, model.pool.workers ? bench.threads : 1, ticks,
+           (double)model.integrate_ns_total / (double)model.flight_steps,
+           (double)model.flight_steps / ((double)model.integrate_ns_total / 1e9) / 1e6);
+    flight_report(&model, stdout);
+    flight_destroy(&model);
+    return 0;
+}
+
+#endif
@@ -10,6 +10,10 @@ inputs, outputs, strings, sockets, memory allocation, character handling, etc.*/
 #include <time.h>
 #include <ctype.h>
 #include <errno.h>
+#include "clientRuntime.h"
+#include "effectorModel.h"
+#include "flightModel.h"
+#include "runStats.h"
 
 /*This is to defined the assigned port, simulation duration, and
 buffer size for the missileSilo client to ping back to the server's IP address.*/
@@ -20,10 +24,17 @@ buffer size for the missileSilo client to ping back to the server's IP address.*
 #define SIMULATION_DURATION 60
 #define BUFFER_SIZE 1024
 #define SUMMARY_FILE "missileSilo_summary.txt"
+#define STATS_FILE "missileSilo_stats.col"
 
 //These are global variables that handles log file and tracks successful launches.
 static FILE *log_fp = NULL;
 static int missiles_launched = 0;
+static ClientRuntime runtime;
+static EffectorModel effectors;
+static FlightModel flights;
+static StatsWriter stats;
+static int stat_received, stat_launched, stat_dropped, stat_acks, stat_queue_delay_ms;
+static int stat_destroyed, stat_missed, stat_flight_ms;
 
 /*This initializes a log file with a timestamped header and opens it in write file mode. 
 It includes an error handling function in case there is a creation failure and a small 
@@ -77,28 +88,33 @@ void caesar_decrypt(const char *ciphertext, char *plaintext, size_t len)
     }
 }
 
-//This set the launch commands formats that separates the command and target details.
-int parse_command(const char *message, char *command, char *target) 
+/*This set the launch commands formats that separates the command and target details.
+The optional priority field is the threat level behind the command and defaults to 0,
+and the optional seq field is the sequence number to acknowledge it with, 0 if there is none.*/
+int parse_command(const char *message, char *command, char *target, int *priority, unsigned long *seq) 
 {
-    char *copy = strdup(message);
-    if (!copy) 
+    /*The message is copied into a stack buffer before it is split,
+    so parsing a command never allocates memory.*/
+    char copy[BUFFER_SIZE];
+    size_t len = strlen(message);
+    if (len >= sizeof(copy)) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Memory allocation failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
+        log_event("ERROR", "Command too long for parsing");
         return 0;
     }
+    memcpy(copy, message, len + 1);
 
     //The details are separated by a pipe delimiter (|) and newline (\0) in the log file.
     command[0] = '\0';
     target[0] = '\0';
+    *priority = 0;
+    *seq = 0;
     char *token = strtok(copy, "|");
     while (token) 
     {
         char *colon = strchr(token, ':');
         if (!colon || colon == token || !colon[1]) 
         {
-            free(copy);
             return 0;
         }
         *colon = '\0';
@@ -113,9 +129,16 @@ int parse_command(const char *message, char *command, char *target)
             strncpy(target, value, 49);
             target[49] = '\0';
         }
+        else if (strcmp(key, "priority") == 0) 
+        {
+            *priority = atoi(value);
+        }
+        else if (strcmp(key, "seq") == 0) 
+        {
+            *seq = strtoul(value, NULL, 10);
+        }
         token = strtok(NULL, "|");
     }
-    free(copy);
     return (command[0] != '\0' && target[0] != '\0');
 }
 
@@ -141,6 +164,13 @@ void generate_summary(void)
         fprintf(summary_fp, "Simulation End: %s\n", time_str);
     }
     fprintf(summary_fp, "Total Missiles Launched: %d\n", missiles_launched);
+    fprintf(summary_fp, "Units Hosted: %d on %d connections\n", runtime.unit_count, runtime.link_count);
+    fprintf(summary_fp, "Reconnects: %lu\n", runtime.reconnects);
+    runtime_report_acks(&runtime, summary_fp);
+    effector_report(&effectors, summary_fp, now_ms());
+    flight_report(&flights, summary_fp);
+    runtime_report_end(&runtime, summary_fp);
+    fprintf(summary_fp, "Per Second Statistics: %s (%d columns)\n", STATS_FILE, stats.column_count);
     fprintf(summary_fp, "=====================================\n");
     fclose(summary_fp);
 
@@ -150,116 +180,234 @@ void generate_summary(void)
     log_event("SUMMARY", log_msg);
 }
 
-/*This is the main execution function that starts the missile silo client system.
-This has the network set to create the TCP socket, server-to-client connection, 
-and receiving data from the nuclearControl center.*/ 
-int main(void) 
+/*This adds what the effector model and the runtime have counted since the last call to
+the statistics file, so their running totals become per second rows.*/
+void sample_stats(long long now) 
 {
-    init_log_file();
-    log_event("STARTUP", "Missile Silo System initializing");
-
-    //This creates the TCP socket of the client.
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) 
-    {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Socket creation failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
-        if (log_fp) fclose(log_fp);
-        return 1;
-    }
+    stats_total(&stats, stat_received, (long long)effectors.commands_received, now);
+    stats_total(&stats, stat_launched, (long long)effectors.commands_launched, now);
+    stats_total(&stats, stat_dropped, (long long)effectors.commands_dropped, now);
+    stats_total(&stats, stat_acks, (long long)runtime.acks_sent, now);
+    stats_total(&stats, stat_destroyed, (long long)flights.destroyed, now);
+    stats_total(&stats, stat_missed, (long long)(flights.ended[FLIGHT_PASSED] + flights.ended[FLIGHT_FELL] +
+                                                 flights.ended[FLIGHT_EXPIRED]), now);
+}
 
-    //This configures the server address for the connection with error handling if there is an invalid address.
-    struct sockaddr_in server_addr = {0};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) 
-    {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Invalid server address: %s", SERVER_IP);
-        log_event("ERROR", log_msg);
-        close(sock);
-        if (log_fp) fclose(log_fp);
-        return 1;
-    }
+/*This carries out a decrypted launch command once one of the unit's launchers is free,
+starts the missile's flight and logs the feedback to confirm the launch in the log file.
+The effector model calls it.*/
+void launch_missile(uint32_t unit_id, const char *target, int priority, unsigned long command_seq, long long queue_delay_ms)
+{
+    char log_msg[BUFFER_SIZE];
+    snprintf(log_msg, sizeof(log_msg), "Unit %u launching missile at %s (priority %d, queued %lld ms)",
+             unit_id, target, priority, queue_delay_ms);
+    log_event("COMMAND", log_msg);
+    missiles_launched++;
+    stats_observe(&stats, stat_queue_delay_ms, queue_delay_ms, now_ms());
 
-    //This prints out the message to confirm the connection to the nuclear control server.
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) 
+    char feedback[256];
+    if (flight_launch(&flights, unit_id, command_seq, target, now_ms()) < 0) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Connection failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
-        close(sock);
-        if (log_fp) fclose(log_fp);
-        return 1;
+        snprintf(feedback, sizeof(feedback), "Unit %u missile launched at %s, but %d flights are already being tracked",
+                 unit_id, target, flights.config.capacity);
+        log_event("ERROR", feedback);
+        return;
     }
+    snprintf(feedback, sizeof(feedback), "Unit %u missile launched at %s successfully", unit_id, target);
+    log_event("FEEDBACK", feedback);
+}
 
-    //This prints out the message to confirm the server connection.
-    log_event("CONNECTION", "Connected to Nuclear Control");
+/*This logs how a missile's flight ended, counts it and reports it to nuclearControl on
+the unit's link. The flight engine calls it for every flight that ended in a tick.*/
+void flight_ended(const FlightModel *model, size_t flight, char result)
+{
+    static const char *const results[] = {"in flight", "intercepted", "passed", "fell", "ran out of time"};
+    long long flight_ms = (long long)(model->t[flight] * 1000.0f);
+    char feedback[256];
+    snprintf(feedback, sizeof(feedback), "Unit %u missile at %s %s after %.1f s: target %s", model->unit[flight],
+             model->target[flight], results[model->state[flight]], model->t[flight],
+             result == OUTCOME_DESTROYED ? "destroyed" : result == OUTCOME_SURVIVED ? "survived" : "missed");
+    log_event("FEEDBACK", feedback);
+    stats_observe(&stats, stat_flight_ms, flight_ms, now_ms());
+    runtime_outcome(&runtime, model->unit[flight], model->seq[flight], result, flight_ms);
+}
 
-    /*This is the main command loop that runs under the duration
-    of the simulation; 60 seconds.*/
-    char buffer[BUFFER_SIZE];
+/*This handles a frame from nuclearControl. A command addressed to unit 0 is meant for
+every unit on the link it arrived on, otherwise only the addressed unit launches.
+Commands are queued in the effector model rather than carried out here, so the
+client goes straight back to receiving while launchers reload, and every command
+is acknowledged back to nuclearControl with the time it was queued.
+It includes an error handling function to display an error if there is an unknown command or format.*/
+void handle_frame(ClientRuntime *rt, Link *link, const FrameHeader *header, const char *payload)
+{
+    char buffer[FRAME_MAX_PAYLOAD + 1];
     char plaintext[BUFFER_SIZE];
     char command[20];
     char target[50];
+    int priority;
+    unsigned long seq;
     char log_msg[BUFFER_SIZE];
-    time_t start_time = time(NULL);
+    long long now = now_ms();
+    int valid;
 
-    /*This receives encryption command data with error handling to disconnect with the server
-    to prevent leaks.*/
-    while (time(NULL) - start_time < SIMULATION_DURATION) 
+    if (header->type == FRAME_COMMAND_BIN) 
     {
-        ssize_t bytes = recv(sock, buffer, sizeof(buffer) - 1, 0);
-        if (bytes <= 0) 
+        //A binary command is always a launch and its fields are read straight out of the frame.
+        WireCommand wire;
+        valid = wire_decode_command(payload, header->length, &wire) == 0;
+        snprintf(plaintext, sizeof(plaintext), "[Binary] %u bytes", header->length);
+        if (valid) 
         {
-            snprintf(log_msg, sizeof(log_msg), "Disconnected: %s",
-                     bytes == 0 ? "Server closed connection" : strerror(errno));
-            log_event("CONNECTION", log_msg);
-            break;
+            snprintf(command, sizeof(command), "launch");
+            snprintf(target, sizeof(target), "%.*s", (int)wire.target.length, wire.target.text);
+            priority = wire.priority;
+            seq = (unsigned long)wire.seq;
+            snprintf(log_msg, sizeof(log_msg), "Received: [Binary] launch at %s, priority %d, seq %lu",
+                     target, priority, seq);
+            log_event("MESSAGE", log_msg);
         }
-        buffer[bytes] = '\0';
+    } 
+    else if (header->type == FRAME_COMMAND) 
+    {
+        memcpy(buffer, payload, header->length);
+        buffer[header->length] = '\0';
 
         //This is to decrypt the encryption command  by using the caesar cipher.
         caesar_decrypt(buffer, plaintext, sizeof(plaintext));
         snprintf(log_msg, sizeof(log_msg), "Received: [Encrypted] %s -> [Decrypted] %s",
                  buffer, plaintext);
         log_event("MESSAGE", log_msg);
+        valid = parse_command(plaintext, command, target, &priority, &seq);
+    } 
+    else 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Unexpected frame type %u on link %d", header->type, link->index);
+        log_event("ERROR", log_msg);
+        return;
+    }
 
-        //This accepts valid commands to initiate the launching procedure to the target from the log file.
-        if (parse_command(plaintext, command, target)) 
+    //This accepts valid commands to initiate the launching procedure to the target from the log file.
+    if (valid) 
+    {
+        /*The command is acknowledged as soon as it is queued. A retransmission of one
+        already queued is acknowledged again but not launched twice. */
+        if (seq != 0 && runtime_ack(rt, link, seq, now)) 
         {
-            if (strcmp(command, "launch") == 0) 
+            snprintf(log_msg, sizeof(log_msg), "Command %lu already received, acknowledging again", seq);
+            log_event("MESSAGE", log_msg);
+        }
+        else if (strcmp(command, "launch") == 0) 
+        {
+            int dropped = 0;
+            if (header->unit_id != UNIT_BROADCAST) 
             {
-                snprintf(log_msg, sizeof(log_msg), "Launching missile at %s", target);
-                log_event("COMMAND", log_msg);
-                missiles_launched++;
-                
-                /*This allows to get feedback to confirm if the target is destroyed in the log file.
-                It also includes an error handling function to display an error if there is an unknown command or format.*/
-                char feedback[256];
-                snprintf(feedback, sizeof(feedback), "Missile launched at %s successfully", target);
-                log_event("FEEDBACK", feedback);
+                dropped += effector_submit(&effectors, header->unit_id, target, priority, seq, now) < 0;
             } 
             else 
             {
-                snprintf(log_msg, sizeof(log_msg), "Unknown command: %s", command);
+                for (int unit = link->index + 1; unit <= rt->unit_count; unit += rt->link_count) 
+                {
+                    dropped += effector_submit(&effectors, (uint32_t)unit, target, priority, seq, now) < 0;
+                }
+            }
+            if (dropped) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Command queue full, %d units dropped launch at %s", dropped, target);
                 log_event("ERROR", log_msg);
             }
         } 
         else 
         {
-            snprintf(log_msg, sizeof(log_msg), "Invalid message format: %s", plaintext);
+            snprintf(log_msg, sizeof(log_msg), "Unknown command: %s", command);
             log_event("ERROR", log_msg);
         }
-        usleep(500000); //Delay for 0.5 seconds between threats
+    } 
+    else 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Invalid message format: %s", plaintext);
+        log_event("ERROR", log_msg);
+    }
+}
+
+/*This is the main execution function that starts the missile silo client system.
+It hosts "--units N" missile silo units over "--connections M" shared links to the
+nuclearControl center and keeps receiving commands until the simulation ends.
+Links that drop are reconnected by the runtime instead of ending the run.*/ 
+int main(int argc, char *argv[]) 
+{
+    RuntimeConfig runtime_config = {.units = 1, .connections = 1, .nodes = 1, .transport = TRANSPORT_TCP,
+                                    .batch_bytes = REPORT_BATCH_BYTES};
+    EffectorConfig effector_config = {DEFAULT_LAUNCHERS, DEFAULT_RELOAD_MS, DEFAULT_QUEUE_DEPTH};
+    FlightConfig flight_config = {1, FLIGHT_DEFAULT_STEP_MS, 1, FLIGHT_DEFAULT_CAPACITY, 0};
+    for (int i = 1; i < argc; i++) 
+    {
+        int used = runtime_parse_option(&runtime_config, argc, argv, &i);
+        if (used == 0) used = effector_parse_option(&effector_config, argc, argv, &i);
+        if (used == 0) used = flight_parse_option(&flight_config, argc, argv, &i);
+        if (used != 1) 
+        {
+            fprintf(stderr, "Usage: %s [--units N] [--connections M] [--nodes K] [--codec text|binary] [--failover] "
+                    "[--transport tcp|unix|shm|tls] [--transport-benchmark N] [--nodelay] "
+                    "[--launchers N] [--reload-ms MS] [--queue-depth N] [--flight-threads N] [--flight-step-ms MS] "
+                    "[--flight-time-scale X] [--max-flights N] [--flight-benchmark N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (flight_config.benchmark > 0) return flight_benchmark(&flight_missile, &flight_config);
+    if (runtime_config.transport_benchmark > 0) return runtime_transport_benchmark(runtime_config.transport_benchmark, runtime_config.batch_bytes, caesar_decrypt);
+
+    srand((unsigned int)time(NULL));
+    init_log_file();
+    log_event("STARTUP", "Missile Silo System initializing");
+
+    if (runtime_init(&runtime, "Missile Silo", SERVER_IP, SERVER_PORT, &runtime_config, handle_frame) < 0 ||
+        effector_init(&effectors, runtime_config.units, &effector_config, launch_missile, now_ms()) < 0 ||
+        flight_init(&flights, &flight_missile, &flight_config) < 0) 
+    {
+        log_event("ERROR", "Failed to allocate the client runtime");
+        if (log_fp) fclose(log_fp);
+        return 1;
+    }
+
+    if (flight_start_threads(&flights) < 0) log_event("ERROR", "Failed to start the flight threads, integrating on one");
+
+    //This opens the per second statistics file; the run goes on without it if it cannot be created.
+    if (stats_open(&stats, STATS_FILE, "missileSilo", now_ms()) < 0) log_event("ERROR", "Failed to create statistics file");
+    stat_received = stats_column(&stats, "commands_received");
+    stat_launched = stats_column(&stats, "launches");
+    stat_dropped = stats_column(&stats, "commands_dropped");
+    stat_acks = stats_column(&stats, "acks_sent");
+    stat_queue_delay_ms = stats_histogram(&stats, "queue_delay_ms");
+    stat_destroyed = stats_column(&stats, "targets_destroyed");
+    stat_missed = stats_column(&stats, "flights_missed");
+    stat_flight_ms = stats_histogram(&stats, "time_of_flight_ms");
+
+    /*This is the main command loop that runs under the duration
+    of the simulation; 60 seconds. It fires any queued commands whose launcher
+    has reloaded and brings the flights in progress up to date, reporting the ones that
+    ended, then waits for new commands until the next launcher or flight tick is due.
+    The run ends early once nuclearControl has sent END on every link.*/
+    long long end_time = now_ms() + SIMULATION_DURATION * 1000LL;
+    for (long long now = now_ms(); now < end_time && !runtime_ended(&runtime); now = now_ms()) 
+    {
+        long long next_event = effector_run(&effectors, now);
+        long long next_tick = flight_tick(&flights, now, flight_ended);
+        runtime_flush_all_outcomes(&runtime);
+        if (next_event > next_tick) next_event = next_tick;
+        if (next_event > end_time) next_event = end_time;
+        if (next_event > now + STATS_INTERVAL_MS) next_event = now + STATS_INTERVAL_MS; //Keeps the statistics rows current.
+        runtime_poll(&runtime, (int)(next_event - now));
+        sample_stats(now_ms());
     }
 
-    /* This shuts down the simulation sequence and 
+    /*This shuts down the simulation sequence and 
     display a message saying the missile silo system has been terminated.*/
-    shutdown(sock, SHUT_RDWR);
-    close(sock);
+    runtime_close(&runtime);
+    sample_stats(now_ms());
     generate_summary();
+    stats_close(&stats, now_ms());
+    effector_destroy(&effectors);
+    flight_destroy(&flights);
     log_event("SHUTDOWN", "Missile Silo System terminated");
     if (log_fp) fclose(log_fp);
     return 0;
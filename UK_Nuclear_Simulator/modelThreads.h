@@ -0,0 +1,130 @@
+/*This is what the simulation models share: the pool of threads that split a step between
+them, and the inverse square root their distances are taken with.
+
+A pool runs a model's step on "threads" threads. The thread that steps the model does
+share 0 itself and the pool's threads do shares 1 to threads - 1, meeting it at the start
+barrier before the step and at the done barrier after it, so the model's state is only
+written by one side at a time. orbitModel.h, flightModel.h and patrolModel.h each keep one.*/
+#ifndef MODEL_THREADS_H
+#define MODEL_THREADS_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+//This does one thread's share of a step, index being 0 for the stepping thread.
+typedef void (*ModelShare)(void *model, int index);
+
+typedef struct ModelPool ModelPool;
+
+//This is one thread of a pool.
+typedef struct
+{
+    ModelPool *pool;
+    pthread_t thread;
+    int index;
+} ModelThread;
+
+//This is the pool. workers is NULL when the model steps on one thread.
+struct ModelPool
+{
+    void *model;
+    ModelShare share;
+    int threads;
+    int stopping;
+    ModelThread *workers;
+    pthread_barrier_t start, done;
+};
+
+//This is a pool thread: it does its share every time the start barrier opens.
+static inline void *model_thread(void *arg)
+{
+    ModelThread *worker = arg;
+    ModelPool *pool = worker->pool;
+    for (;;)
+    {
+        pthread_barrier_wait(&pool->start);
+        if (pool->stopping) return NULL;
+        pool->share(pool->model, worker->index);
+        pthread_barrier_wait(&pool->done);
+    }
+}
+
+/*This starts a thread for every share of a step but the first. It returns 0, also when
+threads is 1 and nothing needs starting, or -1 if the threads could not all be started,
+in which case none are left running and the model steps on one thread.*/
+static inline int model_pool_start(ModelPool *pool, int threads, ModelShare share, void *model)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (threads <= 1) return 0;
+    pool->workers = calloc((size_t)threads, sizeof(ModelThread));
+    if (!pool->workers) return -1;
+    pool->model = model;
+    pool->share = share;
+    pool->threads = threads;
+    pthread_barrier_init(&pool->start, NULL, (unsigned)threads);
+    pthread_barrier_init(&pool->done, NULL, (unsigned)threads);
+    for (int t = 1; t < threads; t++)
+    {
+        pool->workers[t].pool = pool;
+        pool->workers[t].index = t;
+        if (pthread_create(&pool->workers[t].thread, NULL, model_thread, &pool->workers[t]) != 0)
+        {
+            //The threads already started are stopped by a barrier sized for the ones that exist.
+            pool->stopping = 1;
+            pthread_barrier_destroy(&pool->start);
+            pthread_barrier_init(&pool->start, NULL, (unsigned)t);
+            pthread_barrier_wait(&pool->start);
+            for (int s = 1; s < t; s++) pthread_join(pool->workers[s].thread, NULL);
+            pthread_barrier_destroy(&pool->start);
+            pthread_barrier_destroy(&pool->done);
+            free(pool->workers);
+            memset(pool, 0, sizeof(*pool));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//This runs one step on every thread of the pool and returns when all the shares are done.
+static inline void model_pool_run(ModelPool *pool)
+{
+    pthread_barrier_wait(&pool->start);
+    pool->share(pool->model, 0);
+    pthread_barrier_wait(&pool->done);
+}
+
+//This stops the pool's threads, if it has any.
+static inline void model_pool_stop(ModelPool *pool)
+{
+    if (!pool->workers) return;
+    pool->stopping = 1;
+    pthread_barrier_wait(&pool->start);
+    for (int t = 1; t < pool->threads; t++) pthread_join(pool->workers[t].thread, NULL);
+    pthread_barrier_destroy(&pool->start);
+    pthread_barrier_destroy(&pool->done);
+    free(pool->workers);
+    memset(pool, 0, sizeof(*pool));
+}
+
+/*This returns 1 / sqrt(v) from the bit pattern estimate refined by two Newton steps,
+which is within about 5 parts in a million.*/
+static inline float model_rsqrt(float v)
+{
+    int32_t bits;
+    float r;
+    memcpy(&bits, &v, sizeof(bits));
+    bits = 0x5f3759df - (bits >> 1);
+    memcpy(&r, &bits, sizeof(r));
+    r = r * (1.5f - 0.5f * v * r * r);
+    return r * (1.5f - 0.5f * v * r * r);
+}
+
+//This returns sqrt(v) as v / sqrt(v), or 0 when v is not above 0.
+static inline float model_sqrt(float v)
+{
+    return v > 0.0f ? v * model_rsqrt(v) : 0.0f;
+}
+
+#endif
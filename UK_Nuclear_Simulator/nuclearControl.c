@@ -12,6 +12,20 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include "slab.h"
+#include "protocol.h"
+#include "uring.h"
+#include "wireCodec.h"
+#include "runStats.h"
+#include "topology.h"
+#include "replicaLog.h"
+#include "assignmentModel.h"
+#include "shmRing.h"
+#include "tlsTransport.h"
 
 /*These are to define ports for different clients. 
 Included a log and summary text file for nuclearControl to 
@@ -21,12 +35,50 @@ operation details of the performance after the simulation */
 #define PORT_SUB 8082
 #define PORT_RADAR 8083
 #define PORT_SAT 8084
-#define MAX_CLIENTS 4
+#define PORT_PEER 8085
+#define NUM_PORTS 4
+#define NODE_PORT_STRIDE 100 //Node K listens on every port above plus K * 100.
+#define MAX_NODES 16
+#define DEFAULT_MAX_CLIENTS 64
+#define DEFAULT_FRAME_BUFFERS 256
+#define FRAME_REFS_OFFSET (FRAME_BUFFER_SIZE - 64) //Send frames keep a FrameTrailer in their last cache line.
+#define COMMAND_BINARY_OFFSET (3 * BUFFER_SIZE)    //Where a command frame keeps its binary encoding.
+#define URING_MIN_ENTRIES 64
+#define URING_MAX_ENTRIES 4096
+#define URING_BUFFER_GROUP 0
+#define DEFAULT_ACK_TIMEOUT_MS 1000
+#define DEFAULT_ACK_RETRIES 2
+#define DEFAULT_MAX_INFLIGHT 1024
+#define WHEEL_SLOTS 256
+#define WHEEL_TICK_MS 10 //The timer wheel covers 2.56 seconds, later deadlines go round again.
+#define DEFAULT_INTEL_QUEUE 256
+#define DEFAULT_INTEL_RATE 100
+#define DEFAULT_INTEL_BURST 200
+#define DRAIN_TIMEOUT_MS 500 //How long clients get to close after the END frame before they are shut down.
 #define LOG_FILE "nuclearControl.log"
+#define NODE_LOG_FILE "nuclearControl_node%d.log"
 #define CAESAR_SHIFT 3
 #define SIMULATION_DURATION 60
 #define BUFFER_SIZE 1024
 #define SUMMARY_FILE "nuclearControl_summary.txt"
+#define NODE_SUMMARY_FILE "nuclearControl_node%d_summary.txt"
+#define STATS_FILE "nuclearControl_stats.col"
+#define NODE_STATS_FILE "nuclearControl_node%d_stats.col"
+#define REPL_SOCKET "nuclearControl.repl"
+#define NODE_REPL_SOCKET "nuclearControl_node%d.repl"
+#define REPL_RETRY_MS 1000 //How often a primary tries to reach a standby that is not there.
+#define REPL_POLL_MS 20
+#define MAX_BUSY_POLL_US 1000000
+#define DEFAULT_LISTEN_BACKLOG SOMAXCONN
+#define MAX_ACCEPTORS 16
+#define ACCEPT_STORM_SECONDS 60 //Accepts are counted per second over the first minute of a run.
+
+//This is the pause instruction a spinning thread runs between attempts, where the CPU has one.
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_RELAX() __builtin_ia32_pause()
+#else
+#define CPU_RELAX() ((void)0)
+#endif
 
 //These are structured to contain data of threat reports
 typedef struct 
@@ -46,26 +98,372 @@ typedef struct
     int sock;
     char ip[INET_ADDRSTRLEN];
     int port;
+    int role;
     bool valid;
+    int units;
     pthread_t thread;
+    char *rx;       //The pool frame holding a partial frame between receives (io_uring backend).
+    size_t rx_used;
+    struct InFlight *inflight; //Commands sent on this connection that are not acknowledged yet.
+    double tokens;             //The connection's token bucket for routine reports.
+    long long tokens_ms;
+    atomic_int credits_owed;   //INTEL frames taken in but not yet handed back as credit.
+    int codec;                 //The binary codec version agreed at HELLO, 0 for the text encoding.
+    bool local;                //Accepted on an AF_UNIX listener, where every receive is one packet.
+    ShmLink shm;               //The connection's shared-memory rings with --shm, segment is NULL on TCP.
+#ifdef USE_TLS
+    SSL *tls;                  //The connection's TLS state with --tls, NULL until its handshake is over.
+    pthread_mutex_t tls_lock;  //Keeps the client thread's reads apart from the senders' writes.
+#endif
 } Client;
 
+/*This is kept at the end of every send frame from the pool. A command frame holds
+the text and binary encodings of the same command side by side, so each connection
+is sent the one it negotiated without building the command twice. */
+typedef struct
+{
+    atomic_int refs;
+    int text_len;
+    int binary_len;
+} FrameTrailer;
+
+/*This is a routine report waiting in the evaluation queue. It is already parsed,
+the encrypted text is kept for the log. */
+typedef struct
+{
+    uint32_t unit_id;
+    long long queued_ms;
+    long long queued_ns; //For the hand-off to the worker, which takes well under a millisecond.
+    Intel intel;
+    char encrypted[FRAME_MAX_PAYLOAD + 1];
+} QueuedIntel;
+
+/*This is one command sent to one effector connection and not acknowledged yet.
+It is in two lists at once, the timer wheel slot of its deadline and its client's
+list, so a timeout and an ACK both find it without looking through every command. */
+typedef struct InFlight
+{
+    unsigned long seq;
+    Client *client;
+    uint32_t unit_id; //The unit it was addressed to, UNIT_BROADCAST for every unit on the connection.
+    char location[50];
+    int priority;
+    int retries;
+    long long first_sent_ms;
+    long long sent_ms;
+    long long deadline_ms;
+    struct InFlight *wheel_prev;
+    struct InFlight *wheel_next;
+    struct InFlight *client_prev;
+    struct InFlight *client_next;
+} InFlight;
+
+/*These are the startup settings that size the connection slab and the frame pool,
+and place this process in a cluster of "nodes" nuclearControl instances.
+They default to the values above and can be changed on the command line.*/
+typedef struct
+{
+    int test_mode;
+    int max_clients;
+    int frame_buffers;
+    int node_id;
+    int nodes;
+    const char *io_backend;
+    int ack_timeout_ms;
+    int ack_retries;
+    int max_inflight;
+    int intel_queue;
+    int intel_rate;
+    int intel_burst;
+    const char *cpu_io;
+    const char *cpu_worker;
+    const char *cpu_timer;
+    int replicate;
+    int standby;
+    int busy_poll_sensors_us;
+    int busy_poll_effectors_us;
+    int assign_window_ms;
+    const char *assign_solver;
+    int assign_budget_us;
+    int assign_capacity;
+    int max_effectors;
+    int assign_benchmark;
+    int listen_backlog;
+    int acceptors;
+    int unix_sockets;
+    int shm;
+    int tls;
+} ServerConfig;
+
+/*This is the listening socket and port handed to each accept thread. The role is
+the standard port of the client type (e.g. PORT_SILO) whatever node offset is applied.
+With "--acceptors N" every port has N listeners bound with SO_REUSEPORT, and the kernel
+spreads incoming connections over their queues; acceptor is this one's place in that group.
+A local listener is the port's AF_UNIX socket of "--unix-sockets" (see protocol.h).*/
+typedef struct
+{
+    int sock;
+    int port;
+    int role;
+    int acceptor;
+    int local;
+    atomic_ulong accepts;
+} Listener;
+
+/*This is the connection backend. Everything above the sockets (frame handling,
+threat evaluation, command fan-out) only goes through this table, so the backend
+can be picked with "--io-backend" and the two compared on the same workload.
+send may only queue the frame, flush then pushes out everything queued so far. */
+typedef struct
+{
+    const char *name;
+    int (*start)(int listener_count);
+    int (*send)(Client *client, char *buffer, const char *frame, size_t length);
+    void (*flush)(void);
+    void (*stop)(int listener_count);
+} IoBackend;
+
 /*These are global variables for server/client management system
-and designed to be thread-safe so they can be safely modified by threads */
-static Client clients[MAX_CLIENTS];
+and designed to be thread-safe so they can be safely modified by threads.
+The clients live in a slab that is allocated once at startup and every
+receive and send frame comes out of the frame pool, so nothing is malloc'd per message.*/
+static ServerConfig config = {.max_clients = DEFAULT_MAX_CLIENTS, .frame_buffers = DEFAULT_FRAME_BUFFERS, .nodes = 1,
+                              .io_backend = "threads", .ack_timeout_ms = DEFAULT_ACK_TIMEOUT_MS,
+                              .ack_retries = DEFAULT_ACK_RETRIES, .max_inflight = DEFAULT_MAX_INFLIGHT,
+                              .intel_queue = DEFAULT_INTEL_QUEUE, .intel_rate = DEFAULT_INTEL_RATE,
+                              .intel_burst = DEFAULT_INTEL_BURST, .assign_solver = "greedy",
+                              .assign_budget_us = ASSIGN_DEFAULT_BUDGET_US, .assign_capacity = ASSIGN_DEFAULT_CAPACITY,
+                              .max_effectors = ASSIGN_DEFAULT_EFFECTORS, .listen_backlog = DEFAULT_LISTEN_BACKLOG,
+                              .acceptors = 1};
+static Slab client_slab;
+static Slab frame_pool;
+static Listener listeners[(NUM_PORTS + 1) * (MAX_ACCEPTORS + 1)];
+static char log_path[64] = LOG_FILE;
+static char summary_path[64] = SUMMARY_FILE;
+static char stats_path[64] = STATS_FILE;
+static char repl_path[64] = REPL_SOCKET;
+static char replica_path[64];
+
+/*These are the outgoing peer links to the other nodes of a cluster. They are
+connected on first use and the mutex keeps forwarded decisions from interleaving. */
+static int peer_socks[MAX_NODES];
+static pthread_mutex_t peer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int decisions_forwarded = 0;
+static atomic_int decisions_received = 0;
 static atomic_int client_count = 0;
 static pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clients_closed = PTHREAD_COND_INITIALIZER; //Signalled when the last client is released.
 static atomic_bool running = true;
+static atomic_bool stop_requested = false;
 static FILE *log_fp = NULL;
-static int threats_detected = 0;
-static int commands_issued = 0;
+static atomic_int threats_detected = 0; //Counted by the client threads and the worker at once.
+static atomic_int commands_issued = 0;
+
+/*These count frames and the socket system calls spent moving them, so the
+summary can show the cost per message of whichever backend was running. */
+static const IoBackend *backend;
+static atomic_ulong frames_received = 0;
+static atomic_ulong frames_sent = 0;
+static atomic_ulong io_syscalls = 0;
+
+/*These count accepted connections in each second of the run, so the summary can show
+how fast a start-up storm of clients was taken off the listen queues. */
+static atomic_ulong accepts_per_second[ACCEPT_STORM_SECONDS];
+static atomic_ulong accepts_total = 0;
+
+/*These count the connections that moved to shared-memory rings and what went through
+the rings of those that have closed, including the doorbells the server had to ring. */
+static atomic_ulong ring_clients = 0;
+static atomic_ulong ring_refused = 0;
+static unsigned long ring_records_in = 0;  //These four are updated under clients_mutex.
+static unsigned long ring_records_out = 0;
+static unsigned long ring_doorbells = 0;
+static unsigned long ring_full = 0;
+
+/*These count the TLS handshakes of --tls, how long they took and on how many of them
+the kernel took over sending and receiving the records (kTLS). */
+static atomic_ulong tls_handshakes = 0;
+static atomic_ulong tls_failures = 0;
+static atomic_ulong tls_handshake_ns = 0;
+static atomic_ulong tls_kernel_send = 0;
+static atomic_ulong tls_kernel_recv = 0;
+#ifdef USE_TLS
+static SSL_CTX *tls_ctx;
+#endif
+
+/*These compare the two encodings: how many frames of each kind came in and went out,
+their payload bytes, and the time spent turning a report payload into an Intel. */
+static atomic_ulong intel_text_frames = 0;
+static atomic_ulong intel_text_bytes = 0;
+static atomic_ulong intel_text_decode_ns = 0;
+static atomic_ulong intel_binary_frames = 0;
+static atomic_ulong intel_binary_bytes = 0;
+static atomic_ulong intel_binary_decode_ns = 0;
+static atomic_ulong command_text_frames = 0;
+static atomic_ulong command_text_bytes = 0;
+static atomic_ulong command_binary_frames = 0;
+static atomic_ulong command_binary_bytes = 0;
+
+/*These are the per second statistics written to the columnar stats file (see runStats.h).
+The counters the server keeps anyway are sampled by the timer thread, the rest are
+recorded where they happen. stats_mutex is only ever taken last. */
+static StatsWriter stats;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int stat_frames_in;
+static int stat_frames_out;
+static int stat_reports;
+static int stat_critical;
+static int stat_shed;
+static int stat_commands_sent;
+static int stat_threats;
+static int stat_delivery_ms;
+static int stat_queue_wait_ms;
+static int stat_handoff_us;
+static int stat_migrations;
+static int stat_rx_wake_us;
+static int stat_destroyed;
+static int stat_flight_ms;
+static int stat_assign_us;
+static int stat_accepts;
+
+/*These are the receive modes of the thread backend. A client thread either blocks in recv,
+or with --busy-poll-sensors / --busy-poll-effectors spins on its socket with non-blocking
+receives for up to that many microseconds (SO_BUSY_POLL lets the kernel poll the device
+for it too) and only then parks in poll. Sensors are the radar and satellite connections,
+effectors the silo, submarine and peer connections that carry ACKs and decisions. Every
+receive is timed from the kernel's SO_TIMESTAMPNS arrival stamp to the moment the thread
+has the bytes, per role, which is the wake-up cost the two modes trade against CPU. */
+enum { POLL_SENSORS, POLL_EFFECTORS, POLL_ROLES };
+static atomic_ulong rx_count[POLL_ROLES];
+static atomic_ulong rx_wake_total_ns[POLL_ROLES];
+static atomic_ulong rx_wake_max_ns[POLL_ROLES];
+static atomic_ulong spin_hits[POLL_ROLES];  //Receives that found data while the thread was spinning.
+static atomic_ulong spin_parks[POLL_ROLES]; //Spins that ran out and parked the thread in poll.
+static atomic_ulong spin_ns[POLL_ROLES];
+static atomic_bool busy_poll_refused = false;
+
+/*These are where the threads run. The I/O threads (accept, client and io_uring), the
+evaluation worker and the timer thread each get a set of CPUs, and the main thread joins
+the timer once startup is done. A role given no CPUs keeps the ones the server started on.
+The pools are zeroed while the main thread is pinned to the CPUs that use them, so their
+pages come from the same NUMA node. worker_migrations counts the times the worker woke
+up on another CPU than the last time, which pinning brings down to zero. */
+static Topology topology;
+static CpuMask startup_cpus;
+static CpuMask io_cpus;
+static CpuMask worker_cpus;
+static CpuMask timer_cpus;
+static atomic_ulong worker_migrations = 0;
+
+/*These track commands until the effectors acknowledge them. Every command gets the next
+sequence number and one in-flight entry per connection it went to, taken from a slab.
+The timer wheel is advanced by its own thread and all of it is guarded by inflight_mutex,
+which is always taken after clients_mutex when both are needed. */
+static Slab inflight_slab;
+static InFlight *wheel[WHEEL_SLOTS];
+static long long wheel_tick;
+static pthread_mutex_t inflight_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_ulong command_seq = 0;
+static unsigned long commands_acked = 0;
+static unsigned long commands_retransmitted = 0;
+static unsigned long commands_timed_out = 0;
+static unsigned long commands_lost = 0;
+static unsigned long commands_untracked = 0;
+static unsigned long ack_frames_received = 0;
+static unsigned long acks_unmatched = 0;
+static long long delivery_total_ms = 0;
+static long long delivery_max_ms = 0;
+static long long ack_rtt_total_ms = 0;
+static long long ack_rtt_max_ms = 0;
+
+/*These are the weapon-target assignment (see assignmentModel.h), used with --assign-window-ms.
+The effector inventory and the open window's targets are guarded by clients_mutex, like the
+connections the effectors registered on, and the timer thread closes a window once it is due. */
+static AssignModel assignment;
+static long long assign_window_end_ms = 0;
+
+/*These count how the flights the effectors launched ended, as their OUTCOME frames
+report them, per effector type (0 for silos, 1 for submarines) and result. They are
+guarded by stats_mutex, which is taken to record them in the stats file anyway. */
+static unsigned long outcomes[2][3];
+static unsigned long outcome_frames = 0;
+static long long flight_total_ms = 0;
+static long long flight_max_ms = 0;
+
+/*These are the admission control state. Critical reports are evaluated as soon as they
+arrive. Routine reports have to get a token from their connection's bucket and then wait
+in a bounded queue for the evaluation worker, and are shed when either runs out. While the
+queue is congested no credit is handed back, so the sensors slow down themselves. */
+static QueuedIntel *intel_queue;
+static int intel_head = 0;
+static int intel_count = 0;
+static int intel_queue_peak = 0;
+static pthread_mutex_t intel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t intel_ready = PTHREAD_COND_INITIALIZER;
+static atomic_bool intel_congested = false;
+static atomic_ulong intel_critical = 0;
+static atomic_ulong shed_rate_limited = 0;
+static atomic_ulong shed_queue_full = 0;
+static atomic_ulong shed_after_stop = 0;
+static atomic_ulong credits_granted = 0;
+static atomic_ulong credit_frames = 0;
+static unsigned long intel_queued = 0;
+static unsigned long intel_evaluated = 0;
+static long long intel_wait_total_ms = 0;
+static long long intel_wait_max_ms = 0;
+
+/*These describe the drain at the end of the run for the summary. They are only
+written by the main thread before it writes the summary. */
+static const char *stop_reason = "simulation complete";
+static long long drain_ms = 0;
+static int drain_closed = 0;
+static int drain_forced = 0;
+
+/*These are the primary's side of the replication to a standby (see replicaLog.h). Records
+are appended to repl_buffer by whichever thread changes the state and sent by the timer
+thread, so nothing waits on the standby. repl_mutex is only ever taken after clients_mutex
+and inflight_mutex. The run's wall clock start and end go to the standby with the counters. */
+static unsigned char repl_buffer[REPL_BUFFER_SIZE];
+static size_t repl_used = 0;
+static int repl_sock = -1;
+static bool repl_overflowed = false;
+static bool repl_waiting = false;
+static long long repl_next_attempt_ms = 0;
+static long long repl_heartbeat_ms = 0;
+static pthread_mutex_t repl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long repl_records = 0;
+static unsigned long repl_bytes = 0;
+static unsigned long repl_writes = 0;
+static unsigned long repl_connects = 0;
+static unsigned long repl_resyncs = 0;
+static unsigned long long repl_append_ns = 0;
+static unsigned long long repl_send_ns = 0;
+static long long run_start_wall_ms = 0;
+static atomic_llong run_end_wall_ms = 0;
+
+/*These are the standby's side. replica_units holds the units each connection slot of the
+primary had registered. The failover times are monotonic ms, 0 until they happen. */
+static int *replica_units;
+static unsigned long replica_records = 0;
+static unsigned long replica_bytes = 0;
+static unsigned long replica_corrupt = 0;
+static bool replica_ended = false;
+static const char *failover_cause = NULL;
+static long long failover_lost_ms = 0;
+static long long failover_detected_ms = 0;
+static long long failover_listening_ms = 0;
+static long long failover_first_unit_ms = 0;
+static long long failover_complete_ms = 0;
+static int failover_expected_units = 0;
+static int failover_units_back = 0;
+static long failover_unconfirmed = 0; //Commands the primary sent that were not acknowledged when it was lost.
 
 /*This block is to intialize the nuclearControl log file with a timestamp
 It includes an error handling function and making the file in write mode to edit. 
 The log file is program to set into the current time to convert it into a string. */
 void init_log_file(void) 
 {
-    log_fp = fopen(LOG_FILE, "w");
+    log_fp = fopen(log_path, "w");
     if (!log_fp) {
         perror("Failed to create log file");
         exit(1);
@@ -81,20 +479,39 @@ void init_log_file(void)
     }
 }
 
-/*This is to log every messages with a timestamp and each category's detail*/
+/*This is to log every messages with a timestamp and each category's detail.
+Every thread logs, so the time is formatted into a local buffer the way ctime does
+rather than with ctime itself, whose one static buffer the threads would share.*/
 void log_event(const char *event_type, const char *details) 
 {
     if (!log_fp) return;
     time_t now = time(NULL);
-    char *time_str = ctime(&now);
-    if (time_str) 
+    struct tm local;
+    char time_str[32];
+    if (localtime_r(&now, &local) && strftime(time_str, sizeof(time_str), "%a %b %e %H:%M:%S %Y", &local) > 0) 
     {
-        time_str[strlen(time_str) - 1] = '\0';
         fprintf(log_fp, "[%s] %-12s %s\n", time_str, event_type, details);
         fflush(log_fp);
     }
 }
 
+/*This returns a monotonic clock reading in nanoseconds, for timing the decoders,
+the hand-off to the evaluation worker and the replication. */
+static long long now_ns(void) 
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+//This returns the wall clock in ms, which the primary and the standby agree on unlike now_ms.
+static long long wall_ms(void) 
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 //This is to use the caesar cipher to encrypt only letters in the plaintext messages 
 void caesar_encrypt(const char *plaintext, char *ciphertext, size_t len) 
 {
@@ -130,28 +547,55 @@ void caesar_decrypt(const char *ciphertext, char *plaintext, size_t len)
     }
 }
 
-/*This is for memory allocation pass an intelligence message into an Intel struct
+/*This is to split the next "key:value" field off a pipe delimited message in place.
+It returns the field or NULL once the message runs out, skipping empty fields. */
+static char *next_field(char **cursor)
+{
+    char *token = *cursor;
+    while (token && *token == '|') token++;
+    if (!token || *token == '\0') 
+    {
+        *cursor = NULL;
+        return NULL;
+    }
+    char *bar = strchr(token, '|');
+    if (bar) 
+    {
+        *bar = '\0';
+        *cursor = bar + 1;
+    } 
+    else 
+    {
+        *cursor = NULL;
+    }
+    return token;
+}
+
+/*This is to pass an intelligence message into an Intel struct.
+The message is copied into a stack buffer and split in place, so no heap memory is used.
 This also includes error handling to return a 0 for invalid format. */
 int parse_intel(const char *message, Intel *intel) 
 {
-    char *copy = strdup(message);
-    if (!copy) 
+    char copy[BUFFER_SIZE];
+    size_t len = strlen(message);
+    if (len >= sizeof(copy)) 
     {
-        log_event("ERROR", "Memory allocation failed for parsing");
+        log_event("ERROR", "Intelligence message too long for parsing");
         return 0;
     }
+    memcpy(copy, message, len + 1);
 
     /*This is to clear the struct and split the input string into 
     tokens. It also includes error handling to return a 0 for invalid format. */ 
     memset(intel, 0, sizeof(Intel));
     int fields_found = 0;
-    char *token = strtok(copy, "|");
+    char *cursor = copy;
+    char *token = next_field(&cursor);
     while (token) 
     {
         char *colon = strchr(token, ':');
         if (!colon || colon == token || !colon[1]) 
         {
-            free(copy);
             return 0;
         }
         *colon = '\0';
@@ -180,7 +624,6 @@ int parse_intel(const char *message, Intel *intel)
             char *endptr;
             intel->threat_level = (int)strtol(value, &endptr, 10);
             if (*endptr != '\0' || intel->threat_level < 0) {
-                free(copy);
                 return 0;
             }
             fields_found++;
@@ -190,293 +633,2687 @@ int parse_intel(const char *message, Intel *intel)
             strncpy(intel->location, value, sizeof(intel->location) - 1);
             fields_found++;
         }
-        token = strtok(NULL, "|");
+        token = next_field(&cursor);
     }
-    free(copy);
     return fields_found == 5; //Maximum of 5 field data 
 }
 
-/*This is to send encrypted launch commands to missileSilo and submarine to attack.
-Then it displays the order from command and where the target is located. */
-void send_command_to_clients(const char *location) 
+//This returns the trailer kept at the end of a send frame from the pool.
+static FrameTrailer *frame_trailer(char *buffer) 
 {
-    char command[256];
-    char ciphertext[BUFFER_SIZE];
-    char log_msg[BUFFER_SIZE];
-    snprintf(command, sizeof(command), "command:launch|target:%s", location);
-    caesar_encrypt(command, ciphertext, sizeof(ciphertext));
+    return (FrameTrailer *)(buffer + FRAME_REFS_OFFSET);
+}
 
-    //This is to deisplay the ecrypted and decrypted logs versions from the radar or satellite.
-    snprintf(log_msg, sizeof(log_msg), "Encrypted command: %s", ciphertext);
-    log_event("COMMAND", log_msg);
-    snprintf(log_msg, sizeof(log_msg), "Decrypted command: %s", command);
-    log_event("COMMAND", log_msg);
+//This returns the reference count kept at the end of a send frame from the pool.
+static atomic_int *frame_refs(char *buffer) 
+{
+    return &frame_trailer(buffer)->refs;
+}
 
-    /*This is to handle any errors during the simulation and be threaded safe 
-    to synchronize access to the clients or shared data. */
-    pthread_mutex_lock(&clients_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+/*This drops one reference to a send frame. The io_uring backend holds one per queued
+send, so the frame only goes back to the pool once the kernel is done with it. */
+static void frame_release(char *buffer) 
+{
+    if (atomic_fetch_sub(frame_refs(buffer), 1) == 1) 
     {
-        if (clients[i].valid && (clients[i].port == PORT_SILO || clients[i].port == PORT_SUB)) 
-        {
-            if (send(clients[i].sock, ciphertext, strlen(ciphertext), 0) < 0) 
-            {
-                snprintf(log_msg, sizeof(log_msg), "Failed to send command to %s:%d", 
-                         clients[i].ip, clients[i].port);
-                log_event("ERROR", log_msg);
-            } 
-            else 
-            {
-                snprintf(log_msg, sizeof(log_msg), "Sent command to %s:%d", 
-                         clients[i].ip, clients[i].port);
-                log_event("COMMAND", log_msg);
-                commands_issued++;
-            }
-        }
+        slab_free(&frame_pool, buffer);
     }
-    pthread_mutex_unlock(&clients_mutex);
 }
 
-/*This is to communicate with one of the clients and display
-its messages with encrypted and decrypted logs and connection status. */
-void *handle_client(void *arg) 
+/*This is to build a launch command for unit_id in a send frame from the pool. The plaintext
+command is left in command, the encrypted text frame starts BUFFER_SIZE bytes into the returned
+buffer and the binary frame COMMAND_BINARY_OFFSET bytes in, and command_frame picks
+between them. It returns NULL if the frame pool is exhausted. */
+char *build_command(const char *location, int priority, unsigned long seq, uint32_t unit_id, char *command,
+                    size_t command_size) 
 {
-    Client *client = (Client *)arg;
-    int client_sock = client->sock;
-    char buffer[BUFFER_SIZE];
-    char plaintext[BUFFER_SIZE];
-    Intel intel;
-    char log_msg[BUFFER_SIZE];
+    //The encrypted command is built in a send frame from the pool instead of a fresh allocation.
+    char *ciphertext = slab_alloc(&frame_pool);
+    if (!ciphertext) return NULL;
+    FrameTrailer *trailer = frame_trailer(ciphertext);
+    atomic_init(&trailer->refs, 1);
+    snprintf(command, command_size, "command:launch|target:%s|priority:%d|seq:%lu", location, priority, seq);
+    caesar_encrypt(command, ciphertext, BUFFER_SIZE);
 
-    //This is to log new intelligence messages from a different client.
-    snprintf(log_msg, sizeof(log_msg), "Client connected from %s:%d", 
-             client->ip, client->port);
-    log_event("CONNECTION", log_msg);
+    /*A command for unit 0 is framed once, and every silo or submarine unit sharing the
+    connection treats it as addressed to itself. */
+    trailer->text_len = frame_encode(ciphertext + BUFFER_SIZE, COMMAND_BINARY_OFFSET - BUFFER_SIZE, FRAME_COMMAND,
+                                     unit_id, ciphertext, strlen(ciphertext));
 
-    /*This to continue to simulate until the program's been terminated.
-    Also to handle any errors or if disconnection occurs between the server and client. */
-    while (atomic_load(&running)) 
+    //The binary encoding is built next to it, it is a few bytes more work than the copy it replaces.
+    char binary[FRAME_MAX_PAYLOAD];
+    int binary_len = wire_encode_command(binary, sizeof(binary), location, priority, seq);
+    trailer->binary_len = binary_len < 0 ? -1 :
+                          frame_encode(ciphertext + COMMAND_BINARY_OFFSET, FRAME_REFS_OFFSET - COMMAND_BINARY_OFFSET,
+                                       FRAME_COMMAND_BIN, unit_id, binary, (size_t)binary_len);
+    return ciphertext;
+}
+
+/*This returns the encoding of a built command that suits a connection, and its length.
+It counts the frame for the summary, so it is only called right before the send. */
+static const char *command_frame(char *buffer, const Client *client, size_t *length) 
+{
+    FrameTrailer *trailer = frame_trailer(buffer);
+    if (client->codec && trailer->binary_len > 0) 
     {
-        ssize_t bytes = recv(client_sock, buffer, sizeof(buffer) - 1, 0);
-        if (bytes <= 0) 
-        {
-            snprintf(log_msg, sizeof(log_msg), "Client %s:%d disconnected: %s", 
-                     client->ip, client->port, bytes == 0 ? "closed connection" : strerror(errno));
-            log_event("CONNECTION", log_msg);
-            break;
-        }
-        buffer[bytes] = '\0';
+        *length = (size_t)trailer->binary_len;
+        atomic_fetch_add(&command_binary_frames, 1);
+        atomic_fetch_add(&command_binary_bytes, *length - FRAME_HEADER_SIZE);
+        return buffer + COMMAND_BINARY_OFFSET;
+    }
+    *length = (size_t)trailer->text_len;
+    atomic_fetch_add(&command_text_frames, 1);
+    atomic_fetch_add(&command_text_bytes, *length - FRAME_HEADER_SIZE);
+    return buffer + BUFFER_SIZE;
+}
 
-        //Displays encrypted messages 
-        snprintf(log_msg, sizeof(log_msg), "Encrypted message: %s", buffer);
-        log_event("MESSAGE", log_msg);
+//This puts an in-flight command into the timer wheel slot of its deadline.
+static void wheel_insert(InFlight *entry) 
+{
+    InFlight **slot = &wheel[(entry->deadline_ms / WHEEL_TICK_MS) % WHEEL_SLOTS];
+    entry->wheel_prev = NULL;
+    entry->wheel_next = *slot;
+    if (*slot) (*slot)->wheel_prev = entry;
+    *slot = entry;
+}
 
-         //Displays dedcrypted messages
-        caesar_decrypt(buffer, plaintext, sizeof(plaintext));
-        snprintf(log_msg, sizeof(log_msg), "Decrypted message: %s", plaintext);
-        log_event("MESSAGE", log_msg);
+static void wheel_remove(InFlight *entry) 
+{
+    if (entry->wheel_prev) entry->wheel_prev->wheel_next = entry->wheel_next;
+    else wheel[(entry->deadline_ms / WHEEL_TICK_MS) % WHEEL_SLOTS] = entry->wheel_next;
+    if (entry->wheel_next) entry->wheel_next->wheel_prev = entry->wheel_prev;
+}
 
-        /*Parses and processes important details to form as an intelligence report*/
-        if (parse_intel(plaintext, &intel)) 
-        {
-            snprintf(log_msg, sizeof(log_msg), 
-                     "Source: %s, Type: %s, Details: %s, Threat Level: %d, Location: %s",
-                     intel.source, intel.type, intel.data, intel.threat_level, intel.location);
-            log_event("THREAT", log_msg);
-            threats_detected++;
+/*This starts tracking a command sent to a client. It is called before the send,
+so an ACK can never arrive for a command the server does not know about yet.
+It returns NULL if the in-flight slab is full, and the command then goes untracked. */
+InFlight *inflight_track(Client *client, unsigned long seq, uint32_t unit_id, const char *location, int priority) 
+{
+    pthread_mutex_lock(&inflight_mutex);
+    InFlight *entry = slab_alloc(&inflight_slab);
+    if (!entry) 
+    {
+        commands_untracked++;
+        pthread_mutex_unlock(&inflight_mutex);
+        return NULL;
+    }
+    entry->seq = seq;
+    entry->client = client;
+    entry->unit_id = unit_id;
+    snprintf(entry->location, sizeof(entry->location), "%s", location);
+    entry->priority = priority;
+    entry->first_sent_ms = entry->sent_ms = now_ms();
+    entry->deadline_ms = entry->sent_ms + config.ack_timeout_ms;
+    wheel_insert(entry);
+    entry->client_next = client->inflight;
+    if (client->inflight) client->inflight->client_prev = entry;
+    client->inflight = entry;
+    pthread_mutex_unlock(&inflight_mutex);
+    return entry;
+}
 
-             /*This triggers a launch command to the missileSilo and submarine if the radar or satellite detects a threat level above 70. 
-            Also this includes an error handling function if na invalid message occurs */
-            if (intel.threat_level > 70 && 
-                (strcmp(intel.source, "Radar") == 0 || strcmp(intel.source, "Satellite") == 0)) 
-            {
-                send_command_to_clients(intel.location);
-            }
+//This stops tracking a command. The in-flight mutex must be held.
+static void inflight_forget(InFlight *entry) 
+{
+    wheel_remove(entry);
+    if (entry->client_prev) entry->client_prev->client_next = entry->client_next;
+    else entry->client->inflight = entry->client_next;
+    if (entry->client_next) entry->client_next->client_prev = entry->client_prev;
+    slab_free(&inflight_slab, entry);
+}
+
+//This forgets a command whose send failed, so it is not retransmitted as well.
+void inflight_cancel(InFlight *entry) 
+{
+    if (!entry) return;
+    pthread_mutex_lock(&inflight_mutex);
+    inflight_forget(entry);
+    pthread_mutex_unlock(&inflight_mutex);
+}
+
+/*This forgets every command still in flight on a connection that closed. They are
+counted as lost, because an effector that reconnects starts from a fresh connection. */
+void inflight_drop_client(Client *client) 
+{
+    pthread_mutex_lock(&inflight_mutex);
+    while (client->inflight) 
+    {
+        commands_lost++;
+        inflight_forget(client->inflight);
+    }
+    pthread_mutex_unlock(&inflight_mutex);
+}
+
+/*This is to process an ACK frame from an effector connection. Each entry closes one
+in-flight command and records how long it took to reach the effector and how long
+until the acknowledgement came back. */
+void process_acks(Client *client, const char *payload, uint32_t length) 
+{
+    char acks[FRAME_MAX_PAYLOAD + 1];
+    memcpy(acks, payload, length);
+    acks[length] = '\0';
+    long long now = now_ms();
+    char *cursor = acks;
+    char *end = acks;
+
+    pthread_mutex_lock(&inflight_mutex);
+    ack_frames_received++;
+    while (*cursor) 
+    {
+        unsigned long seq = strtoul(cursor, &end, 10);
+        if (end == cursor || *end != '@') break;
+        long long processed_ms = strtoll(end + 1, &end, 10);
+
+        InFlight *entry = client->inflight;
+        while (entry && entry->seq != seq) entry = entry->client_next;
+        if (!entry) 
+        {
+            acks_unmatched++; //It already timed out, or it was the second ACK of a retransmission.
         } 
         else 
         {
-            snprintf(log_msg, sizeof(log_msg), "Invalid message: %s", plaintext);
-            log_event("ERROR", log_msg);
+            long long delivery = processed_ms - entry->first_sent_ms;
+            long long rtt = now - entry->sent_ms;
+            delivery_total_ms += delivery;
+            if (delivery > delivery_max_ms) delivery_max_ms = delivery;
+            ack_rtt_total_ms += rtt;
+            if (rtt > ack_rtt_max_ms) ack_rtt_max_ms = rtt;
+            pthread_mutex_lock(&stats_mutex);
+            stats_observe(&stats, stat_delivery_ms, delivery, now);
+            pthread_mutex_unlock(&stats_mutex);
+            commands_acked++;
+            inflight_forget(entry);
         }
+        if (*end != ',') break;
+        cursor = end + 1;
     }
+    pthread_mutex_unlock(&inflight_mutex);
 
-    //This is to cleanup the disconnection process. 
-    close(client_sock);
-    pthread_mutex_lock(&clients_mutex);
-    client->valid = false;
-    atomic_fetch_sub(&client_count, 1);
-    pthread_mutex_unlock(&clients_mutex);
-    return NULL;
+    if (*end != '\0') 
+    {
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg), "Malformed ACK frame from %s:%d", client->ip, client->port);
+        log_event("ERROR", log_msg);
+    }
 }
 
-//This is to start a test mode for simulating scenarios of different types of  air and sea threats. 
-void simulate_war_test(void) 
+/*This adds one record to the replication buffer for the timer thread to send. Records
+are only kept while a standby is connected, since every connection starts with a snapshot.
+If the standby falls so far behind that the buffer fills, the connection is dropped and
+the next one starts again from a snapshot. */
+static void repl_append(uint8_t type, const uint64_t *values, int value_count,
+                        const char *const *names, int name_count) 
 {
-    const char *threat_types[] = {"Air", "Sea"};
-    const char *threat_data[] = {"Enemy Aircraft", "Ballistic Missile", "Enemy Submarine", "Naval Fleet"};
-    const char *locations[] = {"North Atlantic", "Norwegian Sea", "English Channel", "Arctic Ocean"};
-    Intel intel;
-    char log_msg[BUFFER_SIZE];
-
-    //This for loop receive threats randomy during a test mode. It receives 3 Intelligence reports.
-    for (int i = 0; i < 3 && atomic_load(&running); i++) 
+    if (!config.replicate) return;
+    unsigned char record[REPL_MAX_RECORD + 16];
+    long long started = now_ns();
+    size_t length = repl_encode(record, sizeof(record), type, values, value_count, names, name_count);
+    pthread_mutex_lock(&repl_mutex);
+    if (repl_sock >= 0 && length > 0) 
     {
-        snprintf(intel.source, sizeof(intel.source), "TEST");
-        int idx = rand() % 4;
-        snprintf(intel.type, sizeof(intel.type), "%s", threat_types[idx % 2]);
-        snprintf(intel.data, sizeof(intel.data), "%s", threat_data[idx]);
-        intel.threat_level = (rand() % 100 < 50) ? 71 + (rand() % 30) : 10 + (rand() % 61);
-        snprintf(intel.location, sizeof(intel.location), "%s", locations[rand() % 4]);
-
-        //This is to process and display threat logs with a delay of 10 seconds.
-        snprintf(log_msg, sizeof(log_msg), 
-                 "Source: %s, Type: %s, Details: %s, Threat Level: %d, Location: %s",
-                 intel.source, intel.type, intel.data, intel.threat_level, intel.location);
-        log_event("WAR_TEST", log_msg);
-        threats_detected++;
-
-        //This is to initiate a launch if the threat level is above 70
-        if (intel.threat_level > 70) 
+        if (repl_used + length > sizeof(repl_buffer)) 
+        {
+            repl_overflowed = true;
+        }
+        else 
         {
-            send_command_to_clients(intel.location);
+            memcpy(repl_buffer + repl_used, record, length);
+            repl_used += length;
+            repl_records++;
+            repl_bytes += length;
         }
-        sleep(10); //Delay for 10 seconds between threats
     }
+    repl_append_ns += (unsigned long long)(now_ns() - started);
+    pthread_mutex_unlock(&repl_mutex);
 }
 
-//This is to generate a summary report at the end of the simulation program
-void generate_summary(void) 
+//This appends the run's counters, which every REPL_HEARTBEAT_MS is also the heartbeat.
+static void repl_counters(void) 
 {
-    FILE *summary_fp = fopen(SUMMARY_FILE, "w");
-    if (!summary_fp) 
+    uint64_t values[REPL_COUNTER_COUNT];
+    pthread_mutex_lock(&inflight_mutex);
+    values[REPL_COMMANDS_ACKED] = commands_acked;
+    pthread_mutex_unlock(&inflight_mutex);
+    values[REPL_END_WALL_MS] = (uint64_t)atomic_load(&run_end_wall_ms);
+    values[REPL_THREATS] = (uint64_t)atomic_load(&threats_detected);
+    values[REPL_COMMANDS] = (uint64_t)atomic_load(&commands_issued);
+    values[REPL_COMMAND_SEQ] = atomic_load(&command_seq);
+    values[REPL_DECISIONS_FORWARDED] = (uint64_t)atomic_load(&decisions_forwarded);
+    values[REPL_DECISIONS_RECEIVED] = (uint64_t)atomic_load(&decisions_received);
+    repl_append(REPL_COUNTERS, values, REPL_COUNTER_COUNT, NULL, 0);
+}
+
+//This appends the units a connection has registered, 0 once it closed. clients_mutex is held.
+static void repl_client(Client *client, int units) 
+{
+    uint64_t values[3] = {(uint64_t)slab_index(&client_slab, client), (uint64_t)client->role, (uint64_t)units};
+    repl_append(REPL_CLIENT, values, 3, NULL, 0);
+}
+
+/*This connects to the standby's socket and starts the stream with a snapshot: START, the
+counters and the units of every open connection. clients_mutex is held for the snapshot,
+so no connection can register or close between it and the records that follow. */
+static void repl_connect(long long now) 
+{
+    char log_msg[256];
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", repl_path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) 
     {
-        log_event("ERROR", "Failed to create summary file");
+        if (!repl_waiting) 
+        {
+            snprintf(log_msg, sizeof(log_msg), "Standby not reachable on %s (%s), retrying every %d ms",
+                     repl_path, strerror(errno), REPL_RETRY_MS);
+            log_event("ERROR", log_msg);
+            repl_waiting = true;
+        }
+        if (sock >= 0) close(sock);
+        repl_next_attempt_ms = now + REPL_RETRY_MS;
         return;
     }
+    repl_waiting = false;
 
-    /*The report box starts here and contains the time when the simulation ended, 
-    total threats it detected, total commands send to the silo and submarine, and
-    number of clients it connected to the server.*/
-    fprintf(summary_fp, "===== Nuclear Control Simulation Summary =====\n");
-    time_t now = time(NULL);
-    char *time_str = ctime(&now);
-    if (time_str) 
-    {
-        time_str[strlen(time_str) - 1] = '\0';
-        fprintf(summary_fp, "Simulation End: %s\n", time_str);
-    }
-    fprintf(summary_fp, "Total Threats Detected: %d\n", threats_detected);
-    fprintf(summary_fp, "Total Commands Issued: %d\n", commands_issued);
-    fprintf(summary_fp, "Connected Clients:\n");
     pthread_mutex_lock(&clients_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    pthread_mutex_lock(&repl_mutex);
+    repl_sock = sock;
+    repl_used = 0;
+    repl_overflowed = false;
+    repl_connects++;
+    pthread_mutex_unlock(&repl_mutex);
+    uint64_t start[3] = {REPL_VERSION, (uint64_t)config.node_id, (uint64_t)run_start_wall_ms};
+    repl_append(REPL_START, start, 3, NULL, 0);
+    repl_counters();
+    for (int i = 0; i < client_slab.capacity; i++) 
     {
-        if (clients[i].valid) {
-            fprintf(summary_fp, "  - %s:%d\n", clients[i].ip, clients[i].port);
-        }
+        Client *client = slab_at(&client_slab, i);
+        if (client->valid && client->units > 0) repl_client(client, client->units);
     }
     pthread_mutex_unlock(&clients_mutex);
-    fprintf(summary_fp, "=====================================\n");
-    fclose(summary_fp);
-
-    //This shows where the summary report has been generated in an text file.
-    char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "Summary generated in %s", SUMMARY_FILE);
-    log_event("SUMMARY", log_msg);
+    repl_heartbeat_ms = now;
+    snprintf(log_msg, sizeof(log_msg), "Replicating to the standby on %s", repl_path);
+    log_event("REPLICATION", log_msg);
 }
 
-//This is to accept new client connections the user enters in a seperate terminal.
-void *accept_clients(void *arg) 
+/*This sends what has been appended since the last call without blocking, keeping what
+the socket did not take for the next tick. The timer thread calls it every tick, and it
+adds the heartbeat when it is due. A standby that went away or fell behind is dropped
+and reconnected straight away, starting from a new snapshot. */
+static void replicate(long long now) 
 {
-    int server_sock = *(int *)arg;
-    int port = *(int *)((char *)arg + sizeof(int));
-    char log_msg[BUFFER_SIZE];
-
-    /*This is a while loop that accepts incoming client connections on a listening socket.
-    It also handles error and log failures. */
-    while (atomic_load(&running)) 
+    if (!config.replicate) return;
+    if (repl_sock < 0 && now >= repl_next_attempt_ms) repl_connect(now);
+    if (repl_sock < 0) return;
+    if (now - repl_heartbeat_ms >= REPL_HEARTBEAT_MS) 
     {
-        struct sockaddr_in client_addr;
-        socklen_t addr_len = sizeof(client_addr);
-        int client_sock = accept(server_sock, (struct sockaddr *)&client_addr, &addr_len);
-        if (client_sock < 0) {
-            if (errno != EINTR && atomic_load(&running)) 
-            {
-                snprintf(log_msg, sizeof(log_msg), "Accept failed on port %d: %s", port, strerror(errno));
-                log_event("ERROR", log_msg);
-            }
-            continue;
-        }
+        repl_heartbeat_ms = now;
+        repl_counters();
+    }
 
-        //This allocates the memory of incoming clients. It also includes handles error.
-        Client *client = malloc(sizeof(Client));
-        if (!client) 
+    pthread_mutex_lock(&repl_mutex);
+    long long started = now_ns();
+    bool overflowed = repl_overflowed;
+    bool failed = overflowed;
+    size_t sent = 0;
+    while (!failed && sent < repl_used) 
+    {
+        ssize_t bytes = send(repl_sock, repl_buffer + sent, repl_used - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (bytes > 0) 
         {
-            snprintf(log_msg, sizeof(log_msg), "Client allocation failed on port %d", port);
-            log_event("ERROR", log_msg);
-            close(client_sock);
-            continue;
+            sent += (size_t)bytes;
+            repl_writes++;
         }
-
-        //This initialises to store thre client's data such as its socket, port, and IP.
-        client->sock = client_sock;
-        client->port = port;
-        client->valid = true;
-        inet_ntop(AF_INET, &client_addr.sin_addr, client->ip, sizeof(client->ip));
-
-        //This is a safety procedure to handle thread and safely increments the counter without race conditions.
-        pthread_mutex_lock(&clients_mutex);
-        int added = 0;
-        for (int i = 0; i < MAX_CLIENTS; i++) 
+        else if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) 
         {
-            if (!clients[i].valid) {
-                clients[i] = *client;
-                atomic_fetch_add(&client_count, 1);
-                added = 1;
-                break;
-            }
+            break;
         }
-        pthread_mutex_unlock(&clients_mutex);
-
-         /* This sets the maximum amount of clients the server can accept,
-        and once it does, it rejects incoming clients*/
-        if (!added) 
+        else 
         {
-            snprintf(log_msg, sizeof(log_msg), "Max clients reached, rejecting %s:%d", client->ip, port);
-            log_event("ERROR", log_msg);
-            close(client_sock);
-            free(client);
-            continue;
-        }
-
-        /*This creates a new thread to handle a client connection in case one fails,
-        it cleans up its old resources and logs the failure with error handling to close the socket,
-        and freeing the memory prevent a leak. */
-        if (pthread_create(&client->thread, NULL, handle_client, client) != 0)
-         {
-            snprintf(log_msg, sizeof(log_msg), "Thread creation failed for %s:%d", client->ip, port);
-            log_event("ERROR", log_msg);
-            pthread_mutex_lock(&clients_mutex);
-            client->valid = false;
-            atomic_fetch_sub(&client_count, 1);
-            pthread_mutex_unlock(&clients_mutex);
-            close(client_sock);
-            free(client);
-            continue;
+            failed = true;
         }
-        pthread_detach(client->thread);
     }
-    return NULL;
+    memmove(repl_buffer, repl_buffer + sent, repl_used - sent);
+    repl_used -= sent;
+    if (sent > 0) repl_send_ns += (unsigned long long)(now_ns() - started);
+    if (failed) 
+    {
+        close(repl_sock);
+        repl_sock = -1;
+        repl_used = 0;
+        repl_next_attempt_ms = now;
+        repl_resyncs++;
+    }
+    pthread_mutex_unlock(&repl_mutex);
+    if (failed) 
+    {
+        log_event("ERROR", overflowed ? "Standby fell behind the replication log, resending the snapshot"
+                                      : "Lost the standby, reconnecting");
+    }
 }
 
-/* This int function initializes a TCP server on given port and
- configures its socket with en error handling function in all cases. */
-int start_server(int port) 
+/*This ends the replication at the end of a run that finished normally, so the standby
+stands down instead of taking over. It is called once the timer and the worker have stopped. */
+static void repl_finish(void) 
 {
-    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_sock < 0) 
+    if (!config.replicate || repl_sock < 0) return;
+    repl_counters();
+    repl_append(REPL_END, NULL, 0, NULL, 0);
+    replicate(now_ms());
+    pthread_mutex_lock(&repl_mutex);
+    if (repl_sock >= 0) 
     {
-        perror("Socket creation failed");
+        if (repl_used > 0) log_event("ERROR", "The standby did not take the whole replication log");
+        close(repl_sock);
+        repl_sock = -1;
+    }
+    pthread_mutex_unlock(&repl_mutex);
+}
+
+/*This sends a built launch command to one silo or submarine connection, for unit_id or
+every unit on it, and tracks it until it is acknowledged. It is called with clients_mutex
+held and the caller flushes the backend. */
+static void send_command_to_client(Client *client, char *ciphertext, unsigned long seq, uint32_t unit_id,
+                                   const char *location, int priority) 
+{
+    char log_msg[BUFFER_SIZE];
+    InFlight *entry = inflight_track(client, seq, unit_id, location, priority);
+    size_t frame_len;
+    const char *frame = command_frame(ciphertext, client, &frame_len);
+    if (backend->send(client, ciphertext, frame, frame_len) < 0)
+    {
+        inflight_cancel(entry);
+        snprintf(log_msg, sizeof(log_msg), "Failed to send command to %s:%d", 
+                 client->ip, client->port);
+        log_event("ERROR", log_msg);
+        return;
+    }
+    if (unit_id == UNIT_BROADCAST) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Sent command to %s:%d (%d units)", 
+                 client->ip, client->port, client->units);
+    }
+    else 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Sent command to unit %u on %s:%d", unit_id, client->ip, client->port);
+    }
+    log_event("COMMAND", log_msg);
+    atomic_fetch_add(&commands_issued, 1);
+    pthread_mutex_lock(&stats_mutex);
+    stats_count(&stats, "commands", client->role == PORT_SILO ? "missileSilo" : "submarine", 1, now_ms());
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+/*This is to build an encrypted launch command under the next sequence number, replicate
+the decision and log both versions. It returns the command's frame, or NULL if the frame
+pool is exhausted. */
+static char *new_command(const char *location, int priority, uint32_t unit_id, unsigned long *seq) 
+{
+    char command[256];
+    char log_msg[BUFFER_SIZE];
+    *seq = atomic_fetch_add(&command_seq, 1) + 1;
+    uint64_t decision[2] = {*seq, (uint64_t)priority};
+    repl_append(REPL_DECISION, decision, 2, &location, 1);
+    char *ciphertext = build_command(location, priority, *seq, unit_id, command, sizeof(command));
+    if (!ciphertext) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Frame pool exhausted, dropping command for %s", location);
+        log_event("ERROR", log_msg);
+        return NULL;
+    }
+
+    //This is to deisplay the ecrypted and decrypted logs versions from the radar or satellite.
+    snprintf(log_msg, sizeof(log_msg), "Encrypted command: %s", ciphertext);
+    log_event("COMMAND", log_msg);
+    snprintf(log_msg, sizeof(log_msg), "Decrypted command: %s", command);
+    log_event("COMMAND", log_msg);
+    return ciphertext;
+}
+
+/*This is to send encrypted launch commands to missileSilo and submarine to attack.
+Then it displays the order from command and where the target is located.
+The threat level goes along as the priority, so effectors with a backlog launch
+at the most dangerous targets first, and the sequence number is what they acknowledge. */
+void send_command_to_clients(const char *location, int priority) 
+{
+    unsigned long seq;
+    char *ciphertext = new_command(location, priority, UNIT_BROADCAST, &seq);
+    if (!ciphertext) return;
+
+    /*This is to handle any errors during the simulation and be threaded safe 
+    to synchronize access to the clients or shared data. */
+    pthread_mutex_lock(&clients_mutex);
+    for (int i = 0; i < client_slab.capacity; i++) 
+    {
+        Client *client = slab_at(&client_slab, i);
+        if (client->valid && (client->role == PORT_SILO || client->role == PORT_SUB)) 
+        {
+            send_command_to_client(client, ciphertext, seq, UNIT_BROADCAST, location, priority);
+        }
+    }
+    backend->flush(); //The io_uring backend submits the whole fan-out in one system call here.
+    pthread_mutex_unlock(&clients_mutex);
+    frame_release(ciphertext);
+}
+
+/*This closes the decision window: the targets collected since it opened are assigned to
+effector units (see assignmentModel.h) and each unit is sent its own command. Targets that
+no effector can reach are logged. It is called with clients_mutex held. */
+static void close_assignment_window(void) 
+{
+    char log_msg[BUFFER_SIZE];
+    int targets = assignment.target_count;
+    int orders = assign_solve(&assignment);
+    int sent = 0;
+    for (int o = 0; o < orders; o++) 
+    {
+        const AssignTarget *target = &assignment.targets[assignment.order_target[o]];
+        int e = assignment.order_effector[o];
+        if (e < 0) 
+        {
+            snprintf(log_msg, sizeof(log_msg), "No effector in range has a weapon left for %s (priority %d)",
+                     target->location, target->priority);
+            log_event("ERROR", log_msg);
+            continue;
+        }
+        unsigned long seq;
+        char *ciphertext = new_command(target->location, target->priority, assignment.effectors[e].unit_id, &seq);
+        if (!ciphertext) continue;
+        send_command_to_client(assignment.effectors[e].owner, ciphertext, seq, assignment.effectors[e].unit_id,
+                               target->location, target->priority);
+        frame_release(ciphertext);
+        sent++;
+    }
+    backend->flush();
+    assign_next_window(&assignment);
+
+    snprintf(log_msg, sizeof(log_msg), "Assigned %d targets: %d of %d orders sent to %d effectors in the inventory in %lld us",
+             targets, sent, orders, assignment.effector_count, assignment.last_solve_ns / 1000);
+    log_event("ASSIGN", log_msg);
+    pthread_mutex_lock(&stats_mutex);
+    stats_observe(&stats, stat_assign_us, assignment.last_solve_ns / 1000, now_ms());
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+/*This adds a launch decision to the decision window, opening one if none is open. When
+the window is full it is closed early, so the decision goes into the next one. */
+static void queue_for_assignment(const char *location, int priority) 
+{
+    pthread_mutex_lock(&clients_mutex);
+    if (assignment.target_count > 0 && assign_add_target(&assignment, location, priority) == 0) 
+    {
+        pthread_mutex_unlock(&clients_mutex);
+        return;
+    }
+    if (assignment.target_count > 0) close_assignment_window();
+    assign_window_end_ms = now_ms() + config.assign_window_ms;
+    assign_add_target(&assignment, location, priority);
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+/*This is to launch at a target with this node's own effectors: every silo and submarine
+at once, or with --assign-window-ms the ones the next decision window assigns to it. */
+void launch_locally(const char *location, int priority) 
+{
+    if (config.assign_window_ms > 0) queue_for_assignment(location, priority);
+    else send_command_to_clients(location, priority);
+}
+
+/*This handles an in-flight command whose deadline has passed. It is sent again to
+the same connection with a doubled deadline until --ack-retries is used up, and is
+then reported as unacknowledged. Both mutexes are held. */
+static void inflight_expire(InFlight *entry, long long now) 
+{
+    char log_msg[256];
+    char command[256];
+    Client *client = entry->client;
+    if (entry->retries < config.ack_retries) 
+    {
+        size_t frame_len;
+        char *buffer = build_command(entry->location, entry->priority, entry->seq, entry->unit_id, command,
+                                     sizeof(command));
+        const char *frame = buffer ? command_frame(buffer, client, &frame_len) : NULL;
+        if (frame && backend->send(client, buffer, frame, frame_len) == 0)
+        {
+            wheel_remove(entry);
+            entry->retries++;
+            entry->sent_ms = now;
+            entry->deadline_ms = now + ((long long)config.ack_timeout_ms << entry->retries);
+            wheel_insert(entry);
+            commands_retransmitted++;
+            frame_release(buffer);
+            snprintf(log_msg, sizeof(log_msg), "Retransmitting command %lu to %s:%d (attempt %d)",
+                     entry->seq, client->ip, client->port, entry->retries + 1);
+            log_event("COMMAND", log_msg);
+            return;
+        }
+        if (buffer) frame_release(buffer);
+    }
+    snprintf(log_msg, sizeof(log_msg), "Command %lu (launch at %s) to %s:%d not acknowledged after %d sends",
+             entry->seq, entry->location, client->ip, client->port, entry->retries + 1);
+    log_event("ERROR", log_msg);
+    commands_timed_out++;
+    inflight_forget(entry);
+}
+
+/*This samples the server's running totals into the stats file, which also closes
+the current bucket once its second is over. The timer thread calls it every tick. */
+static void sample_stats(long long now) 
+{
+    pthread_mutex_lock(&stats_mutex);
+    stats_total(&stats, stat_frames_in, (long long)atomic_load(&frames_received), now);
+    stats_total(&stats, stat_frames_out, (long long)atomic_load(&frames_sent), now);
+    stats_total(&stats, stat_reports,
+                (long long)(atomic_load(&intel_text_frames) + atomic_load(&intel_binary_frames)), now);
+    stats_total(&stats, stat_critical, (long long)atomic_load(&intel_critical), now);
+    stats_total(&stats, stat_shed, (long long)(atomic_load(&shed_rate_limited) + atomic_load(&shed_queue_full) +
+                                               atomic_load(&shed_after_stop)), now);
+    stats_total(&stats, stat_commands_sent,
+                (long long)(atomic_load(&command_text_frames) + atomic_load(&command_binary_frames)), now);
+    stats_total(&stats, stat_migrations, (long long)atomic_load(&worker_migrations), now);
+    stats_total(&stats, stat_destroyed, (long long)(outcomes[0][0] + outcomes[1][0]), now);
+    stats_total(&stats, stat_accepts, (long long)atomic_load(&accepts_total), now);
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+/*This pins the calling thread to the CPUs of its role. A failure is logged and the
+thread carries on wherever the scheduler puts it. */
+static void pin_thread(const CpuMask *cpus, const char *role) 
+{
+    if (topology_set_affinity(cpus) < 0) 
+    {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "Failed to pin the %s thread: %s", role, strerror(errno));
+        log_event("ERROR", log_msg);
+    }
+}
+
+/*This is the timer wheel's thread. Every tick it looks at the slots whose time has
+come and expires the commands in them that are due, skipping entries that belong to a
+later turn of the wheel. Retransmissions are flushed together at the end of the tick. */
+void *ack_timer(void *arg) 
+{
+    (void)arg;
+    pin_thread(&timer_cpus, "timer");
+    while (atomic_load(&running)) 
+    {
+        usleep(WHEEL_TICK_MS * 1000);
+        long long now = now_ms();
+        pthread_mutex_lock(&clients_mutex);
+        if (config.assign_window_ms > 0 && assignment.target_count > 0 && now >= assign_window_end_ms) 
+        {
+            close_assignment_window();
+        }
+        pthread_mutex_lock(&inflight_mutex);
+        for (; wheel_tick <= now / WHEEL_TICK_MS; wheel_tick++) 
+        {
+            InFlight *entry = wheel[wheel_tick % WHEEL_SLOTS];
+            while (entry) 
+            {
+                InFlight *next = entry->wheel_next;
+                if (entry->deadline_ms <= now) inflight_expire(entry, now);
+                entry = next;
+            }
+        }
+        backend->flush();
+        pthread_mutex_unlock(&inflight_mutex);
+        pthread_mutex_unlock(&clients_mutex);
+        sample_stats(now);
+        replicate(now);
+    }
+    return NULL;
+}
+
+/*This is to pick the node that owns a target location in cluster mode.
+Every node hashes the name the same way (FNV-1a), so they all agree on the owner. */
+int location_owner(const char *location) 
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)location; *c; c++) 
+    {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return (int)(hash % (uint32_t)config.nodes);
+}
+
+/*This is to forward a launch decision to the node that owns the target over its peer link.
+The link is connected on first use. It returns 0 once the decision is sent and -1 if the
+peer could not be reached, in which case the caller launches with its own effectors. */
+int forward_decision(int owner, const char *location, int priority) 
+{
+    char decision[128];
+    char ciphertext[128];
+    char frame[FRAME_HEADER_SIZE + 128];
+    char log_msg[256];
+    snprintf(decision, sizeof(decision), "%d|%s", priority, location);
+    caesar_encrypt(decision, ciphertext, sizeof(ciphertext));
+    int frame_len = frame_encode(frame, sizeof(frame), FRAME_DECISION, (uint32_t)config.node_id,
+                                 ciphertext, strlen(ciphertext));
+
+    pthread_mutex_lock(&peer_mutex);
+    if (peer_socks[owner] < 0) 
+    {
+        struct sockaddr_in peer_addr = {0};
+        peer_addr.sin_family = AF_INET;
+        peer_addr.sin_port = htons(PORT_PEER + owner * NODE_PORT_STRIDE);
+        peer_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock >= 0 && connect(sock, (struct sockaddr *)&peer_addr, sizeof(peer_addr)) == 0) 
+        {
+            peer_socks[owner] = sock;
+            snprintf(log_msg, sizeof(log_msg), "Peer link to node %d established", owner);
+            log_event("CLUSTER", log_msg);
+        } 
+        else if (sock >= 0) 
+        {
+            close(sock);
+        }
+    }
+    int result = -1;
+    if (peer_socks[owner] >= 0) 
+    {
+        result = send_all(peer_socks[owner], frame, (size_t)frame_len);
+        if (result < 0) 
+        {
+            close(peer_socks[owner]);
+            peer_socks[owner] = -1;
+        }
+    }
+    pthread_mutex_unlock(&peer_mutex);
+
+    if (result == 0) 
+    {
+        atomic_fetch_add(&decisions_forwarded, 1);
+        snprintf(log_msg, sizeof(log_msg), "Forwarded launch at %s to node %d", location, owner);
+        log_event("CLUSTER", log_msg);
+    } 
+    else 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Node %d unreachable, launching at %s locally", owner, location);
+        log_event("ERROR", log_msg);
+    }
+    return result;
+}
+
+/*This is to act on a launch decision. In a single node run, or when this node owns
+the target, the command goes to this node's silos and submarines. Otherwise
+the decision is handed to the owning node so its effectors launch. */
+void dispatch_launch(const char *location, int priority) 
+{
+    int owner = config.nodes > 1 ? location_owner(location) : config.node_id;
+    if (owner == config.node_id || forward_decision(owner, location, priority) < 0) 
+    {
+        launch_locally(location, priority);
+    }
+}
+
+//This counts a detected threat by its type and location in the stats file.
+static void record_threat(const Intel *intel) 
+{
+    long long now = now_ms();
+    pthread_mutex_lock(&stats_mutex);
+    stats_add(&stats, stat_threats, 1, now);
+    stats_count(&stats, "threat_type", intel->type, 1, now);
+    stats_count(&stats, "threat_location", intel->location, 1, now);
+    pthread_mutex_unlock(&stats_mutex);
+    uint64_t level = (uint64_t)(intel->threat_level > 0 ? intel->threat_level : 0);
+    const char *names[2] = {intel->type, intel->location};
+    repl_append(REPL_THREAT, &level, 1, names, 2);
+}
+
+/*This is to log and evaluate one parsed intelligence report from a sensor unit.
+encrypted is the report as it arrived, or empty if it came in the binary encoding.
+It triggers launch commands when the reported threat is above the critical threshold. */
+void evaluate_intel(uint32_t unit_id, const char *encrypted, const Intel *intel) 
+{
+    char plaintext[BUFFER_SIZE];
+    char log_msg[BUFFER_SIZE];
+
+    if (encrypted[0] == '\0') 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Binary message from unit %u", unit_id);
+        log_event("MESSAGE", log_msg);
+    }
+    else 
+    {
+        //Displays encrypted messages 
+        snprintf(log_msg, sizeof(log_msg), "Encrypted message from unit %u: %s", unit_id, encrypted);
+        log_event("MESSAGE", log_msg);
+
+         //Displays dedcrypted messages
+        caesar_decrypt(encrypted, plaintext, sizeof(plaintext));
+        snprintf(log_msg, sizeof(log_msg), "Decrypted message: %s", plaintext);
+        log_event("MESSAGE", log_msg);
+    }
+
+    snprintf(log_msg, sizeof(log_msg),
+             "Source: %s, Type: %s, Details: %s, Threat Level: %d, Location: %s",
+             intel->source, intel->type, intel->data, intel->threat_level, intel->location);
+    log_event("THREAT", log_msg);
+    atomic_fetch_add(&threats_detected, 1);
+    record_threat(intel);
+
+     /*This triggers a launch command to the missileSilo and submarine if the radar or satellite detects a threat level above 70. */
+    if (intel->threat_level > CRITICAL_THREAT_LEVEL &&
+        (strcmp(intel->source, "Radar") == 0 || strcmp(intel->source, "Satellite") == 0)) 
+    {
+        dispatch_launch(intel->location, intel->threat_level);
+    }
+}
+
+/*This sends a small control frame for the whole connection in a send frame from the pool.
+It is called with clients_mutex held and the caller flushes the backend. It returns 0 or -1. */
+static int send_control(Client *client, uint8_t type, const char *payload, size_t length) 
+{
+    char *buffer = slab_alloc(&frame_pool);
+    if (!buffer) return -1;
+    atomic_init(frame_refs(buffer), 1);
+    int frame_len = frame_encode(buffer, FRAME_REFS_OFFSET, type, UNIT_BROADCAST, payload, length);
+    int result = frame_len < 0 ? -1 : backend->send(client, buffer, buffer, (size_t)frame_len);
+    frame_release(buffer);
+    return result;
+}
+
+/*This hands a connection's owed credit back to the sensor in one CREDIT frame.
+It is called with clients_mutex held and the caller flushes the backend. */
+static void grant_credits(Client *client) 
+{
+    int owed = atomic_exchange(&client->credits_owed, 0);
+    if (owed <= 0 || !client->valid) return;
+    char count[16];
+    int len = snprintf(count, sizeof(count), "%d", owed);
+    if (send_control(client, FRAME_CREDIT, count, (size_t)len) < 0) 
+    {
+        atomic_fetch_add(&client->credits_owed, owed); //Tried again with the next report.
+        return;
+    }
+    atomic_fetch_add(&credits_granted, (unsigned long)owed);
+    atomic_fetch_add(&credit_frames, 1);
+}
+
+/*This records one more report taken in from a sensor connection, and hands the credit
+back once half a window is owed, unless the evaluation queue is congested. */
+static void return_credit(Client *client) 
+{
+    if (client->role != PORT_RADAR && client->role != PORT_SAT) return;
+    if (atomic_fetch_add(&client->credits_owed, 1) + 1 < CREDIT_WINDOW / 2 || atomic_load(&intel_congested)) return;
+    pthread_mutex_lock(&clients_mutex);
+    grant_credits(client);
+    backend->flush();
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+//This hands back the credit held while the queue was congested, to every sensor connection.
+static void resume_credits(void) 
+{
+    pthread_mutex_lock(&clients_mutex);
+    for (int i = 0; i < client_slab.capacity; i++) 
+    {
+        Client *client = slab_at(&client_slab, i);
+        if (client->valid && (client->role == PORT_RADAR || client->role == PORT_SAT)) 
+        {
+            grant_credits(client);
+        }
+    }
+    backend->flush();
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+//This takes a token from a connection's bucket, refilling it for the time since the last report.
+static int take_token(Client *client, long long now) 
+{
+    if (client->tokens_ms == 0) 
+    {
+        client->tokens = config.intel_burst;
+    }
+    else 
+    {
+        client->tokens += (double)(now - client->tokens_ms) * config.intel_rate / 1000.0;
+        if (client->tokens > config.intel_burst) client->tokens = config.intel_burst;
+    }
+    client->tokens_ms = now;
+    if (client->tokens < 1.0) return 0;
+    client->tokens -= 1.0;
+    return 1;
+}
+
+/*This puts a routine report in the evaluation queue. It returns -1 and sheds the report
+if the queue is full or the run is stopping, and marks the queue congested once it is
+three quarters full. */
+static int enqueue_intel(uint32_t unit_id, const char *encrypted, const Intel *intel, long long now) 
+{
+    pthread_mutex_lock(&intel_mutex);
+    if (!atomic_load(&running)) 
+    {
+        pthread_mutex_unlock(&intel_mutex);
+        atomic_fetch_add(&shed_after_stop, 1);
+        return -1;
+    }
+    if (intel_count == config.intel_queue) 
+    {
+        pthread_mutex_unlock(&intel_mutex);
+        atomic_fetch_add(&shed_queue_full, 1);
+        return -1;
+    }
+    QueuedIntel *item = &intel_queue[(intel_head + intel_count) % config.intel_queue];
+    item->unit_id = unit_id;
+    item->queued_ms = now;
+    item->queued_ns = now_ns();
+    item->intel = *intel;
+    snprintf(item->encrypted, sizeof(item->encrypted), "%s", encrypted);
+    intel_count++;
+    intel_queued++;
+    if (intel_count > intel_queue_peak) intel_queue_peak = intel_count;
+    if (intel_count * 4 >= config.intel_queue * 3) atomic_store(&intel_congested, true);
+    pthread_cond_signal(&intel_ready);
+    pthread_mutex_unlock(&intel_mutex);
+    return 0;
+}
+
+/*This is the evaluation worker. It takes routine reports off the queue in arrival order,
+and hands the credit back to the sensors once the queue has drained to a quarter.
+When the run stops it finishes the reports already queued before it returns. */
+void *intel_worker(void *arg) 
+{
+    (void)arg;
+    QueuedIntel item;
+    int last_cpu = -1;
+    pin_thread(&worker_cpus, "evaluation worker");
+    pthread_mutex_lock(&intel_mutex);
+    while (atomic_load(&running) || intel_count > 0) 
+    {
+        if (intel_count == 0) 
+        {
+            pthread_cond_wait(&intel_ready, &intel_mutex);
+            continue;
+        }
+        item = intel_queue[intel_head];
+        intel_head = (intel_head + 1) % config.intel_queue;
+        intel_count--;
+        intel_evaluated++;
+        long long wait = now_ms() - item.queued_ms;
+        intel_wait_total_ms += wait;
+        if (wait > intel_wait_max_ms) intel_wait_max_ms = wait;
+        int cpu = topology_current_cpu();
+        if (last_cpu >= 0 && cpu != last_cpu) atomic_fetch_add(&worker_migrations, 1);
+        last_cpu = cpu;
+        pthread_mutex_lock(&stats_mutex);
+        stats_observe(&stats, stat_queue_wait_ms, wait, item.queued_ms + wait);
+        stats_observe(&stats, stat_handoff_us, (now_ns() - item.queued_ns) / 1000, item.queued_ms + wait);
+        pthread_mutex_unlock(&stats_mutex);
+        bool resume = atomic_load(&intel_congested) && intel_count * 4 <= config.intel_queue;
+        if (resume) atomic_store(&intel_congested, false);
+        pthread_mutex_unlock(&intel_mutex);
+
+        evaluate_intel(item.unit_id, item.encrypted, &item.intel);
+        if (resume) resume_credits();
+        pthread_mutex_lock(&intel_mutex);
+    }
+    pthread_mutex_unlock(&intel_mutex);
+    return NULL;
+}
+
+/*This is to admit one decoded intelligence report from a sensor unit. A critical
+report from a radar or satellite is evaluated straight away, so it never waits behind
+routine ones. Routine reports are rate limited per connection and queued for the worker. */
+static void admit_intel(Client *client, uint32_t unit_id, const char *encrypted, const Intel *intel) 
+{
+    long long now = now_ms();
+    if (!atomic_load(&running)) 
+    {
+        atomic_fetch_add(&shed_after_stop, 1);
+    }
+    else if (intel->threat_level > CRITICAL_THREAT_LEVEL &&
+        (strcmp(intel->source, "Radar") == 0 || strcmp(intel->source, "Satellite") == 0)) 
+    {
+        atomic_fetch_add(&intel_critical, 1);
+        evaluate_intel(unit_id, encrypted, intel);
+    }
+    else if (!take_token(client, now)) 
+    {
+        atomic_fetch_add(&shed_rate_limited, 1);
+    }
+    else 
+    {
+        enqueue_intel(unit_id, encrypted, intel, now);
+    }
+}
+
+//This is to decrypt, parse and admit one text intelligence report from a sensor unit.
+void process_intel(Client *client, uint32_t unit_id, const char *payload, uint32_t length) 
+{
+    char buffer[FRAME_MAX_PAYLOAD + 1];
+    char plaintext[BUFFER_SIZE];
+    char log_msg[BUFFER_SIZE];
+    Intel intel;
+    long long started = now_ns();
+
+    memcpy(buffer, payload, length);
+    buffer[length] = '\0';
+    caesar_decrypt(buffer, plaintext, sizeof(plaintext));
+
+    /*Parses and processes important details to form as an intelligence report*/
+    int parsed = parse_intel(plaintext, &intel);
+    atomic_fetch_add(&intel_text_decode_ns, (unsigned long)(now_ns() - started));
+    atomic_fetch_add(&intel_text_frames, 1);
+    atomic_fetch_add(&intel_text_bytes, length);
+    if (!parsed) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Invalid message from %s:%d: %s", client->ip, client->port, plaintext);
+        log_event("ERROR", log_msg);
+    }
+    else 
+    {
+        admit_intel(client, unit_id, buffer, &intel);
+    }
+    return_credit(client);
+}
+
+//This copies a decoded name into a fixed Intel field, cutting it short if it does not fit.
+static void copy_name(char *out, size_t size, const WireName *name) 
+{
+    size_t length = name->length < size - 1 ? name->length : size - 1;
+    memcpy(out, name->text, length);
+    out[length] = '\0';
+}
+
+/*This is to decode and admit one binary intelligence report. The fields are IDs into
+the name table, so decoding is a few lookups and copies with no decryption or parsing. */
+void process_intel_binary(Client *client, uint32_t unit_id, const char *payload, uint32_t length) 
+{
+    char log_msg[BUFFER_SIZE];
+    WireIntel wire;
+    Intel intel;
+    long long started = now_ns();
+
+    int decoded = client->codec && wire_decode_intel(payload, length, &wire) == 0;
+    if (decoded) 
+    {
+        copy_name(intel.source, sizeof(intel.source), &wire.source);
+        copy_name(intel.type, sizeof(intel.type), &wire.type);
+        copy_name(intel.data, sizeof(intel.data), &wire.data);
+        copy_name(intel.location, sizeof(intel.location), &wire.location);
+        intel.threat_level = wire.threat_level;
+    }
+    atomic_fetch_add(&intel_binary_decode_ns, (unsigned long)(now_ns() - started));
+    atomic_fetch_add(&intel_binary_frames, 1);
+    atomic_fetch_add(&intel_binary_bytes, length);
+    if (!decoded) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Invalid binary message (%u bytes) from %s:%d", length,
+                 client->ip, client->port);
+        log_event("ERROR", log_msg);
+    }
+    else 
+    {
+        admit_intel(client, unit_id, "", &intel);
+    }
+    return_credit(client);
+}
+
+/*This agrees to the binary codec for a connection the first time one of its HELLO frames
+offers a version this server speaks, and tells the client with a CODEC frame. A client
+that offers nothing, or a version this server does not know, stays on the text encoding.
+It is called with clients_mutex held. */
+static void negotiate_codec(Client *client, const char *payload, uint32_t length) 
+{
+    char hello[64];
+    char log_msg[256];
+    if (client->codec || length >= sizeof(hello)) return;
+    memcpy(hello, payload, length);
+    hello[length] = '\0';
+    char *offer = strstr(hello, CODEC_OFFER);
+    if (!offer || atoi(offer + strlen(CODEC_OFFER)) != WIRE_VERSION) return;
+
+    char version = WIRE_VERSION;
+    if (send_control(client, FRAME_CODEC, &version, 1) < 0) return; //Offered again by the next HELLO.
+    backend->flush();
+    client->codec = WIRE_VERSION;
+    snprintf(log_msg, sizeof(log_msg), "%s:%d using binary codec version %d", client->ip, client->port, WIRE_VERSION);
+    log_event("CONNECTION", log_msg);
+}
+
+/*This counts a unit registering with a standby that has taken over, to time how long
+the failover took for the units to come back. clients_mutex is held. */
+static void note_failover_unit(void) 
+{
+    if (!failover_cause) return;
+    long long now = now_ms();
+    failover_units_back++;
+    if (failover_first_unit_ms == 0) failover_first_unit_ms = now;
+    if (failover_complete_ms == 0 && failover_units_back >= failover_expected_units) 
+    {
+        failover_complete_ms = now;
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "All %d units back %lld ms after the primary was lost",
+                 failover_units_back, now - failover_lost_ms);
+        log_event("FAILOVER", log_msg);
+    }
+}
+
+/*This is to process an OUTCOME frame from an effector connection. Each entry is one
+flight that ended, counted by the connection's effector type and result. */
+void process_outcomes(Client *client, const char *payload, uint32_t length) 
+{
+    char entries[FRAME_MAX_PAYLOAD + 1];
+    char log_msg[256];
+    memcpy(entries, payload, length);
+    entries[length] = '\0';
+    int type = client->role == PORT_SUB;
+    char *cursor = entries;
+    char *end = entries;
+
+    while (*cursor && (client->role == PORT_SILO || client->role == PORT_SUB)) 
+    {
+        unsigned long unit = strtoul(cursor, &end, 10);
+        if (end == cursor || *end != ':') break;
+        unsigned long seq = strtoul(end + 1, &end, 10);
+        if (*end != ':' || (end[1] != OUTCOME_DESTROYED && end[1] != OUTCOME_SURVIVED && end[1] != OUTCOME_MISSED) ||
+            end[2] != ':') break;
+        char result = end[1];
+        long long flight_ms = strtoll(end + 3, &end, 10);
+        const char *seen = result == OUTCOME_DESTROYED ? "destroyed" : result == OUTCOME_SURVIVED ? "survived" : "missed";
+
+        pthread_mutex_lock(&stats_mutex);
+        outcomes[type][result == OUTCOME_DESTROYED ? 0 : result == OUTCOME_SURVIVED ? 1 : 2]++;
+        flight_total_ms += flight_ms;
+        if (flight_ms > flight_max_ms) flight_max_ms = flight_ms;
+        stats_observe(&stats, stat_flight_ms, flight_ms, now_ms());
+        pthread_mutex_unlock(&stats_mutex);
+        snprintf(log_msg, sizeof(log_msg), "%s unit %lu (command %lu): target %s after %lld ms",
+                 type ? "Submarine" : "Missile Silo", unit, seq, seen, flight_ms);
+        log_event("OUTCOME", log_msg);
+        if (*end != ',') break;
+        cursor = end + 1;
+    }
+
+    pthread_mutex_lock(&stats_mutex);
+    outcome_frames++;
+    pthread_mutex_unlock(&stats_mutex);
+    if (*end != '\0' || (client->role != PORT_SILO && client->role != PORT_SUB)) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Malformed OUTCOME frame from %s:%d", client->ip, client->port);
+        log_event("ERROR", log_msg);
+    }
+}
+
+/*This answers a client's offer of shared-memory rings (see shmRing.h). With --shm the
+segment it names is mapped, and once the answer has gone out on the socket every frame to
+and from the connection goes through the rings. Otherwise, or if the segment cannot be
+mapped, the answer is a refusal and the connection carries on over TCP. */
+static void attach_ring(Client *client, const char *payload, uint32_t length) 
+{
+    char name[SHM_NAME_SIZE];
+    char log_msg[256];
+    ShmLink shm = {0};
+    const char *refused = NULL;
+    if (!config.shm) refused = "not enabled (--shm)";
+    else if (client->role == PORT_PEER || client->shm.segment || length >= sizeof(name)) refused = "unexpected offer";
+    else 
+    {
+        memcpy(name, payload, length);
+        name[length] = '\0';
+        if (shm_link_open(&shm, name) < 0) refused = strerror(errno);
+    }
+
+    char answer = refused ? '0' : SHM_ACCEPTED;
+    pthread_mutex_lock(&clients_mutex);
+    int sent = send_control(client, FRAME_SHM, &answer, 1) == 0;
+    backend->flush();
+    if (!refused && sent) client->shm = shm;
+    pthread_mutex_unlock(&clients_mutex);
+    if (!refused && !sent) shm_link_close(&shm);
+
+    if (refused) 
+    {
+        atomic_fetch_add(&ring_refused, 1);
+        snprintf(log_msg, sizeof(log_msg), "Shared-memory rings from %s:%d refused: %s", client->ip, client->port, refused);
+    }
+    else 
+    {
+        atomic_fetch_add(&ring_clients, 1);
+        snprintf(log_msg, sizeof(log_msg), "%s:%d using shared-memory rings %s", client->ip, client->port, name);
+    }
+    log_event("CONNECTION", log_msg);
+}
+
+/*This is to act on one frame from a client. HELLO frames register the logical
+units that share the connection and may offer the binary codec, INTEL frames carry
+their reports in either encoding, ACK frames acknowledge commands and OUTCOME
+frames say how the launches ended. SHM frames offer shared-memory rings or ring their
+doorbell. DECISION frames are only accepted from other nodes on the peer port. */
+void process_frame(Client *client, const FrameHeader *header, const char *payload) 
+{
+    char log_msg[256];
+    char decision[128];
+    char ciphertext[128];
+    char *location;
+    switch (header->type) 
+    {
+        case FRAME_DECISION:
+            if (client->role != PORT_PEER || header->length >= sizeof(ciphertext)) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Rejected decision frame from %s:%d", client->ip, client->port);
+                log_event("ERROR", log_msg);
+                break;
+            }
+            memcpy(ciphertext, payload, header->length);
+            ciphertext[header->length] = '\0';
+            caesar_decrypt(ciphertext, decision, sizeof(decision));
+            int priority = (int)strtol(decision, &location, 10);
+            if (*location != '|') 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Malformed decision from node %u", header->unit_id);
+                log_event("ERROR", log_msg);
+                break;
+            }
+            location++;
+            snprintf(log_msg, sizeof(log_msg), "Node %u forwarded launch at %s", header->unit_id, location);
+            log_event("CLUSTER", log_msg);
+            atomic_fetch_add(&decisions_received, 1);
+            launch_locally(location, priority);
+            break;
+        case FRAME_HELLO:
+            pthread_mutex_lock(&clients_mutex);
+            client->units++;
+            repl_client(client, client->units);
+            note_failover_unit();
+            negotiate_codec(client, payload, header->length);
+            int armed = config.assign_window_ms <= 0 || (client->role != PORT_SILO && client->role != PORT_SUB) ||
+                        assign_add_effector(&assignment, client, header->unit_id,
+                                            client->role == PORT_SUB ? ASSIGN_SUB : ASSIGN_SILO) == 0;
+            pthread_mutex_unlock(&clients_mutex);
+            if (!armed) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Effector inventory full (--max-effectors %d), unit %u on %s:%d is not assigned targets",
+                         config.max_effectors, header->unit_id, client->ip, client->port);
+                log_event("ERROR", log_msg);
+            }
+            snprintf(log_msg, sizeof(log_msg), "Unit %u (%.*s) registered on %s:%d", header->unit_id,
+                     (int)(header->length < 32 ? header->length : 32), payload, client->ip, client->port);
+            log_event("CONNECTION", log_msg);
+            break;
+        case FRAME_INTEL:
+            process_intel(client, header->unit_id, payload, header->length);
+            break;
+        case FRAME_INTEL_BIN:
+            process_intel_binary(client, header->unit_id, payload, header->length);
+            break;
+        case FRAME_ACK:
+            process_acks(client, payload, header->length);
+            break;
+        case FRAME_OUTCOME:
+            process_outcomes(client, payload, header->length);
+            break;
+        case FRAME_SHM:
+            if (header->length > 0) attach_ring(client, payload, header->length);
+            break; //An empty one is a doorbell, and the ring is read once the socket has been.
+        default:
+            snprintf(log_msg, sizeof(log_msg), "Unexpected frame type %u from %s:%d",
+                     header->type, client->ip, client->port);
+            log_event("ERROR", log_msg);
+            break;
+    }
+}
+
+/*This is to process every complete frame at the start of data. It returns the number
+of bytes used, leaving any partial frame for the next receive, or -1 on an invalid frame. */
+int consume_frames(Client *client, const char *data, size_t used) 
+{
+    size_t offset = 0;
+    int consumed;
+    FrameHeader header;
+    const char *payload;
+    while ((consumed = frame_parse(data + offset, used - offset, &header, &payload)) > 0) 
+    {
+        process_frame(client, &header, payload);
+        atomic_fetch_add(&frames_received, 1);
+        offset += (size_t)consumed;
+    }
+    if (consumed < 0) 
+    {
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg), "Invalid frame from %s:%d, closing connection", 
+                 client->ip, client->port);
+        log_event("ERROR", log_msg);
+        return -1;
+    }
+    return (int)offset;
+}
+
+/*This processes every record waiting in a connection's ring. A record is what the client
+put in the ring with one send and holds whole frames, which are parsed in place. It returns
+0, or -1 on an invalid record, which includes one whose length runs past the ring. */
+static int consume_ring(Client *client) 
+{
+    size_t length;
+    const char *record;
+    while ((record = shm_link_peek(&client->shm, &length)) != NULL) 
+    {
+        int consumed = consume_frames(client, record, length);
+        if (consumed < 0) return -1;
+        if (shm_link_release(&client->shm, length) < 0 || (size_t)consumed != length) break;
+    }
+    if (record || length == SHM_INVALID) 
+    {
+        char log_msg[256];
+        snprintf(log_msg, sizeof(log_msg), "Invalid ring record from %s:%d, closing connection",
+                 client->ip, client->port);
+        log_event("ERROR", log_msg);
+        return -1;
+    }
+    return 0;
+}
+
+/*This puts a frame for a client in its ring instead of on its socket. The doorbell, an
+empty SHM frame, is only sent when the client has said it is waiting for one. clients_mutex
+is held by every sender, so the ring has one producer at a time. It returns 0 or -1. */
+static int ring_send(Client *client, const char *frame, size_t length) 
+{
+    int wake = shm_link_send(&client->shm, frame, length);
+    if (wake < 0) return -1;
+    atomic_fetch_add(&frames_sent, 1);
+    if (wake == 0) return 0;
+    char doorbell[FRAME_HEADER_SIZE];
+    int doorbell_len = frame_encode(doorbell, sizeof(doorbell), FRAME_SHM, UNIT_BROADCAST, "", 0);
+    atomic_fetch_add(&io_syscalls, 1);
+    return send_all(client->sock, doorbell, (size_t)doorbell_len);
+}
+
+/*This is to cleanup the disconnection process. The receive frame and the
+connection object both go back to their pools for the next client. The socket is
+closed under clients_mutex once the connection is invalid, because a command fan-out
+may be sending on it, and a descriptor closed under it could already belong to the
+next connection accepted. */
+void release_client(Client *client, char *buffer) 
+{
+    if (buffer) slab_free(&frame_pool, buffer);
+    pthread_mutex_lock(&clients_mutex);
+    client->valid = false;
+    close(client->sock);
+#ifdef USE_TLS
+    if (client->tls) 
+    {
+        SSL_free(client->tls);
+        pthread_mutex_destroy(&client->tls_lock);
+    }
+#endif
+    if (client->shm.segment) 
+    {
+        ring_records_in += client->shm.records_received;
+        ring_records_out += client->shm.records_sent;
+        ring_doorbells += client->shm.doorbells;
+        ring_full += client->shm.full;
+        shm_link_close(&client->shm);
+    }
+    inflight_drop_client(client);
+    if (config.assign_window_ms > 0) assign_remove_owner(&assignment, client);
+    if (client->units > 0) repl_client(client, 0);
+    if (atomic_fetch_sub(&client_count, 1) == 1) pthread_cond_broadcast(&clients_closed);
+    slab_free(&client_slab, client);
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+//This raises a running maximum that several threads update.
+static void atomic_max(atomic_ulong *max, unsigned long value) 
+{
+    unsigned long seen = atomic_load(max);
+    while (value > seen && !atomic_compare_exchange_weak(max, &seen, value)) 
+    {
+    }
+}
+
+//This records how long received bytes waited after the kernel time stamped their arrival.
+static void record_wake(int role, struct msghdr *msg) 
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) 
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS) continue;
+        struct timespec arrived;
+        struct timespec now;
+        memcpy(&arrived, CMSG_DATA(cmsg), sizeof(arrived));
+        clock_gettime(CLOCK_REALTIME, &now);
+        long long waited = (long long)(now.tv_sec - arrived.tv_sec) * 1000000000LL + (now.tv_nsec - arrived.tv_nsec);
+        if (waited < 0) return;
+        atomic_fetch_add(&rx_count[role], 1);
+        atomic_fetch_add(&rx_wake_total_ns[role], (unsigned long)waited);
+        atomic_max(&rx_wake_max_ns[role], (unsigned long)waited);
+        pthread_mutex_lock(&stats_mutex);
+        stats_observe(&stats, stat_rx_wake_us, waited / 1000, now_ms());
+        pthread_mutex_unlock(&stats_mutex);
+        return;
+    }
+}
+
+#ifdef USE_TLS
+/*This runs the server's side of the TLS handshake of --tls on a new connection. Only then
+is the connection made valid, since a command fan-out that wrote to it in the meantime would
+break the handshake. It returns 0, or -1 if the connection is to be closed. */
+static int tls_accept(Client *client) 
+{
+    char error[256];
+    char log_msg[512];
+    long long started = now_ns();
+    SSL *ssl = tls_handshake(tls_ctx, client->sock, 1, error, sizeof(error));
+    if (!ssl) 
+    {
+        atomic_fetch_add(&tls_failures, 1);
+        snprintf(log_msg, sizeof(log_msg), "TLS handshake with %s:%d failed: %s, closing connection",
+                 client->ip, client->port, error);
+        log_event("ERROR", log_msg);
+        return -1;
+    }
+    int kernel_send = tls_ktls_send(ssl);
+    int kernel_recv = tls_ktls_recv(ssl);
+    atomic_fetch_add(&tls_handshakes, 1);
+    atomic_fetch_add(&tls_handshake_ns, (unsigned long)(now_ns() - started));
+    atomic_fetch_add(&tls_kernel_send, (unsigned long)kernel_send);
+    atomic_fetch_add(&tls_kernel_recv, (unsigned long)kernel_recv);
+
+    pthread_mutex_init(&client->tls_lock, NULL);
+    pthread_mutex_lock(&clients_mutex);
+    client->tls = ssl;
+    client->valid = true;
+    pthread_mutex_unlock(&clients_mutex);
+    snprintf(log_msg, sizeof(log_msg), "%s:%d using %s with %s, records sent by the %s and received by the %s",
+             client->ip, client->port, SSL_get_version(ssl), SSL_get_cipher_name(ssl),
+             kernel_send ? "kernel" : "process", kernel_recv ? "kernel" : "process");
+    log_event("CONNECTION", log_msg);
+    return 0;
+}
+
+/*This receives on a TLS connection. Its socket is non-blocking, so the thread only holds
+tls_lock while OpenSSL reads and waits in poll without it, leaving senders free to write. */
+static ssize_t tls_receive(Client *client, char *data, size_t size) 
+{
+    for (;;) 
+    {
+        pthread_mutex_lock(&client->tls_lock);
+        ssize_t bytes = tls_read(client->tls, client->sock, data, size);
+        int saved = errno;
+        pthread_mutex_unlock(&client->tls_lock);
+        atomic_fetch_add(&io_syscalls, 1);
+        if (bytes >= 0 || saved != EAGAIN) 
+        {
+            errno = saved;
+            return bytes;
+        }
+        struct pollfd fd = {client->sock, POLLIN, 0};
+        poll(&fd, 1, -1);
+        atomic_fetch_add(&io_syscalls, 1);
+    }
+}
+#endif
+
+/*This logs a packet from a local client that did not fit its receive buffer. The kernel
+drops the rest of such a packet, so its last frame is cut short and the connection is
+closed as a protocol error. It returns -1. */
+static int truncated_packet(const Client *client) 
+{
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Truncated packet from %s:%d, closing connection", client->ip, client->port);
+    log_event("ERROR", log_msg);
+    return -1;
+}
+
+/*This receives into a connection's buffer like recv. With spin_us 0 it blocks. Otherwise
+it retries a non-blocking receive for up to spin_us microseconds and then parks in poll
+until the socket is readable, and starts spinning again after the next wake-up. TLS
+connections are always read by tls_receive. */
+static ssize_t receive_bytes(Client *client, int role, int spin_us, char *data, size_t size) 
+{
+#ifdef USE_TLS
+    if (client->tls) return tls_receive(client, data, size);
+#endif
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct iovec iov = {data, size};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    long long spin_started = 0;
+    ssize_t bytes;
+    for (;;) 
+    {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        bytes = recvmsg(client->sock, &msg, spin_us > 0 ? MSG_DONTWAIT : 0);
+        atomic_fetch_add(&io_syscalls, 1);
+        if (bytes >= 0 || spin_us == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) break;
+
+        long long now = now_ns();
+        if (spin_started == 0) 
+        {
+            spin_started = now;
+        }
+        else if (now - spin_started >= spin_us * 1000LL) 
+        {
+            atomic_fetch_add(&spin_ns[role], (unsigned long)(now - spin_started));
+            atomic_fetch_add(&spin_parks[role], 1);
+            spin_started = 0;
+            struct pollfd fd = {client->sock, POLLIN, 0};
+            poll(&fd, 1, -1);
+            atomic_fetch_add(&io_syscalls, 1);
+        }
+        else 
+        {
+            CPU_RELAX();
+        }
+    }
+    if (spin_started) 
+    {
+        atomic_fetch_add(&spin_ns[role], (unsigned long)(now_ns() - spin_started));
+        if (bytes > 0) atomic_fetch_add(&spin_hits[role], 1);
+    }
+    if (bytes > 0 && (msg.msg_flags & MSG_TRUNC)) 
+    {
+        errno = EMSGSIZE;
+        return truncated_packet(client);
+    }
+    if (bytes > 0) record_wake(role, &msg);
+    return bytes;
+}
+
+/*This is called before the thread of a connection on rings waits on its socket. When the
+role is busy polled the ring is watched for spin_us first, as the socket would have been.
+It returns 1 once the ring is empty and marked as sleeping, so the client rings the
+doorbell with its next record, or 0 if records arrived and are to be read first. */
+static int ring_idle(Client *client, int spin_us) 
+{
+    size_t length;
+    if (spin_us > 0) 
+    {
+        long long give_up = now_ns() + spin_us * 1000LL;
+        while (!shm_link_peek(&client->shm, &length) && length != SHM_INVALID) 
+        {
+            if (now_ns() >= give_up) return shm_link_idle(&client->shm);
+            CPU_RELAX();
+        }
+        return 0;
+    }
+    return shm_link_idle(&client->shm);
+}
+
+/*This is to communicate with one of the clients and display
+its messages with encrypted and decrypted logs and connection status. 
+The bytes received are collected in the connection's pool buffer until
+they form complete frames, since one recv may hold several frames or part of one. */
+void *handle_client(void *arg) 
+{
+    Client *client = (Client *)arg;
+    int client_sock = client->sock;
+    char log_msg[BUFFER_SIZE];
+    pin_thread(&io_cpus, "client");
+
+    /*Every connection has its receives time stamped, and one of a busy polled role asks the
+    kernel to busy poll as well. That needs CAP_NET_ADMIN beyond net.core.busy_read, and
+    without it the thread still spins in user space, which is logged once. */
+    int role = client->role == PORT_RADAR || client->role == PORT_SAT ? POLL_SENSORS : POLL_EFFECTORS;
+    int spin_us = role == POLL_SENSORS ? config.busy_poll_sensors_us : config.busy_poll_effectors_us;
+    int on = 1;
+    setsockopt(client_sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    if (spin_us > 0 && setsockopt(client_sock, SOL_SOCKET, SO_BUSY_POLL, &spin_us, sizeof(spin_us)) < 0 &&
+        !atomic_exchange(&busy_poll_refused, true)) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "SO_BUSY_POLL refused (%s), spinning in user space only", strerror(errno));
+        log_event("ERROR", log_msg);
+    }
+
+    //This is to log new intelligence messages from a different client.
+    snprintf(log_msg, sizeof(log_msg), "Client connected from %s:%d", 
+             client->ip, client->port);
+    log_event("CONNECTION", log_msg);
+#ifdef USE_TLS
+    if (config.tls && client->role != PORT_PEER && tls_accept(client) < 0) 
+    {
+        release_client(client, NULL);
+        return NULL;
+    }
+#endif
+
+    //Each connection holds one receive frame from the pool for as long as it stays open.
+    char *buffer = slab_alloc(&frame_pool);
+    if (!buffer) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Frame pool exhausted, dropping %s:%d", 
+                 client->ip, client->port);
+        log_event("ERROR", log_msg);
+    }
+
+    /*This to continue to simulate until the connection ends, either because the client closes
+    it after the END frame, the drain shuts it down or an error or disconnection occurs. */
+    size_t used = 0;
+    while (buffer) 
+    {
+        //A connection on rings gets its frames from its ring, and only doorbells on the socket.
+        if (client->shm.segment) 
+        {
+            if (consume_ring(client) < 0) break;
+            if (!ring_idle(client, spin_us)) continue;
+        }
+        ssize_t bytes = receive_bytes(client, role, spin_us, buffer + used, FRAME_BUFFER_SIZE - used);
+        if (bytes <= 0) 
+        {
+            snprintf(log_msg, sizeof(log_msg), "Client %s:%d disconnected: %s", 
+                     client->ip, client->port, bytes == 0 ? "closed connection" : strerror(errno));
+            log_event("CONNECTION", log_msg);
+            break;
+        }
+        used += (size_t)bytes;
+
+        //This processes every complete frame and keeps any partial frame for the next recv.
+        int offset = consume_frames(client, buffer, used);
+        if (offset < 0) break;
+        memmove(buffer, buffer + offset, used - (size_t)offset);
+        used -= (size_t)offset;
+    }
+    release_client(client, buffer);
+    return NULL;
+}
+
+/*This waits up to ms for SIGINT or SIGTERM. main blocks both signals before it starts
+any thread, so they stay pending until a wait here takes them. It returns 1 once a stop
+has been asked for, so sleeps end as soon as it is. */
+static int wait_for_stop(long long ms) 
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    long long deadline = now_ms() + ms;
+    while (!atomic_load(&stop_requested)) 
+    {
+        long long left = deadline - now_ms();
+        if (left < 0) left = 0;
+        struct timespec timeout = {(time_t)(left / 1000), (long)(left % 1000) * 1000000L};
+        int signal_number = sigtimedwait(&signals, NULL, &timeout);
+        if (signal_number < 0 && left == 0) return 0;
+        if (signal_number == SIGINT || signal_number == SIGTERM) 
+        {
+            atomic_store(&stop_requested, true);
+            stop_reason = signal_number == SIGINT ? "stopped by SIGINT" : "stopped by SIGTERM";
+            log_event("SHUTDOWN", "Stop signal received, draining");
+        }
+    }
+    return 1;
+}
+
+/*This ends every connection at the end of the run. Anything the backend still has queued
+is flushed and every client is sent an END frame, which it answers by sending its last
+ACKs and closing, so the connection is released by its own thread or completion. Those
+still open after DRAIN_TIMEOUT_MS are shut down, never closed from here, so no socket is
+closed while its thread may still use it. It returns once every client has been released. */
+static void drain_clients(void) 
+{
+    long long started = now_ms();
+    pthread_mutex_lock(&clients_mutex);
+    for (int i = 0; i < client_slab.capacity; i++) 
+    {
+        Client *client = slab_at(&client_slab, i);
+        if (!client->valid) continue;
+        if (client->role == PORT_PEER) 
+        {
+            shutdown(client->sock, SHUT_RDWR); //Peer nodes only send on their links and never read END.
+        }
+        else if (send_control(client, FRAME_END, stop_reason, strlen(stop_reason)) == 0) 
+        {
+            drain_closed++;
+        }
+    }
+    backend->flush();
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += DRAIN_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (long)(DRAIN_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) 
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (atomic_load(&client_count) > 0) 
+    {
+        if (pthread_cond_timedwait(&clients_closed, &clients_mutex, &deadline) == ETIMEDOUT) break;
+    }
+
+    //This shuts down the connections whose clients did not close in time and waits for their release.
+    for (int i = 0; i < client_slab.capacity && atomic_load(&client_count) > 0; i++) 
+    {
+        Client *client = slab_at(&client_slab, i);
+        if (!client->valid) continue;
+        shutdown(client->sock, SHUT_RDWR);
+        drain_forced++;
+    }
+    while (atomic_load(&client_count) > 0) 
+    {
+        pthread_cond_wait(&clients_closed, &clients_mutex);
+    }
+    pthread_mutex_unlock(&clients_mutex);
+    drain_closed = drain_closed > drain_forced ? drain_closed - drain_forced : 0;
+    drain_ms = now_ms() - started;
+}
+
+/*This applies one record from the primary to the standby's copy of the run. Threats and
+decisions are logged as REPLICA events and threats counted in the stats file as well, so
+the standby's log and stats carry the whole run if it takes over. */
+static void replica_apply(const ReplRecord *record) 
+{
+    char log_msg[256];
+    char first[WIRE_NAME_MAX + 1];
+    char second[WIRE_NAME_MAX + 1];
+    uint64_t values[REPL_MAX_VALUES];
+    WireName names[REPL_MAX_NAMES];
+    int name_count = record->type == REPL_THREAT ? 2 : record->type == REPL_DECISION ? 1 : 0;
+    if (repl_decode(record, values, names, name_count) < 0) 
+    {
+        replica_corrupt++;
+        snprintf(log_msg, sizeof(log_msg), "Malformed replication record of type %u", record->type);
+        log_event("ERROR", log_msg);
+        return;
+    }
+    replica_records++;
+    switch (record->type) 
+    {
+        case REPL_START:
+            snprintf(log_msg, sizeof(log_msg), "Following primary node %llu (replication version %llu), "
+                     "its run started %lld ms ago", (unsigned long long)values[1], (unsigned long long)values[0],
+                     wall_ms() - (long long)values[2]);
+            log_event("REPLICATION", log_msg);
+            break;
+        case REPL_COUNTERS:
+            atomic_store(&run_end_wall_ms, (long long)values[REPL_END_WALL_MS]);
+            atomic_store(&threats_detected, (int)values[REPL_THREATS]);
+            atomic_store(&commands_issued, (int)values[REPL_COMMANDS]);
+            atomic_store(&command_seq, (unsigned long)values[REPL_COMMAND_SEQ]);
+            commands_acked = (unsigned long)values[REPL_COMMANDS_ACKED];
+            atomic_store(&decisions_forwarded, (int)values[REPL_DECISIONS_FORWARDED]);
+            atomic_store(&decisions_received, (int)values[REPL_DECISIONS_RECEIVED]);
+            break;
+        case REPL_THREAT:
+            copy_name(first, sizeof(first), &names[0]);
+            copy_name(second, sizeof(second), &names[1]);
+            snprintf(log_msg, sizeof(log_msg), "Threat Level: %llu, Type: %s, Location: %s",
+                     (unsigned long long)values[0], first, second);
+            log_event("REPLICA", log_msg);
+            stats_add(&stats, stat_threats, 1, now_ms());
+            stats_count(&stats, "threat_type", first, 1, now_ms());
+            stats_count(&stats, "threat_location", second, 1, now_ms());
+            break;
+        case REPL_DECISION:
+            copy_name(first, sizeof(first), &names[0]);
+            snprintf(log_msg, sizeof(log_msg), "Command %llu: launch at %s, priority %llu",
+                     (unsigned long long)values[0], first, (unsigned long long)values[1]);
+            log_event("REPLICA", log_msg);
+            break;
+        case REPL_CLIENT:
+            if (values[0] < (uint64_t)config.max_clients) replica_units[values[0]] = (int)values[2];
+            break;
+        case REPL_END:
+            replica_ended = true;
+            break;
+    }
+}
+
+/*This is the standby. It listens on the replication socket, appends everything the primary
+sends to the replica file and applies it, until the primary ends the run (it returns 0, as
+it does on a stop signal) or is lost, by the stream closing or REPL_TIMEOUT_MS without a
+record, in which case it returns 1 and main carries on as the server on the standby ports. */
+static int run_standby(void) 
+{
+    static unsigned char rx[REPL_BUFFER_SIZE];
+    char log_msg[256];
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", repl_path);
+    unlink(repl_path);
+    replica_units = calloc((size_t)config.max_clients, sizeof(int));
+    int listen_sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (!replica_units || listen_sock < 0 || bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(listen_sock, 1) < 0) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Failed to listen for the primary on %s: %s", repl_path, strerror(errno));
+        log_event("ERROR", log_msg);
+        if (listen_sock >= 0) close(listen_sock);
+        return 0;
+    }
+    FILE *replica_fp = fopen(replica_path, "wb");
+    if (!replica_fp) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Failed to create replica file %s, continuing without it", replica_path);
+        log_event("ERROR", log_msg);
+    }
+    snprintf(log_msg, sizeof(log_msg), "Standby waiting for the primary on %s", repl_path);
+    log_event("STARTUP", log_msg);
+
+    int conn = -1;
+    size_t used = 0;
+    long long last_record_ms = 0;
+    int takeover = -1;
+    while (takeover < 0) 
+    {
+        struct pollfd fd = {conn >= 0 ? conn : listen_sock, POLLIN, 0};
+        int ready = poll(&fd, 1, REPL_POLL_MS);
+        long long now = now_ms();
+        if (wait_for_stop(0)) 
+        {
+            takeover = 0;
+        }
+        else if (conn < 0) 
+        {
+            if (ready > 0 && (conn = accept(listen_sock, NULL, NULL)) >= 0) 
+            {
+                last_record_ms = now;
+                used = 0;
+                log_event("REPLICATION", "Primary connected");
+            }
+        }
+        else if (ready > 0) 
+        {
+            ssize_t bytes = recv(conn, rx + used, sizeof(rx) - used, 0);
+            if (bytes <= 0) 
+            {
+                failover_cause = "replication stream closed";
+                failover_lost_ms = now;
+                takeover = 1;
+                break;
+            }
+            if (replica_fp) 
+            {
+                fwrite(rx + used, 1, (size_t)bytes, replica_fp);
+                fflush(replica_fp);
+            }
+            replica_bytes += (unsigned long)bytes;
+            used += (size_t)bytes;
+            last_record_ms = now;
+
+            size_t offset = 0;
+            ReplRecord record;
+            int consumed;
+            while ((consumed = repl_parse(rx + offset, used - offset, &record)) > 0) 
+            {
+                replica_apply(&record);
+                offset += (size_t)consumed;
+            }
+            memmove(rx, rx + offset, used - offset);
+            used -= offset;
+            if (consumed < 0) 
+            {
+                //The primary reconnects and starts again from a snapshot once its send fails.
+                replica_corrupt++;
+                log_event("ERROR", "Corrupt replication stream, waiting for the primary to reconnect");
+                close(conn);
+                conn = -1;
+            }
+            else if (replica_ended) 
+            {
+                takeover = 0;
+            }
+        }
+        else if (now - last_record_ms > REPL_TIMEOUT_MS) 
+        {
+            failover_cause = "heartbeat timeout";
+            failover_lost_ms = last_record_ms;
+            takeover = 1;
+        }
+    }
+    if (conn >= 0) close(conn);
+    close(listen_sock);
+    unlink(repl_path);
+    if (replica_fp) fclose(replica_fp);
+
+    if (takeover == 0) 
+    {
+        log_event("REPLICATION", replica_ended ? "Primary ended the run normally, standing down"
+                                               : "Stop requested, standing down");
+        return 0;
+    }
+    failover_detected_ms = now_ms();
+    failover_unconfirmed = (long)atomic_load(&commands_issued) - (long)commands_acked;
+    for (int i = 0; i < config.max_clients; i++) 
+    {
+        failover_expected_units += replica_units[i];
+    }
+    snprintf(log_msg, sizeof(log_msg), "Primary lost (%s) %lld ms after its last record, "
+             "taking over with %d units to come back", failover_cause, failover_detected_ms - failover_lost_ms,
+             failover_expected_units);
+    log_event("FAILOVER", log_msg);
+    return 1;
+}
+
+//This is to start a test mode for simulating scenarios of different types of  air and sea threats. 
+void simulate_war_test(void) 
+{
+    const char *threat_types[] = {"Air", "Sea"};
+    const char *threat_data[] = {"Enemy Aircraft", "Ballistic Missile", "Enemy Submarine", "Naval Fleet"};
+    const char *locations[] = {"North Atlantic", "Norwegian Sea", "English Channel", "Arctic Ocean"};
+    Intel intel;
+    char log_msg[BUFFER_SIZE];
+
+    //This for loop receive threats randomy during a test mode. It receives 3 Intelligence reports.
+    for (int i = 0; i < 3 && atomic_load(&running); i++) 
+    {
+        snprintf(intel.source, sizeof(intel.source), "TEST");
+        int idx = rand() % 4;
+        snprintf(intel.type, sizeof(intel.type), "%s", threat_types[idx % 2]);
+        snprintf(intel.data, sizeof(intel.data), "%s", threat_data[idx]);
+        intel.threat_level = (rand() % 100 < 50) ? 71 + (rand() % 30) : 10 + (rand() % 61);
+        snprintf(intel.location, sizeof(intel.location), "%s", locations[rand() % 4]);
+
+        //This is to process and display threat logs with a delay of 10 seconds.
+        snprintf(log_msg, sizeof(log_msg), 
+                 "Source: %s, Type: %s, Details: %s, Threat Level: %d, Location: %s",
+                 intel.source, intel.type, intel.data, intel.threat_level, intel.location);
+        log_event("WAR_TEST", log_msg);
+        atomic_fetch_add(&threats_detected, 1);
+        record_threat(&intel);
+
+        //This is to initiate a launch if the threat level is above 70
+        if (intel.threat_level > CRITICAL_THREAT_LEVEL) 
+        {
+            dispatch_launch(intel.location, intel.threat_level);
+        }
+        if (wait_for_stop(10000)) break; //Delay for 10 seconds between threats
+    }
+}
+
+//This is to generate a summary report at the end of the simulation program
+void generate_summary(void) 
+{
+    FILE *summary_fp = fopen(summary_path, "w");
+    if (!summary_fp) 
+    {
+        log_event("ERROR", "Failed to create summary file");
+        return;
+    }
+
+    /*The report box starts here and contains the time when the simulation ended, 
+    total threats it detected, total commands send to the silo and submarine, and
+    number of clients it connected to the server.*/
+    fprintf(summary_fp, "===== Nuclear Control Simulation Summary =====\n");
+    time_t now = time(NULL);
+    char *time_str = ctime(&now);
+    if (time_str) 
+    {
+        time_str[strlen(time_str) - 1] = '\0';
+        fprintf(summary_fp, "Simulation End: %s\n", time_str);
+    }
+    fprintf(summary_fp, "Total Threats Detected: %d\n", atomic_load(&threats_detected));
+    fprintf(summary_fp, "Total Commands Issued: %d\n", atomic_load(&commands_issued));
+
+    /*This reports how many commands the effectors confirmed and how long they took,
+    measured from the first send to the time the effector queued the command. */
+    pthread_mutex_lock(&inflight_mutex);
+    unsigned long unacked = commands_timed_out + commands_lost + (unsigned long)inflight_slab.in_use;
+    fprintf(summary_fp, "Commands Acknowledged: %lu, Retransmitted: %lu, Untracked (in-flight table full): %lu\n",
+            commands_acked, commands_retransmitted, commands_untracked);
+    fprintf(summary_fp, "Unacknowledged Commands: %lu (timed out %lu, connection closed %lu, still in flight %d)\n",
+            unacked, commands_timed_out, commands_lost, inflight_slab.in_use);
+    fprintf(summary_fp, "Delivery Latency: avg %.1f ms, max %lld ms; Ack Round Trip: avg %.1f ms, max %lld ms\n",
+            commands_acked ? (double)delivery_total_ms / (double)commands_acked : 0.0, delivery_max_ms,
+            commands_acked ? (double)ack_rtt_total_ms / (double)commands_acked : 0.0, ack_rtt_max_ms);
+    fprintf(summary_fp, "ACK Frames: %lu (%.1f acknowledgements per frame), Unmatched ACKs: %lu\n",
+            ack_frames_received,
+            ack_frames_received ? (double)(commands_acked + acks_unmatched) / (double)ack_frames_received : 0.0,
+            acks_unmatched);
+    pthread_mutex_unlock(&inflight_mutex);
+
+    //This reports how the launched flights ended, as the effectors saw them.
+    pthread_mutex_lock(&stats_mutex);
+    unsigned long flights = outcomes[0][0] + outcomes[0][1] + outcomes[0][2] + outcomes[1][0] + outcomes[1][1] +
+                            outcomes[1][2];
+    fprintf(summary_fp, "Missile Outcomes: destroyed %lu, survived %lu, missed %lu; "
+            "Torpedo Outcomes: destroyed %lu, survived %lu, missed %lu\n", outcomes[0][0], outcomes[0][1],
+            outcomes[0][2], outcomes[1][0], outcomes[1][1], outcomes[1][2]);
+    fprintf(summary_fp, "Time Of Flight: avg %.1f s, max %.1f s (simulated), OUTCOME Frames: %lu\n",
+            flights ? (double)flight_total_ms / 1000.0 / (double)flights : 0.0, (double)flight_max_ms / 1000.0,
+            outcome_frames);
+    pthread_mutex_unlock(&stats_mutex);
+    if (config.assign_window_ms > 0) assign_report(&assignment, summary_fp);
+    if (config.nodes > 1) 
+    {
+        fprintf(summary_fp, "Cluster Node: %d of %d\n", config.node_id, config.nodes);
+        fprintf(summary_fp, "Decisions Forwarded: %d, Decisions Received: %d\n", 
+                atomic_load(&decisions_forwarded), atomic_load(&decisions_received));
+    }
+
+    //This reports how reports were admitted and how much load was shed under overload.
+    pthread_mutex_lock(&intel_mutex);
+    fprintf(summary_fp, "Critical Reports Evaluated On Arrival: %lu\n", atomic_load(&intel_critical));
+    fprintf(summary_fp, "Routine Reports Queued: %lu, Evaluated: %lu, Queue Peak: %d/%d, "
+            "Queue Wait: avg %.1f ms, max %lld ms\n", intel_queued, intel_evaluated, intel_queue_peak,
+            config.intel_queue, intel_evaluated ? (double)intel_wait_total_ms / (double)intel_evaluated : 0.0,
+            intel_wait_max_ms);
+    pthread_mutex_unlock(&intel_mutex);
+    fprintf(summary_fp, "Shed Load: %lu rate limited, %lu queue full, %lu after the stop; "
+            "Credits Granted: %lu in %lu frames\n", atomic_load(&shed_rate_limited), atomic_load(&shed_queue_full),
+            atomic_load(&shed_after_stop), atomic_load(&credits_granted), atomic_load(&credit_frames));
+    fprintf(summary_fp, "Shutdown: %s, connections drained in %lld ms (%d closed by their clients, %d shut down)\n",
+            stop_reason, drain_ms, drain_closed, drain_forced);
+    fprintf(summary_fp, "Connected Clients:\n");
+    pthread_mutex_lock(&clients_mutex);
+    for (int i = 0; i < client_slab.capacity; i++) 
+    {
+        Client *client = slab_at(&client_slab, i);
+        if (client->valid) {
+            fprintf(summary_fp, "  - %s:%d (%d units)\n", client->ip, client->port, client->units);
+        }
+    }
+    pthread_mutex_unlock(&clients_mutex);
+
+    //This reports how close the connection slab and frame pool came to running out.
+    fprintf(summary_fp, "Connection Slab Peak: %d/%d (exhausted %lu times)\n",
+            client_slab.high_water, client_slab.capacity, client_slab.exhausted);
+    fprintf(summary_fp, "Frame Pool Peak: %d/%d (exhausted %lu times)\n",
+            frame_pool.high_water, frame_pool.capacity, frame_pool.exhausted);
+
+    //This compares the backends by the socket system calls each frame cost.
+    unsigned long frames = atomic_load(&frames_received) + atomic_load(&frames_sent);
+    unsigned long syscalls = atomic_load(&io_syscalls);
+    fprintf(summary_fp, "I/O Backend: %s\n", backend ? backend->name : config.io_backend);
+    char io[128], worker[128], timer[128];
+    cpu_mask_format(&io_cpus, io, sizeof(io));
+    cpu_mask_format(&worker_cpus, worker, sizeof(worker));
+    cpu_mask_format(&timer_cpus, timer, sizeof(timer));
+    fprintf(summary_fp, "Thread Topology: I/O on CPUs %s, worker on CPUs %s, timer on CPUs %s; "
+            "Worker CPU Migrations: %lu\n", io, worker, timer, atomic_load(&worker_migrations));
+
+    /*This shows how fast connections came off the listen queues: the busiest second
+    of the first minute, which is the start-up storm when every client starts together,
+    and how evenly the kernel spread them over the listeners of each port. */
+    unsigned long peak = 0;
+    int peak_second = 0;
+    for (int second = 0; second < ACCEPT_STORM_SECONDS; second++) 
+    {
+        unsigned long count = atomic_load(&accepts_per_second[second]);
+        if (count > peak) 
+        {
+            peak = count;
+            peak_second = second;
+        }
+    }
+    unsigned long busiest = 0, quietest = 0;
+    int listener_total = 0;
+    for (int i = 0; i < (NUM_PORTS + 1) * (MAX_ACCEPTORS + 1); i++) 
+    {
+        if (listeners[i].port == 0) continue;
+        unsigned long count = atomic_load(&listeners[i].accepts);
+        if (listener_total == 0 || count > busiest) busiest = count;
+        if (listener_total == 0 || count < quietest) quietest = count;
+        listener_total++;
+    }
+    if (config.tls) 
+    {
+        unsigned long handshakes = atomic_load(&tls_handshakes);
+        fprintf(summary_fp, "TLS 1.3: %lu handshakes (avg %.2f ms), %lu failed; kernel TLS sending on %lu, "
+                "receiving on %lu\n", handshakes,
+                handshakes ? (double)atomic_load(&tls_handshake_ns) / handshakes / 1e6 : 0.0,
+                atomic_load(&tls_failures), atomic_load(&tls_kernel_send), atomic_load(&tls_kernel_recv));
+    }
+    if (config.shm) 
+    {
+        pthread_mutex_lock(&clients_mutex);
+        fprintf(summary_fp, "Shared-Memory Rings: %lu connections, %lu offers refused; records in %lu, out %lu, "
+                "doorbells rung %lu, ring full %lu times\n", atomic_load(&ring_clients), atomic_load(&ring_refused),
+                ring_records_in, ring_records_out, ring_doorbells, ring_full);
+        pthread_mutex_unlock(&clients_mutex);
+    }
+    fprintf(summary_fp, "Accepts: %lu on %d listeners (%d per port, backlog %d), peak %lu/s in second %d; "
+            "busiest listener %lu, quietest %lu\n", atomic_load(&accepts_total), listener_total,
+            config.acceptors, config.listen_backlog, peak, peak_second, busiest, quietest);
+
+    /*This reports the receive modes against what they cost: how long received bytes waited
+    for their thread, how often spinning found them, and the CPU time of the whole process. */
+    const char *role_names[POLL_ROLES] = {"Sensor", "Effector"};
+    int role_spin_us[POLL_ROLES] = {config.busy_poll_sensors_us, config.busy_poll_effectors_us};
+    for (int role = 0; role < POLL_ROLES; role++) 
+    {
+        unsigned long receives = atomic_load(&rx_count[role]);
+        char mode[64];
+        if (role_spin_us[role] > 0) snprintf(mode, sizeof(mode), "spin %d us then park", role_spin_us[role]);
+        else snprintf(mode, sizeof(mode), "blocking");
+        fprintf(summary_fp, "%s Receives (%s): %lu, wake-up avg %.1f us, max %.1f us; "
+                "spin hits %lu, parks %lu, spinning %.1f ms\n", role_names[role], mode, receives,
+                receives ? (double)atomic_load(&rx_wake_total_ns[role]) / (double)receives / 1000.0 : 0.0,
+                (double)atomic_load(&rx_wake_max_ns[role]) / 1000.0, atomic_load(&spin_hits[role]),
+                atomic_load(&spin_parks[role]), (double)atomic_load(&spin_ns[role]) / 1e6);
+    }
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) 
+    {
+        double user_s = (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6;
+        double system_s = (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+        double run_s = (double)(wall_ms() - run_start_wall_ms) / 1000.0;
+        fprintf(summary_fp, "Process CPU: %.2f s user, %.2f s system (%.0f%% of one core over %.1f s)\n",
+                user_s, system_s, run_s > 0 ? (user_s + system_s) * 100.0 / run_s : 0.0, run_s);
+    }
+    fprintf(summary_fp, "Frames Received: %lu, Frames Sent: %lu, I/O System Calls: %lu (%.2f per frame)\n",
+            atomic_load(&frames_received), atomic_load(&frames_sent), syscalls,
+            frames ? (double)syscalls / (double)frames : 0.0);
+
+    //This compares the text and binary encodings by payload size and decode time.
+    unsigned long text = atomic_load(&intel_text_frames);
+    unsigned long binary = atomic_load(&intel_binary_frames);
+    fprintf(summary_fp, "Text Reports: %lu (avg %.1f bytes, decode avg %.0f ns); "
+            "Binary Reports: %lu (avg %.1f bytes, decode avg %.0f ns)\n",
+            text, text ? (double)atomic_load(&intel_text_bytes) / (double)text : 0.0,
+            text ? (double)atomic_load(&intel_text_decode_ns) / (double)text : 0.0,
+            binary, binary ? (double)atomic_load(&intel_binary_bytes) / (double)binary : 0.0,
+            binary ? (double)atomic_load(&intel_binary_decode_ns) / (double)binary : 0.0);
+    text = atomic_load(&command_text_frames);
+    binary = atomic_load(&command_binary_frames);
+    fprintf(summary_fp, "Text Commands: %lu (avg %.1f bytes); Binary Commands: %lu (avg %.1f bytes)\n",
+            text, text ? (double)atomic_load(&command_text_bytes) / (double)text : 0.0,
+            binary, binary ? (double)atomic_load(&command_binary_bytes) / (double)binary : 0.0);
+    pthread_mutex_lock(&stats_mutex);
+    fprintf(summary_fp, "Per Second Statistics: %s (%d columns)\n", stats_path, stats.column_count);
+    pthread_mutex_unlock(&stats_mutex);
+
+    //This reports what replicating to a standby cost the primary, or what the standby did.
+    if (config.replicate) 
+    {
+        pthread_mutex_lock(&repl_mutex);
+        fprintf(summary_fp, "Replication: %lu records, %lu bytes (avg %.1f per record) in %lu writes; "
+                "append avg %.0f ns per record, send avg %.0f ns per write; %lu connects, %lu resyncs\n",
+                repl_records, repl_bytes, repl_records ? (double)repl_bytes / (double)repl_records : 0.0,
+                repl_writes, repl_records ? (double)repl_append_ns / (double)repl_records : 0.0,
+                repl_writes ? (double)repl_send_ns / (double)repl_writes : 0.0, repl_connects, repl_resyncs);
+        pthread_mutex_unlock(&repl_mutex);
+    }
+    if (config.standby) 
+    {
+        fprintf(summary_fp, "Replica Log: %s, %lu records, %lu bytes, %lu malformed\n",
+                replica_path, replica_records, replica_bytes, replica_corrupt);
+        if (failover_cause) 
+        {
+            fprintf(summary_fp, "Failover: %s; detected after %lld ms, listening after %lld ms, "
+                    "first unit back after %lld ms, all %d units back after %lld ms (%d of %d back)\n",
+                    failover_cause, failover_detected_ms - failover_lost_ms,
+                    failover_listening_ms - failover_lost_ms,
+                    failover_first_unit_ms ? failover_first_unit_ms - failover_lost_ms : -1,
+                    failover_expected_units, failover_complete_ms ? failover_complete_ms - failover_lost_ms : -1,
+                    failover_units_back, failover_expected_units);
+            fprintf(summary_fp, "Commands Unacknowledged When The Primary Was Lost: %ld\n", failover_unconfirmed);
+        }
+        else 
+        {
+            fprintf(summary_fp, "Failover: none, the primary %s\n",
+                    replica_ended ? "ended the run normally" : "was still running at the stop");
+        }
+    }
+    fprintf(summary_fp, "=====================================\n");
+    fclose(summary_fp);
+
+    //This shows where the summary report has been generated in an text file.
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Summary generated in %s", summary_path);
+    log_event("SUMMARY", log_msg);
+}
+
+/*This counts a connection against the listener that accepted it and against the
+second of the run it was accepted in. Accepts after the first minute are only totalled. */
+static void count_accept(Listener *listener) 
+{
+    atomic_fetch_add(&listener->accepts, 1);
+    atomic_fetch_add(&accepts_total, 1);
+    long long second = (wall_ms() - run_start_wall_ms) / 1000;
+    if (second >= 0 && second < ACCEPT_STORM_SECONDS) 
+    {
+        atomic_fetch_add(&accepts_per_second[second], 1);
+    }
+}
+
+//This writes where a connection came from, which is "local" for one on an AF_UNIX listener.
+static void peer_address(const Listener *listener, const struct sockaddr_in *addr, char *ip, size_t size) 
+{
+    if (listener->local) snprintf(ip, size, "local");
+    else inet_ntop(AF_INET, &addr->sin_addr, ip, (socklen_t)size);
+}
+
+/*This pins an accept thread. A single acceptor per port may run on any I/O CPU, but
+the acceptors of a SO_REUSEPORT group are spread one per I/O CPU, so each listen
+queue is drained by its own core instead of all of them taking turns on one. */
+static void pin_acceptor(const Listener *listener) 
+{
+    int count = cpu_mask_count(&io_cpus);
+    if (config.acceptors == 1 || count <= 1) 
+    {
+        pin_thread(&io_cpus, "accept");
+        return;
+    }
+    int wanted = listener->acceptor % count;
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++) 
+    {
+        if (cpu_mask_has(&io_cpus, cpu) && wanted-- == 0) 
+        {
+            CpuMask one = {0};
+            cpu_mask_set(&one, cpu);
+            pin_thread(&one, "accept");
+            return;
+        }
+    }
+}
+
+/*This is to accept new client connections the user enters in a seperate terminal.
+Connections are taken with accept4, which sets their flags in the accept itself rather
+than with a further fcntl per client. They are close-on-exec but stay blocking, because
+each one is served by a thread that blocks in recv on it. */
+void *accept_clients(void *arg) 
+{
+    Listener *listener = (Listener *)arg;
+    int server_sock = listener->sock;
+    int port = listener->port;
+    int role = listener->role;
+    char log_msg[BUFFER_SIZE];
+    pin_acceptor(listener);
+
+    /*Client threads are created detached, because the connection object they
+    run on may be handed to the next client as soon as they finish. */
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    /*This is a while loop that accepts incoming client connections on a listening socket.
+    It also handles error and log failures. */
+    while (atomic_load(&running)) 
+    {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int client_sock = (int)syscall(SYS_accept4, server_sock, (struct sockaddr *)&client_addr,
+                                       &addr_len, SOCK_CLOEXEC);
+        atomic_fetch_add(&io_syscalls, 1);
+        if (client_sock < 0) {
+            if (errno != EINTR && atomic_load(&running)) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Accept failed on port %d: %s", port, strerror(errno));
+                log_event("ERROR", log_msg);
+            }
+            continue;
+        }
+        if (!atomic_load(&running)) 
+        {
+            close(client_sock); //Accepted while the listener was being closed.
+            break;
+        }
+        count_accept(listener);
+
+        /*This takes a connection object from the slab. The slab is the only copy of the client,
+        so the thread and the server always see the same valid flag. Once every object is in use
+        the server has reached its maximum amount of clients and rejects incoming ones. */
+        pthread_mutex_lock(&clients_mutex);
+        Client *client = slab_alloc(&client_slab);
+        if (client) 
+        {
+            //This initialises to store thre client's data such as its socket, port, and IP.
+            client->sock = client_sock;
+            client->port = port;
+            client->role = role;
+            client->valid = !config.tls || role == PORT_PEER; //With --tls, once its handshake is over.
+            client->local = listener->local;
+            peer_address(listener, &client_addr, client->ip, sizeof(client->ip));
+            atomic_fetch_add(&client_count, 1);
+        }
+        pthread_mutex_unlock(&clients_mutex);
+
+        if (!client) 
+        {
+            char ip[INET_ADDRSTRLEN];
+            peer_address(listener, &client_addr, ip, sizeof(ip));
+            snprintf(log_msg, sizeof(log_msg), "Max clients reached, rejecting %s:%d", ip, port);
+            log_event("ERROR", log_msg);
+            close(client_sock);
+            continue;
+        }
+
+        /*This creates a new thread to handle a client connection in case one fails,
+        it cleans up its old resources and logs the failure with error handling to close the socket,
+        and returns the connection object to the slab. */
+        if (pthread_create(&client->thread, &attr, handle_client, client) != 0)
+         {
+            snprintf(log_msg, sizeof(log_msg), "Thread creation failed for %s:%d", client->ip, port);
+            log_event("ERROR", log_msg);
+            pthread_mutex_lock(&clients_mutex);
+            client->valid = false;
+            atomic_fetch_sub(&client_count, 1);
+            slab_free(&client_slab, client);
+            pthread_mutex_unlock(&clients_mutex);
+            close(client_sock);
+            continue;
+        }
+    }
+    pthread_attr_destroy(&attr);
+    return NULL;
+}
+
+/*The thread backend is the original design: one blocking accept thread per
+listener and one thread per client, every send being its own system call. */
+static pthread_t accept_threads[(NUM_PORTS + 1) * (MAX_ACCEPTORS + 1)];
+
+//This launches threads that stores sockets and port to accept clients.
+int threads_start(int listener_count) 
+{
+    char log_msg[256];
+    for (int i = 0; i < listener_count; i++) 
+    {
+        if (pthread_create(&accept_threads[i], NULL, accept_clients, &listeners[i]) != 0) 
+        {
+            snprintf(log_msg, sizeof(log_msg), "Failed to create accept thread for port %d", listeners[i].port);
+            log_event("ERROR", log_msg);
+            accept_threads[i] = 0;
+        }
+    }
+    return 0;
+}
+
+//This sends a frame straight away on the client's blocking socket.
+int threads_send(Client *client, char *buffer, const char *frame, size_t length) 
+{
+    (void)buffer;
+    if (client->shm.segment) return ring_send(client, frame, length);
+    atomic_fetch_add(&io_syscalls, 1);
+#ifdef USE_TLS
+    if (client->tls) 
+    {
+        pthread_mutex_lock(&client->tls_lock);
+        int result = tls_write_all(client->tls, client->sock, frame, length);
+        pthread_mutex_unlock(&client->tls_lock);
+        if (result < 0) return -1;
+        atomic_fetch_add(&frames_sent, 1);
+        return 0;
+    }
+#endif
+    if (send_all(client->sock, frame, length) < 0) return -1;
+    atomic_fetch_add(&frames_sent, 1);
+    return 0;
+}
+
+//Nothing is ever queued by the thread backend.
+void threads_flush(void) 
+{
+}
+
+//This wait for the accept threads to finish once their listeners are closed.
+void threads_stop(int listener_count) 
+{
+    for (int i = 0; i < listener_count; i++) 
+    {
+        if (accept_threads[i]) 
+        {
+            pthread_join(accept_threads[i], NULL);
+        }
+    }
+}
+
+static const IoBackend thread_backend = {"threads", threads_start, threads_send, threads_flush, threads_stop};
+
+/*The io_uring backend runs every listener and client on one ring and one thread.
+Each listener has a multishot accept and each client a multishot receive, so the
+kernel keeps producing completions without being asked again. Receives land in a
+provided buffer ring and are parsed in place, and the sends of a command fan-out
+are queued and submitted together. The low bits of each entry's user data say
+what it is for, since clients and pool frames are 64 byte aligned. */
+enum
+{
+    URING_ACCEPT = 1,
+    URING_RECV = 2,
+    URING_SEND = 3,
+    URING_WAKE = 4
+};
+#define URING_TAG_MASK 7
+
+static Uring ring;
+static BufferRing rx_ring;
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t uring_thread;
+static atomic_bool ring_running = true; //Outlives running, so the drain's END frames and closes complete.
+
+//This returns a submission entry, submitting what is queued first if the ring is full.
+static struct io_uring_sqe *uring_sqe(void) 
+{
+    struct io_uring_sqe *sqe = uring_get_sqe(&ring);
+    if (!sqe && uring_submit(&ring) > 0) 
+    {
+        atomic_fetch_add(&io_syscalls, 1);
+        sqe = uring_get_sqe(&ring);
+    }
+    return sqe;
+}
+
+//This submits whatever is queued on the ring. The ring mutex must be held.
+static void uring_flush_locked(void) 
+{
+    int submitted = uring_submit(&ring);
+    if (submitted != 0) atomic_fetch_add(&io_syscalls, 1);
+    if (submitted < 0) 
+    {
+        char log_msg[128];
+        snprintf(log_msg, sizeof(log_msg), "io_uring submit failed: %s", strerror(errno));
+        log_event("ERROR", log_msg);
+    }
+}
+
+//This queues a multishot accept for a listener, identified by its index.
+static void uring_arm_accept(int index) 
+{
+    pthread_mutex_lock(&ring_mutex);
+    struct io_uring_sqe *sqe = uring_sqe();
+    if (sqe) 
+    {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listeners[index].sock;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = ((uint64_t)index << 3) | URING_ACCEPT;
+    }
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+//This queues a multishot receive for a client that takes its buffers from the buffer ring.
+static void uring_arm_recv(Client *client) 
+{
+    pthread_mutex_lock(&ring_mutex);
+    struct io_uring_sqe *sqe = uring_sqe();
+    if (sqe) 
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = client->sock;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->msg_flags = client->local ? MSG_TRUNC : 0; //A packet's whole length, to spot one that did not fit.
+        sqe->user_data = (uint64_t)(uintptr_t)client | URING_RECV;
+    }
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+/*This queues a send of a frame held in a pool buffer. MSG_WAITALL makes the kernel
+finish short writes itself. The buffer stays referenced until the send completes.
+It is called with clients_mutex held, and the caller flushes once for the whole fan-out. */
+int uring_send(Client *client, char *buffer, const char *frame, size_t length) 
+{
+    if (client->shm.segment) return ring_send(client, frame, length);
+    pthread_mutex_lock(&ring_mutex);
+    struct io_uring_sqe *sqe = uring_sqe();
+    if (sqe) 
+    {
+        atomic_fetch_add(frame_refs(buffer), 1);
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = client->sock;
+        sqe->addr = (uint64_t)(uintptr_t)frame;
+        sqe->len = (uint32_t)length;
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        sqe->user_data = (uint64_t)(uintptr_t)buffer | URING_SEND;
+    }
+    pthread_mutex_unlock(&ring_mutex);
+    return sqe ? 0 : -1;
+}
+
+void uring_flush(void) 
+{
+    pthread_mutex_lock(&ring_mutex);
+    uring_flush_locked();
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+/*This sets up a client for a connection accepted by the ring, the same way as
+accept_clients does, except that the receive frame is kept on the client. */
+void uring_accept(Listener *listener, int client_sock) 
+{
+    char log_msg[BUFFER_SIZE];
+    struct sockaddr_in client_addr = {0};
+    socklen_t addr_len = sizeof(client_addr);
+    getpeername(client_sock, (struct sockaddr *)&client_addr, &addr_len);
+    atomic_fetch_add(&io_syscalls, 1);
+
+    pthread_mutex_lock(&clients_mutex);
+    Client *client = slab_alloc(&client_slab);
+    char *buffer = client ? slab_alloc(&frame_pool) : NULL;
+    if (client && buffer) 
+    {
+        client->sock = client_sock;
+        client->port = listener->port;
+        client->role = listener->role;
+        client->valid = true;
+        client->local = listener->local;
+        client->rx = buffer;
+        peer_address(listener, &client_addr, client->ip, sizeof(client->ip));
+        atomic_fetch_add(&client_count, 1);
+    } 
+    else if (client) 
+    {
+        slab_free(&client_slab, client);
+    }
+    pthread_mutex_unlock(&clients_mutex);
+
+    if (!client || !buffer) 
+    {
+        char ip[INET_ADDRSTRLEN];
+        peer_address(listener, &client_addr, ip, sizeof(ip));
+        snprintf(log_msg, sizeof(log_msg), "%s, rejecting %s:%d",
+                 client ? "Frame pool exhausted" : "Max clients reached", ip, listener->port);
+        log_event("ERROR", log_msg);
+        close(client_sock);
+        return;
+    }
+    snprintf(log_msg, sizeof(log_msg), "Client connected from %s:%d", client->ip, client->port);
+    log_event("CONNECTION", log_msg);
+    uring_arm_recv(client);
+}
+
+/*This handles the bytes of one receive. When nothing is left over from the last
+receive the frames are processed straight out of the kernel's buffer. Otherwise the
+bytes are added to the client's partial frame first. It returns 0 or -1 to close. */
+int uring_receive(Client *client, const char *data, size_t length) 
+{
+    if (client->rx_used == 0) 
+    {
+        int consumed = consume_frames(client, data, length);
+        if (consumed < 0) return -1;
+        data += consumed;
+        length -= (size_t)consumed;
+    }
+    while (length > 0) 
+    {
+        size_t room = FRAME_BUFFER_SIZE - client->rx_used;
+        size_t chunk = length < room ? length : room;
+        memcpy(client->rx + client->rx_used, data, chunk);
+        client->rx_used += chunk;
+        data += chunk;
+        length -= chunk;
+        int consumed = consume_frames(client, client->rx, client->rx_used);
+        if (consumed < 0) return -1;
+        memmove(client->rx, client->rx + consumed, client->rx_used - (size_t)consumed);
+        client->rx_used -= (size_t)consumed;
+    }
+    return 0;
+}
+
+//This acts on one completion taken off the ring.
+void uring_complete(uint64_t user_data, int res, uint32_t flags) 
+{
+    char log_msg[256];
+    switch (user_data & URING_TAG_MASK) 
+    {
+        case URING_ACCEPT:
+        {
+            int index = (int)(user_data >> 3);
+            if (res >= 0 && atomic_load(&running)) 
+            {
+                count_accept(&listeners[index]);
+                uring_accept(&listeners[index], res);
+            } 
+            else if (res >= 0) 
+            {
+                close(res); //Accepted while the listeners were being closed.
+            } 
+            else if (atomic_load(&running)) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Accept failed on port %d: %s", 
+                         listeners[index].port, strerror(-res));
+                log_event("ERROR", log_msg);
+            }
+            if (!(flags & IORING_CQE_F_MORE) && atomic_load(&running)) uring_arm_accept(index);
+            break;
+        }
+        case URING_RECV:
+        {
+            Client *client = (Client *)(uintptr_t)(user_data & ~(uint64_t)URING_TAG_MASK);
+            if (res > 0) 
+            {
+                unsigned bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                int result = client->local && res > FRAME_BUFFER_SIZE ? truncated_packet(client)
+                             : uring_receive(client, buffer_ring_data(&rx_ring, bid), (size_t)res);
+                buffer_ring_recycle(&rx_ring, bid);
+                while (result == 0 && client->shm.segment) 
+                {
+                    //The socket of a connection on rings only rings the doorbell.
+                    result = consume_ring(client);
+                    if (result == 0 && shm_link_idle(&client->shm)) break;
+                }
+                if (result < 0) 
+                {
+                    //The final receive completion that follows does the cleanup.
+                    shutdown(client->sock, SHUT_RDWR);
+                } 
+                else if (!(flags & IORING_CQE_F_MORE)) 
+                {
+                    uring_arm_recv(client);
+                }
+            } 
+            else if (res == -ENOBUFS) 
+            {
+                //Every provided buffer was in use, so the receive simply starts again.
+                uring_arm_recv(client);
+            } 
+            else if (!(flags & IORING_CQE_F_MORE)) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Client %s:%d disconnected: %s", 
+                         client->ip, client->port, res == 0 ? "closed connection" : strerror(-res));
+                log_event("CONNECTION", log_msg);
+                release_client(client, client->rx);
+            }
+            break;
+        }
+        case URING_SEND:
+        {
+            if (res < 0) 
+            {
+                snprintf(log_msg, sizeof(log_msg), "Failed to send command: %s", strerror(-res));
+                log_event("ERROR", log_msg);
+            } 
+            else 
+            {
+                atomic_fetch_add(&frames_sent, 1);
+            }
+            frame_release((char *)(uintptr_t)(user_data & ~(uint64_t)URING_TAG_MASK));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/*This is the ring's completion thread. It sleeps in the kernel until something
+completes, handles every completion that is waiting, and submits what that queued. */
+void *uring_loop(void *arg) 
+{
+    (void)arg;
+    pin_thread(&io_cpus, "io_uring");
+    while (atomic_load(&ring_running)) 
+    {
+        if (uring_wait(&ring) < 0 && errno != EINTR) 
+        {
+            char log_msg[128];
+            snprintf(log_msg, sizeof(log_msg), "io_uring wait failed: %s", strerror(errno));
+            log_event("ERROR", log_msg);
+            break;
+        }
+        atomic_fetch_add(&io_syscalls, 1);
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = uring_peek_cqe(&ring)) != NULL) 
+        {
+            uint64_t user_data = cqe->user_data;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            uring_cqe_seen(&ring);
+            uring_complete(user_data, res, flags);
+        }
+        uring_flush();
+    }
+    return NULL;
+}
+
+/*This creates the ring and the provided buffer ring, arms a multishot accept on every
+listener and starts the completion thread. It returns -1 if io_uring is not available. */
+int uring_start(int listener_count) 
+{
+    char log_msg[256];
+    unsigned entries = URING_MIN_ENTRIES;
+    while (entries < (unsigned)config.max_clients * 2 && entries < URING_MAX_ENTRIES) entries *= 2;
+    unsigned buffers = 1;
+    while (buffers < (unsigned)config.frame_buffers && buffers < 32768) buffers *= 2;
+
+    if (uring_init(&ring, entries) < 0) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "io_uring setup failed: %s", strerror(errno));
+        log_event("ERROR", log_msg);
+        return -1;
+    }
+    if (buffer_ring_init(&ring, &rx_ring, URING_BUFFER_GROUP, buffers, FRAME_BUFFER_SIZE) < 0) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "io_uring buffer ring registration failed: %s", strerror(errno));
+        log_event("ERROR", log_msg);
+        uring_close(&ring, NULL);
+        return -1;
+    }
+    for (int i = 0; i < listener_count; i++) 
+    {
+        uring_arm_accept(i);
+    }
+    uring_flush();
+    if (pthread_create(&uring_thread, NULL, uring_loop, NULL) != 0) 
+    {
+        log_event("ERROR", "Failed to create io_uring thread");
+        uring_close(&ring, &rx_ring);
+        return -1;
+    }
+    snprintf(log_msg, sizeof(log_msg), "io_uring backend: %u entries, %u x %d byte receive buffers",
+             entries, buffers, FRAME_BUFFER_SIZE);
+    log_event("STARTUP", log_msg);
+    return 0;
+}
+
+//This wakes the completion thread with a no-op so it sees the backend is stopping.
+void uring_stop(int listener_count) 
+{
+    (void)listener_count;
+    atomic_store(&ring_running, false);
+    pthread_mutex_lock(&ring_mutex);
+    struct io_uring_sqe *sqe = uring_sqe();
+    if (sqe) 
+    {
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = URING_WAKE;
+    }
+    uring_flush_locked();
+    pthread_mutex_unlock(&ring_mutex);
+    pthread_join(uring_thread, NULL);
+    uring_close(&ring, &rx_ring);
+}
+
+static const IoBackend uring_backend = {"uring", uring_start, uring_send, uring_flush, uring_stop};
+
+/* This int function initializes a TCP server on given port and
+ configures its socket with en error handling function in all cases.
+ The listen queue holds "--listen-backlog" connections (SOMAXCONN by default, the
+ kernel caps it at net.core.somaxconn), so a storm of clients starting together is
+ queued instead of refused. With reuse_port the socket joins a SO_REUSEPORT group,
+ which must be set on every member before it is bound. */
+int start_server(int port, int reuse_port) 
+{
+    int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_sock < 0) 
+    {
+        perror("Socket creation failed");
         return -1;
     }
 
@@ -492,6 +3329,12 @@ int start_server(int port)
         close(server_sock);
         return -1;
     }
+    if (reuse_port && setsockopt(server_sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) 
+    {
+        perror("SO_REUSEPORT failed");
+        close(server_sock);
+        return -1;
+    }
 
     if (bind(server_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) 
     {
@@ -500,7 +3343,7 @@ int start_server(int port)
         return -1;
     }
 
-    if (listen(server_sock, 5) < 0) 
+    if (listen(server_sock, config.listen_backlog) < 0) 
     {
         perror("Listen failed");
         close(server_sock);
@@ -508,41 +3351,506 @@ int start_server(int port)
     }
 
     char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "Server started on port %d", port);
+    snprintf(log_msg, sizeof(log_msg), "Server started on port %d (backlog %d%s)", port,
+             config.listen_backlog, reuse_port ? ", SO_REUSEPORT" : "");
+    log_event("STARTUP", log_msg);
+    return server_sock;
+}
+
+/*This listens on the AF_UNIX SOCK_SEQPACKET socket of a port for "--unix-sockets",
+replacing a socket file a previous run left behind. It returns the socket or -1. */
+int start_local_server(int port) 
+{
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), UNIX_SOCKET_PATH, port);
+    unlink(addr.sun_path);
+    int server_sock = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (server_sock < 0 || bind(server_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(server_sock, config.listen_backlog) < 0) 
+    {
+        perror("Local socket failed");
+        if (server_sock >= 0) close(server_sock);
+        return -1;
+    }
+
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Server started on %s (SOCK_SEQPACKET, backlog %d)", addr.sun_path,
+             config.listen_backlog);
     log_event("STARTUP", log_msg);
     return server_sock;
 }
 
+/*This logs the CPUs every thread role runs on and the NUMA node of each pool, as the
+kernel reports it for the pool's first page, so a run can be checked against what was asked. */
+static void log_topology(void) 
+{
+    const CpuMask *masks[] = {&io_cpus, &worker_cpus, &timer_cpus};
+    const char *roles[] = {"I/O threads", "Evaluation worker", "Timer and main threads"};
+    const char *lists[] = {config.cpu_io, config.cpu_worker, config.cpu_timer};
+    char cpus[128];
+    char log_msg[512];
+    snprintf(log_msg, sizeof(log_msg), "Topology: %d CPUs on %d NUMA node(s)", topology.cpu_count,
+             topology.node_count);
+    log_event("STARTUP", log_msg);
+    for (int i = 0; i < 3; i++) 
+    {
+        int node = topology_node_of(&topology, masks[i]);
+        cpu_mask_format(masks[i], cpus, sizeof(cpus));
+        const char *pinned = lists[i] ? "" : " (not pinned)";
+        if (node >= 0) snprintf(log_msg, sizeof(log_msg), "%s: CPUs %s, NUMA node %d%s", roles[i], cpus, node, pinned);
+        else snprintf(log_msg, sizeof(log_msg), "%s: CPUs %s, spanning NUMA nodes%s", roles[i], cpus, pinned);
+        log_event("STARTUP", log_msg);
+    }
+    snprintf(log_msg, sizeof(log_msg), "Pool NUMA nodes: connection slab %d, frame pool %d, in-flight table %d, "
+             "evaluation queue %d (-1 if the kernel cannot tell)", topology_page_node(client_slab.memory),
+             topology_page_node(frame_pool.memory), topology_page_node(inflight_slab.memory),
+             topology_page_node(intel_queue));
+    log_event("STARTUP", log_msg);
+}
+
+/*This reads the command line settings. "--test" keeps working on its own, and the
+pool sizes can be given as "--max-clients N" and "--frame-buffers N". Cluster mode is
+enabled with "--nodes N --node-id K" and "--io-backend threads|uring" picks the
+connection backend. Command acknowledgement is tuned with "--ack-timeout-ms MS",
+"--ack-retries N" and "--max-inflight N", and admission of routine reports with
+"--intel-queue N", "--intel-rate R" per second and "--intel-burst B" per connection.
+Threads are pinned with "--cpu-io LIST", "--cpu-worker LIST" and "--cpu-timer LIST",
+where a list looks like "0-3,8". Weapon-target assignment is turned on with
+"--assign-window-ms MS" and tuned with "--assign-solver greedy|auction",
+"--assign-budget-us US", "--assign-capacity N" and "--max-effectors N". The listen queues
+are sized with "--listen-backlog N" and "--acceptors N" gives every port N SO_REUSEPORT
+listeners, and "--unix-sockets" adds an AF_UNIX one for clients on this host. "--shm" takes
+up the shared-memory rings clients on this host offer. "--tls" puts the client ports
+behind TLS 1.3 (see tlsTransport.h), if the server was built with it. It returns 0 if the
+arguments are valid and -1 otherwise. */
+int parse_args(int argc, char *argv[]) 
+{
+    for (int i = 1; i < argc; i++) 
+    {
+        if (strcmp(argv[i], "--test") == 0) 
+        {
+            config.test_mode = 1;
+        } 
+        else if (strcmp(argv[i], "--max-clients") == 0 && i + 1 < argc) 
+        {
+            config.max_clients = atoi(argv[++i]);
+        } 
+        else if (strcmp(argv[i], "--frame-buffers") == 0 && i + 1 < argc) 
+        {
+            config.frame_buffers = atoi(argv[++i]);
+        } 
+        else if (strcmp(argv[i], "--nodes") == 0 && i + 1 < argc) 
+        {
+            config.nodes = atoi(argv[++i]);
+        } 
+        else if (strcmp(argv[i], "--node-id") == 0 && i + 1 < argc) 
+        {
+            config.node_id = atoi(argv[++i]);
+        } 
+        else if (strcmp(argv[i], "--io-backend") == 0 && i + 1 < argc) 
+        {
+            config.io_backend = argv[++i];
+        } 
+        else if (strcmp(argv[i], "--ack-timeout-ms") == 0 && i + 1 < argc) 
+        {
+            config.ack_timeout_ms = atoi(argv[++i]);
+        } 
+        else if (strcmp(argv[i], "--ack-retries") == 0 && i + 1 < argc) 
+        {
+            config.ack_retries = atoi(argv[++i]);
+        } 
+        else if (strcmp(argv[i], "--max-inflight") == 0 && i + 1 < argc) 
+        {
+            config.max_inflight = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--intel-queue") == 0 && i + 1 < argc) 
+        {
+            config.intel_queue = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--intel-rate") == 0 && i + 1 < argc) 
+        {
+            config.intel_rate = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--intel-burst") == 0 && i + 1 < argc) 
+        {
+            config.intel_burst = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cpu-io") == 0 && i + 1 < argc) 
+        {
+            config.cpu_io = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu-worker") == 0 && i + 1 < argc) 
+        {
+            config.cpu_worker = argv[++i];
+        }
+        else if (strcmp(argv[i], "--cpu-timer") == 0 && i + 1 < argc) 
+        {
+            config.cpu_timer = argv[++i];
+        }
+        else if (strcmp(argv[i], "--replicate") == 0) 
+        {
+            config.replicate = 1;
+        }
+        else if (strcmp(argv[i], "--standby") == 0) 
+        {
+            config.standby = 1;
+        }
+        else if (strcmp(argv[i], "--busy-poll-sensors") == 0 && i + 1 < argc) 
+        {
+            config.busy_poll_sensors_us = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--busy-poll-effectors") == 0 && i + 1 < argc) 
+        {
+            config.busy_poll_effectors_us = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--assign-window-ms") == 0 && i + 1 < argc) 
+        {
+            config.assign_window_ms = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--assign-solver") == 0 && i + 1 < argc) 
+        {
+            config.assign_solver = argv[++i];
+        }
+        else if (strcmp(argv[i], "--assign-budget-us") == 0 && i + 1 < argc) 
+        {
+            config.assign_budget_us = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--assign-capacity") == 0 && i + 1 < argc) 
+        {
+            config.assign_capacity = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--max-effectors") == 0 && i + 1 < argc) 
+        {
+            config.max_effectors = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--assign-benchmark") == 0 && i + 1 < argc) 
+        {
+            config.assign_benchmark = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--listen-backlog") == 0 && i + 1 < argc) 
+        {
+            config.listen_backlog = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--acceptors") == 0 && i + 1 < argc) 
+        {
+            config.acceptors = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--unix-sockets") == 0) 
+        {
+            config.unix_sockets = 1;
+        }
+        else if (strcmp(argv[i], "--shm") == 0) 
+        {
+            config.shm = 1;
+        }
+        else if (strcmp(argv[i], "--tls") == 0) 
+        {
+            config.tls = 1;
+        }
+        else 
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        }
+    }
+    if (config.max_clients <= 0 || config.frame_buffers <= 0) 
+    {
+        fprintf(stderr, "--max-clients and --frame-buffers must be positive\n");
+        return -1;
+    }
+    if (config.nodes < 1 || config.nodes > MAX_NODES || config.node_id < 0 || config.node_id >= config.nodes) 
+    {
+        fprintf(stderr, "--nodes must be 1 to %d and --node-id 0 to nodes-1\n", MAX_NODES);
+        return -1;
+    }
+    if (config.ack_timeout_ms <= 0 || config.ack_retries < 0 || config.ack_retries > 8 || config.max_inflight <= 0) 
+    {
+        fprintf(stderr, "--ack-timeout-ms and --max-inflight must be positive and --ack-retries 0 to 8\n");
+        return -1;
+    }
+    if (config.intel_queue <= 0 || config.intel_rate <= 0 || config.intel_burst <= 0) 
+    {
+        fprintf(stderr, "--intel-queue, --intel-rate and --intel-burst must be positive\n");
+        return -1;
+    }
+    if (strcmp(config.io_backend, "threads") != 0 && strcmp(config.io_backend, "uring") != 0) 
+    {
+        fprintf(stderr, "--io-backend must be threads or uring\n");
+        return -1;
+    }
+    if (config.replicate && config.standby) 
+    {
+        fprintf(stderr, "--replicate is for the primary and --standby for the standby, not both\n");
+        return -1;
+    }
+    if (config.busy_poll_sensors_us < 0 || config.busy_poll_sensors_us > MAX_BUSY_POLL_US ||
+        config.busy_poll_effectors_us < 0 || config.busy_poll_effectors_us > MAX_BUSY_POLL_US) 
+    {
+        fprintf(stderr, "--busy-poll-sensors and --busy-poll-effectors take 0 to %d microseconds\n", MAX_BUSY_POLL_US);
+        return -1;
+    }
+    if ((config.busy_poll_sensors_us || config.busy_poll_effectors_us) && strcmp(config.io_backend, "threads") != 0) 
+    {
+        fprintf(stderr, "--busy-poll-sensors and --busy-poll-effectors need the threads backend\n");
+        return -1;
+    }
+    if (config.assign_window_ms < 0 || config.assign_budget_us <= 0 || config.assign_capacity <= 0 ||
+        config.max_effectors <= 0 || config.assign_benchmark < 0) 
+    {
+        fprintf(stderr, "--assign-budget-us, --assign-capacity and --max-effectors must be positive, "
+                "--assign-window-ms 0 or more\n");
+        return -1;
+    }
+    if (strcmp(config.assign_solver, "greedy") != 0 && strcmp(config.assign_solver, "auction") != 0) 
+    {
+        fprintf(stderr, "--assign-solver must be greedy or auction\n");
+        return -1;
+    }
+    if (config.listen_backlog <= 0 || config.acceptors < 1 || config.acceptors > MAX_ACCEPTORS) 
+    {
+        fprintf(stderr, "--listen-backlog must be positive and --acceptors 1 to %d\n", MAX_ACCEPTORS);
+        return -1;
+    }
+#ifndef USE_TLS
+    if (config.tls) 
+    {
+        fprintf(stderr, "--tls needs nuclearControl built with -DUSE_TLS and linked with -lssl -lcrypto\n");
+        return -1;
+    }
+#endif
+    if (config.tls && (strcmp(config.io_backend, "threads") != 0 || config.unix_sockets || config.shm)) 
+    {
+        fprintf(stderr, "--tls needs the threads backend and is for TCP, not --unix-sockets or --shm\n");
+        return -1;
+    }
+
+    //This turns the CPU lists into sets, which must be CPUs the server is allowed to run on.
+    const char *lists[] = {config.cpu_io, config.cpu_worker, config.cpu_timer};
+    CpuMask *masks[] = {&io_cpus, &worker_cpus, &timer_cpus};
+    topology_get_affinity(&startup_cpus);
+    for (int i = 0; i < 3; i++) 
+    {
+        if (!lists[i]) 
+        {
+            *masks[i] = startup_cpus;
+        }
+        else if (cpu_mask_parse(masks[i], lists[i]) < 0 || !cpu_mask_within(masks[i], &startup_cpus)) 
+        {
+            fprintf(stderr, "--cpu-io, --cpu-worker and --cpu-timer take lists of usable CPUs such as 0-3,8\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//This puts "_standby" in a file name in front of its ending, e.g. ".log".
+static void add_standby_suffix(char *path, size_t size, const char *ending) 
+{
+    char name[64];
+    size_t stem = strlen(path) - strlen(ending);
+    snprintf(name, sizeof(name), "%.*s_standby%s", (int)stem, path, ending);
+    snprintf(path, size, "%s", name);
+}
+
 /*This is the int main function that simulates the control center either in normal or test mode.
 Its support by an implemented the multi-threaded server system and handles
 multiple client connections across different ports. It includes a the duration timer to show how much
 time is left before shutting down the server and disconnect all client connections. */
 int main(int argc, char *argv[]) 
 {
-    int test_mode = 0;
-    if (argc > 1 && strcmp(argv[1], "--test") == 0) 
+    if (parse_args(argc, argv) < 0) 
+    {
+        fprintf(stderr, "Usage: %s [--test] [--max-clients N] [--frame-buffers N] "
+                "[--nodes N --node-id K] [--io-backend threads|uring] "
+                "[--ack-timeout-ms MS] [--ack-retries N] [--max-inflight N] "
+                "[--intel-queue N] [--intel-rate R] [--intel-burst B] "
+                "[--cpu-io LIST] [--cpu-worker LIST] [--cpu-timer LIST] [--replicate | --standby] "
+                "[--busy-poll-sensors US] [--busy-poll-effectors US] "
+                "[--assign-window-ms MS] [--assign-solver greedy|auction] [--assign-budget-us US] "
+                "[--assign-capacity N] [--max-effectors N] [--assign-benchmark N] "
+                "[--listen-backlog N] [--acceptors N] [--unix-sockets] [--shm] [--tls]\n", argv[0]);
+        return 1;
+    }
+    if (config.assign_benchmark > 0) 
+    {
+        return assign_benchmark(config.assign_benchmark, config.assign_capacity, config.assign_budget_us);
+    }
+    if (config.test_mode) 
     {
-        test_mode = 1;
         srand((unsigned int)time(NULL));
     }
 
+    /*SIGINT and SIGTERM are blocked here, before any thread exists, so every thread inherits
+    the mask and the signals are only ever taken by wait_for_stop in the main thread. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    /*In cluster mode every node runs on the same host, so each one writes its own
+    log and summary and listens on its own block of ports plus a peer port. */
+    int listener_count = NUM_PORTS;
+    if (config.nodes > 1) 
+    {
+        snprintf(log_path, sizeof(log_path), NODE_LOG_FILE, config.node_id);
+        snprintf(summary_path, sizeof(summary_path), NODE_SUMMARY_FILE, config.node_id);
+        snprintf(stats_path, sizeof(stats_path), NODE_STATS_FILE, config.node_id);
+        snprintf(repl_path, sizeof(repl_path), NODE_REPL_SOCKET, config.node_id);
+        listener_count = NUM_PORTS + 1;
+    }
+
+    /*A standby runs next to its primary, so its files get "_standby" in their names
+    (e.g. nuclearControl_standby.log) and the replica file is named after the socket. */
+    if (config.standby) 
+    {
+        add_standby_suffix(log_path, sizeof(log_path), ".log");
+        add_standby_suffix(summary_path, sizeof(summary_path), "_summary.txt");
+        add_standby_suffix(stats_path, sizeof(stats_path), "_stats.col");
+        snprintf(replica_path, sizeof(replica_path), "%.*s_standby.replica", (int)(strlen(repl_path) - 5), repl_path);
+    }
+    run_start_wall_ms = wall_ms();
+    for (int i = 0; i < MAX_NODES; i++) 
+    {
+        peer_socks[i] = -1;
+    }
+
     init_log_file(); //Opens a log file to keep track of the events.
 
-    int ports[] = {PORT_SILO, PORT_SUB, PORT_RADAR, PORT_SAT};
-    int server_socks[MAX_CLIENTS] = {-1, -1, -1, -1};
-    pthread_t accept_threads[MAX_CLIENTS] = {0};
+    /*This sizes the connection slab and the frame pool once at startup. Every client
+    connection and every message after this point reuses their memory. The evaluation
+    queue is zeroed on the worker's CPUs and the rest on the I/O CPUs, so each pool is
+    local to the threads that use it (calloc alone may leave the pages untouched). */
+    topology_load(&topology);
+    pin_thread(&worker_cpus, "main");
+    intel_queue = calloc((size_t)config.intel_queue, sizeof(QueuedIntel));
+    if (intel_queue) memset(intel_queue, 0, (size_t)config.intel_queue * sizeof(QueuedIntel));
+    pin_thread(&io_cpus, "main");
+    if (!intel_queue ||
+        slab_init(&client_slab, config.max_clients, sizeof(Client)) < 0 ||
+        slab_init(&frame_pool, config.frame_buffers, FRAME_BUFFER_SIZE) < 0 ||
+        slab_init(&inflight_slab, config.max_inflight, sizeof(InFlight)) < 0) 
+    {
+        log_event("ERROR", "Failed to allocate connection slab, frame pool, in-flight table and evaluation queue");
+        if (log_fp) fclose(log_fp);
+        return 1;
+    }
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Connection slab: %d clients, frame pool: %d x %d bytes",
+             config.max_clients, config.frame_buffers, FRAME_BUFFER_SIZE);
+    log_event("STARTUP", log_msg);
+    snprintf(log_msg, sizeof(log_msg), "Admission: %d queued routine reports, %d/s per connection (burst %d)",
+             config.intel_queue, config.intel_rate, config.intel_burst);
+    log_event("STARTUP", log_msg);
+    snprintf(log_msg, sizeof(log_msg), "Command acknowledgement: %d ms timeout, %d retries, %d in flight at most",
+             config.ack_timeout_ms, config.ack_retries, config.max_inflight);
+    log_event("STARTUP", log_msg);
+    if (config.busy_poll_sensors_us || config.busy_poll_effectors_us) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Busy polling: sensors spin %d us, effectors spin %d us (0 blocks)",
+                 config.busy_poll_sensors_us, config.busy_poll_effectors_us);
+        log_event("STARTUP", log_msg);
+    }
+    if (config.assign_window_ms > 0) 
+    {
+        if (assign_init(&assignment, config.max_effectors, config.assign_capacity,
+                        strcmp(config.assign_solver, "auction") == 0, config.assign_budget_us) < 0) 
+        {
+            log_event("ERROR", "Failed to allocate the weapon-target assignment model");
+            if (log_fp) fclose(log_fp);
+            return 1;
+        }
+        snprintf(log_msg, sizeof(log_msg), "Weapon-target assignment: %d ms windows, %s solver (%d us budget), "
+                 "%d weapons per unit, %d effectors at most", config.assign_window_ms, config.assign_solver,
+                 config.assign_budget_us, config.assign_capacity, config.max_effectors);
+        log_event("STARTUP", log_msg);
+    }
+
+    //This opens the stats file with the columns every run has, so runs line up when merged.
+    if (stats_open(&stats, stats_path, "nuclearControl", now_ms()) < 0) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Failed to create stats file %s, continuing without it", stats_path);
+        log_event("ERROR", log_msg);
+    }
+    stat_frames_in = stats_column(&stats, "frames_in");
+    stat_frames_out = stats_column(&stats, "frames_out");
+    stat_reports = stats_column(&stats, "reports");
+    stat_critical = stats_column(&stats, "critical_reports");
+    stat_shed = stats_column(&stats, "shed_reports");
+    stat_commands_sent = stats_column(&stats, "command_frames");
+    stat_threats = stats_column(&stats, "threats");
+    stat_delivery_ms = stats_histogram(&stats, "delivery_ms");
+    stat_queue_wait_ms = stats_histogram(&stats, "queue_wait_ms");
+    stat_handoff_us = stats_histogram(&stats, "handoff_us");
+    stat_migrations = stats_column(&stats, "worker_migrations");
+    stat_rx_wake_us = stats_histogram(&stats, "rx_wake_us");
+    stat_destroyed = stats_column(&stats, "targets_destroyed");
+    stat_flight_ms = stats_histogram(&stats, "time_of_flight_ms");
+    stat_assign_us = stats_histogram(&stats, "assign_us");
+    stat_accepts = stats_column(&stats, "accepts");
+
+    /*A standby follows the primary here until it takes over, when it goes on as the server
+    on the standby ports for the rest of the run, or stands down and writes its summary. */
+    if (config.standby && !run_standby()) 
+    {
+        generate_summary();
+        stats_close(&stats, now_ms());
+        log_event("SHUTDOWN", "Nuclear Control standby terminated");
+        if (log_fp) fclose(log_fp);
+        return 0;
+    }
+
+#ifdef USE_TLS
+    /*With --tls the key and certificate are loaded, or made the first time, before any port
+    is opened. The peer port stays plain TCP, since the other nodes do not speak TLS. */
+    if (config.tls) 
+    {
+        char error[200]; //Leaves room for the prefix in log_msg.
+        int generated;
+        tls_ctx = tls_server_context(TLS_CERT_FILE, TLS_KEY_FILE, &generated, error, sizeof(error));
+        if (!tls_ctx) 
+        {
+            snprintf(log_msg, sizeof(log_msg), "TLS unavailable: %s", error);
+            log_event("ERROR", log_msg);
+            if (log_fp) fclose(log_fp);
+            return 1;
+        }
+        snprintf(log_msg, sizeof(log_msg), "TLS 1.3 on the client ports with %s %s and %s (%s)",
+                 generated ? "a new self-signed" : "the", TLS_CERT_FILE, TLS_KEY_FILE, OpenSSL_version(OPENSSL_VERSION));
+        log_event("STARTUP", log_msg);
+    }
+#endif
+
+    int ports[] = {PORT_SILO, PORT_SUB, PORT_RADAR, PORT_SAT, PORT_PEER};
+    if (config.nodes > 1) 
+    {
+        snprintf(log_msg, sizeof(log_msg), "Cluster node %d of %d, port offset %d",
+                 config.node_id, config.nodes, config.node_id * NODE_PORT_STRIDE);
+        log_event("STARTUP", log_msg);
+    }
 
     /*These for looops starts the servers on multiple ports. If it fails, it
-    closes all opened sockets prior.*/ 
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    closes all opened sockets prior. Each port gets "--acceptors" listeners in a row,
+    followed with --unix-sockets by the local listener of every port.*/ 
+    int port_count = listener_count;
+    listener_count = port_count * config.acceptors + (config.unix_sockets ? port_count : 0);
+    for (int i = 0; i < listener_count; i++) 
     {
-        server_socks[i] = start_server(ports[i]);
-        if (server_socks[i] < 0) {
+        int local = i >= port_count * config.acceptors;
+        int role = ports[local ? i - port_count * config.acceptors : i / config.acceptors];
+        listeners[i].role = role;
+        listeners[i].acceptor = local ? 0 : i % config.acceptors;
+        listeners[i].local = local;
+        listeners[i].port = role + config.node_id * NODE_PORT_STRIDE + (config.standby ? STANDBY_PORT_OFFSET : 0);
+        listeners[i].sock = local ? start_local_server(listeners[i].port)
+                                  : start_server(listeners[i].port, config.acceptors > 1);
+        if (listeners[i].sock < 0) {
             for (int j = 0; j < i; j++) 
             {
-                if (server_socks[j] != -1) 
+                if (listeners[j].sock != -1) 
                 {
-                    close(server_socks[j]);
+                    close(listeners[j].sock);
                 }
             }
             if (log_fp) fclose(log_fp);
@@ -550,85 +3858,133 @@ int main(int argc, char *argv[])
         }
     }
 
-    /*This for loop launches threads that stores sockets and port to accept clients. */
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    /*This starts accepting clients on the chosen backend. If the kernel does not
+    allow io_uring the server carries on with the thread backend. */
+    backend = strcmp(config.io_backend, "uring") == 0 ? &uring_backend : &thread_backend;
+    if (backend->start(listener_count) < 0) 
     {
-        int *args = malloc(sizeof(int) * 2);
-        if (!args) 
-        {
-            log_event("ERROR", "Failed to allocate memory for accept thread args");
-            continue;
-        }
-        args[0] = server_socks[i];
-        args[1] = ports[i];
-        if (pthread_create(&accept_threads[i], NULL, accept_clients, args) != 0) 
-        {
-            char log_msg[256];
-            snprintf(log_msg, sizeof(log_msg), "Failed to create accept thread for port %d", ports[i]);
-            log_event("ERROR", log_msg);
-            free(args);
-            continue;
-        }
+        log_event("ERROR", "io_uring unavailable, falling back to the thread backend");
+        backend = &thread_backend;
+        backend->start(listener_count);
+    }
+    snprintf(log_msg, sizeof(log_msg), "I/O backend: %s", backend->name);
+    log_event("STARTUP", log_msg);
+    log_topology();
+    pin_thread(&timer_cpus, "main");
+    if (failover_cause) 
+    {
+        failover_listening_ms = now_ms();
+        snprintf(log_msg, sizeof(log_msg), "Listening on the standby ports %lld ms after the primary was lost",
+                 failover_listening_ms - failover_lost_ms);
+        log_event("FAILOVER", log_msg);
     }
 
-    //This runs the simulation in test mode.
-    if (test_mode) 
+    //This starts the timer wheel that retransmits unacknowledged commands.
+    pthread_t timer_thread;
+    wheel_tick = now_ms() / WHEEL_TICK_MS;
+    int timer_started = pthread_create(&timer_thread, NULL, ack_timer, NULL) == 0;
+    if (!timer_started) 
+    {
+        log_event("ERROR", "Failed to create the acknowledgement timer thread");
+    }
+
+    //This starts the worker that evaluates routine reports from the queue.
+    pthread_t worker_thread;
+    int worker_started = pthread_create(&worker_thread, NULL, intel_worker, NULL) == 0;
+    if (!worker_started) 
+    {
+        log_event("ERROR", "Failed to create the evaluation worker thread");
+    }
+
+    //This runs the simulation in test mode. A standby that took over joins a run already under way.
+    if (config.test_mode && !failover_cause) 
     {
         simulate_war_test();
     }
 
-    time_t start_time = time(NULL);
-    while (time(NULL) - start_time < SIMULATION_DURATION && atomic_load(&running)) 
+    /*A standby that took over ends when the primary's run would have, which it was
+    sent as a wall clock time since the two processes do not share a start. */
+    long long end_ms = now_ms() + SIMULATION_DURATION * 1000LL;
+    if (failover_cause && atomic_load(&run_end_wall_ms) > 0) 
+    {
+        end_ms = now_ms() + (atomic_load(&run_end_wall_ms) - wall_ms());
+    }
+    else 
+    {
+        atomic_store(&run_end_wall_ms, wall_ms() + SIMULATION_DURATION * 1000LL);
+    }
+    while (!atomic_load(&stop_requested) && now_ms() < end_ms) 
     {
             
-        //Keeps track how much time left within a 60 seconds duration.
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Simulation running: %ld seconds remaining",
-                 SIMULATION_DURATION - (time(NULL) - start_time));
+        //Keeps track how much time left within a 60 seconds duration, ending early on a stop signal.
+        long long left = end_ms - now_ms();
+        snprintf(log_msg, sizeof(log_msg), "Simulation running: %lld seconds remaining", (left + 999) / 1000);
         log_event("SIMULATION", log_msg);
-        sleep(5);
+        wait_for_stop(left < 5000 ? left : 5000);
     }
 
+    /*This is the drain. Nothing new is accepted or admitted from here on, the worker finishes
+    the reports already queued, and then every connection is ended with an END frame. */
+    long long stop_ms = now_ms();
     atomic_store(&running, false);
 
-    //This closes all server sockets.
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    //This closes all server sockets and removes the socket files of the local ones.
+    for (int i = 0; i < listener_count; i++) 
     {
-        if (server_socks[i] != -1) 
+        if (listeners[i].sock != -1) 
         {
-            shutdown(server_socks[i], SHUT_RDWR);
-            close(server_socks[i]);
+            shutdown(listeners[i].sock, SHUT_RDWR);
+            close(listeners[i].sock);
         }
-    }
-
-    //This wait for all threads to finish 
-    for (int i = 0; i < MAX_CLIENTS; i++) 
-    {
-        if (accept_threads[i]) 
+        if (listeners[i].local) 
         {
-            pthread_join(accept_threads[i], NULL);
+            char path[64];
+            snprintf(path, sizeof(path), UNIX_SOCKET_PATH, listeners[i].port);
+            unlink(path);
         }
     }
 
-    //This disconnect all clients at the end.
+    /*This waits for the timer and the worker, then ends the connections and finally waits
+    for the backend's threads, since the timer and the drain still send through the backend. */
+    if (timer_started) 
+    {
+        pthread_join(timer_thread, NULL);
+    }
+    if (worker_started) 
+    {
+        pthread_mutex_lock(&intel_mutex);
+        pthread_cond_broadcast(&intel_ready);
+        pthread_mutex_unlock(&intel_mutex);
+        pthread_join(worker_thread, NULL);
+    }
     pthread_mutex_lock(&clients_mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) 
+    if (config.assign_window_ms > 0 && assignment.target_count > 0) close_assignment_window(); //The last decisions still go out.
+    pthread_mutex_unlock(&clients_mutex);
+    repl_finish();
+    drain_clients();
+    backend->stop(listener_count);
+
+    //This closes the peer links to the other nodes of a cluster.
+    pthread_mutex_lock(&peer_mutex);
+    for (int i = 0; i < MAX_NODES; i++) 
     {
-        if (clients[i].valid) 
+        if (peer_socks[i] >= 0) 
         {
-            shutdown(clients[i].sock, SHUT_RDWR);
-            close(clients[i].sock);
-            clients[i].valid = false;
+            close(peer_socks[i]);
+            peer_socks[i] = -1;
         }
     }
-    atomic_store(&client_count, 0);
-    pthread_mutex_unlock(&clients_mutex);
+    pthread_mutex_unlock(&peer_mutex);
 
+    sample_stats(now_ms());
     generate_summary();
+    stats_close(&stats, now_ms());
+    snprintf(log_msg, sizeof(log_msg), "Drained %d clients in %lld ms, summary written %lld ms after the stop",
+             drain_closed + drain_forced, drain_ms, now_ms() - stop_ms);
+    log_event("SHUTDOWN", log_msg);
 
     //Prints out the shutdown message in the log file.
     log_event("SHUTDOWN", "Nuclear Control terminated");
     if (log_fp) fclose(log_fp);
     return 0;
 }
-
@@ -0,0 +1,465 @@
+/*This is the simulated constellation used by the satellite client. The satellites fly
+Keplerian orbits whose node and perigee drift with the J2 term of the Earth's oblateness,
+and every step propagates all of them, turns their positions into the Earth fixed frame
+and checks which of the ORBIT_REGIONS watched regions each one can see. The client then
+reports the threats in a region through a unit whose satellite is overhead.
+
+The orbits are kept as a structure of arrays and propagated ORBIT_LANES satellites at a
+time with GCC's vector extensions, like the radar sweep in radarModel.h. Kepler's equation
+is solved with Newton steps and the sines and cosines are polynomials, so the kernel needs
+no libm. The constellation can be split over "--propagate-threads" threads that meet at a
+barrier every step, and orbit_propagate_scalar is the same computation one satellite at a
+time for "--benchmark".
+
+A satellite sees a region when the region's centre has it at least ORBIT_MIN_ELEVATION
+degrees above the horizon, which is tested from the dot product of the two positions
+without any trigonometry.*/
+#ifndef ORBIT_MODEL_H
+#define ORBIT_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "modelThreads.h"
+
+#define ORBIT_EARTH_RADIUS_KM 6378.137f
+#define ORBIT_MU 398600.4418          //Earth's gravitational parameter in km3/s2.
+#define ORBIT_J2 1.08263e-3
+#define ORBIT_EARTH_RATE 7.2921159e-5 //Earth's rotation in rad/s.
+#define ORBIT_ALTITUDE_KM 550.0f
+#define ORBIT_MIN_ELEVATION 10.0f
+#define ORBIT_DEFAULT_STEP_S 10
+#define ORBIT_MAX_STEP_S 600          //Less than a tenth of an orbit, so angles wrap at most once per step.
+#define ORBIT_MAX_SATELLITES (1 << 20)
+#define ORBIT_MAX_THREADS 64
+#define ORBIT_REGIONS 4
+#define ORBIT_PI 3.14159265f
+
+#ifdef __AVX__
+#define ORBIT_LANES 8
+#else
+#define ORBIT_LANES 4
+#endif
+
+typedef float OrbitVec __attribute__((vector_size(ORBIT_LANES * sizeof(float))));
+typedef int32_t OrbitMask __attribute__((vector_size(ORBIT_LANES * sizeof(int32_t))));
+
+/*These are the settings the satellite client accepts on the command line: "--satellites N"
+in the constellation (0 keeps the old random reports), "--step-s S" of simulated time per
+propagation, "--time-scale X" simulated seconds per real second, "--propagate-threads N"
+and "--benchmark STEPS" to time the propagation without a server.*/
+typedef struct
+{
+    int satellites;
+    int step_s;
+    int time_scale;
+    int threads;
+    int benchmark;
+} OrbitConfig;
+
+//These are the regions the constellation watches, with the latitude and longitude of their centres.
+static const struct
+{
+    const char *name;
+    float latitude;
+    float longitude;
+} orbit_regions[ORBIT_REGIONS] =
+{
+    {"Arctic Ocean", 82.0f, 0.0f},
+    {"Mediterranean", 35.0f, 18.0f},
+    {"Barents Sea", 74.0f, 40.0f},
+    {"North Sea", 56.0f, 3.0f}
+};
+
+typedef struct OrbitModel OrbitModel;
+
+/*These are the orbits and the counters the summary reports. Every field is an array with
+one entry per satellite, padded to a whole number of vectors with satellites that never
+see anything. Angles are kept in radians between 0 and 2 pi.*/
+struct OrbitModel
+{
+    OrbitConfig config;
+    int planes;
+    size_t count;
+    float *anomaly, *motion;     //Mean anomaly and mean motion in rad/s.
+    float *node, *node_rate;     //Right ascension of the ascending node and its J2 drift.
+    float *perigee, *perigee_rate;
+    float *eccentricity, *axis, *minor_axis; //Semi-major and semi-minor axes in km.
+    float *cos_incl, *sin_incl;
+    float *x, *y, *z;            //Earth fixed position in km after the last step.
+    int32_t *seen;               //Bit r is set when the satellite sees region r.
+    int32_t *valid;              //-1 for real satellites, 0 for the padding.
+    float region_x[ORBIT_REGIONS], region_y[ORBIT_REGIONS], region_z[ORBIT_REGIONS];
+    int seen_by[ORBIT_REGIONS];  //The first satellite that saw each region in the last step, or -1.
+    double earth_angle;
+    double simulated_s;
+    int scalar;                  //Set by the benchmark to use orbit_propagate_scalar.
+    float dt, cos_earth, sin_earth;
+    ModelPool pool;
+    unsigned long steps;
+    unsigned long long propagations;
+    unsigned long long overhead[ORBIT_REGIONS]; //Satellites seeing each region, summed over the steps.
+    long long propagate_ns_total;
+    long long propagate_ns_max;
+};
+
+/*This consumes one constellation option at argv[*i]. It returns 1 if the option
+belonged to the model, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int orbit_parse_option(OrbitConfig *config, int argc, char *argv[], int *i)
+{
+    int *target = NULL;
+    if (strcmp(argv[*i], "--satellites") == 0) target = &config->satellites;
+    else if (strcmp(argv[*i], "--step-s") == 0) target = &config->step_s;
+    else if (strcmp(argv[*i], "--time-scale") == 0) target = &config->time_scale;
+    else if (strcmp(argv[*i], "--propagate-threads") == 0) target = &config->threads;
+    else if (strcmp(argv[*i], "--benchmark") == 0) target = &config->benchmark;
+    else return 0;
+
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+    *target = atoi(argv[++*i]);
+    return (config->satellites <= ORBIT_MAX_SATELLITES && config->step_s > 0 && config->step_s <= ORBIT_MAX_STEP_S &&
+            config->time_scale > 0 && config->threads > 0 && config->threads <= ORBIT_MAX_THREADS) ? 1 : -1;
+}
+
+/*This returns the sine of x for x between -3 pi / 2 and 3 pi / 2. x is folded into
+[-pi / 2, pi / 2] and the Taylor series to x^11 is within 1e-7 there.*/
+static inline float orbit_sin_folded(float x)
+{
+    if (x > ORBIT_PI / 2.0f) x = ORBIT_PI - x;
+    else if (x < -ORBIT_PI / 2.0f) x = -ORBIT_PI - x;
+    float s = x * x;
+    return x * (1.0f + s * (-1.0f / 6.0f + s * (1.0f / 120.0f + s * (-1.0f / 5040.0f + s * (1.0f / 362880.0f -
+                s / 39916800.0f)))));
+}
+
+//These return the sine and cosine of an angle between -pi / 2 and 2 pi.
+static inline float orbit_sin(float x)
+{
+    return -orbit_sin_folded(x - ORBIT_PI);
+}
+
+static inline float orbit_cos(float x)
+{
+    return -orbit_sin_folded(x - ORBIT_PI / 2.0f);
+}
+
+//This brings an angle that has crossed 0 or 2 pi at most once back between them.
+static inline float orbit_wrap(float x)
+{
+    if (x >= 2.0f * ORBIT_PI) return x - 2.0f * ORBIT_PI;
+    if (x < 0.0f) return x + 2.0f * ORBIT_PI;
+    return x;
+}
+
+//This is the square root by Newton's method, only used while the orbits are set up.
+static inline double orbit_sqrt(double v)
+{
+    double r = v > 1.0 ? v : 1.0;
+    for (int i = 0; i < 64 && v > 0.0; i++) r = 0.5 * (r + v / r);
+    return v > 0.0 ? r : 0.0;
+}
+
+//This stops the propagation threads and releases the orbit arrays, or whatever orbit_init reserved.
+static inline void orbit_destroy(OrbitModel *model)
+{
+    model_pool_stop(&model->pool);
+    float **fields[] = {&model->anomaly, &model->motion, &model->node, &model->node_rate, &model->perigee,
+                        &model->perigee_rate, &model->eccentricity, &model->axis, &model->minor_axis,
+                        &model->cos_incl, &model->sin_incl, &model->x, &model->y, &model->z};
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        free(*fields[f]);
+    }
+    free(model->seen);
+    free(model->valid);
+    memset(model, 0, sizeof(*model));
+}
+
+/*This reserves the arrays and lays the constellation out as a Walker pattern: about
+sqrt(N) / 2 planes evenly spaced in node, alternating between 53 degrees and sun
+synchronous 97.6 degrees so the polar regions are covered too, with the satellites
+evenly spaced along each plane and a little random eccentricity. It returns 0 or -1,
+and frees what it reserved on failure.*/
+static inline int orbit_init(OrbitModel *model, const OrbitConfig *config)
+{
+    memset(model, 0, sizeof(*model));
+    model->config = *config;
+    model->count = ((size_t)config->satellites + ORBIT_LANES - 1) / ORBIT_LANES * ORBIT_LANES;
+    size_t size = (model->count > 0 ? model->count : ORBIT_LANES) * sizeof(float);
+    float **fields[] = {&model->anomaly, &model->motion, &model->node, &model->node_rate, &model->perigee,
+                        &model->perigee_rate, &model->eccentricity, &model->axis, &model->minor_axis,
+                        &model->cos_incl, &model->sin_incl, &model->x, &model->y, &model->z};
+    int failed = 0;
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        failed |= !(*fields[f] = aligned_alloc(sizeof(OrbitVec), size));
+    }
+    failed |= !(model->seen = aligned_alloc(sizeof(OrbitVec), size));
+    failed |= !(model->valid = aligned_alloc(sizeof(OrbitVec), size));
+    if (failed)
+    {
+        orbit_destroy(model);
+        return -1;
+    }
+
+    model->planes = (int)(orbit_sqrt((double)config->satellites) / 2.0);
+    if (model->planes < 1) model->planes = 1;
+    int per_plane = (config->satellites + model->planes - 1) / model->planes;
+    for (size_t s = 0; s < model->count; s++)
+    {
+        int plane = (int)s / per_plane;
+        int slot = (int)s % per_plane;
+        double incl = (plane % 2 ? 97.6 : 53.0) * ORBIT_PI / 180.0;
+        double e = (double)(rand() % 1000) / 1000000.0;
+        double a = ORBIT_EARTH_RADIUS_KM + ORBIT_ALTITUDE_KM + (float)(rand() % 2000) / 100.0f;
+        double p = a * (1.0 - e * e);
+        double n = orbit_sqrt(ORBIT_MU / (a * a * a));
+        double c = orbit_cos((float)incl);
+        double j2 = 1.5 * n * ORBIT_J2 * (ORBIT_EARTH_RADIUS_KM / p) * (ORBIT_EARTH_RADIUS_KM / p);
+
+        model->anomaly[s] = orbit_wrap(2.0f * ORBIT_PI * ((float)slot / per_plane + (float)plane / config->satellites));
+        model->motion[s] = (float)n;
+        model->node[s] = 2.0f * ORBIT_PI * (float)plane / model->planes;
+        model->node_rate[s] = (float)(-j2 * c);
+        model->perigee[s] = 2.0f * ORBIT_PI * (float)(rand() % 1000) / 1000.0f;
+        model->perigee_rate[s] = (float)(0.5 * j2 * (5.0 * c * c - 1.0));
+        model->eccentricity[s] = (float)e;
+        model->axis[s] = (float)a;
+        model->minor_axis[s] = (float)(a * orbit_sqrt(1.0 - e * e));
+        model->cos_incl[s] = (float)c;
+        model->sin_incl[s] = orbit_sin((float)incl);
+        model->x[s] = model->y[s] = model->z[s] = 0.0f;
+        model->seen[s] = 0;
+        model->valid[s] = s < (size_t)config->satellites ? -1 : 0;
+    }
+
+    //The regions are unit vectors in the Earth fixed frame.
+    for (int r = 0; r < ORBIT_REGIONS; r++)
+    {
+        float lat = orbit_regions[r].latitude * ORBIT_PI / 180.0f;
+        float lon = orbit_wrap(orbit_regions[r].longitude * ORBIT_PI / 180.0f);
+        model->region_x[r] = orbit_cos(lat) * orbit_cos(lon);
+        model->region_y[r] = orbit_cos(lat) * orbit_sin(lon);
+        model->region_z[r] = orbit_sin(lat);
+    }
+    return 0;
+}
+
+//This picks a where bits are set in the mask and b elsewhere.
+static inline OrbitVec orbit_select(OrbitMask mask, OrbitVec a, OrbitVec b)
+{
+    return (OrbitVec)(((OrbitMask)a & mask) | ((OrbitMask)b & ~mask));
+}
+
+//This is orbit_sin_folded for every lane.
+static inline OrbitVec orbit_sin_folded_vec(OrbitVec x)
+{
+    x = orbit_select(x > ORBIT_PI / 2.0f, ORBIT_PI - x, orbit_select(x < -ORBIT_PI / 2.0f, -ORBIT_PI - x, x));
+    OrbitVec s = x * x;
+    return x * (1.0f + s * (-1.0f / 6.0f + s * (1.0f / 120.0f + s * (-1.0f / 5040.0f + s * (1.0f / 362880.0f -
+                s / 39916800.0f)))));
+}
+
+//This is orbit_wrap for every lane.
+static inline OrbitVec orbit_wrap_vec(OrbitVec x)
+{
+    x = orbit_select(x >= 2.0f * ORBIT_PI, x - 2.0f * ORBIT_PI, x);
+    return orbit_select(x < 0.0f, x + 2.0f * ORBIT_PI, x);
+}
+
+/*This is the propagation kernel for the satellites from first to end, which must be on
+ORBIT_LANES boundaries. It moves every orbit on by the model's dt, solves Kepler's
+equation for the eccentric anomaly with three Newton steps from M + e sin M, rotates
+the position out of the orbit's plane into the Earth fixed frame and sets the bits of
+the regions each satellite sees.*/
+static inline void orbit_propagate_vector(OrbitModel *model, size_t first, size_t end)
+{
+    const float elevation = 0.17364818f; //sin(ORBIT_MIN_ELEVATION)
+    const float re = ORBIT_EARTH_RADIUS_KM;
+    float dt = model->dt, ce = model->cos_earth, se = model->sin_earth;
+    for (size_t i = first; i < end; i += ORBIT_LANES)
+    {
+        OrbitVec *anomaly = (OrbitVec *)&model->anomaly[i];
+        OrbitVec *node = (OrbitVec *)&model->node[i];
+        OrbitVec *perigee = (OrbitVec *)&model->perigee[i];
+        *anomaly = orbit_wrap_vec(*anomaly + *(OrbitVec *)&model->motion[i] * dt);
+        *node = orbit_wrap_vec(*node + *(OrbitVec *)&model->node_rate[i] * dt);
+        *perigee = orbit_wrap_vec(*perigee + *(OrbitVec *)&model->perigee_rate[i] * dt);
+
+        OrbitVec m = *anomaly;
+        OrbitVec e = *(OrbitVec *)&model->eccentricity[i];
+        OrbitVec ea = m + e * -orbit_sin_folded_vec(m - ORBIT_PI);
+        for (int step = 0; step < 3; step++)
+        {
+            OrbitVec sin_ea = -orbit_sin_folded_vec(ea - ORBIT_PI);
+            OrbitVec cos_ea = -orbit_sin_folded_vec(ea - ORBIT_PI / 2.0f);
+            ea -= (ea - e * sin_ea - m) / (1.0f - e * cos_ea);
+        }
+        OrbitVec px = *(OrbitVec *)&model->axis[i] * (-orbit_sin_folded_vec(ea - ORBIT_PI / 2.0f) - e);
+        OrbitVec py = *(OrbitVec *)&model->minor_axis[i] * -orbit_sin_folded_vec(ea - ORBIT_PI);
+
+        //This rotates by the argument of perigee, the inclination and the node, then by the Earth's turn.
+        OrbitVec cw = -orbit_sin_folded_vec(*perigee - ORBIT_PI / 2.0f), sw = -orbit_sin_folded_vec(*perigee - ORBIT_PI);
+        OrbitVec cn = -orbit_sin_folded_vec(*node - ORBIT_PI / 2.0f), sn = -orbit_sin_folded_vec(*node - ORBIT_PI);
+        OrbitVec ci = *(OrbitVec *)&model->cos_incl[i], si = *(OrbitVec *)&model->sin_incl[i];
+        OrbitVec u = cw * px - sw * py;
+        OrbitVec v = sw * px + cw * py;
+        OrbitVec xi = cn * u - sn * ci * v;
+        OrbitVec yi = sn * u + cn * ci * v;
+        OrbitVec x = ce * xi + se * yi;
+        OrbitVec y = ce * yi - se * xi;
+        OrbitVec z = si * v;
+        *(OrbitVec *)&model->x[i] = x;
+        *(OrbitVec *)&model->y[i] = y;
+        *(OrbitVec *)&model->z[i] = z;
+
+        /*A region sees the satellite above the minimum elevation when the height above its
+        horizon plane h = r.u - Re is positive and h^2 >= sin^2(elevation) |r - Re u|^2.*/
+        OrbitVec r2 = x * x + y * y + z * z;
+        OrbitMask seen = (OrbitMask){0};
+        for (int r = 0; r < ORBIT_REGIONS; r++)
+        {
+            OrbitVec dot = x * model->region_x[r] + y * model->region_y[r] + z * model->region_z[r];
+            OrbitVec h = dot - re;
+            OrbitMask visible = (h > 0.0f) & (h * h >= elevation * elevation * (r2 - 2.0f * re * dot + re * re));
+            seen |= visible & (1 << r);
+        }
+        *(OrbitMask *)&model->seen[i] = seen & *(OrbitMask *)&model->valid[i];
+    }
+}
+
+//This is the same propagation one satellite at a time, for comparison with the kernel above.
+static inline void orbit_propagate_scalar(OrbitModel *model, size_t first, size_t end)
+{
+    const float elevation = 0.17364818f;
+    const float re = ORBIT_EARTH_RADIUS_KM;
+    float dt = model->dt, ce = model->cos_earth, se = model->sin_earth;
+    for (size_t i = first; i < end; i++)
+    {
+        model->anomaly[i] = orbit_wrap(model->anomaly[i] + model->motion[i] * dt);
+        model->node[i] = orbit_wrap(model->node[i] + model->node_rate[i] * dt);
+        model->perigee[i] = orbit_wrap(model->perigee[i] + model->perigee_rate[i] * dt);
+
+        float m = model->anomaly[i], e = model->eccentricity[i];
+        float ea = m + e * orbit_sin(m);
+        for (int step = 0; step < 3; step++)
+        {
+            ea -= (ea - e * orbit_sin(ea) - m) / (1.0f - e * orbit_cos(ea));
+        }
+        float px = model->axis[i] * (orbit_cos(ea) - e);
+        float py = model->minor_axis[i] * orbit_sin(ea);
+
+        float cw = orbit_cos(model->perigee[i]), sw = orbit_sin(model->perigee[i]);
+        float cn = orbit_cos(model->node[i]), sn = orbit_sin(model->node[i]);
+        float u = cw * px - sw * py;
+        float v = sw * px + cw * py;
+        float xi = cn * u - sn * model->cos_incl[i] * v;
+        float yi = sn * u + cn * model->cos_incl[i] * v;
+        float x = ce * xi + se * yi;
+        float y = ce * yi - se * xi;
+        float z = model->sin_incl[i] * v;
+        model->x[i] = x;
+        model->y[i] = y;
+        model->z[i] = z;
+
+        float r2 = x * x + y * y + z * z;
+        int32_t seen = 0;
+        for (int r = 0; r < ORBIT_REGIONS; r++)
+        {
+            float dot = x * model->region_x[r] + y * model->region_y[r] + z * model->region_z[r];
+            float h = dot - re;
+            if (h > 0.0f && h * h >= elevation * elevation * (r2 - 2.0f * re * dot + re * re)) seen |= 1 << r;
+        }
+        model->seen[i] = seen & model->valid[i];
+    }
+}
+
+//This propagates a share of the constellation with the kernel the model is set to use.
+static inline void orbit_propagate(OrbitModel *model, size_t first, size_t end)
+{
+    if (model->scalar) orbit_propagate_scalar(model, first, end);
+    else orbit_propagate_vector(model, first, end);
+}
+
+//This propagates a thread's share of the constellation, split on ORBIT_LANES boundaries.
+static inline void orbit_propagate_share(void *arg, int index)
+{
+    OrbitModel *model = arg;
+    size_t vectors = model->count / ORBIT_LANES;
+    size_t threads = (size_t)model->config.threads;
+    orbit_propagate(model, vectors * (size_t)index / threads * ORBIT_LANES,
+                    vectors * (size_t)(index + 1) / threads * ORBIT_LANES);
+}
+
+/*This starts a thread for every share of the constellation but the first, which the
+stepping thread does itself. It returns 0 or -1, and the model carries on single threaded
+if it fails.*/
+static inline int orbit_start_threads(OrbitModel *model)
+{
+    return model_pool_start(&model->pool, model->config.threads, orbit_propagate_share, model);
+}
+
+/*This advances the constellation by dt seconds: the Earth turns, every satellite is
+propagated (by every thread at once if there are several) and the first satellite over
+each region is noted. Only the propagation is timed for its cost.*/
+static inline void orbit_step(OrbitModel *model, float dt)
+{
+    model->earth_angle += ORBIT_EARTH_RATE * dt;
+    while (model->earth_angle >= 2.0 * ORBIT_PI) model->earth_angle -= 2.0 * ORBIT_PI;
+    model->simulated_s += dt;
+    model->dt = dt;
+    model->cos_earth = orbit_cos((float)model->earth_angle);
+    model->sin_earth = orbit_sin((float)model->earth_angle);
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (model->pool.workers)
+    {
+        model_pool_run(&model->pool);
+    }
+    else
+    {
+        orbit_propagate(model, 0, model->count);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    long long ns = (finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec);
+    model->steps++;
+    model->propagations += (unsigned long long)model->config.satellites;
+    model->propagate_ns_total += ns;
+    if (ns > model->propagate_ns_max) model->propagate_ns_max = ns;
+
+    for (int r = 0; r < ORBIT_REGIONS; r++) model->seen_by[r] = -1;
+    for (size_t s = 0; s < model->count; s++)
+    {
+        if (!model->seen[s]) continue;
+        for (int r = 0; r < ORBIT_REGIONS; r++)
+        {
+            if (!(model->seen[s] & (1 << r))) continue;
+            model->overhead[r]++;
+            if (model->seen_by[r] < 0) model->seen_by[r] = (int)s;
+        }
+    }
+}
+
+//This writes the constellation figures to a summary file.
+static inline void orbit_report(const OrbitModel *model, FILE *summary_fp)
+{
+    fprintf(summary_fp, "Constellation: %d satellites in %d planes, Step: %d s, Time Scale: %dx, "
+            "Propagation Threads: %d, Kernel Width: %d lanes\n", model->config.satellites, model->planes,
+            model->config.step_s, model->config.time_scale, model->pool.workers ? model->config.threads : 1, ORBIT_LANES);
+    fprintf(summary_fp, "Steps: %lu, Simulated Time: %.0f s, Propagations: %llu, Cost: %.2f ns each, max %.3f ms per step\n",
+            model->steps, model->simulated_s, model->propagations,
+            model->propagations ? (double)model->propagate_ns_total / (double)model->propagations : 0.0,
+            (double)model->propagate_ns_max / 1e6);
+    fprintf(summary_fp, "Satellites Overhead (avg):");
+    for (int r = 0; r < ORBIT_REGIONS; r++)
+    {
+        fprintf(summary_fp, "%s %s %.1f", r ? "," : "", orbit_regions[r].name,
+                model->steps ? (double)model->overhead[r] / (double)model->steps : 0.0);
+    }
+    fprintf(summary_fp, "\n");
+}
+
+#endif
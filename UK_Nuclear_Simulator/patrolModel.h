@@ -0,0 +1,475 @@
+/*This is the patrol model submarine runs when it is started with "--patrol". Every unit
+the process hosts becomes a boat on the map of assignmentModel.h, starting from the station
+assign_place gives that submarine, so nuclearControl's assignment and the boats agree on
+where they are. A boat patrols at PATROL_SPEED_KMS between random waypoints within
+PATROL_BOX_KM of its station, and after it fires it evades at PATROL_EVADE_KMS, away from
+its target, for PATROL_EVADE_S before returning to its patrol.
+
+The boats are kept as a structure of arrays and indexed in a uniform grid of
+PATROL_CELL_KM sea areas, each cell an array of its boats with a copy of their positions,
+so a lookup reads each cell it covers in one sweep. A tick moves the boats and their
+copies; the ones that crossed into another cell are collected and moved between the cells'
+arrays afterwards, so the grid is updated incrementally rather than rebuilt. With "--patrol-threads N" the boats
+are split into N shares that meet at a barrier once per tick, like the flight threads of
+flightModel.h. Finding the boats within range of a target only looks at the cells the
+range covers, which is what limits a broadcast command to the boats in range.*/
+#ifndef PATROL_MODEL_H
+#define PATROL_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "assignmentModel.h"
+#include "modelThreads.h"
+
+#define PATROL_CELL_KM 100.0f
+#define PATROL_GRID 80           //ASSIGN_WORLD_KM / PATROL_CELL_KM cells each way.
+#define PATROL_TICK_MS 100       //How often the boats are moved.
+#define PATROL_PARALLEL_MIN 2048 //Fewer boats than this are moved on the calling thread.
+#define PATROL_MAX_THREADS 64
+#define PATROL_MAX_BOATS (1 << 20)
+#define PATROL_BOX_KM 100.0f
+#define PATROL_SPEED_KMS 0.0041f //8 knots.
+#define PATROL_EVADE_KMS 0.0129f //25 knots.
+#define PATROL_EVADE_S 600.0f
+#define PATROL_EVADE_KM 50.0f    //How far an evading boat heads away from its target.
+#define PATROL_DEFAULT_RANGE_KM 500
+#define PATROL_DEFAULT_TIME_SCALE 60
+
+/*These are the settings submarine accepts on the command line for the model: "--patrol"
+to move the boats and limit broadcast commands to the ones in range, "--patrol-threads N",
+"--patrol-time-scale X" simulated seconds per real second, "--patrol-range-km KM" within
+which a boat engages a target and "--patrol-benchmark N" to run N boats without a server.*/
+typedef struct
+{
+    int enabled;
+    int threads;
+    int time_scale;
+    int range_km;
+    int benchmark;
+} PatrolConfig;
+
+typedef struct PatrolModel PatrolModel;
+
+//This is a boat's entry in its cell.
+typedef struct
+{
+    float x, y;
+    int boat;
+} PatrolSlot;
+
+/*This is the model: the boats, boat i being unit i + 1, the grid and the counters the
+summary reports. cell and slot hold where each boat is in the grid.*/
+struct PatrolModel
+{
+    PatrolConfig config;
+    int count;
+    float *x, *y;
+    float *wx, *wy;   //The waypoint the boat is heading for.
+    float *sx, *sy;   //Its patrol station.
+    float *evade_s;   //Simulated seconds of evasion left, 0 on patrol.
+    uint32_t *seed;
+    int *cell;
+    int *slot;
+    PatrolSlot **cells;
+    int *cell_count, *cell_capacity;
+    int *moved;       //The boats that changed cell, in each thread's share of the array.
+    int *found;       //Room for every boat, for the results of patrol_in_range.
+    long long last_tick_ms;
+    float tick_s;
+    ModelPool pool;
+    int moved_count[PATROL_MAX_THREADS]; //How many boats of each thread's share changed cell.
+    unsigned long ticks;
+    unsigned long long boat_updates;
+    long long update_ns_total;
+    unsigned long cell_moves;
+    unsigned long queries;
+    unsigned long long boats_tested;
+    unsigned long long boats_in_range;
+    unsigned long evasions;
+};
+
+/*This consumes one patrol option at argv[*i]. It returns 1 if the option belonged to
+the model, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int patrol_parse_option(PatrolConfig *config, int argc, char *argv[], int *i)
+{
+    int *target = NULL;
+    if (strcmp(argv[*i], "--patrol") == 0)
+    {
+        config->enabled = 1;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--patrol-threads") == 0) target = &config->threads;
+    else if (strcmp(argv[*i], "--patrol-time-scale") == 0) target = &config->time_scale;
+    else if (strcmp(argv[*i], "--patrol-range-km") == 0) target = &config->range_km;
+    else if (strcmp(argv[*i], "--patrol-benchmark") == 0) target = &config->benchmark;
+    else return 0;
+
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+    *target = atoi(argv[++*i]);
+    return (config->threads > 0 && config->threads <= PATROL_MAX_THREADS && config->time_scale > 0 &&
+            config->range_km > 0 && config->range_km < (int)ASSIGN_WORLD_KM &&
+            config->benchmark <= PATROL_MAX_BOATS) ? 1 : -1;
+}
+
+//This is a boat's own random number generator (xorshift), so the threads never share one.
+static inline float patrol_random(uint32_t *seed)
+{
+    uint32_t s = *seed;
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    *seed = s;
+    return assign_spread(s >> 8);
+}
+
+static inline int patrol_cell(float x, float y)
+{
+    int cx = (int)((x + ASSIGN_WORLD_KM / 2.0f) / PATROL_CELL_KM);
+    int cy = (int)((y + ASSIGN_WORLD_KM / 2.0f) / PATROL_CELL_KM);
+    return cy * PATROL_GRID + cx;
+}
+
+//This makes room for one more boat in a cell, doubling its array when it is full. It returns 0 or -1.
+static inline int patrol_reserve(PatrolModel *model, int cell)
+{
+    if (model->cell_count[cell] < model->cell_capacity[cell]) return 0;
+    int capacity = model->cell_capacity[cell] ? 2 * model->cell_capacity[cell] : 8;
+    PatrolSlot *slots = realloc(model->cells[cell], (size_t)capacity * sizeof(PatrolSlot));
+    if (!slots) return -1;
+    model->cells[cell] = slots;
+    model->cell_capacity[cell] = capacity;
+    return 0;
+}
+
+/*These add a boat to a cell, which must have room, and take it out again by moving the
+cell's last boat into its place.*/
+static inline void patrol_link(PatrolModel *model, int boat, int cell)
+{
+    PatrolSlot *slot = &model->cells[cell][model->cell_count[cell]];
+    slot->x = model->x[boat];
+    slot->y = model->y[boat];
+    slot->boat = boat;
+    model->cell[boat] = cell;
+    model->slot[boat] = model->cell_count[cell]++;
+}
+
+static inline void patrol_unlink(PatrolModel *model, int boat)
+{
+    int cell = model->cell[boat];
+    int last = --model->cell_count[cell];
+    if (model->slot[boat] != last)
+    {
+        model->cells[cell][model->slot[boat]] = model->cells[cell][last];
+        model->slot[model->cells[cell][last].boat] = model->slot[boat];
+    }
+}
+
+//This gives a boat its next waypoint within its patrol box.
+static inline void patrol_waypoint(PatrolModel *model, int boat)
+{
+    model->wx[boat] = assign_clamp(model->sx[boat] + patrol_random(&model->seed[boat]) * PATROL_BOX_KM);
+    model->wy[boat] = assign_clamp(model->sy[boat] + patrol_random(&model->seed[boat]) * PATROL_BOX_KM);
+}
+
+/*This moves the boats from first to end by step_s simulated seconds, towards their
+waypoints, and notes the ones that changed cell in moved. It returns how many did.*/
+static inline int patrol_move(PatrolModel *model, int first, int end, float step_s, int *moved)
+{
+    int moved_count = 0;
+    for (int i = first; i < end; i++)
+    {
+        float speed = PATROL_SPEED_KMS;
+        if (model->evade_s[i] > 0.0f)
+        {
+            speed = PATROL_EVADE_KMS;
+            model->evade_s[i] -= step_s;
+            if (model->evade_s[i] <= 0.0f)
+            {
+                model->evade_s[i] = 0.0f;
+                patrol_waypoint(model, i);
+            }
+        }
+        float dx = model->wx[i] - model->x[i], dy = model->wy[i] - model->y[i];
+        float distance = model_sqrt(dx * dx + dy * dy);
+        float travel = speed * step_s;
+        if (travel >= distance)
+        {
+            model->x[i] = model->wx[i];
+            model->y[i] = model->wy[i];
+            if (model->evade_s[i] == 0.0f) patrol_waypoint(model, i); //An evading boat holds there until it is over.
+        }
+        else
+        {
+            model->x[i] += dx * travel / distance;
+            model->y[i] += dy * travel / distance;
+        }
+        PatrolSlot *slot = &model->cells[model->cell[i]][model->slot[i]];
+        slot->x = model->x[i];
+        slot->y = model->y[i];
+        if (patrol_cell(model->x[i], model->y[i]) != model->cell[i]) moved[moved_count++] = i;
+    }
+    return moved_count;
+}
+
+//This is the share of the boats a thread moves.
+static inline void patrol_share(const PatrolModel *model, int index, int threads, int *first, int *end)
+{
+    *first = (int)((long long)model->count * index / threads);
+    *end = (int)((long long)model->count * (index + 1) / threads);
+}
+
+//This moves a thread's share of the boats and notes the ones that changed cell.
+static inline void patrol_move_share(void *arg, int index)
+{
+    PatrolModel *model = arg;
+    int first, end;
+    patrol_share(model, index, model->config.threads, &first, &end);
+    model->moved_count[index] = patrol_move(model, first, end, model->tick_s, model->moved + first);
+}
+
+//This stops the patrol threads and releases the boats, or whatever patrol_init reserved.
+static inline void patrol_destroy(PatrolModel *model)
+{
+    model_pool_stop(&model->pool);
+    float **fields[] = {&model->x, &model->y, &model->wx, &model->wy, &model->sx, &model->sy, &model->evade_s};
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        free(*fields[f]);
+    }
+    free(model->seed);
+    free(model->cell);
+    free(model->slot);
+    if (model->cells)
+    {
+        for (int c = 0; c < PATROL_GRID * PATROL_GRID; c++) free(model->cells[c]);
+    }
+    free(model->cells);
+    free(model->cell_count);
+    free(model->cell_capacity);
+    free(model->moved);
+    free(model->found);
+    memset(model, 0, sizeof(*model));
+}
+
+/*This places boats boats on their stations and adds them to the grid. It returns 0
+or -1, and frees what it reserved on failure.*/
+static inline int patrol_init(PatrolModel *model, int boats, const PatrolConfig *config, long long now)
+{
+    memset(model, 0, sizeof(*model));
+    model->config = *config;
+    model->count = boats;
+    float **fields[] = {&model->x, &model->y, &model->wx, &model->wy, &model->sx, &model->sy, &model->evade_s};
+    int failed = 0;
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        failed |= !(*fields[f] = calloc((size_t)boats, sizeof(float)));
+    }
+    model->seed = calloc((size_t)boats, sizeof(uint32_t));
+    model->cell = calloc((size_t)boats, sizeof(int));
+    model->slot = calloc((size_t)boats, sizeof(int));
+    model->moved = calloc((size_t)boats, sizeof(int));
+    model->found = calloc((size_t)boats, sizeof(int));
+    model->cells = calloc(PATROL_GRID * PATROL_GRID, sizeof(PatrolSlot *));
+    model->cell_count = calloc(PATROL_GRID * PATROL_GRID, sizeof(int));
+    model->cell_capacity = calloc(PATROL_GRID * PATROL_GRID, sizeof(int));
+    if (failed || !model->seed || !model->cell || !model->slot || !model->moved || !model->found || !model->cells ||
+        !model->cell_count || !model->cell_capacity)
+    {
+        patrol_destroy(model);
+        return -1;
+    }
+    for (int i = 0; i < boats; i++)
+    {
+        assign_place(ASSIGN_SUB, (uint32_t)i + 1, &model->sx[i], &model->sy[i]);
+        model->sx[i] = assign_clamp(model->sx[i]);
+        model->sy[i] = assign_clamp(model->sy[i]);
+        model->x[i] = model->sx[i];
+        model->y[i] = model->sy[i];
+        model->seed[i] = assign_mix((uint32_t)i * 2654435761u + 1u) | 1u;
+        patrol_waypoint(model, i);
+        int cell = patrol_cell(model->x[i], model->y[i]);
+        if (patrol_reserve(model, cell) < 0)
+        {
+            patrol_destroy(model);
+            return -1;
+        }
+        patrol_link(model, i, cell);
+    }
+    model->last_tick_ms = now;
+    return 0;
+}
+
+/*This starts a thread for every share of the boats but the first, which the calling
+thread moves itself. It returns 0 or -1, and the model carries on single threaded if it fails.*/
+static inline int patrol_start_threads(PatrolModel *model)
+{
+    return model_pool_start(&model->pool, model->config.threads, patrol_move_share, model);
+}
+
+/*This moves the boats in moved[0, count) to the cells they are now in. A boat whose new
+cell cannot grow stays where it is and is tried again next tick.*/
+static inline void patrol_relink(PatrolModel *model, const int *moved, int count)
+{
+    for (int m = 0; m < count; m++)
+    {
+        int boat = moved[m];
+        int cell = patrol_cell(model->x[boat], model->y[boat]);
+        if (patrol_reserve(model, cell) < 0) continue;
+        patrol_unlink(model, boat);
+        patrol_link(model, boat, cell);
+        model->cell_moves++;
+    }
+}
+
+/*This moves the boats by the real time since the last tick times the time scale, on
+every thread once there are PATROL_PARALLEL_MIN boats, then relinks the ones that changed
+cell. It returns when the next tick is due.*/
+static inline long long patrol_tick(PatrolModel *model, long long now)
+{
+    if (now < model->last_tick_ms + PATROL_TICK_MS) return model->last_tick_ms + PATROL_TICK_MS;
+    model->tick_s = (float)((now - model->last_tick_ms) * model->config.time_scale) / 1000.0f;
+    model->last_tick_ms = now;
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    if (model->pool.workers && model->count >= PATROL_PARALLEL_MIN)
+    {
+        model_pool_run(&model->pool);
+        for (int t = 0; t < model->config.threads; t++)
+        {
+            int first, end;
+            patrol_share(model, t, model->config.threads, &first, &end);
+            patrol_relink(model, model->moved + first, model->moved_count[t]);
+        }
+    }
+    else
+    {
+        patrol_relink(model, model->moved, patrol_move(model, 0, model->count, model->tick_s, model->moved));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    model->update_ns_total += (finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec);
+    model->boat_updates += (unsigned long long)model->count;
+    model->ticks++;
+    return now + PATROL_TICK_MS;
+}
+
+/*This finds the boats within config.range_km of a location, looking only at the cells the
+range covers, and puts up to max of them in out. It returns how many there are in range.*/
+static inline int patrol_in_range(PatrolModel *model, const char *location, int *out, int max)
+{
+    float tx, ty;
+    assign_locate(location, &tx, &ty);
+    tx = assign_clamp(tx);
+    ty = assign_clamp(ty);
+    float range = (float)model->config.range_km;
+    int low = patrol_cell(assign_clamp(tx - range), assign_clamp(ty - range));
+    int high = patrol_cell(assign_clamp(tx + range), assign_clamp(ty + range));
+    int found = 0;
+    for (int cy = low / PATROL_GRID; cy <= high / PATROL_GRID; cy++)
+    {
+        for (int cx = low % PATROL_GRID; cx <= high % PATROL_GRID; cx++)
+        {
+            const PatrolSlot *slots = model->cells[cy * PATROL_GRID + cx];
+            int count = model->cell_count[cy * PATROL_GRID + cx];
+            for (int k = 0; k < count; k++)
+            {
+                float dx = slots[k].x - tx, dy = slots[k].y - ty;
+                if (dx * dx + dy * dy > range * range) continue;
+                if (found < max) out[found] = slots[k].boat;
+                found++;
+            }
+            model->boats_tested += (unsigned long long)count;
+        }
+    }
+    model->queries++;
+    model->boats_in_range += (unsigned long long)found;
+    return found;
+}
+
+//This sends a boat that has just fired away from its target, at evasion speed.
+static inline void patrol_evade(PatrolModel *model, int boat, const char *location)
+{
+    float tx, ty;
+    assign_locate(location, &tx, &ty);
+    float dx = model->x[boat] - tx, dy = model->y[boat] - ty;
+    float distance = model_sqrt(dx * dx + dy * dy) + 1e-3f;
+    model->wx[boat] = assign_clamp(model->x[boat] + dx / distance * PATROL_EVADE_KM);
+    model->wy[boat] = assign_clamp(model->y[boat] + dy / distance * PATROL_EVADE_KM);
+    model->evade_s[boat] = PATROL_EVADE_S;
+    model->evasions++;
+}
+
+//This writes the patrol figures to a summary file.
+static inline void patrol_report(const PatrolModel *model, FILE *summary_fp)
+{
+    int evading = 0;
+    for (int i = 0; i < model->count; i++) evading += model->evade_s[i] > 0.0f;
+    fprintf(summary_fp, "Patrol: %d boats on a %d x %d grid of %.0f km sea areas, %d threads, time scale %dx, "
+            "range %d km\n", model->count, PATROL_GRID, PATROL_GRID, PATROL_CELL_KM,
+            model->pool.workers ? model->config.threads : 1, model->config.time_scale, model->config.range_km);
+    fprintf(summary_fp, "Patrol Updates: %lu ticks, %llu boat updates, %.1f ns each, %lu cell changes, "
+            "Evasions: %lu (%d evading at the end)\n", model->ticks, model->boat_updates,
+            model->boat_updates ? (double)model->update_ns_total / (double)model->boat_updates : 0.0,
+            model->cell_moves, model->evasions, evading);
+    fprintf(summary_fp, "Range Queries: %lu, avg %.1f boats in range, avg %.1f boats looked at (of %d)\n",
+            model->queries, model->queries ? (double)model->boats_in_range / (double)model->queries : 0.0,
+            model->queries ? (double)model->boats_tested / (double)model->queries : 0.0, model->count);
+}
+
+/*This is "--patrol-benchmark N": it puts N boats on patrol without a server, moves them
+for a simulated hour tick by tick and then looks up the boats in range of each known sea,
+with the grid and by testing every boat, and prints what each cost.*/
+static inline int patrol_benchmark(const PatrolConfig *config)
+{
+    PatrolModel model;
+    PatrolConfig bench = *config;
+    if (patrol_init(&model, bench.benchmark, &bench, 0) < 0 || patrol_start_threads(&model) < 0)
+    {
+        fprintf(stderr, "Failed to set up %d boats\n", bench.benchmark);
+        return 1;
+    }
+    int ticks = (int)(3600000LL / PATROL_TICK_MS / bench.time_scale) + 1;
+    for (long long now = PATROL_TICK_MS; model.ticks < (unsigned long)ticks; now += PATROL_TICK_MS)
+    {
+        patrol_tick(&model, now);
+    }
+
+    struct timespec started, finished;
+    int rounds = 1000, in_range = 0, brute = 0;
+    float range = (float)bench.range_km;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int r = 0; r < rounds; r++)
+    {
+        in_range += patrol_in_range(&model, assign_places[r % ASSIGN_PLACES].name, model.found, model.count);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double grid_ns = (double)((finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec));
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int r = 0; r < rounds; r++)
+    {
+        float tx = assign_places[r % ASSIGN_PLACES].x, ty = assign_places[r % ASSIGN_PLACES].y;
+        for (int i = 0; i < model.count; i++)
+        {
+            float dx = model.x[i] - tx, dy = model.y[i] - ty;
+            brute += dx * dx + dy * dy <= range * range;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double brute_ns = (double)((finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec));
+
+    printf("%d boats over %d threads, %d ticks: %.1f ns per boat update, %.1f us per tick\n", model.count,
+           model.pool.workers ? bench.threads : 1, ticks, (double)model.update_ns_total / (double)model.boat_updates,
+           (double)model.update_ns_total / 1000.0 / (double)model.ticks);
+    printf("Range lookups: %.2f us with the grid, %.2f us testing every boat, %.1f boats in range (%s)\n",
+           grid_ns / 1000.0 / rounds, brute_ns / 1000.0 / rounds, (double)in_range / rounds,
+           in_range == brute ? "same boats" : "MISMATCH");
+    patrol_report(&model, stdout);
+    patrol_destroy(&model);
+    return in_range == brute ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*This is the framing shared by nuclearControl and the four clients.
+Every message on a connection starts with a small fixed header carrying the
+frame type, the logical unit it belongs to and the payload length, so several
+simulated units can share one socket and messages never run into each other
+on the TCP stream. The payload itself is the Caesar encrypted text, or the
+binary encoding in wireCodec.h on connections that negotiated it.*/
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define FRAME_MAGIC 0x4E43 //"NC" in ASCII
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 12
+#define FRAME_MAX_PAYLOAD 1024
+#define FRAME_BUFFER_SIZE 4096 //Receive buffers hold several frames at once.
+#define UNIT_BROADCAST 0 //Unit ID 0 addresses every unit on the connection.
+
+//These are the frame types that can be sent in either direction.
+enum
+{
+    FRAME_HELLO = 1,   //A unit announces itself, the payload is its kind e.g. "Radar".
+    FRAME_INTEL = 2,   //An encrypted intelligence report from a sensor unit.
+    FRAME_COMMAND = 3, //An encrypted launch command for an effector unit.
+    FRAME_DECISION = 4, //A launch decision forwarded between cluster nodes, the unit ID is the sending node.
+    FRAME_ACK = 5,      //A batch of command acknowledgements from an effector, see below.
+    FRAME_CREDIT = 6,   //More INTEL frames a sensor connection may send, the payload is the count in ASCII.
+    FRAME_CODEC = 7,    //The binary codec version nuclearControl agreed to for the connection, one byte.
+    FRAME_INTEL_BIN = 8,  //An intelligence report in the binary encoding of wireCodec.h.
+    FRAME_COMMAND_BIN = 9, //A launch command in the binary encoding of wireCodec.h.
+    FRAME_END = 10,        //The run is over, the payload says why. See below.
+    FRAME_OUTCOME = 11,    //How the flights of launched weapons ended, see below.
+    FRAME_SHM = 12         //A shared-memory ring offer, its answer or a doorbell, see shmRing.h.
+};
+
+/*A client that can use the binary encoding offers it by ending its HELLO payload with
+"|codec:N", N being its WIRE_VERSION. nuclearControl answers the first offer it supports
+with a CODEC frame, and from then on both ends may send the binary frame types on that
+connection. Anything sent before the CODEC frame, and every frame on a connection that
+never made the offer, stays as Caesar encrypted text.*/
+#define CODEC_OFFER "|codec:"
+
+/*When nuclearControl stops, at the end of the simulation or on SIGINT/SIGTERM, it stops
+accepting, finishes the reports it has queued and then sends every connection an END frame.
+The client sends its pending ACKs, closes the connection and does not reconnect it, so the
+server can write its summary as soon as the last connection has closed.*/
+
+/*A nuclearControl started with --standby follows the primary over its replication log
+(see replicaLog.h) and takes over when the primary dies. It then listens on the usual ports
+plus STANDBY_PORT_OFFSET, so a client started with --failover tries the standby's port when
+its connection is lost, and goes back and forth between the two until one of them answers.*/
+#define STANDBY_PORT_OFFSET 50
+
+/*A client on the same host as nuclearControl may skip the TCP/IP loopback stack. A server
+started with --unix-sockets also listens on an AF_UNIX SOCK_SEQPACKET socket in its working
+directory for every port it listens on, named after the port, and a client started with
+"--transport unix" connects there instead. The frames are the same. Every send is one
+packet holding whole frames, so the kernel keeps the message boundaries and a receive never
+starts with part of a frame, but a receive must have room for the largest packet sent
+(two frames, see runtime_send, or a batch of reports, which is held to FRAME_BUFFER_SIZE),
+since the rest of a packet that does not fit is lost. nuclearControl closes a connection
+whose packet did not fit rather than read frames cut short.*/
+#define UNIX_SOCKET_PATH "nuclearControl_%d.sock"
+
+/*A client started with "--transport shm" sends a SHM frame holding the name of the
+segment it created as the first frame on a new connection, and waits for the answer:
+a SHM frame with SHM_ACCEPTED or anything else for a refusal, after which it carries on
+over TCP. Frames the server sent before its answer are kept and acted on afterwards. A
+server that does not know the frame does not answer, and after SHM_OFFER_TIMEOUT_MS the
+client reconnects and stays on TCP. On an accepted connection every frame goes through
+the rings and an empty SHM frame on the socket is a doorbell.*/
+#define SHM_ACCEPTED '1'
+#define SHM_OFFER_TIMEOUT_MS 1000
+
+/*Sensor connections are flow controlled with credits. Each connection starts with
+CREDIT_WINDOW credits, every INTEL frame uses one, and nuclearControl hands them back
+in CREDIT frames once it has taken the reports in. It stops handing them back while
+its evaluation queue is congested, so a flooding sensor is slowed at the source.
+Reports above CRITICAL_THREAT_LEVEL are sent even without credit and never wait.*/
+#define CREDIT_WINDOW 32
+#define CRITICAL_THREAT_LEVEL 70
+
+/*An ACK payload lists "seq@ms" entries separated by commas, one for every command
+the effector took in since its last ACK frame. seq is the "seq" field of the command
+and ms is the effector's monotonic clock when it queued the command. ACK_MAX_BATCH
+entries always fit in one frame.*/
+#define ACK_MAX_BATCH 16
+
+/*An OUTCOME payload lists "unit:seq:result:ms" entries separated by commas, one for every
+flight that ended since the effector's last OUTCOME frame. unit is the unit that launched,
+seq the command it launched for (0 if the command had none), result is OUTCOME_DESTROYED,
+OUTCOME_SURVIVED (intercepted, but the target was not killed) or OUTCOME_MISSED, and ms
+is the simulated time of flight. OUTCOME_MAX_BATCH entries always fit in one frame.*/
+#define OUTCOME_MAX_BATCH 16
+#define OUTCOME_DESTROYED 'D'
+#define OUTCOME_SURVIVED 'S'
+#define OUTCOME_MISSED 'M'
+
+/*This returns a monotonic clock reading in milliseconds. It is the same clock in
+every process on the host, so the times carried in ACK frames can be compared directly.*/
+static inline long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//This is the decoded frame header. On the wire every field is in network byte order.
+typedef struct
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint32_t unit_id;
+    uint32_t length;
+} FrameHeader;
+
+/*This writes a header and payload into out. It returns the total frame
+size or -1 if the frame does not fit or the payload is too large.*/
+static inline int frame_encode(char *out, size_t cap, uint8_t type, uint32_t unit_id,
+                               const char *payload, size_t length)
+{
+    if (length > FRAME_MAX_PAYLOAD || FRAME_HEADER_SIZE + length > cap) return -1;
+    uint16_t magic = htons(FRAME_MAGIC);
+    uint32_t unit = htonl(unit_id);
+    uint32_t len = htonl((uint32_t)length);
+    memcpy(out, &magic, 2);
+    out[2] = FRAME_VERSION;
+    out[3] = (char)type;
+    memcpy(out + 4, &unit, 4);
+    memcpy(out + 8, &len, 4);
+    if (length) memcpy(out + FRAME_HEADER_SIZE, payload, length);
+    return (int)(FRAME_HEADER_SIZE + length);
+}
+
+/*This looks for one complete frame at the start of buf. It returns the
+number of bytes the frame takes up, 0 if more data is needed, or -1 if the
+data is not a valid frame and the connection should be dropped.*/
+static inline int frame_parse(const char *buf, size_t used, FrameHeader *header, const char **payload)
+{
+    if (used < FRAME_HEADER_SIZE) return 0;
+    uint16_t magic;
+    uint32_t unit;
+    uint32_t len;
+    memcpy(&magic, buf, 2);
+    memcpy(&unit, buf + 4, 4);
+    memcpy(&len, buf + 8, 4);
+    header->magic = ntohs(magic);
+    header->version = (uint8_t)buf[2];
+    header->type = (uint8_t)buf[3];
+    header->unit_id = ntohl(unit);
+    header->length = ntohl(len);
+    if (header->magic != FRAME_MAGIC || header->version != FRAME_VERSION ||
+        header->length > FRAME_MAX_PAYLOAD) return -1;
+    if (used < FRAME_HEADER_SIZE + header->length) return 0;
+    *payload = buf + FRAME_HEADER_SIZE;
+    return (int)(FRAME_HEADER_SIZE + header->length);
+}
+
+/*This sends the whole buffer, retrying short writes. MSG_NOSIGNAL stops a peer
+that went away from killing the process with SIGPIPE. It returns 0 or -1.*/
+static inline int send_all(int sock, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t sent = send(sock, buf, len, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+#endif
@@ -10,6 +10,10 @@ inputs, outputs, strings, sockets, memory allocation, character handling, etc.*/
 #include <time.h>
 #include <ctype.h>
 #include <errno.h>
+#include "clientRuntime.h"
+#include "runStats.h"
+#include "radarModel.h"
+#include "coroutineRuntime.h"
 
 /*This is to defined the assigned port, simulation duration, and  
 buffer size for the radar client to ping back to the server's IP address.*/
@@ -20,10 +24,24 @@ buffer size for the radar client to ping back to the server's IP address.*/
 #define SIMULATION_DURATION 60
 #define BUFFER_SIZE 1024
 #define SUMMARY_FILE "radar_summary.txt"
+#define STATS_FILE "radar_stats.col"
 
 //These are global variables that handles log file and tracks successful transmissions.
 static FILE *log_fp = NULL;
 static int intel_sent = 0;
+static ClientRuntime runtime;
+static StatsWriter stats;
+static int stat_sent, stat_held, stat_dropped, stat_credit_grants;
+static RadarModel radar;
+static int stat_detections, stat_sweep_us;
+
+//This is a radar unit, and the scheduler the units run on, with "--coroutines".
+typedef struct
+{
+    Coroutine co;
+    uint32_t unit_id;
+} RadarUnit;
+static CoScheduler scheduler;
 
 /*This initialize a log file with a timestamped header and opens it in write file mode. 
 It includes an error handling function in case there is a creation failure and a small 
@@ -79,36 +97,53 @@ void caesar_encrypt(const char *plaintext, char *ciphertext, size_t len)
     }
 }
 
-/*This generates and sends intel reports to the nuclear control center about 
-the enemy threats and their location. It also includes buffers of messages to get enough of 
-characters to display. It randomly select any threats and locations from the data sets.
-Lastly, it generates threat level with 30% chance of a threat above 70.*/
-void send_intel(int sock) 
+/*This sends an intel report to the nuclear control center about an enemy threat and
+its location. It also includes buffers of messages to get enough of characters to display.
+The details are added to the log entry after the encoding.*/
+void send_report(ClientRuntime *rt, uint32_t unit_id, const char *threat, int threat_level,
+                 const char *location, const char *details) 
 {
-    const char *threat_data[] = {"Enemy Aircraft", "Missile Strike", "Drone Swarm", "Stealth Bomber"};
-    const char *locations[] = {"North Atlantic", "English Channel", "Baltic Sea", "Irish Sea"};
     char message[512];
-    char ciphertext[BUFFER_SIZE];
-    char log_msg[BUFFER_SIZE];
-    int idx = rand() % 4;
-    int threat_level = (rand() % 100 < 30) ? 71 + (rand() % 30) : 10 + (rand() % 61);
+    char payload[BUFFER_SIZE];
+    char encoding[BUFFER_SIZE + 16];
+    char log_msg[2 * BUFFER_SIZE];
+
+    /*On a link that negotiated the binary codec the report goes as interned IDs instead.
+    Otherwise the report details are encrypted by a caesar cipher and separated by a pipe delimiter.*/
+    Link *link = runtime_link_for(rt, unit_id);
+    uint8_t frame_type = link->codec ? FRAME_INTEL_BIN : FRAME_INTEL;
+    int length;
+    if (link->codec) 
+    {
+        length = wire_encode_intel(payload, sizeof(payload), "Radar", "Air", threat, threat_level, location);
+        snprintf(encoding, sizeof(encoding), "[Binary] %d bytes", length);
+    } 
+    else 
+    {
+        snprintf(message, sizeof(message),
+                 "source:Radar|type:Air|data:%s|threat_level:%d|location:%s",
+                 threat, threat_level, location);
+        caesar_encrypt(message, payload, sizeof(payload));
+        length = (int)strlen(payload);
+        snprintf(encoding, sizeof(encoding), "[Encrypted] %s", payload);
+    }
 
-    //The report details are encrypt by a caesar cipher and separated by a pipe delimiter in the nuclear control log file.
-    snprintf(message, sizeof(message),
-             "source:Radar|type:Air|data:%s|threat_level:%d|location:%s",
-             threat_data[idx], threat_level, locations[idx]);
-    caesar_encrypt(message, ciphertext, sizeof(ciphertext));
+    /*This sends the report frame for the unit over its shared link, or queues it in the link's
+    batch with "--batch-ms". It fails if the link is waiting to reconnect or nuclearControl
+    has asked sensors to slow down, but critical reports are always sent. The report is
+    handed over before it is logged, so the write to the log file does not hold it up.*/
+    int sent = length >= 0 && runtime_send_report(rt, unit_id, frame_type, payload, (size_t)length, threat_level) == 0;
 
     /*This receives and sending intelligence report to the to the nuclear control.*/
     snprintf(log_msg, sizeof(log_msg),
-             "Sending Intelligence: Type=Air, Details=%s, ThreatLevel=%d, Location=%s, [Encrypted] %s",
-             threat_data[idx], threat_level, locations[idx], ciphertext);
+             "Unit %u Sending Intelligence: Type=Air, Details=%s, ThreatLevel=%d, Location=%s, %s%s",
+             unit_id, threat, threat_level, location, encoding, details);
     log_event("INTEL", log_msg);
-
-    //This sends an encrypted data over network with error handling in case it fails to send intelligence.
-    if (send(sock, ciphertext, strlen(ciphertext), 0) < 0)
+    if (length < 0) return;
+    if (!sent) 
     {
-        snprintf(log_msg, sizeof(log_msg), "Failed to send intelligence: %s", strerror(errno));
+        snprintf(log_msg, sizeof(log_msg), "Unit %u failed to send intelligence: %s", unit_id,
+                 link->sock < 0 ? "link down" : "no flow control credit");
         log_event("ERROR", log_msg);
     } 
     else 
@@ -117,6 +152,74 @@ void send_intel(int sock)
     }
 }
 
+/*This generates intel reports when no targets are simulated. It randomly select any
+threats and locations from the data sets, and generates threat level with 30% chance
+of a threat above 70.*/
+void send_intel(ClientRuntime *rt, uint32_t unit_id) 
+{
+    const char *threat_data[] = {"Enemy Aircraft", "Missile Strike", "Drone Swarm", "Stealth Bomber"};
+    const char *locations[] = {"North Atlantic", "English Channel", "Baltic Sea", "Irish Sea"};
+    int idx = rand() % 4;
+    int threat_level = (rand() % 100 < 30) ? 71 + (rand() % 30) : 10 + (rand() % 61);
+    send_report(rt, unit_id, threat_data[idx], threat_level, locations[idx], "");
+}
+
+/*This reports a target the radar model detected in a sweep. Its threat level comes from
+its kind, range and heading and its location from its bearing, and the measurement goes to the log.*/
+void report_detection(const RadarModel *model, uint32_t unit_id, size_t target) 
+{
+    char details[128];
+    snprintf(details, sizeof(details), ", Target=%zu, Range=%.1fkm, Bearing=%.1f, Pd=%.2f",
+             target - model->first[unit_id - 1], model->range[target], model->bearing[target], model->pd[target]);
+    send_report(&runtime, unit_id, radar_kinds[model->kind[target]].name, radar_threat_level(model, target),
+                radar_location(model->bearing[target]), details);
+}
+
+/*This times "--benchmark SWEEPS" sweeps of every unit's targets with the vector kernel
+and then with the scalar one, starting from the same targets each time, and prints the
+cost per target. Nothing is connected or logged. Both should detect the same targets.*/
+int run_benchmark(const RadarConfig *config, int units) 
+{
+    const char *names[] = {"Vector", "Scalar"};
+    const int lanes[] = {RADAR_LANES, 1};
+    double cost[2];
+    for (int k = 0; k < 2; k++) 
+    {
+        RadarModel model;
+        if (radar_init(&model, units, config, 12345u, 0) < 0) 
+        {
+            fprintf(stderr, "Failed to allocate %d targets\n", config->targets);
+            return 1;
+        }
+        long long total_ns = 0;
+        unsigned long long detections = 0;
+        float dt = (float)config->sweep_ms / 1000.0f;
+        for (int sweep = 0; sweep < config->benchmark; sweep++) 
+        {
+            for (int unit = 0; unit < units; unit++) 
+            {
+                struct timespec started, finished;
+                clock_gettime(CLOCK_MONOTONIC, &started);
+                if (k == 0) radar_sweep_vector(&model, model.first[unit], model.first[unit + 1], dt);
+                else radar_sweep_scalar(&model, model.first[unit], model.first[unit + 1], dt);
+                clock_gettime(CLOCK_MONOTONIC, &finished);
+                total_ns += (finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec);
+                for (size_t i = model.first[unit]; i < model.first[unit + 1]; i++) 
+                {
+                    detections += model.detected[i] != 0;
+                }
+            }
+        }
+        cost[k] = (double)total_ns / ((double)model.count * config->benchmark);
+        printf("%s kernel (%d lanes): %.2f ns per target, %.1f million targets per second, %llu detections\n",
+               names[k], lanes[k], cost[k], 1000.0 / cost[k], detections);
+        radar_destroy(&model);
+    }
+    printf("Targets: %d over %d units, %d sweeps, vector speed up %.2fx\n", config->targets, units,
+           config->benchmark, cost[1] / cost[0]);
+    return 0;
+}
+
 /*This generates a summary text file of the client operation of the radar
 and opens it in write mode to edit. It includes details of the timestamped when the simulation ended and 
 total intelligence reports have sent within the duration of the simulation.*/
@@ -139,6 +242,14 @@ void generate_summary(void)
         fprintf(summary_fp, "Simulation End: %s\n", time_str);
     }
     fprintf(summary_fp, "Total Intelligence Reports Sent: %d\n", intel_sent);
+    fprintf(summary_fp, "Units Hosted: %d on %d connections\n", runtime.unit_count, runtime.link_count);
+    fprintf(summary_fp, "Reconnects: %lu, Reports Dropped: %lu\n", runtime.reconnects, runtime.frames_dropped);
+    runtime_report_credits(&runtime, summary_fp);
+    runtime_report_batches(&runtime, summary_fp);
+    runtime_report_end(&runtime, summary_fp);
+    if (radar.count > 0) radar_report(&radar, summary_fp);
+    if (scheduler.spawned > 0) co_report(&scheduler, sizeof(RadarUnit), summary_fp);
+    fprintf(summary_fp, "Per Second Statistics: %s (%d columns)\n", STATS_FILE, stats.column_count);
     fprintf(summary_fp, "=====================================\n");
     fclose(summary_fp);
 
@@ -148,69 +259,203 @@ void generate_summary(void)
     log_event("SUMMARY", log_msg);
 }
 
+/*This adds what the runtime has counted since the last call to the statistics
+file, so its running totals become per second rows.*/
+void sample_stats(long long now) 
+{
+    stats_total(&stats, stat_sent, intel_sent, now);
+    stats_total(&stats, stat_held, (long long)runtime.reports_held, now);
+    stats_total(&stats, stat_dropped, (long long)runtime.frames_dropped, now);
+    stats_total(&stats, stat_credit_grants, (long long)runtime.credit_grants, now);
+    if (radar.count == 0) return;
+    stats_total(&stats, stat_detections, (long long)radar.detections, now);
+    stats_total(&stats, stat_sweep_us, radar.sweep_ns_total / 1000, now);
+}
+
+/*This is a radar unit's behaviour with "--coroutines": it sweeps its targets, or sends a
+report, and sleeps until the next one, for as long as the run lasts. Each unit waits out
+its share of the first interval first, so the sweeps are spread over it.*/
+void radar_unit(CoScheduler *sched, Coroutine *co)
+{
+    RadarUnit *unit = (RadarUnit *)co;
+    CO_BEGIN(co);
+    if (radar.count > 0) CO_SLEEP(sched, co, (long long)radar.config.sweep_ms * (unit->unit_id - 1) / runtime.unit_count);
+    while (!runtime_ended(&runtime)) 
+    {
+        if (radar.count > 0) 
+        {
+            radar_sweep(&radar, (int)unit->unit_id - 1, now_ms(), report_detection);
+            CO_SLEEP(sched, co, radar.config.sweep_ms);
+        }
+        else 
+        {
+            send_intel(&runtime, unit->unit_id);
+            CO_SLEEP(sched, co, (5 + (rand() % 6)) * 1000LL); // Randomize interval
+        }
+    }
+    CO_END(co);
+}
+
+//This keeps the statistics rows current while the units run as coroutines.
+void stats_sampler(CoScheduler *sched, Coroutine *co)
+{
+    CO_BEGIN(co);
+    for (;;) 
+    {
+        sample_stats(now_ms());
+        CO_SLEEP(sched, co, STATS_INTERVAL_MS);
+    }
+    CO_END(co);
+}
+
+/*This runs every unit, every link and the statistics as coroutines on this thread until
+end_time or until nuclearControl has sent END on every link. It returns 0 or -1.*/
+int run_coroutines(long long end_time)
+{
+    RadarUnit *units = calloc((size_t)runtime.unit_count, sizeof(RadarUnit));
+    CoLink *links = calloc((size_t)runtime.link_count, sizeof(CoLink));
+    Coroutine sampler;
+    if (!units || !links || co_init(&scheduler, runtime.unit_count + runtime.link_count + 1) < 0) 
+    {
+        free(units);
+        free(links);
+        return -1;
+    }
+    co_spawn_links(&scheduler, &runtime, links);
+    co_spawn(&scheduler, &sampler, stats_sampler);
+    for (int unit = 0; unit < runtime.unit_count; unit++) 
+    {
+        units[unit].unit_id = (uint32_t)(unit + 1);
+        co_spawn(&scheduler, &units[unit].co, radar_unit);
+    }
+    co_run(&scheduler, end_time);
+    close(scheduler.epoll_fd); //The counters stay for the summary.
+    scheduler.epoll_fd = -1;
+    free(units);
+    free(links);
+    return 0;
+}
+
+/*This handles frames from nuclearControl. Sensors are not sent any orders,
+so anything arriving here is only logged.*/
+void handle_frame(ClientRuntime *rt, Link *link, const FrameHeader *header, const char *payload)
+{
+    (void)rt;
+    (void)payload;
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Unexpected frame type %u for unit %u on link %d",
+             header->type, header->unit_id, link->index);
+    log_event("ERROR", log_msg);
+}
+
 /*This is the main execution function that starts the radar client system.
-This has the network set to create the TCP socket, server-to-client connection, 
-and sending data to the nuclear control center.*/ 
-int main(void) 
+It hosts "--units N" radar units over "--connections M" shared links to the
+nuclear control center. Each unit sends its own reports on a randomised interval, or
+with "--targets N" sweeps its share of the simulated targets every "--sweep-ms" and
+reports what it detects. Links that drop are reconnected by the runtime until the simulation ends.*/
+int main(int argc, char *argv[]) 
 {
+    RuntimeConfig runtime_config = {.units = 1, .connections = 1, .nodes = 1, .transport = TRANSPORT_TCP,
+                                    .batch_bytes = REPORT_BATCH_BYTES};
+    RadarConfig radar_config = {0, RADAR_DEFAULT_SWEEP_MS, 0};
+    CoConfig co_config = {0, 0};
+    for (int i = 1; i < argc; i++) 
+    {
+        int used = runtime_parse_option(&runtime_config, argc, argv, &i);
+        if (used == 0) used = radar_parse_option(&radar_config, argc, argv, &i);
+        if (used == 0) used = co_parse_option(&co_config, argc, argv, &i);
+        if (used != 1) 
+        {
+            fprintf(stderr, "Usage: %s [--units N] [--connections M] [--nodes K] [--codec text|binary] [--failover] "
+                    "[--transport tcp|unix|shm|tls] [--transport-benchmark N] [--batch-ms MS] [--batch-bytes N] "
+                    "[--nodelay] [--targets N] [--sweep-ms MS] [--benchmark SWEEPS] [--coroutines] [--coroutine-benchmark N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (radar_config.benchmark > 0 && radar_config.targets == 0) 
+    {
+        fprintf(stderr, "--benchmark needs simulated targets, e.g. --targets 1000000\n");
+        return 1;
+    }
+    if (radar_config.benchmark > 0) return run_benchmark(&radar_config, runtime_config.units);
+    if (runtime_config.transport_benchmark > 0) return runtime_transport_benchmark(runtime_config.transport_benchmark, runtime_config.batch_bytes, caesar_encrypt);
+    if (co_config.benchmark > 0) return co_benchmark(co_config.benchmark);
+
     srand((unsigned int)time(NULL));
     init_log_file();
     log_event("STARTUP", "Radar System initializing");
 
-    //This creates the TCP socket of the client.
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) 
+    //This sets up the shared links and the time each unit sends its next report.
+    long long *next_report = calloc((size_t)runtime_config.units, sizeof(long long));
+    if (!next_report || runtime_init(&runtime, "Radar", SERVER_IP, SERVER_PORT, &runtime_config, handle_frame) < 0 ||
+        (radar_config.targets > 0 &&
+         radar_init(&radar, runtime_config.units, &radar_config, (uint32_t)rand(), now_ms()) < 0)) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Socket creation failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
+        log_event("ERROR", "Failed to allocate the client runtime");
+        free(next_report);
         if (log_fp) fclose(log_fp);
         return 1;
     }
 
-    //This configures the server address for the connection with error handling if there is an invalid address.
-    struct sockaddr_in server_addr = {0};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) 
+    //This opens the per second statistics file; the run goes on without it if it cannot be created.
+    if (stats_open(&stats, STATS_FILE, "radar", now_ms()) < 0) log_event("ERROR", "Failed to create statistics file");
+    stat_sent = stats_column(&stats, "reports_sent");
+    stat_held = stats_column(&stats, "reports_held");
+    stat_dropped = stats_column(&stats, "reports_dropped");
+    stat_credit_grants = stats_column(&stats, "credit_grants");
+    if (radar.count > 0) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Invalid server address: %s", SERVER_IP);
-        log_event("ERROR", log_msg);
-        close(sock);
-        if (log_fp) fclose(log_fp);
-        return 1;
+        stat_detections = stats_column(&stats, "detections");
+        stat_sweep_us = stats_column(&stats, "sweep_us");
+
+        //The units' sweeps are spread over the first interval rather than all landing at once.
+        for (int unit = 0; unit < runtime_config.units; unit++) 
+        {
+            next_report[unit] = now_ms() + (long long)radar_config.sweep_ms * unit / runtime_config.units;
+        }
     }
+    runtime_poll(&runtime, 0); //Connects the links before the first reports go out.
 
-    //This connects to the nuclear control center server with error handling if a connection failure occurs.
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) 
+    /*This is the main loop that runs under the duration of the simulation; 60 seconds.
+    It sends every report that is due, then waits in the runtime until the next one.
+    With "--coroutines" the units run as coroutines instead and the loop is skipped.
+    The run ends early once nuclearControl has sent END on every link.*/
+    long long end_time = now_ms() + SIMULATION_DURATION * 1000LL;
+    if (co_config.enabled && run_coroutines(end_time) < 0) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Connection failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
-        close(sock);
-        if (log_fp) fclose(log_fp);
-        return 1;
+        log_event("ERROR", "Failed to allocate the coroutines, running the units from the main loop");
     }
-
-    //This prints out the message to confirm the connection to the nuclear control server.
-    log_event("CONNECTION", "Connected to Nuclear Control");
-
-    /*This is the main command loop that runs under the duration
-    of the simulation; 60 seconds.*/
-    time_t start_time = time(NULL);
-    while (time(NULL) - start_time < SIMULATION_DURATION) 
+    for (long long now = now_ms(); now < end_time && !runtime_ended(&runtime) && scheduler.spawned == 0; now = now_ms()) 
     {
-        send_intel(sock);
-        sleep(5 + (rand() % 6)); // Randomize interval
+        long long next_due = end_time;
+        for (int unit = 0; unit < runtime.unit_count; unit++) 
+        {
+            if (next_report[unit] <= now && radar.count > 0) 
+            {
+                radar_sweep(&radar, unit, now, report_detection);
+                next_report[unit] = now + radar_config.sweep_ms;
+            }
+            else if (next_report[unit] <= now) 
+            {
+                send_intel(&runtime, (uint32_t)(unit + 1));
+                next_report[unit] = now + (5 + (rand() % 6)) * 1000LL; // Randomize interval
+            }
+            if (next_report[unit] < next_due) next_due = next_report[unit];
+        }
+        if (next_due > now + STATS_INTERVAL_MS) next_due = now + STATS_INTERVAL_MS; //Keeps the statistics rows current.
+        runtime_poll(&runtime, (int)(next_due - now));
+        sample_stats(now_ms());
     }
 
     /*This shuts down the simulation sequence and 
     display a message saying the radar system has been terminated.*/
-    shutdown(sock, SHUT_RDWR);
-    close(sock);
+    runtime_close(&runtime);
+    free(next_report);
+    sample_stats(now_ms());
     generate_summary();
+    radar_destroy(&radar);
+    stats_close(&stats, now_ms());
     log_event("SHUTDOWN", "Radar System terminated");
     if (log_fp) fclose(log_fp);
     return 0;
-}
\ No newline at end of file
+}
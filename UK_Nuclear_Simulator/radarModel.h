@@ -0,0 +1,380 @@
+/*This is the simulated radar used by the radar client. Each radar unit is a site that
+watches its own square of airspace full of moving targets. Every sweep moves the targets
+and works out the range, bearing and chance of detection of each one, and the client only
+sends intel for the targets that were detected, so the report rate follows the air picture.
+
+Targets are kept as a structure of arrays, one array per field, so a sweep reads each
+field in order and processes RADAR_LANES targets per instruction with GCC's vector
+extensions (SSE or NEON, or AVX when compiled with -mavx2). Square roots and arctangents
+are computed with approximations made of plain arithmetic, so the kernel stays in vector
+registers and needs no libm. radar_sweep_scalar is the same computation one target at a
+time, so "--benchmark" can compare the two.
+
+Detection follows the radar equation: the signal to noise ratio falls with the fourth
+power of range and grows with the target's radar cross section, and the chance of
+detection is 50% where it equals 1 (RADAR_REFERENCE_KM for a 1 m2 target). Every target
+draws its detection from its own xorshift generator, so the result does not depend on
+which kernel ran.*/
+#ifndef RADAR_MODEL_H
+#define RADAR_MODEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "modelThreads.h"
+
+#define RADAR_DEFAULT_SWEEP_MS 5000
+#define RADAR_MAX_TARGETS (1 << 24)
+#define RADAR_AREA_KM 600.0f      //Half the width of the square each site watches.
+#define RADAR_MAX_RANGE_KM 400.0f
+#define RADAR_REFERENCE_KM 200.0f
+#define RADAR_KINDS 4
+
+#ifdef __AVX__
+#define RADAR_LANES 8
+#else
+#define RADAR_LANES 4
+#endif
+
+typedef float RadarVec __attribute__((vector_size(RADAR_LANES * sizeof(float))));
+typedef int32_t RadarMask __attribute__((vector_size(RADAR_LANES * sizeof(int32_t))));
+typedef uint32_t RadarBits __attribute__((vector_size(RADAR_LANES * sizeof(uint32_t))));
+
+/*These are the settings the radar client accepts on the command line: "--targets N"
+simulated targets shared among its units (0 keeps the old random reports), "--sweep-ms MS"
+between sweeps of each unit and "--benchmark SWEEPS" to time the kernels without a server.*/
+typedef struct
+{
+    int targets;
+    int sweep_ms;
+    int benchmark;
+} RadarConfig;
+
+//This is what is known about each kind of target, in the order of the kind IDs.
+static const struct
+{
+    const char *name;
+    float rcs;          //Radar cross section in m2.
+    float speed_kms;
+    float altitude_km;
+    int threat;         //The threat level before range and heading are taken into account.
+} radar_kinds[RADAR_KINDS] =
+{
+    {"Enemy Aircraft", 10.0f, 0.25f, 10.0f, 25},
+    {"Missile Strike", 0.5f, 1.0f, 5.0f, 60},
+    {"Drone Swarm", 0.1f, 0.05f, 2.0f, 15},
+    {"Stealth Bomber", 0.01f, 0.25f, 12.0f, 40}
+};
+
+/*These are the targets and the counters the summary reports. Every field is an array
+with one entry per target. Each unit's targets start on a RADAR_LANES boundary, and the
+slots that pad a unit to the next boundary hold targets that can never be detected.*/
+typedef struct
+{
+    RadarConfig config;
+    int unit_count;
+    size_t count;
+    size_t *first;          //unit_count + 1 offsets: unit u owns first[u] to first[u + 1].
+    long long *swept_ms;    //When each unit last swept.
+    float *x, *y, *z;       //Position in km east, north and up from the unit's site.
+    float *vx, *vy;         //Velocity in km/s.
+    float *rcs;
+    float *range, *bearing; //The last measurement: km and degrees clockwise from north.
+    float *pd;              //The last chance of detection.
+    uint32_t *seed;
+    int32_t *detected;      //-1 for the targets the last sweep detected, 0 for the rest.
+    unsigned char *kind;
+    unsigned long sweeps;
+    unsigned long long targets_swept;
+    unsigned long long detections;
+    long long sweep_ns_total;
+    long long sweep_ns_max;
+} RadarModel;
+
+//This is called for every detected target after a sweep, with its index in the arrays.
+typedef void (*DetectionHandler)(const RadarModel *model, uint32_t unit_id, size_t target);
+
+/*This consumes one radar option at argv[*i]. It returns 1 if the option
+belonged to the model, 0 if the caller should handle it and -1 if it is malformed.*/
+static inline int radar_parse_option(RadarConfig *config, int argc, char *argv[], int *i)
+{
+    int *target = NULL;
+    if (strcmp(argv[*i], "--targets") == 0) target = &config->targets;
+    else if (strcmp(argv[*i], "--sweep-ms") == 0) target = &config->sweep_ms;
+    else if (strcmp(argv[*i], "--benchmark") == 0) target = &config->benchmark;
+    else return 0;
+
+    if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+    *target = atoi(argv[++*i]);
+    return (config->targets <= RADAR_MAX_TARGETS && config->sweep_ms > 0) ? 1 : -1;
+}
+
+//This steps a xorshift generator, the same one for every lane and for the scalar kernel.
+static inline uint32_t radar_next_seed(uint32_t *seed)
+{
+    uint32_t s = *seed;
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return *seed = s;
+}
+
+//This returns a uniform random float in [0, 1) from a generator.
+static inline float radar_uniform(uint32_t *seed)
+{
+    return (float)(radar_next_seed(seed) >> 8) * (1.0f / 16777216.0f);
+}
+
+/*This returns the bearing of a point east and north of the site in degrees clockwise
+from north. The arctangent is a polynomial over the first octant that is within
+0.001 degrees, and the octant is put back from the signs and the larger coordinate.*/
+static inline float radar_bearing(float east, float north)
+{
+    float ax = east < 0.0f ? -east : east;
+    float ay = north < 0.0f ? -north : north;
+    float a = (ax > ay ? ay : ax) / ((ax > ay ? ax : ay) + 1e-20f);
+    float s = a * a;
+    float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+    if (ax > ay) r = 1.5707963f - r;
+    if (north < 0.0f) r = 3.1415927f - r;
+    if (east < 0.0f) r = 6.2831853f - r;
+    return r * 57.2957795f;
+}
+
+//This releases the target arrays at the end of the simulation, or whatever radar_init reserved.
+static inline void radar_destroy(RadarModel *model)
+{
+    free(model->first);
+    free(model->swept_ms);
+    free(model->x);
+    free(model->y);
+    free(model->z);
+    free(model->vx);
+    free(model->vy);
+    free(model->rcs);
+    free(model->range);
+    free(model->bearing);
+    free(model->pd);
+    free(model->seed);
+    free(model->detected);
+    free(model->kind);
+    memset(model, 0, sizeof(*model));
+}
+
+/*This reserves the arrays for every unit's share of the targets and scatters them over
+its airspace with a random kind, heading and seed. It returns 0 or -1, and frees
+what it reserved with radar_destroy on failure.*/
+static inline int radar_init(RadarModel *model, int unit_count, const RadarConfig *config, uint32_t seed,
+                             long long now)
+{
+    memset(model, 0, sizeof(*model));
+    model->config = *config;
+    model->unit_count = unit_count;
+    model->first = calloc((size_t)unit_count + 1, sizeof(size_t));
+    model->swept_ms = calloc((size_t)unit_count, sizeof(long long));
+    if (!model->first || !model->swept_ms)
+    {
+        radar_destroy(model);
+        return -1;
+    }
+    for (int u = 0; u < unit_count; u++)
+    {
+        size_t share = (size_t)config->targets / (size_t)unit_count + ((size_t)u < (size_t)config->targets % (size_t)unit_count);
+        model->first[u + 1] = model->first[u] + (share + RADAR_LANES - 1) / RADAR_LANES * RADAR_LANES;
+        model->swept_ms[u] = now;
+    }
+    model->count = model->first[unit_count];
+
+    //Every array is aligned to a whole vector, and aligned_alloc needs a size that is a multiple of it.
+    size_t size = (model->count > 0 ? model->count : RADAR_LANES) * sizeof(float);
+    float **fields[] = {&model->x, &model->y, &model->z, &model->vx, &model->vy, &model->rcs,
+                        &model->range, &model->bearing, &model->pd};
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+    {
+        *fields[f] = aligned_alloc(sizeof(RadarVec), size);
+    }
+    model->seed = aligned_alloc(sizeof(RadarVec), size);
+    model->detected = aligned_alloc(sizeof(RadarVec), size);
+    model->kind = malloc(size / sizeof(float));
+    if (!model->x || !model->y || !model->z || !model->vx || !model->vy || !model->rcs || !model->range ||
+        !model->bearing || !model->pd || !model->seed || !model->detected || !model->kind)
+    {
+        radar_destroy(model);
+        return -1;
+    }
+
+    for (int u = 0; u < unit_count; u++)
+    {
+        size_t share = (size_t)config->targets / (size_t)unit_count + ((size_t)u < (size_t)config->targets % (size_t)unit_count);
+        for (size_t i = model->first[u]; i < model->first[u + 1]; i++)
+        {
+            uint32_t *s = &model->seed[i];
+            *s = (seed = seed * 1664525u + 1013904223u) | 1u;
+            int kind = (int)(radar_next_seed(s) % RADAR_KINDS);
+            float east = radar_uniform(s) * 2.0f - 1.0f;
+            float north = radar_uniform(s) * 2.0f - 1.0f;
+            float speed = radar_kinds[kind].speed_kms * model_rsqrt(east * east + north * north + 1e-6f);
+            model->kind[i] = (unsigned char)kind;
+            model->x[i] = (radar_uniform(s) * 2.0f - 1.0f) * RADAR_AREA_KM;
+            model->y[i] = (radar_uniform(s) * 2.0f - 1.0f) * RADAR_AREA_KM;
+            model->z[i] = radar_kinds[kind].altitude_km;
+            model->vx[i] = east * speed;
+            model->vy[i] = north * speed;
+            model->rcs[i] = i - model->first[u] < share ? radar_kinds[kind].rcs : 0.0f; //Padding is never seen.
+            model->range[i] = model->bearing[i] = model->pd[i] = 0.0f;
+            model->detected[i] = 0;
+        }
+    }
+    return 0;
+}
+
+//This picks a where bits are set in the mask and b elsewhere.
+static inline RadarVec radar_select(RadarMask mask, RadarVec a, RadarVec b)
+{
+    return (RadarVec)(((RadarMask)a & mask) | ((RadarMask)b & ~mask));
+}
+
+/*This is the sweep kernel: it moves the targets from first to end on by dt seconds,
+turning back those that leave the airspace, and measures and rolls for each of them,
+RADAR_LANES targets at a time. first and end must be on RADAR_LANES boundaries.*/
+static inline void radar_sweep_vector(RadarModel *model, size_t first, size_t end, float dt)
+{
+    const float reference = RADAR_REFERENCE_KM * RADAR_REFERENCE_KM * RADAR_REFERENCE_KM * RADAR_REFERENCE_KM;
+    for (size_t i = first; i < end; i += RADAR_LANES)
+    {
+        RadarVec *x = (RadarVec *)&model->x[i], *y = (RadarVec *)&model->y[i];
+        RadarVec *vx = (RadarVec *)&model->vx[i], *vy = (RadarVec *)&model->vy[i];
+        RadarBits *seed = (RadarBits *)&model->seed[i];
+
+        RadarVec east = *x + *vx * dt;
+        RadarVec north = *y + *vy * dt;
+        *vx = (RadarVec)((RadarMask)*vx ^ (((east > RADAR_AREA_KM) | (east < -RADAR_AREA_KM)) & INT32_MIN));
+        *vy = (RadarVec)((RadarMask)*vy ^ (((north > RADAR_AREA_KM) | (north < -RADAR_AREA_KM)) & INT32_MIN));
+        *x = east;
+        *y = north;
+
+        //This is the range, with 1 / sqrt estimated from the bits and refined twice.
+        RadarVec z = *(RadarVec *)&model->z[i];
+        RadarVec r2 = east * east + north * north + z * z;
+        RadarVec r = (RadarVec)(0x5f3759df - ((RadarMask)r2 >> 1));
+        r = r * (1.5f - 0.5f * r2 * r * r);
+        r = r * (1.5f - 0.5f * r2 * r * r);
+        *(RadarVec *)&model->range[i] = r2 * r;
+
+        //This is radar_bearing for every lane, with the branches turned into selects.
+        RadarVec ax = (RadarVec)((RadarMask)east & INT32_MAX);
+        RadarVec ay = (RadarVec)((RadarMask)north & INT32_MAX);
+        RadarMask steep = ax > ay;
+        RadarVec a = radar_select(steep, ay, ax) / (radar_select(steep, ax, ay) + 1e-20f);
+        RadarVec s = a * a;
+        RadarVec angle = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+        angle = radar_select(steep, 1.5707963f - angle, angle);
+        angle = radar_select(north < 0.0f, 3.1415927f - angle, angle);
+        angle = radar_select(east < 0.0f, 6.2831853f - angle, angle);
+        *(RadarVec *)&model->bearing[i] = angle * 57.2957795f;
+
+        //This is the chance of detection from the signal to noise ratio, zero beyond the maximum range.
+        RadarVec snr = *(RadarVec *)&model->rcs[i] * reference / (r2 * r2);
+        RadarVec pd = snr * snr / (snr * snr + 1.0f);
+        pd = (RadarVec)((RadarMask)pd & ~(r2 > RADAR_MAX_RANGE_KM * RADAR_MAX_RANGE_KM));
+        *(RadarVec *)&model->pd[i] = pd;
+
+        RadarBits bits = *seed;
+        bits ^= bits << 13;
+        bits ^= bits >> 17;
+        bits ^= bits << 5;
+        *seed = bits;
+        RadarVec roll = __builtin_convertvector((RadarMask)(bits >> 8), RadarVec) * (1.0f / 16777216.0f);
+        *(RadarMask *)&model->detected[i] = roll < pd;
+    }
+}
+
+//This is the same sweep one target at a time, for comparison with the kernel above.
+static inline void radar_sweep_scalar(RadarModel *model, size_t first, size_t end, float dt)
+{
+    const float reference = RADAR_REFERENCE_KM * RADAR_REFERENCE_KM * RADAR_REFERENCE_KM * RADAR_REFERENCE_KM;
+    for (size_t i = first; i < end; i++)
+    {
+        float east = model->x[i] + model->vx[i] * dt;
+        float north = model->y[i] + model->vy[i] * dt;
+        if (east > RADAR_AREA_KM || east < -RADAR_AREA_KM) model->vx[i] = -model->vx[i];
+        if (north > RADAR_AREA_KM || north < -RADAR_AREA_KM) model->vy[i] = -model->vy[i];
+        model->x[i] = east;
+        model->y[i] = north;
+
+        float r2 = east * east + north * north + model->z[i] * model->z[i];
+        model->range[i] = r2 * model_rsqrt(r2);
+        model->bearing[i] = radar_bearing(east, north);
+
+        float snr = model->rcs[i] * reference / (r2 * r2);
+        float pd = r2 > RADAR_MAX_RANGE_KM * RADAR_MAX_RANGE_KM ? 0.0f : snr * snr / (snr * snr + 1.0f);
+        model->pd[i] = pd;
+        model->detected[i] = radar_uniform(&model->seed[i]) < pd ? -1 : 0;
+    }
+}
+
+/*This sweeps one unit's airspace at now with the vector kernel, then calls detect for
+every target it detected. Only the kernel is timed for the sweep cost. It returns the
+number of detections.*/
+static inline int radar_sweep(RadarModel *model, int unit, long long now, DetectionHandler detect)
+{
+    size_t first = model->first[unit], end = model->first[unit + 1];
+    float dt = (float)(now - model->swept_ms[unit]) / 1000.0f;
+    model->swept_ms[unit] = now;
+
+    struct timespec started, finished;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    radar_sweep_vector(model, first, end, dt);
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    long long ns = (finished.tv_sec - started.tv_sec) * 1000000000LL + (finished.tv_nsec - started.tv_nsec);
+    model->sweeps++;
+    model->targets_swept += end - first;
+    model->sweep_ns_total += ns;
+    if (ns > model->sweep_ns_max) model->sweep_ns_max = ns;
+
+    int detections = 0;
+    for (size_t i = first; i < end; i++)
+    {
+        if (!model->detected[i]) continue;
+        detections++;
+        detect(model, (uint32_t)(unit + 1), i);
+    }
+    model->detections += (unsigned long long)detections;
+    return detections;
+}
+
+/*This turns a detection into a threat level: the kind's own level, up to 30 more
+the closer it is, and 10 more if it is heading towards the site.*/
+static inline int radar_threat_level(const RadarModel *model, size_t target)
+{
+    float range = model->range[target];
+    float closing = model->x[target] * model->vx[target] + model->y[target] * model->vy[target];
+    int level = radar_kinds[model->kind[target]].threat + (int)(30.0f * (1.0f - range / RADAR_MAX_RANGE_KM));
+    if (closing < 0.0f) level += 10;
+    return level < 10 ? 10 : (level > 100 ? 100 : level);
+}
+
+//This names the sea a bearing looks out over, one per quarter centred on the compass points.
+static inline const char *radar_location(float bearing)
+{
+    static const char *const seas[] = {"Norwegian Sea", "North Sea", "English Channel", "North Atlantic"};
+    int quarter = (int)((bearing + 45.0f) / 90.0f);
+    return seas[quarter % 4];
+}
+
+//This writes the sweep figures to a summary file.
+static inline void radar_report(const RadarModel *model, FILE *summary_fp)
+{
+    fprintf(summary_fp, "Simulated Targets: %d over %d units, Sweep Interval: %d ms, Kernel Width: %d lanes\n",
+            model->config.targets, model->unit_count, model->config.sweep_ms, RADAR_LANES);
+    fprintf(summary_fp, "Sweeps: %lu, Targets Swept: %llu, Detections: %llu (%.1f%% of targets swept)\n",
+            model->sweeps, model->targets_swept, model->detections,
+            model->targets_swept ? 100.0 * (double)model->detections / (double)model->targets_swept : 0.0);
+    fprintf(summary_fp, "Sweep Cost: %.2f ns per target, max %.3f ms per sweep\n",
+            model->targets_swept ? (double)model->sweep_ns_total / (double)model->targets_swept : 0.0,
+            (double)model->sweep_ns_max / 1e6);
+}
+
+#endif
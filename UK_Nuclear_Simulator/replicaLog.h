@@ -0,0 +1,142 @@
+/*This is the replication log a primary nuclearControl streams to its hot standby over a
+Unix socket. The primary appends a record whenever the state the run depends on changes
+(threats, launch decisions and the units each connection has registered), and a COUNTERS
+record every REPL_HEARTBEAT_MS that doubles as its heartbeat. The standby appends every
+record it receives to its replica file and applies it, so it holds the run's state when
+it has to take over, and the file is the append-only log of the run.
+
+A record is a type byte, a varint payload length and the payload. The payload is a fixed
+number of varints for its type, followed by names in the wireCodec.h encoding, so a
+threat or a decision takes a handful of bytes. On every (re)connection the primary starts
+with START, COUNTERS and a CLIENT record per connection, so the standby never depends on
+records it may have missed.*/
+#ifndef REPLICA_LOG_H
+#define REPLICA_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "wireCodec.h"
+
+#define REPL_VERSION 1
+#define REPL_MAX_RECORD 192
+#define REPL_BUFFER_SIZE 65536
+#define REPL_HEARTBEAT_MS 100
+#define REPL_TIMEOUT_MS 300 //A standby that hears nothing for this long takes over.
+#define REPL_MAX_VALUES 12
+#define REPL_MAX_NAMES 2
+
+//These are the record types.
+enum
+{
+    REPL_START = 1,    //version, node ID, wall clock start of the run in ms.
+    REPL_COUNTERS = 2, //The REPL_COUNTER_COUNT counters below, as absolute values.
+    REPL_THREAT = 3,   //threat level; names type and location.
+    REPL_DECISION = 4, //command sequence number, priority; name location.
+    REPL_CLIENT = 5,   //connection slot, role, units registered (0 once it has closed).
+    REPL_END = 6       //The primary finished the run normally, the standby stands down.
+};
+
+//These are the counters in a COUNTERS record, in order.
+enum
+{
+    REPL_END_WALL_MS,     //Wall clock time the run is due to end, 0 until it is known.
+    REPL_THREATS,
+    REPL_COMMANDS,
+    REPL_COMMAND_SEQ,
+    REPL_COMMANDS_ACKED,
+    REPL_DECISIONS_FORWARDED,
+    REPL_DECISIONS_RECEIVED,
+    REPL_COUNTER_COUNT
+};
+
+//This is one record as it was parsed, its payload still encoded.
+typedef struct
+{
+    uint8_t type;
+    const unsigned char *payload;
+    size_t length;
+} ReplRecord;
+
+//This returns how many varints a record of the type starts with, or -1 for an unknown type.
+static inline int repl_value_count(uint8_t type)
+{
+    switch (type)
+    {
+        case REPL_START: return 3;
+        case REPL_COUNTERS: return REPL_COUNTER_COUNT;
+        case REPL_THREAT: return 1;
+        case REPL_DECISION: return 2;
+        case REPL_CLIENT: return 3;
+        case REPL_END: return 0;
+        default: return -1;
+    }
+}
+
+/*This encodes one record into out from its values and names. It returns the record's
+size, or 0 if it does not fit in cap or REPL_MAX_RECORD.*/
+static inline size_t repl_encode(unsigned char *out, size_t cap, uint8_t type, const uint64_t *values,
+                                 int value_count, const char *const *names, int name_count)
+{
+    unsigned char payload[REPL_MAX_RECORD];
+    size_t used = 0;
+    for (int i = 0; i < value_count; i++)
+    {
+        size_t n = wire_put_varint(payload + used, sizeof(payload) - used, values[i]);
+        if (n == 0) return 0;
+        used += n;
+    }
+    for (int i = 0; i < name_count; i++)
+    {
+        size_t n = wire_put_name(payload + used, sizeof(payload) - used, names[i]);
+        if (n == 0) return 0;
+        used += n;
+    }
+
+    unsigned char header[1 + 10];
+    header[0] = type;
+    size_t header_len = 1 + wire_put_varint(header + 1, sizeof(header) - 1, used);
+    if (header_len + used > cap) return 0;
+    memcpy(out, header, header_len);
+    memcpy(out + header_len, payload, used);
+    return header_len + used;
+}
+
+/*This parses the record at the start of in. It returns the bytes it takes, 0 if the
+record is not complete yet, or -1 if the stream is corrupt.*/
+static inline int repl_parse(const unsigned char *in, size_t len, ReplRecord *record)
+{
+    uint64_t length;
+    if (len < 2) return 0;
+    size_t n = wire_get_varint(in + 1, len - 1, &length);
+    if (n == 0) return len - 1 >= 10 ? -1 : 0;
+    if (length > REPL_MAX_RECORD || repl_value_count(in[0]) < 0) return -1;
+    if (1 + n + length > len) return 0;
+    record->type = in[0];
+    record->payload = in + 1 + n;
+    record->length = (size_t)length;
+    return (int)(1 + n + length);
+}
+
+/*This decodes a record's values and up to name_count names. It returns 0, or -1 if
+the payload does not hold what its type says it should.*/
+static inline int repl_decode(const ReplRecord *record, uint64_t *values, WireName *names, int name_count)
+{
+    size_t used = 0;
+    int value_count = repl_value_count(record->type);
+    for (int i = 0; i < value_count; i++)
+    {
+        size_t n = wire_get_varint(record->payload + used, record->length - used, &values[i]);
+        if (n == 0) return -1;
+        used += n;
+    }
+    for (int i = 0; i < name_count; i++)
+    {
+        size_t n = wire_get_name(record->payload + used, record->length - used, &names[i]);
+        if (n == 0) return -1;
+        used += n;
+    }
+    return 0;
+}
+
+#endif
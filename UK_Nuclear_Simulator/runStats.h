@@ -0,0 +1,251 @@
+/*This is the run statistics writer shared by nuclearControl and the four clients.
+Alongside its text summary every program streams one row per STATS_INTERVAL_MS time
+bucket into a small columnar file, so many runs can be merged and queried by statsQuery
+without scraping text. Rows are kept in memory and written STATS_BLOCK_ROWS at a time
+as a block, column after column, and every value is a varint from wireCodec.h.
+
+The file starts with STATS_MAGIC, a version byte and then varints for the bucket length
+in ms, the wall clock start of the run in ms and the program name (length then bytes).
+Each block is a 'B' byte and varints for its first bucket, its row count and its column
+count, then for every column its name (length then bytes) and the byte length of its data,
+then the data of every column in the same order. A reader skips the columns it does not
+want by their lengths. A column only appears from the block it was first used in.
+
+Counters hold the amount for each bucket and are summed when runs are merged. A column
+whose name ends in ".max" holds the largest value and is merged with max. A histogram
+"name" is the columns "name.h0" to "name.h15" and "name.max". h0 counts values below 1,
+column b counts values from 2^(b-1) up to 2^b and h15 everything above that, and
+percentiles are read from them after merging.
+The writer is not thread safe, nuclearControl guards it with its own mutex.*/
+#ifndef RUN_STATS_H
+#define RUN_STATS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wireCodec.h"
+
+#define STATS_MAGIC "NCST"
+#define STATS_VERSION 1
+#define STATS_INTERVAL_MS 1000
+#define STATS_BLOCK_ROWS 60
+#define STATS_MAX_COLUMNS 256
+#define STATS_NAME_SIZE 64
+#define STATS_HIST_BUCKETS 16
+
+//This is the writer: the column names, this block's rows and where the next value goes.
+typedef struct
+{
+    FILE *fp;
+    long long started_ms;
+    long long bucket;       //The bucket rows are being added to, counted from the start of the run.
+    long long block_first;  //The bucket of the block's first row.
+    int rows;               //Rows finished in this block, the current row is rows.
+    int column_count;
+    char (*names)[STATS_NAME_SIZE];
+    long long *values;      //STATS_BLOCK_ROWS values per column.
+    long long *totals;      //The last running total seen by stats_total for each column.
+    unsigned char *scratch; //The encoded block before it is written.
+    unsigned long rows_written;
+    unsigned long blocks_written;
+    unsigned long dropped;  //Values for columns that did not fit in STATS_MAX_COLUMNS.
+} StatsWriter;
+
+//This returns a column's value in the current row.
+static inline long long *stats_cell(StatsWriter *w, int column)
+{
+    return &w->values[(size_t)column * STATS_BLOCK_ROWS + (size_t)w->rows];
+}
+
+/*This writes the block's finished rows out and starts a new block.*/
+static inline void stats_write_block(StatsWriter *w)
+{
+    if (w->rows == 0) return;
+    unsigned char *out = w->scratch;
+    size_t cap = (size_t)STATS_MAX_COLUMNS * (STATS_NAME_SIZE + 20 + (size_t)STATS_BLOCK_ROWS * 10) + 32;
+    size_t used = 0;
+    out[used++] = 'B';
+    used += wire_put_varint(out + used, cap - used, (uint64_t)w->block_first);
+    used += wire_put_varint(out + used, cap - used, (uint64_t)w->rows);
+    used += wire_put_varint(out + used, cap - used, (uint64_t)w->column_count);
+
+    //The column data is encoded first, behind the space the directory can take, so its lengths are known.
+    size_t directory = used;
+    size_t data = directory + (size_t)w->column_count * (STATS_NAME_SIZE + 20);
+    size_t data_start = data;
+    size_t lengths[STATS_MAX_COLUMNS];
+    for (int c = 0; c < w->column_count; c++)
+    {
+        const long long *column = &w->values[(size_t)c * STATS_BLOCK_ROWS];
+        size_t start = data;
+        for (int r = 0; r < w->rows; r++)
+        {
+            data += wire_put_varint(out + data, cap - data, (uint64_t)(column[r] > 0 ? column[r] : 0));
+        }
+        lengths[c] = data - start;
+    }
+    for (int c = 0; c < w->column_count; c++)
+    {
+        size_t name_len = strlen(w->names[c]);
+        used += wire_put_varint(out + used, cap - used, name_len);
+        memcpy(out + used, w->names[c], name_len);
+        used += name_len;
+        used += wire_put_varint(out + used, cap - used, lengths[c]);
+    }
+    memmove(out + used, out + data_start, data - data_start);
+    used += data - data_start;
+    fwrite(out, 1, used, w->fp);
+    fflush(w->fp);
+
+    w->rows_written += (unsigned long)w->rows;
+    w->blocks_written++;
+    w->block_first += w->rows;
+    w->rows = 0;
+}
+
+/*This closes every bucket that has ended by now, adding empty rows for buckets in
+which nothing happened, so row N of every run is always the same point in the run.*/
+static inline void stats_advance(StatsWriter *w, long long now)
+{
+    if (!w->fp) return;
+    long long target = (now - w->started_ms) / STATS_INTERVAL_MS;
+    while (w->bucket < target)
+    {
+        w->rows++;
+        w->bucket++;
+        if (w->rows == STATS_BLOCK_ROWS) stats_write_block(w);
+        for (int c = 0; c < w->column_count; c++)
+        {
+            *stats_cell(w, c) = 0;
+        }
+    }
+}
+
+/*This opens the statistics file of a run and reserves the memory for a block. It returns
+0, or -1 if the file cannot be created, in which case every other call does nothing.*/
+static inline int stats_open(StatsWriter *w, const char *path, const char *program, long long now)
+{
+    memset(w, 0, sizeof(*w));
+    w->names = calloc(STATS_MAX_COLUMNS, STATS_NAME_SIZE);
+    w->values = calloc((size_t)STATS_MAX_COLUMNS * STATS_BLOCK_ROWS, sizeof(long long));
+    w->totals = calloc(STATS_MAX_COLUMNS, sizeof(long long));
+    w->scratch = malloc((size_t)STATS_MAX_COLUMNS * (STATS_NAME_SIZE + 20 + (size_t)STATS_BLOCK_ROWS * 10) + 32);
+    w->fp = (w->names && w->values && w->totals && w->scratch) ? fopen(path, "wb") : NULL;
+    if (!w->fp)
+    {
+        free(w->names);
+        free(w->values);
+        free(w->totals);
+        free(w->scratch);
+        memset(w, 0, sizeof(*w));
+        return -1;
+    }
+    w->started_ms = now;
+
+    unsigned char header[STATS_NAME_SIZE + 40];
+    size_t used = 0;
+    size_t name_len = strlen(program) < STATS_NAME_SIZE ? strlen(program) : STATS_NAME_SIZE - 1;
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    memcpy(header, STATS_MAGIC, 4);
+    used = 4;
+    header[used++] = STATS_VERSION;
+    used += wire_put_varint(header + used, sizeof(header) - used, STATS_INTERVAL_MS);
+    used += wire_put_varint(header + used, sizeof(header) - used,
+                            (uint64_t)wall.tv_sec * 1000 + (uint64_t)wall.tv_nsec / 1000000);
+    used += wire_put_varint(header + used, sizeof(header) - used, name_len);
+    memcpy(header + used, program, name_len);
+    used += name_len;
+    fwrite(header, 1, used, w->fp);
+    return 0;
+}
+
+//This returns the index of a column, adding it if it is new. It returns -1 once the columns run out.
+static inline int stats_column(StatsWriter *w, const char *name)
+{
+    if (!w->fp) return -1;
+    for (int c = 0; c < w->column_count; c++)
+    {
+        if (strcmp(w->names[c], name) == 0) return c;
+    }
+    if (w->column_count == STATS_MAX_COLUMNS)
+    {
+        w->dropped++;
+        return -1;
+    }
+    snprintf(w->names[w->column_count], STATS_NAME_SIZE, "%s", name);
+    return w->column_count++;
+}
+
+//This adds to a counter column in the bucket of now.
+static inline void stats_add(StatsWriter *w, int column, long long amount, long long now)
+{
+    if (column < 0) return;
+    stats_advance(w, now);
+    *stats_cell(w, column) += amount;
+}
+
+/*This adds to a counter column looked up by name, for columns such as one per location.
+A name too long for a column is not counted, since cut short it could be another's.*/
+static inline void stats_count(StatsWriter *w, const char *prefix, const char *name, long long amount,
+                               long long now)
+{
+    char column[STATS_NAME_SIZE];
+    int length = snprintf(column, sizeof(column), "%s/%s", prefix, name);
+    if (length < 0 || length >= (int)sizeof(column)) return;
+    stats_add(w, stats_column(w, column), amount, now);
+}
+
+/*This adds the growth of a running total since the last call to a counter column,
+so counters the programs keep anyway can be sampled instead of updated twice.*/
+static inline void stats_total(StatsWriter *w, int column, long long total, long long now)
+{
+    if (column < 0) return;
+    stats_add(w, column, total - w->totals[column], now);
+    w->totals[column] = total;
+}
+
+//This adds a histogram's columns and returns the first, which stats_observe takes.
+static inline int stats_histogram(StatsWriter *w, const char *name)
+{
+    char column[STATS_NAME_SIZE];
+    int first = -1;
+    for (int b = 0; b <= STATS_HIST_BUCKETS; b++)
+    {
+        if (b < STATS_HIST_BUCKETS) snprintf(column, sizeof(column), "%s.h%d", name, b);
+        else snprintf(column, sizeof(column), "%s.max", name);
+        int index = stats_column(w, column);
+        if (b == 0) first = index;
+        if (index != first + b) return -1; //The columns of a histogram have to be side by side.
+    }
+    return first;
+}
+
+//This counts one value in a histogram in the bucket of now.
+static inline void stats_observe(StatsWriter *w, int histogram, long long value, long long now)
+{
+    if (histogram < 0) return;
+    int b = 0;
+    while (b < STATS_HIST_BUCKETS - 1 && value >= (1LL << b)) b++;
+    stats_add(w, histogram + b, 1, now);
+    long long *max = stats_cell(w, histogram + STATS_HIST_BUCKETS);
+    if (value > *max) *max = value;
+}
+
+//This writes the last bucket and closes the file.
+static inline void stats_close(StatsWriter *w, long long now)
+{
+    if (!w->fp) return;
+    stats_advance(w, now);
+    w->rows++; //The bucket the run ended in.
+    stats_write_block(w);
+    fclose(w->fp);
+    free(w->names);
+    free(w->values);
+    free(w->totals);
+    free(w->scratch);
+    w->fp = NULL;
+}
+
+#endif
@@ -10,6 +10,10 @@ inputs, outputs, strings, sockets, memory allocation, character handling, etc.*/
 #include <time.h>
 #include <ctype.h>
 #include <errno.h>
+#include "clientRuntime.h"
+#include "runStats.h"
+#include "orbitModel.h"
+#include "coroutineRuntime.h"
 
 /*This is to defined the assigned port, simulation duration, and  
 buffer size for the satellite client to ping back to the server's IP address.*/
@@ -20,10 +24,45 @@ buffer size for the satellite client to ping back to the server's IP address.*/
 #define SIMULATION_DURATION 60
 #define BUFFER_SIZE 1024
 #define SUMMARY_FILE "satellite_summary.txt"
+#define STATS_FILE "satellite_stats.col"
+#define REGION_THREAT_S 60 //Mean simulated seconds between new threats in each watched region.
+#define MAX_PENDING 32
 
 //These are global variables that handles log file and tracks successful transmissions.
 static FILE *log_fp = NULL;
 static int intel_sent = 0;
+static ClientRuntime runtime;
+static StatsWriter stats;
+static int stat_sent, stat_held, stat_dropped, stat_credit_grants;
+
+/*These are the constellation and the threats that have appeared in each region and are
+waiting for a satellite to pass over, with when they appeared in simulated seconds.*/
+static OrbitModel orbit;
+static struct
+{
+    int kind;
+    int threat_level;
+    double appeared_s;
+} pending[ORBIT_REGIONS][MAX_PENDING];
+static int pending_count[ORBIT_REGIONS];
+static unsigned long threats_appeared, threats_seen, threats_lost;
+static double coverage_wait_total_s, coverage_wait_max_s;
+static int stat_propagations, stat_propagate_us, stat_threats_seen;
+
+/*This is a satellite unit and the constellation, and the scheduler they run on, with
+"--coroutines". The constellation keeps the time its next step is due.*/
+typedef struct
+{
+    Coroutine co;
+    uint32_t unit_id;
+} SatelliteUnit;
+static struct
+{
+    Coroutine co;
+    long long next_step;
+    long long step_ms;
+} stepper;
+static CoScheduler scheduler;
 
 /*This initialize a log file with a timestamped header and opens it in write file mode. 
 It includes an error handling function in case there is a creation failure and a small 
@@ -80,38 +119,53 @@ void caesar_encrypt(const char *plaintext, char *ciphertext, size_t len)
     }
 }
 
-/*This generates and sends intel reports to the nuclear control center about 
-the enemy threats and their location. It also includes buffers of messages to get enough of 
-characters to display. It randomly select any threats and locations from the data sets.
-Lastly, it generates threat level with 30% chance of a threat above 70.*/
-void send_intel(int sock) 
+/*This sends an intel report to the nuclear control center about an enemy threat and
+its location. It also includes buffers of messages to get enough of characters to display.
+The details are added to the log entry after the encoding.*/
+void send_report(ClientRuntime *rt, uint32_t unit_id, const char *threat_type, const char *threat,
+                 int threat_level, const char *location, const char *details) 
 {
-    const char *threat_types[] = {"Air", "Sea", "Space"};
-    const char *threat_data[] = {"Ballistic Missile", "Naval Fleet", "Satellite Anomaly", "Orbital Debris"};
-    const char *locations[] = {"Arctic Ocean", "Mediterranean", "Barents Sea", "North Sea"};
     char message[512];
-    char ciphertext[BUFFER_SIZE];
-    char log_msg[BUFFER_SIZE];
-    int idx = rand() % 4;
-    int type_idx = rand() % 3;
-    int threat_level = (rand() % 100 < 30) ? 71 + (rand() % 30) : 10 + (rand() % 61);
+    char payload[BUFFER_SIZE];
+    char encoding[BUFFER_SIZE + 16];
+    char log_msg[2 * BUFFER_SIZE];
 
-    //The report details are encrypted by a caesar cipher and separated by a pipe delimiter in the nuclear control log file.
-    snprintf(message, sizeof(message),
-             "source:Satellite|type:%s|data:%s|threat_level:%d|location:%s",
-             threat_types[type_idx], threat_data[idx], threat_level, locations[idx]);
-    caesar_encrypt(message, ciphertext, sizeof(ciphertext));
+    /*On a link that negotiated the binary codec the report goes as interned IDs instead.
+    Otherwise the report details are encrypted by a caesar cipher and separated by a pipe delimiter.*/
+    Link *link = runtime_link_for(rt, unit_id);
+    uint8_t frame_type = link->codec ? FRAME_INTEL_BIN : FRAME_INTEL;
+    int length;
+    if (link->codec) 
+    {
+        length = wire_encode_intel(payload, sizeof(payload), "Satellite", threat_type, threat, threat_level, location);
+        snprintf(encoding, sizeof(encoding), "[Binary] %d bytes", length);
+    } 
+    else 
+    {
+        snprintf(message, sizeof(message),
+                 "source:Satellite|type:%s|data:%s|threat_level:%d|location:%s",
+                 threat_type, threat, threat_level, location);
+        caesar_encrypt(message, payload, sizeof(payload));
+        length = (int)strlen(payload);
+        snprintf(encoding, sizeof(encoding), "[Encrypted] %s", payload);
+    }
+
+    /*This sends the report frame for the unit over its shared link, or queues it in the link's
+    batch with "--batch-ms". It fails if the link is waiting to reconnect or nuclearControl
+    has asked sensors to slow down, but critical reports are always sent. The report is
+    handed over before it is logged, so the write to the log file does not hold it up.*/
+    int sent = length >= 0 && runtime_send_report(rt, unit_id, frame_type, payload, (size_t)length, threat_level) == 0;
 
     /*This receives and sending intelligence report to the to the nuclear control.*/
     snprintf(log_msg, sizeof(log_msg),
-             "Sending Intelligence: Type=%s, Details=%s, ThreatLevel=%d, Location=%s, [Encrypted] %s",
-             threat_types[type_idx], threat_data[idx], threat_level, locations[idx], ciphertext);
+             "Unit %u Sending Intelligence: Type=%s, Details=%s, ThreatLevel=%d, Location=%s, %s%s",
+             unit_id, threat_type, threat, threat_level, location, encoding, details);
     log_event("INTEL", log_msg);
-
-    //This sends an encrypted data over network with error handling in case it fails to send intelligence.    
-    if (send(sock, ciphertext, strlen(ciphertext), 0) < 0) 
+    if (length < 0) return;
+    if (!sent) 
     {
-        snprintf(log_msg, sizeof(log_msg), "Failed to send intelligence: %s", strerror(errno));
+        snprintf(log_msg, sizeof(log_msg), "Unit %u failed to send intelligence: %s", unit_id,
+                 link->sock < 0 ? "link down" : "no flow control credit");
         log_event("ERROR", log_msg);
     } 
     else 
@@ -120,6 +174,102 @@ void send_intel(int sock)
     }
 }
 
+/*This generates intel reports when no constellation is simulated. It randomly select any
+threats and locations from the data sets, and generates threat level with 30% chance of a
+threat above 70.*/
+void send_intel(ClientRuntime *rt, uint32_t unit_id) 
+{
+    const char *threat_types[] = {"Air", "Sea", "Space"};
+    const char *threat_data[] = {"Ballistic Missile", "Naval Fleet", "Satellite Anomaly", "Orbital Debris"};
+    const char *locations[] = {"Arctic Ocean", "Mediterranean", "Barents Sea", "North Sea"};
+    int idx = rand() % 4;
+    int type_idx = rand() % 3;
+    int threat_level = (rand() % 100 < 30) ? 71 + (rand() % 30) : 10 + (rand() % 61);
+    send_report(rt, unit_id, threat_types[type_idx], threat_data[idx], threat_level, locations[idx], "");
+}
+
+/*This moves the constellation on by one step. New threats appear in each region about
+every REGION_THREAT_S simulated seconds, and every threat waiting in a region that a
+satellite now sees is reported through that satellite's unit (satellite s belongs to
+unit s % units + 1), with how long it waited for the satellite in the log.*/
+void constellation_step(ClientRuntime *rt) 
+{
+    const char *threat_types[] = {"Air", "Sea", "Space", "Space"};
+    const char *threat_data[] = {"Ballistic Missile", "Naval Fleet", "Satellite Anomaly", "Orbital Debris"};
+    char details[128];
+    orbit_step(&orbit, (float)orbit.config.step_s);
+
+    for (int r = 0; r < ORBIT_REGIONS; r++) 
+    {
+        if ((double)rand() / ((double)RAND_MAX + 1.0) < (double)orbit.config.step_s / REGION_THREAT_S) 
+        {
+            threats_appeared++;
+            if (pending_count[r] == MAX_PENDING) 
+            {
+                threats_lost++;
+            } 
+            else 
+            {
+                pending[r][pending_count[r]].kind = rand() % 4;
+                pending[r][pending_count[r]].threat_level = (rand() % 100 < 30) ? 71 + (rand() % 30) : 10 + (rand() % 61);
+                pending[r][pending_count[r]++].appeared_s = orbit.simulated_s;
+            }
+        }
+        if (orbit.seen_by[r] < 0) continue;
+
+        int satellite = orbit.seen_by[r];
+        uint32_t unit_id = (uint32_t)(satellite % rt->unit_count + 1);
+        for (int t = 0; t < pending_count[r]; t++) 
+        {
+            double waited = orbit.simulated_s - pending[r][t].appeared_s;
+            coverage_wait_total_s += waited;
+            if (waited > coverage_wait_max_s) coverage_wait_max_s = waited;
+            threats_seen++;
+            snprintf(details, sizeof(details), ", Satellite=%d, Waited=%.0fs", satellite, waited);
+            send_report(rt, unit_id, threat_types[pending[r][t].kind], threat_data[pending[r][t].kind],
+                        pending[r][t].threat_level, orbit_regions[r].name, details);
+        }
+        pending_count[r] = 0;
+    }
+}
+
+/*This times "--benchmark STEPS" propagations of the whole constellation with the scalar
+kernel, the vector kernel and, with "--propagate-threads N", the vector kernel on N threads,
+starting from the same orbits each time, and prints propagations per second. Nothing is
+connected or logged. Every run should end with the satellites in the same places.*/
+int run_benchmark(const OrbitConfig *config) 
+{
+    const char *names[] = {"Scalar kernel", "Vector kernel", "Vector kernel"};
+    int runs = config->threads > 1 ? 3 : 2;
+    float first_x = 0.0f;
+    for (int k = 0; k < runs; k++) 
+    {
+        OrbitModel model;
+        OrbitConfig run_config = *config;
+        if (k < 2) run_config.threads = 1;
+        srand(12345);
+        if (orbit_init(&model, &run_config) < 0 || orbit_start_threads(&model) < 0) 
+        {
+            fprintf(stderr, "Failed to set up %d satellites\n", config->satellites);
+            return 1;
+        }
+        model.scalar = k == 0;
+        for (int step = 0; step < config->benchmark; step++) 
+        {
+            orbit_step(&model, (float)config->step_s);
+        }
+        double seconds = (double)model.propagate_ns_total / 1e9;
+        if (k == 0) first_x = model.x[0];
+        printf("%s, %d thread%s: %.1f million propagations per second, %.2f ns each, satellite 0 at x %.3f km (%+.3f)\n",
+               names[k], run_config.threads, run_config.threads > 1 ? "s" : "", (double)model.propagations / seconds / 1e6,
+               (double)model.propagate_ns_total / (double)model.propagations, model.x[0], model.x[0] - first_x);
+        orbit_destroy(&model);
+    }
+    printf("Satellites: %d, %d steps of %d s, %d lanes\n", config->satellites, config->benchmark, config->step_s,
+           ORBIT_LANES);
+    return 0;
+}
+
 /*This generates a summary text file of the client operation of the satellute
 and opens it in write mode to edit. It includes details of the timestamped when the simulation ended and 
 total intelligence reports have sent within the duration of the simulation.*/
@@ -142,6 +292,23 @@ void generate_summary(void)
         fprintf(summary_fp, "Simulation End: %s\n", time_str);
     }
     fprintf(summary_fp, "Total Intelligence Reports Sent: %d\n", intel_sent);
+    fprintf(summary_fp, "Units Hosted: %d on %d connections\n", runtime.unit_count, runtime.link_count);
+    fprintf(summary_fp, "Reconnects: %lu, Reports Dropped: %lu\n", runtime.reconnects, runtime.frames_dropped);
+    runtime_report_credits(&runtime, summary_fp);
+    runtime_report_batches(&runtime, summary_fp);
+    runtime_report_end(&runtime, summary_fp);
+    if (orbit.count > 0) 
+    {
+        int waiting = 0;
+        for (int r = 0; r < ORBIT_REGIONS; r++) waiting += pending_count[r];
+        orbit_report(&orbit, summary_fp);
+        fprintf(summary_fp, "Threats Appeared: %lu, Seen: %lu, Lost (too many waiting): %lu, Still Waiting: %d\n",
+                threats_appeared, threats_seen, threats_lost, waiting);
+        fprintf(summary_fp, "Wait For A Satellite: avg %.1f s, max %.0f s (simulated)\n",
+                threats_seen ? coverage_wait_total_s / (double)threats_seen : 0.0, coverage_wait_max_s);
+    }
+    if (scheduler.spawned > 0) co_report(&scheduler, sizeof(SatelliteUnit), summary_fp);
+    fprintf(summary_fp, "Per Second Statistics: %s (%d columns)\n", STATS_FILE, stats.column_count);
     fprintf(summary_fp, "=====================================\n");
     fclose(summary_fp);
 
@@ -151,69 +318,222 @@ void generate_summary(void)
     log_event("SUMMARY", log_msg);
 }
 
+/*This adds what the runtime has counted since the last call to the statistics
+file, so its running totals become per second rows.*/
+void sample_stats(long long now) 
+{
+    stats_total(&stats, stat_sent, intel_sent, now);
+    stats_total(&stats, stat_held, (long long)runtime.reports_held, now);
+    stats_total(&stats, stat_dropped, (long long)runtime.frames_dropped, now);
+    stats_total(&stats, stat_credit_grants, (long long)runtime.credit_grants, now);
+    if (orbit.count == 0) return;
+    stats_total(&stats, stat_propagations, (long long)orbit.propagations, now);
+    stats_total(&stats, stat_propagate_us, orbit.propagate_ns_total / 1000, now);
+    stats_total(&stats, stat_threats_seen, (long long)threats_seen, now);
+}
+
+//This is a satellite unit's behaviour with "--coroutines": a report, then a sleep until the next one.
+void satellite_unit(CoScheduler *sched, Coroutine *co)
+{
+    SatelliteUnit *unit = (SatelliteUnit *)co;
+    CO_BEGIN(co);
+    while (!runtime_ended(&runtime)) 
+    {
+        send_intel(&runtime, unit->unit_id);
+        CO_SLEEP(sched, co, (5 + (rand() % 6)) * 1000LL); // Randomize interval
+    }
+    CO_END(co);
+}
+
+/*This moves the constellation on with "--coroutines", one step every step_ms. A step
+that falls behind is caught up on the next resume rather than skipped.*/
+void constellation_stepper(CoScheduler *sched, Coroutine *co)
+{
+    CO_BEGIN(co);
+    while (!runtime_ended(&runtime)) 
+    {
+        constellation_step(&runtime);
+        stepper.next_step += stepper.step_ms > 0 ? stepper.step_ms : 1;
+        if (stepper.next_step > now_ms()) co_sleep_until(sched, co, stepper.next_step);
+        else co_ready(sched, co);
+        CO_SUSPEND(co);
+    }
+    CO_END(co);
+}
+
+//This keeps the statistics rows current while the units run as coroutines.
+void stats_sampler(CoScheduler *sched, Coroutine *co)
+{
+    CO_BEGIN(co);
+    for (;;) 
+    {
+        sample_stats(now_ms());
+        CO_SLEEP(sched, co, STATS_INTERVAL_MS);
+    }
+    CO_END(co);
+}
+
+/*This runs every link, the statistics and either the constellation or every unit as
+coroutines on this thread until end_time or until nuclearControl has sent END on every
+link. It returns 0 or -1.*/
+int run_coroutines(long long end_time, long long step_ms)
+{
+    int units = orbit.count > 0 ? 0 : runtime.unit_count;
+    SatelliteUnit *unit_tasks = calloc((size_t)units + 1, sizeof(SatelliteUnit));
+    CoLink *links = calloc((size_t)runtime.link_count, sizeof(CoLink));
+    Coroutine sampler;
+    if (!unit_tasks || !links || co_init(&scheduler, units + runtime.link_count + 2) < 0) 
+    {
+        free(unit_tasks);
+        free(links);
+        return -1;
+    }
+    co_spawn_links(&scheduler, &runtime, links);
+    co_spawn(&scheduler, &sampler, stats_sampler);
+    if (orbit.count > 0) 
+    {
+        stepper.next_step = now_ms();
+        stepper.step_ms = step_ms;
+        co_spawn(&scheduler, &stepper.co, constellation_stepper);
+    }
+    for (int unit = 0; unit < units; unit++) 
+    {
+        unit_tasks[unit].unit_id = (uint32_t)(unit + 1);
+        co_spawn(&scheduler, &unit_tasks[unit].co, satellite_unit);
+    }
+    co_run(&scheduler, end_time);
+    close(scheduler.epoll_fd); //The counters stay for the summary.
+    scheduler.epoll_fd = -1;
+    free(unit_tasks);
+    free(links);
+    return 0;
+}
+
+/*This handles frames from nuclearControl. Sensors are not sent any orders,
+so anything arriving here is only logged.*/
+void handle_frame(ClientRuntime *rt, Link *link, const FrameHeader *header, const char *payload)
+{
+    (void)rt;
+    (void)payload;
+    char log_msg[256];
+    snprintf(log_msg, sizeof(log_msg), "Unexpected frame type %u for unit %u on link %d",
+             header->type, header->unit_id, link->index);
+    log_event("ERROR", log_msg);
+}
+
 /*This is the main execution function that starts the satellite client system.
-This has the network set to create the TCP socket, server-to-client connection, 
-and sending data to the nuclear control center.*/
-int main(void) 
+It hosts "--units N" satellite units over "--connections M" shared links to the
+nuclear control center. Each unit sends its own reports on a randomised interval, or
+with "--satellites N" the units share a simulated constellation that is propagated every
+"--step-s" of simulated time, "--time-scale" times faster than real time, and report
+the threats their satellites pass over. Links that drop are reconnected by the runtime
+until the simulation ends.*/
+int main(int argc, char *argv[]) 
 {
+    RuntimeConfig runtime_config = {.units = 1, .connections = 1, .nodes = 1, .transport = TRANSPORT_TCP,
+                                    .batch_bytes = REPORT_BATCH_BYTES};
+    OrbitConfig orbit_config = {0, ORBIT_DEFAULT_STEP_S, 1, 1, 0};
+    CoConfig co_config = {0, 0};
+    for (int i = 1; i < argc; i++) 
+    {
+        int used = runtime_parse_option(&runtime_config, argc, argv, &i);
+        if (used == 0) used = orbit_parse_option(&orbit_config, argc, argv, &i);
+        if (used == 0) used = co_parse_option(&co_config, argc, argv, &i);
+        if (used != 1) 
+        {
+            fprintf(stderr, "Usage: %s [--units N] [--connections M] [--nodes K] [--codec text|binary] [--failover] "
+                    "[--transport tcp|unix|shm|tls] [--transport-benchmark N] [--batch-ms MS] [--batch-bytes N] "
+                    "[--nodelay] [--satellites N] [--step-s S] [--time-scale X] [--propagate-threads N] [--benchmark STEPS] "
+                    "[--coroutines] [--coroutine-benchmark N]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (orbit_config.benchmark > 0 && orbit_config.satellites == 0) 
+    {
+        fprintf(stderr, "--benchmark needs a constellation, e.g. --satellites 10000\n");
+        return 1;
+    }
+    if (orbit_config.benchmark > 0) return run_benchmark(&orbit_config);
+    if (runtime_config.transport_benchmark > 0) return runtime_transport_benchmark(runtime_config.transport_benchmark, runtime_config.batch_bytes, caesar_encrypt);
+    if (co_config.benchmark > 0) return co_benchmark(co_config.benchmark);
+
     srand((unsigned int)time(NULL));
     init_log_file();
     log_event("STARTUP", "Satellite System initializing");
 
-    //This creates the TCP socket of the client.
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) 
+    //This sets up the shared links and the time each unit sends its next report.
+    long long *next_report = calloc((size_t)runtime_config.units, sizeof(long long));
+    if (!next_report || runtime_init(&runtime, "Satellite", SERVER_IP, SERVER_PORT, &runtime_config, handle_frame) < 0 ||
+        (orbit_config.satellites > 0 && orbit_init(&orbit, &orbit_config) < 0)) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Socket creation failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
+        log_event("ERROR", "Failed to allocate the client runtime");
+        free(next_report);
         if (log_fp) fclose(log_fp);
         return 1;
     }
 
-    //This configures the server address for the connection with error handling if there is an invalid address.
-    struct sockaddr_in server_addr = {0};
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) 
+    //This opens the per second statistics file; the run goes on without it if it cannot be created.
+    if (stats_open(&stats, STATS_FILE, "satellite", now_ms()) < 0) log_event("ERROR", "Failed to create statistics file");
+    stat_sent = stats_column(&stats, "reports_sent");
+    stat_held = stats_column(&stats, "reports_held");
+    stat_dropped = stats_column(&stats, "reports_dropped");
+    stat_credit_grants = stats_column(&stats, "credit_grants");
+    if (orbit.count > 0) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Invalid server address: %s", SERVER_IP);
-        log_event("ERROR", log_msg);
-        close(sock);
-        if (log_fp) fclose(log_fp);
-        return 1;
+        stat_propagations = stats_column(&stats, "propagations");
+        stat_propagate_us = stats_column(&stats, "propagate_us");
+        stat_threats_seen = stats_column(&stats, "threats_seen");
+        if (orbit_start_threads(&orbit) < 0) log_event("ERROR", "Failed to start the propagation threads, propagating on one");
     }
+    runtime_poll(&runtime, 0); //Connects the links before the first reports go out.
 
-    //This connects to the nuclear control center server with error handling if a connection failure occurs.
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) 
+    /*This is the main loop that runs under the duration of the simulation; 60 seconds.
+    It sends every report that is due, then waits in the runtime until the next one.
+    With "--coroutines" the units run as coroutines instead and the loop is skipped.
+    The run ends early once nuclearControl has sent END on every link.*/
+    long long end_time = now_ms() + SIMULATION_DURATION * 1000LL;
+    long long step_ms = orbit_config.step_s * 1000LL / orbit_config.time_scale;
+    long long next_step = now_ms();
+    if (co_config.enabled && run_coroutines(end_time, step_ms) < 0) 
     {
-        char log_msg[256];
-        snprintf(log_msg, sizeof(log_msg), "Connection failed: %s", strerror(errno));
-        log_event("ERROR", log_msg);
-        close(sock);
-        if (log_fp) fclose(log_fp);
-        return 1;
+        log_event("ERROR", "Failed to allocate the coroutines, running the units from the main loop");
     }
-
-    //This prints out the message to confirm the connection to the nuclear control server.
-    log_event("CONNECTION", "Connected to Nuclear Control");
-
-    /*This is the main command loop that runs under the duration
-    of the simulation; 60 seconds.*/
-    time_t start_time = time(NULL);
-    while (time(NULL) - start_time < SIMULATION_DURATION) 
+    for (long long now = now_ms(); now < end_time && !runtime_ended(&runtime) && scheduler.spawned == 0; now = now_ms()) 
     {
-        send_intel(sock);
-        sleep(5 + (rand() % 6)); // Randomize interval
+        long long next_due = end_time;
+        if (orbit.count > 0) 
+        {
+            //A step that falls behind is caught up on the next pass rather than skipped.
+            if (next_step <= now) 
+            {
+                constellation_step(&runtime);
+                next_step += step_ms > 0 ? step_ms : 1;
+            }
+            if (next_step < next_due) next_due = next_step;
+        }
+        for (int unit = 0; unit < runtime.unit_count && orbit.count == 0; unit++) 
+        {
+            if (next_report[unit] <= now) 
+            {
+                send_intel(&runtime, (uint32_t)(unit + 1));
+                next_report[unit] = now + (5 + (rand() % 6)) * 1000LL; // Randomize interval
+            }
+            if (next_report[unit] < next_due) next_due = next_report[unit];
+        }
+        if (next_due > now + STATS_INTERVAL_MS) next_due = now + STATS_INTERVAL_MS; //Keeps the statistics rows current.
+        runtime_poll(&runtime, (int)(next_due - now));
+        sample_stats(now_ms());
     }
 
     /*This shuts down the simulation sequence and 
     display a message saying the satellite system has been terminated.*/
-    shutdown(sock, SHUT_RDWR);
-    close(sock);
+    runtime_close(&runtime);
+    free(next_report);
+    sample_stats(now_ms());
     generate_summary();
+    orbit_destroy(&orbit);
+    stats_close(&stats, now_ms());
     log_event("SHUTDOWN", "Satellite System terminated");
     if (log_fp) fclose(log_fp);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,294 @@
+/*This is the shared-memory transport used between a client and nuclearControl when
+both run on the same host ("--transport shm" and "--shm"). The client creates a POSIX
+shared memory segment (shm_open, in libc since glibc 2.34 and in -lrt before) holding
+two single-producer single-consumer rings, one for each direction, and offers its name
+over the TCP connection it has just made. If nuclearControl maps it, every frame from
+then on is copied into a ring instead of being sent, and the TCP connection stays open
+to notice the other end going away and as a doorbell: a consumer that runs out of work
+says so in the ring before it waits on its socket, and only then does the producer send
+it an empty SHM frame. A busy consumer is never woken, so a frame costs the copy into
+the ring and the cache lines it moves to the other core. An eventfd would have to be passed
+over a Unix socket, but a futex on the ring's sleeping word would need nothing passed. It is
+not used because a thread blocked in FUTEX_WAIT cannot also wait on its socket, its other
+links or nuclearControl's io_uring, while the socket is already watched for the other end
+going away, so the doorbell reuses it at the cost of a system call per wakeup.*/
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC 0x4E435352 //"NCSR" in ASCII
+#define SHM_VERSION 1
+#define SHM_RING_BYTES (1u << 18) //Each direction holds 256 KB, a few thousand frames.
+#define SHM_RECORD_ALIGN 8
+#define SHM_WRAP 0xFFFFFFFFu //A record length that sends the consumer back to the start.
+#define SHM_INVALID ((size_t)-1) //The length shm_link_peek gives for a record that overruns the ring.
+#define SHM_NAME_PREFIX "/nuclearControl."
+#define SHM_NAME_SIZE 64
+#define SHM_TO_SERVER 0
+#define SHM_TO_CLIENT 1
+
+/*This is the shared state of one direction. The producer only writes tail and the consumer
+head and sleeping, each on its own cache line so neither end's stores evict the other's.
+Positions run freely and are taken modulo the ring size.*/
+typedef struct
+{
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) atomic_uint head;
+    _Alignas(64) atomic_uint sleeping;
+} ShmRing;
+
+//This is the start of the segment. The two rings' data follows it.
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_bytes;
+    ShmRing rings[2];
+} ShmSegment;
+
+/*This is one end's view of a segment. tx is the ring this end produces into and the other
+one is read. The cached positions are the last seen values of the other end's counter,
+so the shared lines are only read again when the cached value says the ring is full or empty.*/
+typedef struct
+{
+    ShmSegment *segment;
+    size_t size;
+    char *data[2];
+    int tx;
+    uint32_t cached_head;
+    uint32_t cached_tail;
+    unsigned long records_sent;
+    unsigned long records_received;
+    unsigned long doorbells;
+    unsigned long full;
+} ShmLink;
+
+//This is the size of a segment with its rings, rounded to whole pages by the kernel.
+static inline size_t shm_segment_size(void)
+{
+    size_t header = (sizeof(ShmSegment) + 63) & ~(size_t)63;
+    return header + 2 * (size_t)SHM_RING_BYTES;
+}
+
+//This sets up the pointers of an end once the segment is mapped.
+static inline void shm_link_map(ShmLink *link, void *memory, size_t size, int tx)
+{
+    memset(link, 0, sizeof(*link));
+    link->segment = memory;
+    link->size = size;
+    link->data[0] = (char *)memory + (size - 2 * (size_t)SHM_RING_BYTES);
+    link->data[1] = link->data[0] + SHM_RING_BYTES;
+    link->tx = tx;
+}
+
+/*This creates a segment for the client end and writes its name into name. The name
+includes the process ID and a counter so every link of every client has its own.
+It returns 0, or -1 with errno set.*/
+static inline int shm_link_create(ShmLink *link, char *name, size_t name_size)
+{
+    static unsigned counter = 0;
+    size_t size = shm_segment_size();
+    snprintf(name, name_size, SHM_NAME_PREFIX "%d.%u", (int)getpid(), counter++);
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)size) < 0)
+    {
+        int saved = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = saved;
+        return -1;
+    }
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        int saved = errno;
+        shm_unlink(name);
+        errno = saved;
+        return -1;
+    }
+    shm_link_map(link, memory, size, SHM_TO_SERVER);
+    link->segment->ring_bytes = SHM_RING_BYTES;
+    link->segment->version = SHM_VERSION;
+    atomic_store(&link->segment->rings[0].tail, 0);
+    atomic_store(&link->segment->rings[1].tail, 0);
+    link->segment->magic = SHM_MAGIC;
+    return 0;
+}
+
+/*This maps a segment offered by a client for the server end. The name must be one a
+client makes and the segment one it has set up. It returns 0, or -1 with errno set.*/
+static inline int shm_link_open(ShmLink *link, const char *name)
+{
+    struct stat info;
+    if (strncmp(name, SHM_NAME_PREFIX, strlen(SHM_NAME_PREFIX)) != 0 || strchr(name + 1, '/'))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return -1;
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size != shm_segment_size())
+    {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *memory = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) return -1;
+    ShmSegment *segment = memory;
+    if (segment->magic != SHM_MAGIC || segment->version != SHM_VERSION || segment->ring_bytes != SHM_RING_BYTES)
+    {
+        munmap(memory, (size_t)info.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    shm_link_map(link, memory, (size_t)info.st_size, SHM_TO_CLIENT);
+    return 0;
+}
+
+//This unmaps an end. The segment itself goes once both ends have unmapped it and its name is removed.
+static inline void shm_link_close(ShmLink *link)
+{
+    if (link->segment) munmap(link->segment, link->size);
+    link->segment = NULL;
+}
+
+//This is the space a record of length bytes takes in a ring, with its length and padding.
+static inline uint32_t shm_record_space(size_t length)
+{
+    return (uint32_t)((sizeof(uint32_t) + length + SHM_RECORD_ALIGN - 1) & ~(size_t)(SHM_RECORD_ALIGN - 1));
+}
+
+/*This copies one record (one or more whole frames) into the end's ring. It returns 1 if
+the consumer is waiting on its socket and has to be sent the doorbell, 0 if not, and -1 if
+the ring has no room for it, which leaves the ring as it was.*/
+static inline int shm_link_send(ShmLink *link, const char *data, size_t length)
+{
+    ShmRing *ring = &link->segment->rings[link->tx];
+    char *base = link->data[link->tx];
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t need = shm_record_space(length);
+    uint32_t offset = tail & (SHM_RING_BYTES - 1);
+    uint32_t skip = offset + need > SHM_RING_BYTES ? SHM_RING_BYTES - offset : 0; //A record never wraps.
+    if (tail + skip + need - link->cached_head > SHM_RING_BYTES)
+    {
+        link->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail + skip + need - link->cached_head > SHM_RING_BYTES)
+        {
+            link->full++;
+            return -1;
+        }
+    }
+    if (skip)
+    {
+        uint32_t wrap = SHM_WRAP;
+        memcpy(base + offset, &wrap, sizeof(wrap));
+        tail += skip;
+        offset = 0;
+    }
+    uint32_t record = (uint32_t)length;
+    memcpy(base + offset, &record, sizeof(record));
+    memcpy(base + offset + sizeof(record), data, length);
+    atomic_store_explicit(&ring->tail, tail + need, memory_order_release);
+    link->records_sent++;
+
+    //This pairs with shm_link_idle: either the consumer sees the new tail or this sees it sleeping.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->sleeping, memory_order_relaxed) && atomic_exchange(&ring->sleeping, 0))
+    {
+        link->doorbells++;
+        return 1;
+    }
+    return 0;
+}
+
+/*This returns the next record waiting for this end, with its length, or NULL if the ring
+is empty. The record stays in the ring, where it can be parsed in place, until it is released.
+The other end writes the lengths and the tail, so a record that would run past the end of
+the ring or past the tail, or a wrap at the start of the ring or beyond the tail, returns
+NULL with the length set to SHM_INVALID, and the connection should be dropped.*/
+static inline const char *shm_link_peek(ShmLink *link, size_t *length)
+{
+    int rx = !link->tx;
+    ShmRing *ring = &link->segment->rings[rx];
+    char *base = link->data[rx];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for (;;)
+    {
+        if (head == link->cached_tail)
+        {
+            link->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+            if (head == link->cached_tail)
+            {
+                *length = 0;
+                return NULL;
+            }
+        }
+        uint32_t offset = head & (SHM_RING_BYTES - 1);
+        uint32_t published = link->cached_tail - head;
+        uint32_t record;
+        memcpy(&record, base + offset, sizeof(record));
+        if (record != SHM_WRAP)
+        {
+            if (record > SHM_RING_BYTES - offset - sizeof(record) ||
+                shm_record_space(record) > published)
+            {
+                *length = SHM_INVALID;
+                return NULL;
+            }
+            *length = record;
+            return base + offset + sizeof(record);
+        }
+        //The producer only wraps when a record does not fit, so never at the start of the ring.
+        if (offset == 0 || published < SHM_RING_BYTES - offset)
+        {
+            *length = SHM_INVALID;
+            return NULL;
+        }
+        head += SHM_RING_BYTES - offset;
+        atomic_store_explicit(&ring->head, head, memory_order_release);
+    }
+}
+
+/*This hands the space of the record returned by shm_link_peek back to the producer. It
+returns 0, or -1 without moving the head if the length would take it past the end of the
+ring or past the tail.*/
+static inline int shm_link_release(ShmLink *link, size_t length)
+{
+    ShmRing *ring = &link->segment->rings[!link->tx];
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t offset = head & (SHM_RING_BYTES - 1);
+    if (length > SHM_RING_BYTES - offset - sizeof(uint32_t)) return -1;
+    uint32_t need = shm_record_space(length);
+    if (need > link->cached_tail - head) return -1;
+    atomic_store_explicit(&ring->head, head + need, memory_order_release);
+    link->records_received++;
+    return 0;
+}
+
+/*This is called by the consumer before it waits on its socket. It marks the ring as
+sleeping and returns 1 if it is still empty, so the next record rings the doorbell, or
+takes the mark back and returns 0 if a record arrived in the meantime.*/
+static inline int shm_link_idle(ShmLink *link)
+{
+    ShmRing *ring = &link->segment->rings[!link->tx];
+    atomic_store(&ring->sleeping, 1);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (atomic_load(&ring->tail) == head) return 1;
+    atomic_store(&ring->sleeping, 0);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,113 @@
+/*This is a fixed-size object slab shared by the server and the clients.
+Every object is carved out of one allocation made at startup, so connection
+churn and message traffic never go back to the heap once the simulation runs.
+It is used for the connection objects and for the receive and send frame pools.*/
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define SLAB_ALIGN 64 //Objects are padded to a cache line so neighbours never share one.
+
+/*This keeps the backing memory, a stack of free object indexes and some
+counters that the summaries report (objects in use, high water mark and how
+many times the slab ran out).*/
+typedef struct
+{
+    char *memory;
+    size_t object_size;
+    int capacity;
+    int *free_stack;
+    int free_top;
+    int in_use;
+    int high_water;
+    unsigned long exhausted;
+    pthread_mutex_t lock;
+} Slab;
+
+/*This allocates the whole slab in one go. It returns 0 on success and -1 if
+the memory could not be reserved, the same way the socket helpers report errors.*/
+static inline int slab_init(Slab *slab, int capacity, size_t object_size)
+{
+    memset(slab, 0, sizeof(*slab));
+    if (capacity <= 0 || object_size == 0) return -1;
+
+    slab->object_size = (object_size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+    slab->capacity = capacity;
+    slab->memory = aligned_alloc(SLAB_ALIGN, slab->object_size * (size_t)capacity);
+    slab->free_stack = malloc(sizeof(int) * (size_t)capacity);
+    if (!slab->memory || !slab->free_stack)
+    {
+        free(slab->memory);
+        free(slab->free_stack);
+        memset(slab, 0, sizeof(*slab));
+        return -1;
+    }
+    memset(slab->memory, 0, slab->object_size * (size_t)capacity);
+
+    //The free stack is filled backwards so that the first allocation hands out index 0.
+    for (int i = 0; i < capacity; i++)
+    {
+        slab->free_stack[i] = capacity - 1 - i;
+    }
+    slab->free_top = capacity;
+    pthread_mutex_init(&slab->lock, NULL);
+    return 0;
+}
+
+//This returns the object stored at a given index, whether it is in use or not.
+static inline void *slab_at(Slab *slab, int index)
+{
+    return slab->memory + (size_t)index * slab->object_size;
+}
+
+//This returns the index of an object that came out of the slab.
+static inline int slab_index(const Slab *slab, const void *object)
+{
+    return (int)(((const char *)object - slab->memory) / slab->object_size);
+}
+
+/*This hands out a zeroed object or NULL when every object is in use.
+Running out is counted instead of falling back to malloc.*/
+static inline void *slab_alloc(Slab *slab)
+{
+    void *object = NULL;
+    pthread_mutex_lock(&slab->lock);
+    if (slab->free_top > 0)
+    {
+        object = slab_at(slab, slab->free_stack[--slab->free_top]);
+        slab->in_use++;
+        if (slab->in_use > slab->high_water) slab->high_water = slab->in_use;
+    }
+    else
+    {
+        slab->exhausted++;
+    }
+    pthread_mutex_unlock(&slab->lock);
+    if (object) memset(object, 0, slab->object_size);
+    return object;
+}
+
+//This gives an object back to the slab so it can be reused by the next allocation.
+static inline void slab_free(Slab *slab, void *object)
+{
+    if (!object) return;
+    pthread_mutex_lock(&slab->lock);
+    slab->free_stack[slab->free_top++] = slab_index(slab, object);
+    slab->in_use--;
+    pthread_mutex_unlock(&slab->lock);
+}
+
+//This releases the backing memory at the end of the simulation.
+static inline void slab_destroy(Slab *slab)
+{
+    if (!slab->memory) return;
+    pthread_mutex_destroy(&slab->lock);
+    free(slab->memory);
+    free(slab->free_stack);
+    memset(slab, 0, sizeof(*slab));
+}
+
+#endif
@@ -0,0 +1,395 @@
+/*These are the standard library headers included for the program such as
+inputs, outputs, strings, memory allocation and time.*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "runStats.h"
+
+/*This is to define how many distinct columns can be merged and the size of the table
+that finds them by name. The table is kept at least twice as big as the columns.*/
+#define MAX_MERGED_COLUMNS 2048
+#define COLUMN_TABLE_SIZE 4096
+#define MAX_FILTERS 32
+
+//This is one column merged across every file: its total and its value in every bucket.
+typedef struct
+{
+    char name[STATS_NAME_SIZE];
+    int is_max;
+    long long total;
+    long long *rows;
+    long long row_count;
+} MergedColumn;
+
+//These are global variables that hold the merged columns and the command line choices.
+static MergedColumn columns[MAX_MERGED_COLUMNS];
+static int column_count = 0;
+static int column_table[COLUMN_TABLE_SIZE];
+static const char *filters[MAX_FILTERS];
+static int filter_count = 0;
+static long long bucket_count = 0;
+static int interval_ms = STATS_INTERVAL_MS;
+
+//This returns a monotonic clock reading in milliseconds with a fraction, for timing the merge.
+static double elapsed_ms(const struct timespec *start) 
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1000.0 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/*This says whether a column was asked for. With no --column every column is, otherwise
+a column matches a name exactly or belongs to the histogram of that name.*/
+static int column_wanted(const char *name, size_t length) 
+{
+    if (filter_count == 0) return 1;
+    for (int i = 0; i < filter_count; i++) 
+    {
+        size_t filter_len = strlen(filters[i]);
+        if (length >= filter_len && memcmp(name, filters[i], filter_len) == 0 &&
+            (length == filter_len || name[filter_len] == '.')) return 1;
+    }
+    return 0;
+}
+
+/*This finds a merged column by name, adding it if it is new and add is set. The names are
+hashed with FNV-1a like the cluster owner of a location. It returns NULL if the column is
+not there and is not added, or once the table is full.*/
+static MergedColumn *find_column(const char *name, size_t length, int add) 
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) 
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    for (uint32_t slot = hash % COLUMN_TABLE_SIZE;; slot = (slot + 1) % COLUMN_TABLE_SIZE) 
+    {
+        int index = column_table[slot] - 1;
+        if (index < 0) 
+        {
+            if (!add || column_count == MAX_MERGED_COLUMNS) return NULL;
+            MergedColumn *column = &columns[column_count];
+            memcpy(column->name, name, length);
+            column->name[length] = '\0';
+            column->is_max = length > 4 && memcmp(name + length - 4, ".max", 4) == 0;
+            column_table[slot] = ++column_count;
+            return column;
+        }
+        if (strncmp(columns[index].name, name, length) == 0 && columns[index].name[length] == '\0') 
+        {
+            return &columns[index];
+        }
+    }
+}
+
+//This merges one value of a column into its bucket and its total.
+static int merge_value(MergedColumn *column, long long bucket, long long value) 
+{
+    if (bucket >= column->row_count) 
+    {
+        long long size = column->row_count ? column->row_count : STATS_BLOCK_ROWS;
+        while (size <= bucket) size *= 2;
+        long long *rows = realloc(column->rows, (size_t)size * sizeof(long long));
+        if (!rows) return -1;
+        memset(rows + column->row_count, 0, (size_t)(size - column->row_count) * sizeof(long long));
+        column->rows = rows;
+        column->row_count = size;
+    }
+    if (column->is_max) 
+    {
+        if (value > column->rows[bucket]) column->rows[bucket] = value;
+        if (value > column->total) column->total = value;
+    }
+    else 
+    {
+        column->rows[bucket] += value;
+        column->total += value;
+    }
+    if (bucket + 1 > bucket_count) bucket_count = bucket + 1;
+    return 0;
+}
+
+/*This reads one statistics file and merges every wanted column of every block into the
+merged columns. Columns that were not asked for are skipped by their length without
+being decoded. It returns 0, or -1 with a message if the file is not a statistics file.*/
+static int merge_file(const char *path, unsigned char **buffer, size_t *capacity) 
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) 
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    size_t size = 0;
+    for (;;) 
+    {
+        if (size == *capacity) 
+        {
+            size_t grown = *capacity ? *capacity * 2 : 65536;
+            unsigned char *bigger = realloc(*buffer, grown);
+            if (!bigger) break;
+            *buffer = bigger;
+            *capacity = grown;
+        }
+        size_t got = fread(*buffer + size, 1, *capacity - size, fp);
+        if (got == 0) break;
+        size += got;
+    }
+    fclose(fp);
+
+    //This checks the file header and reads the bucket length.
+    const unsigned char *data = *buffer;
+    uint64_t value;
+    uint64_t length;
+    size_t pos = 5;
+    if (size < 5 || memcmp(data, STATS_MAGIC, 4) != 0 || data[4] != STATS_VERSION) goto invalid;
+    size_t n = wire_get_varint(data + pos, size - pos, &value);
+    if (n == 0) goto invalid;
+    pos += n;
+    interval_ms = (int)value;
+    n = wire_get_varint(data + pos, size - pos, &value); //The wall clock start is not needed to merge.
+    if (n == 0) goto invalid;
+    pos += n;
+    n = wire_get_varint(data + pos, size - pos, &length);
+    if (n == 0 || pos + n + length > size) goto invalid;
+    pos += n + length;
+
+    //This reads every block: its header, the column directory and then the columns asked for.
+    while (pos < size) 
+    {
+        uint64_t first;
+        uint64_t rows;
+        uint64_t count;
+        if (data[pos++] != 'B') goto invalid;
+        if ((n = wire_get_varint(data + pos, size - pos, &first)) == 0) goto invalid;
+        pos += n;
+        if ((n = wire_get_varint(data + pos, size - pos, &rows)) == 0) goto invalid;
+        pos += n;
+        if ((n = wire_get_varint(data + pos, size - pos, &count)) == 0) goto invalid;
+        pos += n;
+
+        size_t directory = pos;
+        size_t column_data = pos;
+        for (uint64_t c = 0; c < count; c++) 
+        {
+            n = wire_get_varint(data + column_data, size - column_data, &length);
+            if (n == 0 || length >= STATS_NAME_SIZE) goto invalid;
+            column_data += n + length;
+            if (column_data > size || (n = wire_get_varint(data + column_data, size - column_data, &value)) == 0) 
+            {
+                goto invalid;
+            }
+            column_data += n;
+        }
+        for (uint64_t c = 0; c < count; c++) 
+        {
+            n = wire_get_varint(data + directory, size - directory, &length);
+            const char *name = (const char *)data + directory + n;
+            directory += n + length;
+            directory += wire_get_varint(data + directory, size - directory, &value);
+            if (column_data + value > size) goto invalid;
+
+            MergedColumn *column = column_wanted(name, length) ? find_column(name, length, 1) : NULL;
+            size_t cursor = column_data;
+            for (uint64_t r = 0; column && r < rows && cursor < column_data + value; r++) 
+            {
+                uint64_t cell;
+                if ((n = wire_get_varint(data + cursor, column_data + value - cursor, &cell)) == 0) goto invalid;
+                cursor += n;
+                if (merge_value(column, (long long)(first + r), (long long)cell) < 0) 
+                {
+                    fprintf(stderr, "Out of memory merging %s\n", path);
+                    return -1;
+                }
+            }
+            column_data += value;
+        }
+        pos = column_data;
+    }
+    return 0;
+
+invalid:
+    fprintf(stderr, "%s: not a valid statistics file\n", path);
+    return -1;
+}
+
+/*This is to read a percentile out of a merged histogram. It returns the upper bound of
+the bucket the percentile falls in, or the largest value seen for the last bucket.*/
+static long long histogram_percentile(const long long *counts, long long total, long long max, double share) 
+{
+    long long seen = 0;
+    for (int b = 0; b < STATS_HIST_BUCKETS; b++) 
+    {
+        seen += counts[b];
+        if (seen > 0 && (double)seen >= share * (double)total) 
+        {
+            long long bound = 1LL << b;
+            return (b == STATS_HIST_BUCKETS - 1 || bound > max) ? max : bound;
+        }
+    }
+    return max;
+}
+
+/*This collects the buckets of a histogram, either its totals (bucket -1) or one row.
+It returns the number of values counted, or -1 if name is not a histogram.*/
+static long long histogram_counts(const char *name, long long bucket, long long counts[STATS_HIST_BUCKETS],
+                                  long long *max) 
+{
+    char column[STATS_NAME_SIZE + 8];
+    long long total = 0;
+    int found = 0;
+    for (int b = 0; b <= STATS_HIST_BUCKETS; b++) 
+    {
+        int length;
+        if (b < STATS_HIST_BUCKETS) length = snprintf(column, sizeof(column), "%s.h%d", name, b);
+        else length = snprintf(column, sizeof(column), "%s.max", name);
+        MergedColumn *merged = find_column(column, (size_t)length, 0);
+        long long value = 0;
+        if (merged) 
+        {
+            found = 1;
+            value = bucket < 0 ? merged->total : (bucket < merged->row_count ? merged->rows[bucket] : 0);
+        }
+        if (b < STATS_HIST_BUCKETS) 
+        {
+            counts[b] = value;
+            total += value;
+        }
+        else 
+        {
+            *max = value;
+        }
+    }
+    return found ? total : -1;
+}
+
+//This says whether a column belongs to a histogram, and returns the length of the histogram's name.
+static size_t histogram_name(const char *name) 
+{
+    const char *dot = strrchr(name, '.');
+    if (!dot || (strcmp(dot, ".max") != 0 && (dot[1] != 'h' || dot[2] < '0' || dot[2] > '9'))) return 0;
+    return (size_t)(dot - name);
+}
+
+//This is to print the merged totals, and the percentiles of every histogram.
+static void print_totals(int files, double merge_ms) 
+{
+    printf("Runs Merged: %d, Buckets: %lld of %d ms, Columns: %d, Merge Time: %.2f ms\n",
+           files, bucket_count, interval_ms, column_count, merge_ms);
+    for (int i = 0; i < column_count; i++) 
+    {
+        size_t hist_len = histogram_name(columns[i].name);
+        if (hist_len == 0) 
+        {
+            printf("%-40s %lld\n", columns[i].name, columns[i].total);
+            continue;
+        }
+        if (strncmp(columns[i].name + hist_len, ".h0", 4) != 0) continue; //Each histogram is printed once.
+        char name[STATS_NAME_SIZE];
+        long long counts[STATS_HIST_BUCKETS];
+        long long max;
+        snprintf(name, sizeof(name), "%.*s", (int)hist_len, columns[i].name);
+        long long total = histogram_counts(name, -1, counts, &max);
+        printf("%-40s count %lld, p50 <= %lld, p90 <= %lld, p99 <= %lld, max %lld\n", name, total,
+               histogram_percentile(counts, total, max, 0.50), histogram_percentile(counts, total, max, 0.90),
+               histogram_percentile(counts, total, max, 0.99), max);
+    }
+}
+
+/*This is to print one merged row per bucket as comma separated values. Histograms are
+shown as their count, p50, p99 and max in the bucket.*/
+static void print_rows(void) 
+{
+    printf("bucket,start_s");
+    for (int i = 0; i < column_count; i++) 
+    {
+        size_t hist_len = histogram_name(columns[i].name);
+        if (hist_len == 0) printf(",%s", columns[i].name);
+        else if (strncmp(columns[i].name + hist_len, ".h0", 4) == 0) 
+        {
+            printf(",%.*s.count,%.*s.p50,%.*s.p99,%.*s.max", (int)hist_len, columns[i].name, (int)hist_len,
+                   columns[i].name, (int)hist_len, columns[i].name, (int)hist_len, columns[i].name);
+        }
+    }
+    printf("\n");
+    for (long long bucket = 0; bucket < bucket_count; bucket++) 
+    {
+        printf("%lld,%.1f", bucket, (double)bucket * interval_ms / 1000.0);
+        for (int i = 0; i < column_count; i++) 
+        {
+            size_t hist_len = histogram_name(columns[i].name);
+            if (hist_len == 0) 
+            {
+                printf(",%lld", bucket < columns[i].row_count ? columns[i].rows[bucket] : 0);
+            }
+            else if (strncmp(columns[i].name + hist_len, ".h0", 4) == 0) 
+            {
+                char name[STATS_NAME_SIZE];
+                long long counts[STATS_HIST_BUCKETS];
+                long long max;
+                snprintf(name, sizeof(name), "%.*s", (int)hist_len, columns[i].name);
+                long long total = histogram_counts(name, bucket, counts, &max);
+                printf(",%lld,%lld,%lld,%lld", total, histogram_percentile(counts, total, max, 0.50),
+                       histogram_percentile(counts, total, max, 0.99), max);
+            }
+        }
+        printf("\n");
+    }
+}
+
+/*This is the main execution function of the statistics query tool. It merges the
+statistics files of any number of runs, e.g. "./statsQuery run1/radar_stats.col
+run2/radar_stats.col", and prints the totals of every column, or with "--rows" every
+bucket as comma separated values. "--column NAME" (repeatable) limits it to some
+columns or histograms.*/
+int main(int argc, char *argv[]) 
+{
+    int rows = 0;
+    int files = 0;
+    int failed = 0;
+    unsigned char *buffer = NULL;
+    size_t capacity = 0;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 1; i < argc; i++) 
+    {
+        if (strcmp(argv[i], "--rows") == 0) 
+        {
+            rows = 1;
+        }
+        else if (strcmp(argv[i], "--column") == 0 && i + 1 < argc && filter_count < MAX_FILTERS) 
+        {
+            filters[filter_count++] = argv[++i];
+        }
+        else if (argv[i][0] == '-') 
+        {
+            fprintf(stderr, "Usage: %s [--rows] [--column NAME]... FILE...\n", argv[0]);
+            return 1;
+        }
+        else if (merge_file(argv[i], &buffer, &capacity) == 0) 
+        {
+            files++;
+        }
+        else 
+        {
+            failed++;
+        }
+    }
+    free(buffer);
+    if (files == 0) 
+    {
+        fprintf(stderr, "Usage: %s [--rows] [--column NAME]... FILE...\n", argv[0]);
+        return 1;
+    }
+
+    if (rows) print_rows();
+    else print_totals(files, elapsed_ms(&start));
+    for (int i = 0; i < column_count; i++) 
+    {
+        free(columns[i].rows);
+    }
+    return failed ? 2 : 0;
+}
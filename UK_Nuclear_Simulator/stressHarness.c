@@ -0,0 +1,578 @@
+/*These are the standard library headers included for the program such as inputs,
+outputs, strings, sockets, threads, processes and signals.*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "wireCodec.h"
+
+/*This is the stress harness for nuclearControl. It starts the server it is given (normally
+one compiled with -fsanitize=thread or -fsanitize=address), hammers it with many synthetic
+clients that connect, register units, flood reports, acknowledge commands and drop their
+connections at random, and stops it with SIGTERM while they are still going, so the drain
+races the traffic. It does that for a number of rounds and fails a round when the server
+did not exit cleanly, printed a sanitizer report, or wrote a summary whose counts do not
+add up. Every run of the server writes the usual files in the current directory.*/
+#define PORT_SILO 8081
+#define PORT_SUB 8082
+#define PORT_RADAR 8083
+#define PORT_SAT 8084
+#define CAESAR_SHIFT 3
+#define DEFAULT_CLIENTS 64
+#define DEFAULT_SECONDS 20
+#define DEFAULT_ROUNDS 3
+#define DEFAULT_CHURN_MS 250
+#define MAX_SERVER_ARGS 32
+#define MAX_UNITS_PER_CONNECTION 4
+#define STARTUP_TIMEOUT_MS 10000
+#define EXIT_TIMEOUT_MS 30000 //Sanitizer builds are slow to write their summary and exit.
+#define SERVER_OUTPUT "stressHarness_round%d.txt"
+#define SERVER_SUMMARY "nuclearControl_summary.txt"
+
+//These are the command line choices.
+static const char *server_path = NULL;
+static char *server_args[MAX_SERVER_ARGS + 2];
+static int server_arg_count = 0;
+static int client_count = DEFAULT_CLIENTS;
+static int seconds = DEFAULT_SECONDS;
+static int rounds = DEFAULT_ROUNDS;
+static int churn_ms = DEFAULT_CHURN_MS;
+
+/*These count what the synthetic clients did in the current round. The clients are
+threads of their own, so every counter is atomic. */
+static atomic_bool round_over = false;
+static atomic_ulong connections = 0;
+static atomic_ulong connect_failures = 0;
+static atomic_ulong units_registered = 0;
+static atomic_ulong reports_sent = 0;
+static atomic_ulong critical_sent = 0;
+static atomic_ulong commands_received = 0;
+static atomic_ulong acks_sent = 0;
+static atomic_ulong ends_received = 0;
+static atomic_ulong abrupt_closes = 0;
+static atomic_ulong partial_frames = 0;
+
+//This is one synthetic client: the port it connects to and its own random state.
+typedef struct
+{
+    int index;
+    int port;
+    unsigned int seed;
+    pthread_t thread;
+} StressClient;
+
+//This is the caesar cipher the sensors encrypt their reports with.
+static void caesar_encrypt(const char *plaintext, char *ciphertext, size_t len) 
+{
+    memset(ciphertext, 0, len);
+    for (size_t i = 0; plaintext[i] && i < len - 1; i++) 
+    {
+        if (isalpha((unsigned char)plaintext[i])) 
+        {
+            char base = isupper((unsigned char)plaintext[i]) ? 'A' : 'a';
+            ciphertext[i] = (char)((plaintext[i] - base + CAESAR_SHIFT) % 26 + base);
+        }
+        else 
+        {
+            ciphertext[i] = plaintext[i];
+        }
+    }
+}
+
+//This reverses the caesar cipher for the commands sent to the effectors.
+static void caesar_decrypt(const char *ciphertext, char *plaintext, size_t len) 
+{
+    memset(plaintext, 0, len);
+    for (size_t i = 0; ciphertext[i] && i < len - 1; i++) 
+    {
+        if (isalpha((unsigned char)ciphertext[i])) 
+        {
+            char base = isupper((unsigned char)ciphertext[i]) ? 'A' : 'a';
+            plaintext[i] = (char)((ciphertext[i] - base - CAESAR_SHIFT + 26) % 26 + base);
+        }
+        else 
+        {
+            plaintext[i] = ciphertext[i];
+        }
+    }
+}
+
+//This connects to a port on the loopback address. It returns the socket or -1.
+static int connect_port(int port) 
+{
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) 
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+//This frames a payload and sends it. It returns 0 or -1.
+static int send_frame(int sock, uint8_t type, uint32_t unit_id, const char *payload, size_t length) 
+{
+    char frame[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+    int frame_len = frame_encode(frame, sizeof(frame), type, unit_id, payload, length);
+    if (frame_len < 0) return -1;
+    return send_all(sock, frame, (size_t)frame_len);
+}
+
+/*This sends one report from a sensor unit, in the binary encoding if the connection
+agreed it, with about a third of them above the critical threshold. */
+static int send_report(StressClient *client, int sock, uint32_t unit_id, int binary) 
+{
+    const char *types[] = {"Air", "Sea", "Space", "Cyber"};
+    const char *locations[] = {"North Sea", "Irish Sea", "Baltic Sea", "North Atlantic", "English Channel"};
+    const char *type = types[rand_r(&client->seed) % 4];
+    const char *location = locations[rand_r(&client->seed) % 5];
+    int level = rand_r(&client->seed) % 3 == 0 ? CRITICAL_THREAT_LEVEL + 1 + rand_r(&client->seed) % 29
+                                               : 10 + rand_r(&client->seed) % 61;
+    const char *source = client->port == PORT_RADAR ? "Radar" : "Satellite";
+    char message[256];
+    char payload[FRAME_MAX_PAYLOAD];
+    int length;
+    if (binary) 
+    {
+        length = wire_encode_intel(payload, sizeof(payload), source, type, "Stress contact", level, location);
+    }
+    else 
+    {
+        snprintf(message, sizeof(message), "source:%s|type:%s|data:Stress contact|threat_level:%d|location:%s",
+                 source, type, level, location);
+        caesar_encrypt(message, payload, sizeof(payload));
+        length = (int)strlen(payload);
+    }
+    if (length < 0 || send_frame(sock, binary ? FRAME_INTEL_BIN : FRAME_INTEL, unit_id, payload, (size_t)length) < 0) 
+    {
+        return -1;
+    }
+    atomic_fetch_add(&reports_sent, 1);
+    if (level > CRITICAL_THREAT_LEVEL) atomic_fetch_add(&critical_sent, 1);
+    return 0;
+}
+
+/*This acknowledges a command frame the way an effector does. A quarter of the effectors
+never acknowledge anything, so the server's retransmissions and timeouts are exercised too. */
+static int acknowledge(StressClient *client, int sock, const FrameHeader *header, const char *payload) 
+{
+    unsigned long seq = 0;
+    if (header->type == FRAME_COMMAND_BIN) 
+    {
+        WireCommand command;
+        if (wire_decode_command(payload, header->length, &command) < 0) return -1;
+        seq = (unsigned long)command.seq;
+    }
+    else 
+    {
+        char ciphertext[FRAME_MAX_PAYLOAD + 1];
+        char command[FRAME_MAX_PAYLOAD + 1];
+        memcpy(ciphertext, payload, header->length);
+        ciphertext[header->length] = '\0';
+        caesar_decrypt(ciphertext, command, sizeof(command));
+        char *field = strstr(command, "seq:");
+        if (!field) return -1;
+        seq = strtoul(field + 4, NULL, 10);
+    }
+    atomic_fetch_add(&commands_received, 1);
+    if (client->index % 16 < 4) return 0;
+
+    char ack[64];
+    int ack_len = snprintf(ack, sizeof(ack), "%lu@%lld", seq, now_ms());
+    if (send_frame(sock, FRAME_ACK, UNIT_BROADCAST, ack, (size_t)ack_len) < 0) return -1;
+    atomic_fetch_add(&acks_sent, 1);
+    return 0;
+}
+
+/*This reads whatever the server sent without waiting. It returns 1 once the server sent
+END or closed the connection, -1 on a frame the harness does not understand, or 0. */
+static int read_frames(StressClient *client, int sock, char *rx, size_t *used, int *binary) 
+{
+    ssize_t bytes = recv(sock, rx + *used, FRAME_BUFFER_SIZE - *used, MSG_DONTWAIT);
+    if (bytes == 0) return 1;
+    if (bytes < 0) return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : 1;
+    *used += (size_t)bytes;
+
+    size_t offset = 0;
+    int consumed;
+    FrameHeader header;
+    const char *payload;
+    while ((consumed = frame_parse(rx + offset, *used - offset, &header, &payload)) > 0) 
+    {
+        offset += (size_t)consumed;
+        switch (header.type) 
+        {
+            case FRAME_CODEC:
+                *binary = 1;
+                break;
+            case FRAME_COMMAND:
+            case FRAME_COMMAND_BIN:
+                if (acknowledge(client, sock, &header, payload) < 0) return -1;
+                break;
+            case FRAME_END:
+                atomic_fetch_add(&ends_received, 1);
+                return 1;
+            default:
+                break; //CREDIT frames are ignored, so the sensors flood the server.
+        }
+    }
+    if (consumed < 0) return -1;
+    memmove(rx, rx + offset, *used - offset);
+    *used -= offset;
+    return 0;
+}
+
+/*This is one synthetic client. It connects, registers up to MAX_UNITS_PER_CONNECTION units,
+half the time offering the binary codec, and then sends reports as fast as the socket takes
+them (sensors) or acknowledges commands (effectors) for a random part of churn_ms. It then
+drops the connection, sometimes in the middle of a frame, and starts again, until the round
+is over. Connections the server ends are simply made again, which after a stop races the drain. */
+static void *stress_client(void *arg) 
+{
+    StressClient *client = (StressClient *)arg;
+    char rx[FRAME_BUFFER_SIZE];
+    int sensor = client->port == PORT_RADAR || client->port == PORT_SAT;
+    const char *kind = client->port == PORT_SILO ? "MissileSilo" : client->port == PORT_SUB ? "Submarine" :
+                       client->port == PORT_RADAR ? "Radar" : "Satellite";
+    while (!atomic_load(&round_over)) 
+    {
+        int sock = connect_port(client->port);
+        if (sock < 0) 
+        {
+            atomic_fetch_add(&connect_failures, 1);
+            usleep(10000);
+            continue;
+        }
+        atomic_fetch_add(&connections, 1);
+
+        char hello[64];
+        int offer = rand_r(&client->seed) % 2;
+        int hello_len = offer ? snprintf(hello, sizeof(hello), "%s" CODEC_OFFER "%d", kind, WIRE_VERSION)
+                              : snprintf(hello, sizeof(hello), "%s", kind);
+        int units = 1 + rand_r(&client->seed) % MAX_UNITS_PER_CONNECTION;
+        uint32_t first_unit = (uint32_t)client->index * MAX_UNITS_PER_CONNECTION + 1;
+        int failed = 0;
+        for (int u = 0; u < units && !failed; u++) 
+        {
+            failed = send_frame(sock, FRAME_HELLO, first_unit + (uint32_t)u, hello, (size_t)hello_len) < 0;
+            if (!failed) atomic_fetch_add(&units_registered, 1);
+        }
+
+        size_t used = 0;
+        int binary = 0;
+        long long until = now_ms() + rand_r(&client->seed) % (churn_ms + 1);
+        while (!failed && !atomic_load(&round_over) && now_ms() < until) 
+        {
+            if (read_frames(client, sock, rx, &used, &binary) != 0) break;
+            if (sensor) 
+            {
+                failed = send_report(client, sock, first_unit + (uint32_t)(rand_r(&client->seed) % units), binary) < 0;
+            }
+            else 
+            {
+                struct pollfd fd = {sock, POLLIN, 0};
+                poll(&fd, 1, 5);
+            }
+        }
+
+        //Every eighth connection is dropped with half a frame written, a quarter with a reset.
+        if (!failed && rand_r(&client->seed) % 8 == 0) 
+        {
+            char frame[FRAME_HEADER_SIZE + 16];
+            int frame_len = frame_encode(frame, sizeof(frame), FRAME_INTEL, first_unit, "partial frame", 13);
+            if (frame_len > 0 && send(sock, frame, (size_t)frame_len / 2, MSG_NOSIGNAL) > 0) 
+            {
+                atomic_fetch_add(&partial_frames, 1);
+            }
+        }
+        if (rand_r(&client->seed) % 4 == 0) 
+        {
+            struct linger reset = {1, 0}; //Close with a reset instead of a clean shutdown.
+            setsockopt(sock, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+            atomic_fetch_add(&abrupt_closes, 1);
+        }
+        close(sock);
+    }
+    return NULL;
+}
+
+/*This starts the server for a round with its output going to SERVER_OUTPUT, where the
+sanitizers print their reports. It returns the child's process ID or -1. */
+static pid_t start_server(int round) 
+{
+    char output[64];
+    snprintf(output, sizeof(output), SERVER_OUTPUT, round);
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+
+    int fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) 
+    {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    execv(server_path, server_args);
+    perror("Failed to start the server");
+    _exit(127);
+}
+
+//This waits for the server to accept connections. It returns 0, or -1 if it never did.
+static int wait_for_server(pid_t pid) 
+{
+    long long deadline = now_ms() + STARTUP_TIMEOUT_MS;
+    while (now_ms() < deadline) 
+    {
+        int sock = connect_port(PORT_RADAR);
+        if (sock >= 0) 
+        {
+            close(sock);
+            return 0;
+        }
+        if (waitpid(pid, NULL, WNOHANG) == pid) return -1;
+        usleep(50000);
+    }
+    return -1;
+}
+
+/*This waits for the server to exit. It returns its exit status, 128 plus the signal
+that ended it, or -1 if it had to be killed after EXIT_TIMEOUT_MS. */
+static int wait_for_exit(pid_t pid) 
+{
+    int status = 0;
+    long long deadline = now_ms() + EXIT_TIMEOUT_MS;
+    while (waitpid(pid, &status, WNOHANG) == 0) 
+    {
+        if (now_ms() >= deadline) 
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return -1;
+        }
+        usleep(20000);
+    }
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return WEXITSTATUS(status);
+}
+
+//This counts the sanitizer reports in the server's output.
+static int count_reports(int round) 
+{
+    char output[64];
+    char line[1024];
+    snprintf(output, sizeof(output), SERVER_OUTPUT, round);
+    FILE *fp = fopen(output, "r");
+    if (!fp) return 0;
+    int reports = 0;
+    while (fgets(line, sizeof(line), fp)) 
+    {
+        if (strstr(line, "WARNING: ThreadSanitizer") || strstr(line, "ERROR: AddressSanitizer") ||
+            strstr(line, "ERROR: LeakSanitizer") || strstr(line, "runtime error:")) reports++;
+    }
+    fclose(fp);
+    return reports;
+}
+
+//This reads the number after a label in the server's summary, or returns -1 if it is not there.
+static long summary_value(const char *summary, const char *label) 
+{
+    const char *found = summary ? strstr(summary, label) : NULL;
+    return found ? strtol(found + strlen(label), NULL, 10) : -1;
+}
+
+/*This checks that the counts in the server's summary add up: every threat was evaluated
+either on arrival or by the worker, and the server took in no more reports and no more
+acknowledgements than the clients sent. It prints what does not add up and returns the
+number of problems. */
+static int check_summary(void) 
+{
+    char summary[16384];
+    FILE *fp = fopen(SERVER_SUMMARY, "r");
+    if (!fp) 
+    {
+        printf("  summary %s was not written\n", SERVER_SUMMARY);
+        return 1;
+    }
+    size_t length = fread(summary, 1, sizeof(summary) - 1, fp);
+    summary[length] = '\0';
+    fclose(fp);
+
+    int problems = 0;
+    long threats = summary_value(summary, "Total Threats Detected: ");
+    long critical = summary_value(summary, "Critical Reports Evaluated On Arrival: ");
+    long evaluated = summary_value(strstr(summary, "Routine Reports Queued: "), ", Evaluated: ");
+    long text = summary_value(summary, "Text Reports: ");
+    long binary = summary_value(summary, "Binary Reports: ");
+    long acked = summary_value(summary, "Commands Acknowledged: ");
+    if (threats < 0 || critical < 0 || evaluated < 0 || text < 0 || binary < 0 || acked < 0) 
+    {
+        printf("  summary %s is missing counts\n", SERVER_SUMMARY);
+        return 1;
+    }
+    if (threats != critical + evaluated) 
+    {
+        printf("  threats detected %ld != %ld evaluated on arrival + %ld by the worker\n", threats, critical, evaluated);
+        problems++;
+    }
+    if ((unsigned long)(text + binary) > atomic_load(&reports_sent)) 
+    {
+        printf("  server received %ld reports, clients sent %lu\n", text + binary, atomic_load(&reports_sent));
+        problems++;
+    }
+    if ((unsigned long)acked > atomic_load(&acks_sent)) 
+    {
+        printf("  server matched %ld acknowledgements, clients sent %lu\n", acked, atomic_load(&acks_sent));
+        problems++;
+    }
+    return problems;
+}
+
+//This resets the client counters for a new round.
+static void reset_counters(void) 
+{
+    atomic_ulong *counters[] = {&connections, &connect_failures, &units_registered, &reports_sent, &critical_sent,
+                                &commands_received, &acks_sent, &ends_received, &abrupt_closes, &partial_frames};
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) 
+    {
+        atomic_store(counters[i], 0);
+    }
+}
+
+/*This runs one round: start the server, run the clients for the given seconds, send
+SIGTERM while they carry on, and stop them once the server has exited. It returns the
+number of problems found. */
+static int run_round(int round, StressClient *clients) 
+{
+    reset_counters();
+    remove(SERVER_SUMMARY);
+    pid_t pid = start_server(round);
+    if (pid < 0 || wait_for_server(pid) < 0) 
+    {
+        printf("round %d: the server did not start, see " SERVER_OUTPUT "\n", round, round);
+        if (pid > 0) 
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, NULL, 0);
+        }
+        return 1;
+    }
+
+    atomic_store(&round_over, false);
+    int started = 0;
+    while (started < client_count && pthread_create(&clients[started].thread, NULL, stress_client,
+                                                    &clients[started]) == 0) 
+    {
+        started++;
+    }
+    sleep((unsigned int)seconds);
+    long long stop_ms = now_ms();
+    kill(pid, SIGTERM);
+    int status = wait_for_exit(pid);
+    long long exit_ms = now_ms() - stop_ms;
+    atomic_store(&round_over, true);
+    for (int i = 0; i < started; i++) 
+    {
+        pthread_join(clients[i].thread, NULL);
+    }
+
+    int reports = count_reports(round);
+    printf("round %d: %d clients, %lu connections (%lu refused), %lu units, %lu reports (%lu critical), "
+           "%lu commands, %lu acks, %lu ended by the server, %lu reset, %lu partial frames\n",
+           round, started, atomic_load(&connections), atomic_load(&connect_failures),
+           atomic_load(&units_registered), atomic_load(&reports_sent), atomic_load(&critical_sent),
+           atomic_load(&commands_received), atomic_load(&acks_sent), atomic_load(&ends_received),
+           atomic_load(&abrupt_closes), atomic_load(&partial_frames));
+    printf("  server exited with status %d %lld ms after SIGTERM, %d sanitizer reports\n", status, exit_ms, reports);
+    int problems = (status != 0) + reports + (status == 0 ? check_summary() : 0);
+    printf("  %s\n", problems ? "FAILED, see the server's output and log" : "passed");
+    return problems;
+}
+
+/*This is the main function. It reads the options, ignores SIGPIPE so a connection the
+server closed only fails its send, and runs the rounds. It exits with 1 if any failed. */
+int main(int argc, char *argv[]) 
+{
+    for (int i = 1; i < argc; i++) 
+    {
+        if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) 
+        {
+            server_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--server-arg") == 0 && i + 1 < argc && server_arg_count < MAX_SERVER_ARGS) 
+        {
+            server_args[1 + server_arg_count++] = argv[++i];
+        }
+        else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) 
+        {
+            client_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) 
+        {
+            seconds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) 
+        {
+            rounds = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--churn-ms") == 0 && i + 1 < argc) 
+        {
+            churn_ms = atoi(argv[++i]);
+        }
+        else 
+        {
+            server_path = NULL;
+            break;
+        }
+    }
+    if (!server_path || client_count <= 0 || seconds <= 0 || rounds <= 0 || churn_ms <= 0) 
+    {
+        fprintf(stderr, "Usage: %s --server PATH [--server-arg ARG]... [--clients N] [--seconds S] "
+                "[--rounds R] [--churn-ms MS]\n", argv[0]);
+        return 1;
+    }
+    server_args[0] = (char *)server_path;
+    server_args[1 + server_arg_count] = NULL;
+    signal(SIGPIPE, SIG_IGN);
+
+    StressClient *clients = calloc((size_t)client_count, sizeof(StressClient));
+    if (!clients) 
+    {
+        perror("Failed to allocate the clients");
+        return 1;
+    }
+    int ports[] = {PORT_SILO, PORT_SUB, PORT_RADAR, PORT_SAT};
+    for (int i = 0; i < client_count; i++) 
+    {
+        clients[i].index = i;
+        clients[i].port = ports[i % 4];
+        clients[i].seed = (unsigned int)time(NULL) ^ (unsigned int)(i * 2654435761u);
+    }
+
+    int failed = 0;
+    for (int round = 1; round <= rounds; round++) 
+    {
+        if (run_round(round, clients) > 0) failed++;
+    }
+    printf("%d of %d rounds failed\n", failed, rounds);
+    free(clients);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+/*This is the optional TLS 1.3 transport, "--tls" on nuclearControl and "--transport tls" on
+the clients. It is only built with -DUSE_TLS and linked with -lssl -lcrypto, so without it
+the programs still build with the commands in the README. nuclearControl presents the key
+and certificate in TLS_KEY_FILE and TLS_CERT_FILE, making a self-signed pair the first time,
+and clients started from the same directory verify it against that certificate. Both ends
+ask OpenSSL for kernel TLS: once the handshake is over the record keys are handed to the
+socket (the "tls" TCP ULP), so the kernel encrypts and decrypts the records and a write is
+a single sendmsg of the plain frame with no copy through OpenSSL's buffers. Without the tls
+module, or in a direction this OpenSSL cannot offload, the records are done in user space.
+After the handshake sockets are non-blocking, and reads and writes wait in poll themselves.*/
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#ifdef USE_TLS
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
+
+#define TLS_CERT_FILE "nuclearControl_cert.pem"
+#define TLS_KEY_FILE "nuclearControl_key.pem"
+#define TLS_SERVER_NAME "nuclearControl" //The common name of the certificate and what clients check for.
+#define TLS_CERT_DAYS 365
+#define TLS_HANDSHAKE_TIMEOUT_MS 5000
+//The AES-GCM suites come first because those are the ones the kernel can take over.
+#define TLS_CIPHERSUITES "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256"
+
+//This writes OpenSSL's last error into out, for the log.
+static inline void tls_error(char *out, size_t size)
+{
+    unsigned long error = ERR_get_error();
+    if (error) ERR_error_string_n(error, out, size);
+    else snprintf(out, size, "%s", errno ? strerror(errno) : "connection closed by the other end");
+    ERR_clear_error();
+}
+
+/*This sets what both ends ask for: TLS 1.3 only and kernel TLS. A connection closed
+without a close_notify alert reads as closed, which is how every program here closes them.*/
+static inline int tls_common_setup(SSL_CTX *ctx)
+{
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    return SSL_CTX_set_min_proto_version(ctx, TLS1_3_VERSION) == 1 &&
+           SSL_CTX_set_ciphersuites(ctx, TLS_CIPHERSUITES) == 1 ? 0 : -1;
+}
+
+/*This writes a PEM file through a temporary name, so another process never reads half of
+it. The key is only readable by its owner. It returns 1 on success or 0.*/
+static inline int tls_write_pem(const char *path, X509 *cert, EVP_PKEY *key)
+{
+    char temporary[256];
+    snprintf(temporary, sizeof(temporary), "%s.%d", path, (int)getpid());
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, key ? 0600 : 0644);
+    FILE *fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!fp)
+    {
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    int ok = key ? PEM_write_PrivateKey(fp, key, NULL, NULL, 0, NULL, NULL) == 1 : PEM_write_X509(fp, cert) == 1;
+    if (fclose(fp) != 0) ok = 0;
+    if (ok && rename(temporary, path) == 0) return 1;
+    unlink(temporary);
+    return 0;
+}
+
+/*This makes the server's context. The key and certificate in key_path and cert_path are
+used if both are there, so the nodes of a cluster and a standby started from the same
+directory present the same certificate. Otherwise a new P-256 key and a self-signed
+certificate for TLS_SERVER_NAME are made and written there, and generated is set. With
+NULL paths the new pair is only kept in memory. It returns the context, or NULL with the
+reason in error.*/
+static inline SSL_CTX *tls_server_context(const char *cert_path, const char *key_path, int *generated, char *error,
+                                          size_t error_size)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    int ok = ctx && tls_common_setup(ctx) == 0;
+    //The tickets would only be used to resume sessions, which no client does.
+    if (ok) SSL_CTX_set_num_tickets(ctx, 0);
+    *generated = !cert_path || access(cert_path, R_OK) != 0 || access(key_path, R_OK) != 0;
+    if (ok && !*generated)
+    {
+        ok = SSL_CTX_use_certificate_file(ctx, cert_path, SSL_FILETYPE_PEM) == 1 &&
+             SSL_CTX_use_PrivateKey_file(ctx, key_path, SSL_FILETYPE_PEM) == 1 && SSL_CTX_check_private_key(ctx) == 1;
+    }
+    else if (ok)
+    {
+        EVP_PKEY *key = EVP_EC_gen("P-256");
+        X509 *cert = X509_new();
+        ok = key && cert;
+        if (ok)
+        {
+            X509_set_version(cert, 2);
+            ASN1_INTEGER_set(X509_get_serialNumber(cert), (long)time(NULL));
+            X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+            X509_gmtime_adj(X509_getm_notAfter(cert), 60L * 60 * 24 * TLS_CERT_DAYS);
+            X509_NAME *name = X509_get_subject_name(cert);
+            X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *)TLS_SERVER_NAME, -1, -1, 0);
+            X509_set_issuer_name(cert, name);
+            ok = X509_set_pubkey(cert, key) == 1 && X509_sign(cert, key, EVP_sha256()) > 0 &&
+                 SSL_CTX_use_certificate(ctx, cert) == 1 && SSL_CTX_use_PrivateKey(ctx, key) == 1;
+        }
+        //The key goes first, so a certificate on disk always has its key next to it.
+        if (ok && cert_path) ok = tls_write_pem(key_path, NULL, key) && tls_write_pem(cert_path, cert, NULL);
+        X509_free(cert);
+        EVP_PKEY_free(key);
+    }
+    if (ok) return ctx;
+    tls_error(error, error_size);
+    SSL_CTX_free(ctx);
+    return NULL;
+}
+
+/*This makes a client's context. With ca_path the server must present the certificate
+in that file for TLS_SERVER_NAME. Without it the server is not checked at all, which only
+the transport benchmark does. It returns the context, or NULL with the reason in error.*/
+static inline SSL_CTX *tls_client_context(const char *ca_path, char *error, size_t error_size)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    int ok = ctx && tls_common_setup(ctx) == 0;
+    if (ok && ca_path)
+    {
+        ok = SSL_CTX_load_verify_locations(ctx, ca_path, NULL) == 1;
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    }
+    if (ok) return ctx;
+    tls_error(error, error_size);
+    SSL_CTX_free(ctx);
+    return NULL;
+}
+
+/*This runs the handshake on a connected blocking socket, as the server or the client,
+giving up after TLS_HANDSHAKE_TIMEOUT_MS on a peer that does not speak TLS. The socket is
+made non-blocking afterwards. It returns the connection, or NULL with the reason in error.*/
+static inline SSL *tls_handshake(SSL_CTX *ctx, int sock, int server, char *error, size_t error_size)
+{
+    struct timeval timeout = {TLS_HANDSHAKE_TIMEOUT_MS / 1000, (TLS_HANDSHAKE_TIMEOUT_MS % 1000) * 1000};
+    struct timeval none = {0, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    SSL *ssl = SSL_new(ctx);
+    errno = 0;
+    int ok = ssl && SSL_set_fd(ssl, sock) == 1;
+    if (ok && !server && SSL_CTX_get_verify_mode(ctx) != SSL_VERIFY_NONE) ok = SSL_set1_host(ssl, TLS_SERVER_NAME) == 1;
+    if (ok) ok = (server ? SSL_accept(ssl) : SSL_connect(ssl)) == 1;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &none, sizeof(none));
+    if (ok) ok = fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) == 0;
+    if (ok) return ssl;
+    tls_error(error, error_size);
+    SSL_free(ssl);
+    return NULL;
+}
+
+//These say whether the kernel took over the records sent and received on a connection.
+static inline int tls_ktls_send(SSL *ssl)
+{
+    return BIO_get_ktls_send(SSL_get_wbio(ssl)) ? 1 : 0;
+}
+
+static inline int tls_ktls_recv(SSL *ssl)
+{
+    return BIO_get_ktls_recv(SSL_get_rbio(ssl)) ? 1 : 0;
+}
+
+//This waits in poll for whatever the last call on the connection wanted. It returns 0 or -1.
+static inline int tls_wait(SSL *ssl, int sock, int result)
+{
+    int reason = SSL_get_error(ssl, result);
+    if (reason != SSL_ERROR_WANT_READ && reason != SSL_ERROR_WANT_WRITE)
+    {
+        if (reason != SSL_ERROR_SYSCALL || errno == 0) errno = EIO;
+        ERR_clear_error();
+        return -1;
+    }
+    struct pollfd fd = {sock, reason == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, 0};
+    while (poll(&fd, 1, -1) < 0)
+    {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+//This sends all of data on a connection like send_all. It returns 0, or -1 with errno set.
+static inline int tls_write_all(SSL *ssl, int sock, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        size_t written;
+        int result = SSL_write_ex(ssl, data, length, &written);
+        if (result == 1)
+        {
+            data += written;
+            length -= written;
+        }
+        else if (tls_wait(ssl, sock, result) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*This reads like a non-blocking recv: it returns the bytes read, 0 once the other end has
+closed the connection, or -1 with errno set, EAGAIN if no whole record is there yet.
+A read that needs to write (a TLS 1.3 key update) waits until it can.*/
+static inline ssize_t tls_read(SSL *ssl, int sock, char *data, size_t size)
+{
+    for (;;)
+    {
+        size_t bytes;
+        errno = 0;
+        int result = SSL_read_ex(ssl, data, size, &bytes);
+        if (result == 1) return (ssize_t)bytes;
+        int reason = SSL_get_error(ssl, result);
+        if (reason == SSL_ERROR_ZERO_RETURN || (reason == SSL_ERROR_SYSCALL && errno == 0))
+        {
+            ERR_clear_error();
+            return 0;
+        }
+        if (reason == SSL_ERROR_WANT_READ)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (tls_wait(ssl, sock, result) < 0) return -1;
+    }
+}
+
+#endif
+#endif
@@ -0,0 +1,203 @@
+/*This is the CPU and NUMA placement used by nuclearControl to pin its threads.
+Like uring.h it talks to the kernel through the raw system calls (sched_setaffinity,
+getcpu and move_pages) and reads the node layout from /sys, so neither _GNU_SOURCE
+nor libnuma is needed. Memory is placed by first touch: a pool that is zeroed by a
+thread pinned to some CPUs gets its pages from the NUMA node of those CPUs.*/
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TOPOLOGY_MAX_CPUS 1024
+#define TOPOLOGY_MAX_NODES 64
+#define TOPOLOGY_WORDS (TOPOLOGY_MAX_CPUS / 64)
+
+//This is a set of CPUs, one bit per CPU in the layout the affinity system calls use.
+typedef struct
+{
+    uint64_t bits[TOPOLOGY_WORDS];
+} CpuMask;
+
+//This is the host layout: which NUMA node every online CPU belongs to.
+typedef struct
+{
+    int cpu_count;
+    int node_count;
+    short node_of[TOPOLOGY_MAX_CPUS]; //-1 for CPUs that are not online.
+} Topology;
+
+//These set, test and count the CPUs of a set.
+static inline void cpu_mask_set(CpuMask *mask, int cpu)
+{
+    mask->bits[cpu / 64] |= 1ULL << (cpu % 64);
+}
+
+static inline int cpu_mask_has(const CpuMask *mask, int cpu)
+{
+    return (int)((mask->bits[cpu / 64] >> (cpu % 64)) & 1);
+}
+
+static inline int cpu_mask_count(const CpuMask *mask)
+{
+    int count = 0;
+    for (int w = 0; w < TOPOLOGY_WORDS; w++)
+    {
+        count += __builtin_popcountll(mask->bits[w]);
+    }
+    return count;
+}
+
+//This returns 1 if every CPU of the first set is also in the second.
+static inline int cpu_mask_within(const CpuMask *mask, const CpuMask *allowed)
+{
+    for (int w = 0; w < TOPOLOGY_WORDS; w++)
+    {
+        if (mask->bits[w] & ~allowed->bits[w]) return 0;
+    }
+    return 1;
+}
+
+/*This reads a CPU list in the kernel's format, e.g. "0-3,8,10-11". It returns 0,
+or -1 if the list is malformed, empty or names a CPU beyond TOPOLOGY_MAX_CPUS.*/
+static inline int cpu_mask_parse(CpuMask *mask, const char *list)
+{
+    memset(mask, 0, sizeof(*mask));
+    const char *p = list;
+    while (*p && *p != '\n')
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p || first < 0) return -1;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) return -1;
+            p = end;
+        }
+        if (last >= TOPOLOGY_MAX_CPUS) return -1;
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            cpu_mask_set(mask, (int)cpu);
+        }
+        if (*p == ',') p++;
+        else if (*p && *p != '\n') return -1;
+    }
+    return cpu_mask_count(mask) > 0 ? 0 : -1;
+}
+
+//This writes a CPU set back out as a list with ranges, the same format it is parsed from.
+static inline void cpu_mask_format(const CpuMask *mask, char *out, size_t size)
+{
+    size_t used = 0;
+    out[0] = '\0';
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS && used < size; cpu++)
+    {
+        if (!cpu_mask_has(mask, cpu)) continue;
+        int last = cpu;
+        while (last + 1 < TOPOLOGY_MAX_CPUS && cpu_mask_has(mask, last + 1)) last++;
+        int n = last > cpu ? snprintf(out + used, size - used, "%s%d-%d", used ? "," : "", cpu, last)
+                           : snprintf(out + used, size - used, "%s%d", used ? "," : "", cpu);
+        if (n < 0) break;
+        used += (size_t)n;
+        cpu = last;
+    }
+}
+
+//This reads a CPU list file from /sys, returning -1 if it does not exist.
+static inline int topology_read_list(const char *path, CpuMask *mask)
+{
+    char line[4096];
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    int ok = fgets(line, sizeof(line), fp) != NULL;
+    fclose(fp);
+    return ok ? cpu_mask_parse(mask, line) : -1;
+}
+
+/*This loads the host layout. Hosts without /sys/devices/system/node (or with NUMA
+turned off) are treated as one node holding every online CPU.*/
+static inline void topology_load(Topology *topo)
+{
+    CpuMask online;
+    memset(topo, 0, sizeof(*topo));
+    if (topology_read_list("/sys/devices/system/cpu/online", &online) < 0)
+    {
+        memset(&online, 0, sizeof(online));
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < count && cpu < TOPOLOGY_MAX_CPUS; cpu++)
+        {
+            cpu_mask_set(&online, (int)cpu);
+        }
+    }
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++)
+    {
+        topo->node_of[cpu] = (short)(cpu_mask_has(&online, cpu) ? 0 : -1);
+    }
+    topo->cpu_count = cpu_mask_count(&online);
+    topo->node_count = 1;
+
+    char path[64];
+    CpuMask node_cpus;
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (topology_read_list(path, &node_cpus) < 0) continue;
+        for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++)
+        {
+            if (cpu_mask_has(&node_cpus, cpu) && topo->node_of[cpu] >= 0) topo->node_of[cpu] = (short)node;
+        }
+        if (node + 1 > topo->node_count) topo->node_count = node + 1;
+    }
+}
+
+//This returns the NUMA node of a set of CPUs, or -1 if they span more than one.
+static inline int topology_node_of(const Topology *topo, const CpuMask *mask)
+{
+    int node = -1;
+    for (int cpu = 0; cpu < TOPOLOGY_MAX_CPUS; cpu++)
+    {
+        if (!cpu_mask_has(mask, cpu) || topo->node_of[cpu] < 0) continue;
+        if (node >= 0 && topo->node_of[cpu] != node) return -1;
+        node = topo->node_of[cpu];
+    }
+    return node;
+}
+
+//This reads the CPUs the calling thread may run on. It returns 0 or -1.
+static inline int topology_get_affinity(CpuMask *mask)
+{
+    memset(mask, 0, sizeof(*mask));
+    return syscall(SYS_sched_getaffinity, 0, sizeof(mask->bits), mask->bits) < 0 ? -1 : 0;
+}
+
+//This pins the calling thread to a set of CPUs. It returns 0 or -1.
+static inline int topology_set_affinity(const CpuMask *mask)
+{
+    return syscall(SYS_sched_setaffinity, 0, sizeof(mask->bits), mask->bits) < 0 ? -1 : 0;
+}
+
+//This returns the CPU the calling thread is running on right now, or -1.
+static inline int topology_current_cpu(void)
+{
+    unsigned cpu = 0;
+    return syscall(SYS_getcpu, &cpu, NULL, NULL) < 0 ? -1 : (int)cpu;
+}
+
+/*This returns the NUMA node holding the page at an address, which must already have
+been touched, or -1 if the kernel cannot tell (e.g. without NUMA support).*/
+static inline int topology_page_node(const void *address)
+{
+    void *page = (void *)((uintptr_t)address & ~((uintptr_t)sysconf(_SC_PAGESIZE) - 1));
+    int status = -1;
+    if (syscall(SYS_move_pages, 0, 1UL, &page, NULL, &status, 0) < 0 || status < 0) return -1;
+    return status;
+}
+
+#endif
@@ -0,0 +1,231 @@
+/*This is a small io_uring wrapper used by nuclearControl's optional io_uring backend.
+It talks to the kernel through the raw system calls and the ring layout in
+<linux/io_uring.h>, so no extra library has to be installed. It covers what the
+server needs: submission and completion rings, and a provided buffer ring that
+the kernel picks receive buffers from.*/
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+//This is one ring: the mapped submission queue, completion queue and SQE array.
+typedef struct
+{
+    int fd;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_entries;
+    unsigned sqe_tail;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} Uring;
+
+/*This is a provided buffer ring. The kernel takes a free buffer from it for
+every receive, and the server hands the buffer back once the data is processed.*/
+typedef struct
+{
+    struct io_uring_buf_ring *ring;
+    char *buffers;
+    unsigned entries;
+    unsigned buffer_size;
+    unsigned short group;
+    unsigned short tail;
+} BufferRing;
+
+/*This creates a ring with room for entries submissions and maps its queues.
+It returns 0, or -1 with errno set if io_uring is not available.*/
+static inline int uring_init(Uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -1;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) goto fail;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cq_ring = ring->sq_ring;
+    }
+    else
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) goto fail;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) goto fail;
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+
+fail:
+    {
+        int saved = errno;
+        if (ring->sq_ring && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+        if (ring->cq_ring && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring)
+            munmap(ring->cq_ring, ring->cq_ring_size);
+        close(ring->fd);
+        errno = saved;
+        return -1;
+    }
+}
+
+/*This returns a cleared submission entry, or NULL if the submission queue is full
+and has to be submitted first.*/
+static inline struct io_uring_sqe *uring_get_sqe(Uring *ring)
+{
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sqe_tail - head >= ring->sq_entries) return NULL;
+    unsigned index = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+/*This publishes every prepared entry and hands them to the kernel with a single
+io_uring_enter. It returns the number submitted, 0 if there was nothing to do, or -1.*/
+static inline int uring_submit(Uring *ring)
+{
+    unsigned to_submit = ring->sqe_tail - *ring->sq_tail;
+    if (to_submit == 0) return 0;
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    return (int)syscall(__NR_io_uring_enter, ring->fd, to_submit, 0, 0, NULL, 0);
+}
+
+/*This blocks until at least one completion is waiting. It submits nothing, so other
+threads can keep preparing and submitting entries while the completion thread sleeps.*/
+static inline int uring_wait(Uring *ring)
+{
+    return (int)syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+//This returns the next completion, or NULL if none is waiting.
+static inline struct io_uring_cqe *uring_peek_cqe(Uring *ring)
+{
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+//This marks the completion returned by uring_peek_cqe as consumed.
+static inline void uring_cqe_seen(Uring *ring)
+{
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/*This registers a provided buffer ring of entries buffers of buffer_size bytes as
+buffer group "group". entries must be a power of two. It returns 0 or -1.*/
+static inline int buffer_ring_init(Uring *ring, BufferRing *br, unsigned short group,
+                                   unsigned entries, unsigned buffer_size)
+{
+    memset(br, 0, sizeof(*br));
+    size_t ring_size = entries * sizeof(struct io_uring_buf);
+    br->ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (br->ring == MAP_FAILED) return -1;
+    br->buffers = aligned_alloc(64, (size_t)entries * buffer_size);
+    if (!br->buffers)
+    {
+        munmap(br->ring, ring_size);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)br->ring;
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        munmap(br->ring, ring_size);
+        free(br->buffers);
+        return -1;
+    }
+    br->entries = entries;
+    br->buffer_size = buffer_size;
+    br->group = group;
+    for (unsigned i = 0; i < entries; i++)
+    {
+        struct io_uring_buf *buf = &br->ring->bufs[(br->tail + i) & (entries - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(br->buffers + (size_t)i * buffer_size);
+        buf->len = buffer_size;
+        buf->bid = (unsigned short)i;
+    }
+    br->tail = (unsigned short)(br->tail + entries);
+    __atomic_store_n(&br->ring->tail, br->tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+//This returns the address of a provided buffer by its buffer ID.
+static inline char *buffer_ring_data(BufferRing *br, unsigned bid)
+{
+    return br->buffers + (size_t)bid * br->buffer_size;
+}
+
+//This hands a provided buffer back to the kernel after its data has been processed.
+static inline void buffer_ring_recycle(BufferRing *br, unsigned bid)
+{
+    struct io_uring_buf *buf = &br->ring->bufs[br->tail & (br->entries - 1)];
+    buf->addr = (uint64_t)(uintptr_t)buffer_ring_data(br, bid);
+    buf->len = br->buffer_size;
+    buf->bid = (unsigned short)bid;
+    br->tail++;
+    __atomic_store_n(&br->ring->tail, br->tail, __ATOMIC_RELEASE);
+}
+
+//This unmaps the ring. Closing the ring's descriptor also cancels anything still in flight.
+static inline void uring_close(Uring *ring, BufferRing *br)
+{
+    if (br && br->ring)
+    {
+        munmap(br->ring, br->entries * sizeof(struct io_uring_buf));
+        free(br->buffers);
+    }
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+}
+
+#endif
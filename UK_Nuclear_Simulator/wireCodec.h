@@ -0,0 +1,184 @@
+/*This is the compact binary encoding for intelligence reports and launch commands,
+used alongside the pipe delimited text once a connection has negotiated it.
+Every binary payload starts with the codec version, numbers are varints and the
+sources, types, threat details and locations are sent as IDs into the name table
+below, which every program is built with. A name that is not in the table is sent
+as ID 0 followed by its length and bytes, so new names still work. Decoding is a
+few table lookups and never touches the text parser. The binary payloads carry no
+letters for the Caesar cipher to shift, so they are not Caesar encrypted.*/
+#ifndef WIRE_CODEC_H
+#define WIRE_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define WIRE_VERSION 1
+#define WIRE_NAME_MAX 63
+
+/*This is the name table. IDs are positions in it, so names must only ever be added
+at the end, and a new WIRE_VERSION is needed to change or remove one.*/
+static const char *const wire_names[] =
+{
+    "",
+    "Radar", "Satellite", "TEST",
+    "Air", "Sea", "Space",
+    "Enemy Aircraft", "Missile Strike", "Drone Swarm", "Stealth Bomber",
+    "Ballistic Missile", "Naval Fleet", "Satellite Anomaly", "Orbital Debris", "Enemy Submarine",
+    "North Atlantic", "English Channel", "Baltic Sea", "Irish Sea",
+    "Arctic Ocean", "Mediterranean", "Barents Sea", "North Sea", "Norwegian Sea"
+};
+#define WIRE_NAME_COUNT (sizeof(wire_names) / sizeof(wire_names[0]))
+
+//This is a name as decoded: it points into the name table or into the payload, and is not NUL terminated.
+typedef struct
+{
+    const char *text;
+    uint32_t length;
+} WireName;
+
+//This is a decoded intelligence report.
+typedef struct
+{
+    uint8_t threat_level;
+    WireName source;
+    WireName type;
+    WireName data;
+    WireName location;
+} WireIntel;
+
+//This is a decoded launch command.
+typedef struct
+{
+    uint8_t priority;
+    uint64_t seq;
+    WireName target;
+} WireCommand;
+
+//This writes value as a varint, seven bits per byte. It returns the bytes used or 0 if it does not fit.
+static inline size_t wire_put_varint(unsigned char *out, size_t cap, uint64_t value)
+{
+    size_t used = 0;
+    do
+    {
+        if (used == cap) return 0;
+        out[used++] = (unsigned char)((value & 0x7F) | (value > 0x7F ? 0x80 : 0));
+        value >>= 7;
+    } while (value);
+    return used;
+}
+
+//This reads a varint. It returns the bytes used or 0 if the varint is cut short or too long.
+static inline size_t wire_get_varint(const unsigned char *in, size_t len, uint64_t *value)
+{
+    *value = 0;
+    for (size_t i = 0; i < len && i < 10; i++)
+    {
+        *value |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) return i + 1;
+    }
+    return 0;
+}
+
+//This writes a name as its table ID, or as ID 0 and the literal bytes. It returns the bytes used or 0.
+static inline size_t wire_put_name(unsigned char *out, size_t cap, const char *name)
+{
+    for (size_t id = 1; id < WIRE_NAME_COUNT; id++)
+    {
+        if (strcmp(wire_names[id], name) == 0) return wire_put_varint(out, cap, id);
+    }
+    size_t length = strlen(name);
+    if (length > WIRE_NAME_MAX || cap < 2 + length) return 0;
+    out[0] = 0;
+    out[1] = (unsigned char)length;
+    memcpy(out + 2, name, length);
+    return 2 + length;
+}
+
+//This reads a name written by wire_put_name. It returns the bytes used or 0 if it is malformed.
+static inline size_t wire_get_name(const unsigned char *in, size_t len, WireName *name)
+{
+    uint64_t id;
+    size_t used = wire_get_varint(in, len, &id);
+    if (used == 0 || id >= WIRE_NAME_COUNT) return 0;
+    if (id > 0)
+    {
+        name->text = wire_names[id];
+        name->length = (uint32_t)strlen(wire_names[id]);
+        return used;
+    }
+    if (used >= len || in[used] > WIRE_NAME_MAX || used + 1 + in[used] > len) return 0;
+    name->length = in[used];
+    name->text = (const char *)in + used + 1;
+    return used + 1 + name->length;
+}
+
+/*This encodes a report as [version][threat level][source][type][data][location].
+It returns the payload size or -1 if it does not fit in cap.*/
+static inline int wire_encode_intel(char *out, size_t cap, const char *source, const char *type,
+                                    const char *data, int threat_level, const char *location)
+{
+    unsigned char *p = (unsigned char *)out;
+    const char *names[] = {source, type, data, location};
+    if (cap < 2 || threat_level < 0 || threat_level > 255) return -1;
+    p[0] = WIRE_VERSION;
+    p[1] = (unsigned char)threat_level;
+    size_t used = 2;
+    for (int i = 0; i < 4; i++)
+    {
+        size_t n = wire_put_name(p + used, cap - used, names[i]);
+        if (n == 0) return -1;
+        used += n;
+    }
+    return (int)used;
+}
+
+//This decodes a report payload. It returns 0, or -1 if the version is unknown or the payload is malformed.
+static inline int wire_decode_intel(const char *payload, size_t len, WireIntel *intel)
+{
+    const unsigned char *p = (const unsigned char *)payload;
+    WireName *names[] = {&intel->source, &intel->type, &intel->data, &intel->location};
+    if (len < 2 || p[0] != WIRE_VERSION) return -1;
+    intel->threat_level = p[1];
+    size_t used = 2;
+    for (int i = 0; i < 4; i++)
+    {
+        size_t n = wire_get_name(p + used, len - used, names[i]);
+        if (n == 0) return -1;
+        used += n;
+    }
+    return used == len ? 0 : -1;
+}
+
+//This encodes a launch command as [version][priority][seq][target]. It returns the payload size or -1.
+static inline int wire_encode_command(char *out, size_t cap, const char *target, int priority, uint64_t seq)
+{
+    unsigned char *p = (unsigned char *)out;
+    if (cap < 2 || priority < 0 || priority > 255) return -1;
+    p[0] = WIRE_VERSION;
+    p[1] = (unsigned char)priority;
+    size_t used = 2;
+    size_t n = wire_put_varint(p + used, cap - used, seq);
+    if (n == 0) return -1;
+    used += n;
+    n = wire_put_name(p + used, cap - used, target);
+    if (n == 0) return -1;
+    return (int)(used + n);
+}
+
+//This decodes a launch command payload. It returns 0 or -1.
+static inline int wire_decode_command(const char *payload, size_t len, WireCommand *command)
+{
+    const unsigned char *p = (const unsigned char *)payload;
+    if (len < 2 || p[0] != WIRE_VERSION) return -1;
+    command->priority = p[1];
+    size_t used = 2;
+    size_t n = wire_get_varint(p + used, len - used, &command->seq);
+    if (n == 0) return -1;
+    used += n;
+    n = wire_get_name(p + used, len - used, &command->target);
+    if (n == 0) return -1;
+    return used + n == len ? 0 : -1;
+}
+
+#endif